@@ -0,0 +1,391 @@
+#include "Animation.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace DS {
+
+namespace {
+
+	// Range of the three smallest components of a unit quaternion.
+	const float SMALLEST_RANGE = 0.70710678f;
+
+	const float SCALE_TOLERANCE = 1e-3f;
+
+	const unsigned int MAX_FRAMES = 0xFFFF;
+
+	unsigned short QuantizeSmallest( float v, unsigned int maxValue ) {
+		float t = std::min( std::max( v / SMALLEST_RANGE * 0.5f + 0.5f, 0.0f ), 1.0f );
+		return ( unsigned short ) ( t * maxValue + 0.5f );
+	}
+
+	float DequantizeSmallest( unsigned int q, unsigned int maxValue ) {
+		return ( ( float ) q / maxValue * 2.0f - 1.0f ) * SMALLEST_RANGE;
+	}
+
+	/*
+		Drops the largest component, which the other three and unit length
+		give back. Its index goes in the top bits of the first two words, and
+		the sign is folded into q since q and -q are the same rotation.
+	*/
+	void PackRotation( const Math::Quaternion& rotation, unsigned short v[ 3 ] ) {
+		Math::Quaternion q = Math::Normalize( rotation );
+		float c[ 4 ] = { q.x, q.y, q.z, q.w };
+
+		int largest = 0;
+		for ( int i = 1; i < 4; ++i ) {
+			if ( fabsf( c[ i ] ) > fabsf( c[ largest ] ) ) {
+				largest = i;
+			}
+		}
+
+		float sign = c[ largest ] < 0.0f ? -1.0f : 1.0f;
+		float rest[ 3 ];
+		int n = 0;
+
+		for ( int i = 0; i < 4; ++i ) {
+			if ( i != largest ) {
+				rest[ n++ ] = c[ i ] * sign;
+			}
+		}
+
+		v[ 0 ] = ( unsigned short ) ( QuantizeSmallest( rest[ 0 ], 0x7FFF ) | ( ( largest & 1 ) << 15 ) );
+		v[ 1 ] = ( unsigned short ) ( QuantizeSmallest( rest[ 1 ], 0x7FFF ) | ( ( largest >> 1 ) << 15 ) );
+		v[ 2 ] = QuantizeSmallest( rest[ 2 ], 0xFFFF );
+	}
+
+	Math::Quaternion UnpackRotation( const unsigned short v[ 3 ] ) {
+		int largest = ( v[ 0 ] >> 15 ) | ( ( v[ 1 ] >> 15 ) << 1 );
+
+		float rest[ 3 ] = {
+			DequantizeSmallest( v[ 0 ] & 0x7FFF, 0x7FFF ),
+			DequantizeSmallest( v[ 1 ] & 0x7FFF, 0x7FFF ),
+			DequantizeSmallest( v[ 2 ], 0xFFFF )
+		};
+
+		float c[ 4 ];
+		int n = 0;
+
+		for ( int i = 0; i < 4; ++i ) {
+			if ( i == largest ) {
+				float sum = rest[ 0 ] * rest[ 0 ] + rest[ 1 ] * rest[ 1 ] + rest[ 2 ] * rest[ 2 ];
+				c[ i ] = sqrtf( std::max( 1.0f - sum, 0.0f ) );
+			} else {
+				c[ i ] = rest[ n++ ];
+			}
+		}
+
+		return Math::Quaternion( c[ 0 ], c[ 1 ], c[ 2 ], c[ 3 ] );
+	}
+
+	/*
+		Greedy key reduction. Each segment is stretched for as long as
+		interpolating between its two end keys reproduces every frame inside
+		it, as judged by fits( start, end, frame, t ).
+	*/
+	template< typename Fits >
+	void ReduceKeys( unsigned int frameCount, const Fits& fits, std::vector< unsigned short >& keys ) {
+		keys.clear();
+		keys.push_back( 0 );
+
+		unsigned int start = 0;
+
+		while ( start + 1 < frameCount ) {
+			unsigned int end = start + 1;
+
+			while ( end + 1 < frameCount ) {
+				bool ok = true;
+
+				for ( unsigned int k = start + 1; k <= end && ok; ++k ) {
+					ok = fits( start, end + 1, k, ( float ) ( k - start ) / ( end + 1 - start ) );
+				}
+
+				if ( !ok ) {
+					break;
+				}
+
+				++end;
+			}
+
+			keys.push_back( ( unsigned short ) end );
+			start = end;
+		}
+
+		// A track that never changes needs only its first key.
+		if ( keys.size() == 2 && fits( 0, keys[ 1 ], keys[ 1 ], 0.0f ) ) {
+			keys.pop_back();
+		}
+	}
+
+	// Keys around frame f, and how far f is between them.
+	void FindKeys( const unsigned short* frames, unsigned int count, float f, unsigned int* lo, unsigned int* hi, float* t ) {
+		unsigned int h = ( unsigned int ) ( std::upper_bound( frames, frames + count, f ) - frames );
+
+		if ( h >= count ) {
+			*lo = *hi = count - 1;
+			*t = 0.0f;
+			return;
+		}
+
+		*lo = h - 1;
+		*hi = h;
+		*t = ( f - frames[ *lo ] ) / ( frames[ *hi ] - frames[ *lo ] );
+	}
+
+	unsigned short Quantize( float v, float min, float step ) {
+		return step > 0.0f ? ( unsigned short ) ( ( v - min ) / step + 0.5f ) : 0;
+	}
+
+	Math::Vector3 Lerp( const Math::Vector3& a, const Math::Vector3& b, float t ) {
+		return a + ( b - a ) * t;
+	}
+
+}
+
+unsigned int Skeleton::JointCount( void ) const {
+	return ( unsigned int ) parents.size();
+}
+
+void Skeleton::Finalize( void ) {
+	unsigned int count = JointCount();
+
+	std::vector< Math::Matrix4 > model( count );
+	LocalToModel( *this, bindPose, &model[ 0 ] );
+
+	std::vector< Math::DualQuaternion > modelDQ( count );
+
+	inverseBind.resize( count );
+	inverseBindDQ.resize( count );
+
+	for ( unsigned int i = 0; i < count; ++i ) {
+		inverseBind[ i ] = model[ i ].GetInverse();
+
+		Math::DualQuaternion local( bindPose[ i ].rotation, bindPose[ i ].translation );
+		modelDQ[ i ] = parents[ i ] < 0 ? local : modelDQ[ parents[ i ] ] * local;
+
+		// Unit dual quaternions invert by conjugating both parts.
+		inverseBindDQ[ i ] = Math::DualQuaternion( modelDQ[ i ].real.Conjugate(), modelDQ[ i ].dual.Conjugate() );
+	}
+}
+
+Math::Matrix4 ToMatrix( const JointPose& joint ) {
+	Math::Matrix4 m = Math::ToMatrix( joint.rotation );
+
+	for ( int r = 0; r < 3; ++r ) {
+		for ( int c = 0; c < 3; ++c ) {
+			m.c[ r ][ c ] *= joint.scale;
+		}
+
+		m.c[ r ][ 3 ] = joint.translation[ r ];
+	}
+
+	return m;
+}
+
+void BlendPoses( const Pose& a, const Pose& b, float t, Pose& out ) {
+	out.resize( a.size() );
+
+	for ( size_t i = 0; i < a.size(); ++i ) {
+		out[ i ].rotation = Math::Nlerp( a[ i ].rotation, b[ i ].rotation, t );
+		out[ i ].translation = Lerp( a[ i ].translation, b[ i ].translation, t );
+		out[ i ].scale = a[ i ].scale + ( b[ i ].scale - a[ i ].scale ) * t;
+	}
+}
+
+void LocalToModel( const Skeleton& skeleton, const Pose& pose, Math::Matrix4* model ) {
+	for ( unsigned int i = 0; i < skeleton.JointCount(); ++i ) {
+		Math::Matrix4 local = ToMatrix( pose[ i ] );
+		int parent = skeleton.parents[ i ];
+
+		model[ i ] = parent < 0 ? local : Math::Multiply( model[ parent ], local );
+	}
+}
+
+void SkinningPalette( const Skeleton& skeleton, const Pose& pose, const Math::Matrix4& world, Math::Matrix4* palette ) {
+	Math::Matrix4 model[ MAX_JOINTS ];
+	LocalToModel( skeleton, pose, model );
+
+	for ( unsigned int i = 0; i < skeleton.JointCount(); ++i ) {
+		palette[ i ] = Math::Multiply( world, Math::Multiply( model[ i ], skeleton.inverseBind[ i ] ) );
+	}
+}
+
+void SkinningDualQuaternions( const Skeleton& skeleton, const Pose& pose, const Math::DualQuaternion& world, Math::DualQuaternion* palette ) {
+	Math::DualQuaternion model[ MAX_JOINTS ];
+
+	for ( unsigned int i = 0; i < skeleton.JointCount(); ++i ) {
+		Math::DualQuaternion local( pose[ i ].rotation, pose[ i ].translation );
+		int parent = skeleton.parents[ i ];
+
+		model[ i ] = parent < 0 ? local : model[ parent ] * local;
+		palette[ i ] = world * model[ i ] * skeleton.inverseBindDQ[ i ];
+	}
+}
+
+AnimationClip::AnimationClip( void )
+	: frameRate( 30.0f ), frameCount( 0 ) {
+}
+
+AnimationClip::~AnimationClip( void ) {
+}
+
+bool AnimationClip::Build( const std::vector< Pose >& frames, float rate, float rotationTolerance, float translationTolerance ) {
+	if ( frames.empty() || frames.size() > MAX_FRAMES ) {
+		fprintf( stderr, "AnimationClip: %u frames, need 1 to %u\n", ( unsigned int ) frames.size(), MAX_FRAMES );
+		return false;
+	}
+
+	MemoryScope scope( MEMORY_ANIMATION );
+
+	frameRate = rate;
+	frameCount = ( unsigned int ) frames.size();
+
+	unsigned int jointCount = ( unsigned int ) frames[ 0 ].size();
+
+	joints.assign( jointCount, Tracks() );
+	rotationFrames.clear();
+	rotations.clear();
+	translationFrames.clear();
+	translations.clear();
+	scaleFrames.clear();
+	scales.clear();
+
+	float cosTolerance = cosf( rotationTolerance * Math::PI_OVER_360 );
+	std::vector< unsigned short > keys;
+
+	for ( unsigned int j = 0; j < jointCount; ++j ) {
+		Tracks& tracks = joints[ j ];
+
+		// Rotation, the angle between the interpolated and the real rotation.
+		ReduceKeys( frameCount, [ & ]( unsigned int a, unsigned int b, unsigned int k, float t ) {
+			Math::Quaternion q = Math::Nlerp( frames[ a ][ j ].rotation, frames[ b ][ j ].rotation, t );
+			return fabsf( Math::Dot( q, Math::Normalize( frames[ k ][ j ].rotation ) ) ) >= cosTolerance;
+		}, keys );
+
+		tracks.rotationFirst = ( unsigned int ) rotations.size();
+		tracks.rotationCount = ( unsigned int ) keys.size();
+
+		for ( size_t i = 0; i < keys.size(); ++i ) {
+			PackedRotation p;
+			PackRotation( frames[ keys[ i ] ][ j ].rotation, p.v );
+
+			rotationFrames.push_back( keys[ i ] );
+			rotations.push_back( p );
+		}
+
+		// Translation
+		ReduceKeys( frameCount, [ & ]( unsigned int a, unsigned int b, unsigned int k, float t ) {
+			Math::Vector3 v = Lerp( frames[ a ][ j ].translation, frames[ b ][ j ].translation, t );
+			return ( v - frames[ k ][ j ].translation ).Length() <= translationTolerance;
+		}, keys );
+
+		for ( int c = 0; c < 3; ++c ) {
+			float lo = frames[ keys[ 0 ] ][ j ].translation[ c ];
+			float hi = lo;
+
+			for ( size_t i = 1; i < keys.size(); ++i ) {
+				lo = std::min( lo, frames[ keys[ i ] ][ j ].translation[ c ] );
+				hi = std::max( hi, frames[ keys[ i ] ][ j ].translation[ c ] );
+			}
+
+			tracks.translationMin[ c ] = lo;
+			tracks.translationStep[ c ] = ( hi - lo ) / 0xFFFF;
+		}
+
+		tracks.translationFirst = ( unsigned int ) translationFrames.size();
+		tracks.translationCount = ( unsigned int ) keys.size();
+
+		for ( size_t i = 0; i < keys.size(); ++i ) {
+			translationFrames.push_back( keys[ i ] );
+
+			for ( int c = 0; c < 3; ++c ) {
+				translations.push_back( Quantize( frames[ keys[ i ] ][ j ].translation[ c ], tracks.translationMin[ c ], tracks.translationStep[ c ] ) );
+			}
+		}
+
+		// Scale
+		ReduceKeys( frameCount, [ & ]( unsigned int a, unsigned int b, unsigned int k, float t ) {
+			float s = frames[ a ][ j ].scale + ( frames[ b ][ j ].scale - frames[ a ][ j ].scale ) * t;
+			return fabsf( s - frames[ k ][ j ].scale ) <= SCALE_TOLERANCE;
+		}, keys );
+
+		float lo = frames[ keys[ 0 ] ][ j ].scale;
+		float hi = lo;
+
+		for ( size_t i = 1; i < keys.size(); ++i ) {
+			lo = std::min( lo, frames[ keys[ i ] ][ j ].scale );
+			hi = std::max( hi, frames[ keys[ i ] ][ j ].scale );
+		}
+
+		tracks.scaleMin = lo;
+		tracks.scaleStep = ( hi - lo ) / 0xFFFF;
+		tracks.scaleFirst = ( unsigned int ) scaleFrames.size();
+		tracks.scaleCount = ( unsigned int ) keys.size();
+
+		for ( size_t i = 0; i < keys.size(); ++i ) {
+			scaleFrames.push_back( keys[ i ] );
+			scales.push_back( Quantize( frames[ keys[ i ] ][ j ].scale, lo, tracks.scaleStep ) );
+		}
+	}
+
+	return true;
+}
+
+void AnimationClip::Sample( float time, Pose& out ) const {
+	out.resize( joints.size() );
+
+	float duration = Duration();
+	float f = 0.0f;
+
+	if ( duration > 0.0f ) {
+		float t = fmodf( time, duration );
+		f = ( t < 0.0f ? t + duration : t ) * frameRate;
+	}
+
+	for ( size_t j = 0; j < joints.size(); ++j ) {
+		const Tracks& tracks = joints[ j ];
+		unsigned int lo, hi;
+		float t;
+
+		FindKeys( &rotationFrames[ tracks.rotationFirst ], tracks.rotationCount, f, &lo, &hi, &t );
+		out[ j ].rotation = Math::Nlerp( UnpackRotation( rotations[ tracks.rotationFirst + lo ].v ),
+										 UnpackRotation( rotations[ tracks.rotationFirst + hi ].v ), t );
+
+		FindKeys( &translationFrames[ tracks.translationFirst ], tracks.translationCount, f, &lo, &hi, &t );
+		const unsigned short* a = &translations[ ( tracks.translationFirst + lo ) * 3 ];
+		const unsigned short* b = &translations[ ( tracks.translationFirst + hi ) * 3 ];
+
+		for ( int c = 0; c < 3; ++c ) {
+			float va = tracks.translationMin[ c ] + a[ c ] * tracks.translationStep[ c ];
+			float vb = tracks.translationMin[ c ] + b[ c ] * tracks.translationStep[ c ];
+			out[ j ].translation[ c ] = va + ( vb - va ) * t;
+		}
+
+		FindKeys( &scaleFrames[ tracks.scaleFirst ], tracks.scaleCount, f, &lo, &hi, &t );
+		float sa = tracks.scaleMin + scales[ tracks.scaleFirst + lo ] * tracks.scaleStep;
+		float sb = tracks.scaleMin + scales[ tracks.scaleFirst + hi ] * tracks.scaleStep;
+		out[ j ].scale = sa + ( sb - sa ) * t;
+	}
+}
+
+float AnimationClip::Duration( void ) const {
+	return frameCount > 1 ? ( frameCount - 1 ) / frameRate : 0.0f;
+}
+
+unsigned int AnimationClip::JointCount( void ) const {
+	return ( unsigned int ) joints.size();
+}
+
+size_t AnimationClip::CompressedBytes( void ) const {
+	return sizeof( Tracks ) * joints.size() +
+		   sizeof( unsigned short ) * ( rotationFrames.size() + translationFrames.size() + translations.size() + scaleFrames.size() + scales.size() ) +
+		   sizeof( PackedRotation ) * rotations.size();
+}
+
+size_t AnimationClip::RawBytes( void ) const {
+	return sizeof( JointPose ) * joints.size() * frameCount;
+}
+
+}
@@ -0,0 +1,129 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+
+#include "Vector3.h"
+#include "Matrix4.h"
+#include "Quaternion.h"
+
+namespace DS {
+
+// Palette size, matches BONES in skinned.vert.
+const int MAX_JOINTS = 48;
+
+struct JointPose {
+	JointPose( void )
+		: translation( 0.0f, 0.0f, 0.0f ), scale( 1.0f ) {
+	}
+
+	Math::Quaternion rotation;
+	Math::Vector3 translation;
+	float scale;
+};
+
+// Local ( parent relative ) transform of every joint.
+typedef std::vector< JointPose > Pose;
+
+/**
+	DS::Skeleton - Joint hierarchy
+
+	Parents must come before their children so a single forward pass
+	resolves the hierarchy. Finalize derives the inverse bind transforms
+	from the local bind pose and must run after the joints are set up.
+**/
+struct Skeleton {
+	std::vector< int > parents;						// -1 for a root.
+	Pose bindPose;
+
+	std::vector< Math::Matrix4 > inverseBind;		// Model space, column vectors.
+	std::vector< Math::DualQuaternion > inverseBindDQ;
+
+	unsigned int JointCount( void ) const;
+	void Finalize( void );
+};
+
+// Translate * Rotate * Scale, column vectors.
+Math::Matrix4 ToMatrix( const JointPose& joint );
+
+void BlendPoses( const Pose& a, const Pose& b, float t, Pose& out );
+
+// model[ i ] is joint i's transform into model space.
+void LocalToModel( const Skeleton& skeleton, const Pose& pose, Math::Matrix4* model );
+
+/**
+	DS::SkinningPalette, DS::SkinningDualQuaternions
+
+	Per joint transforms from bind pose model space straight to world
+	space, ready for skinning. The dual quaternion palette ignores scale.
+**/
+void SkinningPalette( const Skeleton& skeleton, const Pose& pose, const Math::Matrix4& world, Math::Matrix4* palette );
+void SkinningDualQuaternions( const Skeleton& skeleton, const Pose& pose, const Math::DualQuaternion& world, Math::DualQuaternion* palette );
+
+/**
+	DS::AnimationClip - Compressed keyframe animation
+
+	Build takes uniformly sampled poses and stores each joint's rotation,
+	translation and scale as separate tracks. A track drops every key that
+	interpolation from its neighbours reproduces within tolerance, so
+	joints that hold still cost one key. The keys that remain are
+	quantized: rotations to 48 bits with the smallest three encoding,
+	translations and scales to 16 bits per component across the track's
+	range.
+
+	Sample is read only and safe to call from many threads at once.
+**/
+class AnimationClip {
+public:
+	AnimationClip( void );
+	~AnimationClip( void );
+
+	// rotationTolerance is in degrees, translationTolerance in model units.
+	bool Build( const std::vector< Pose >& frames, float frameRate, float rotationTolerance, float translationTolerance );
+
+	// Loops over the clip's duration.
+	void Sample( float time, Pose& out ) const;
+
+	float Duration( void ) const;
+	unsigned int JointCount( void ) const;
+
+	size_t CompressedBytes( void ) const;
+	size_t RawBytes( void ) const;
+
+private:
+	struct PackedRotation {
+		unsigned short v[ 3 ];
+	};
+
+	struct Tracks {
+		unsigned int rotationFirst;
+		unsigned int rotationCount;
+		unsigned int translationFirst;
+		unsigned int translationCount;
+		unsigned int scaleFirst;
+		unsigned int scaleCount;
+
+		float translationMin[ 3 ];
+		float translationStep[ 3 ];
+		float scaleMin;
+		float scaleStep;
+	};
+
+	std::vector< Tracks > joints;
+
+	std::vector< unsigned short > rotationFrames;
+	std::vector< PackedRotation > rotations;
+
+	std::vector< unsigned short > translationFrames;
+	std::vector< unsigned short > translations;		// Three per key.
+
+	std::vector< unsigned short > scaleFrames;
+	std::vector< unsigned short > scales;
+
+	float frameRate;
+	unsigned int frameCount;
+};
+
+}
+
+#endif
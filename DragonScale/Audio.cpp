@@ -0,0 +1,872 @@
+#include "Audio.h"
+#include "MemoryTracker.h"
+#include "Matrix4.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <emmintrin.h>
+#include <SDL.h>
+
+namespace DS {
+
+namespace {
+
+	const unsigned int MAX_VOICES = 256;
+	const int MIX_BLOCK = 256;						// Frames mixed at a time, a multiple of 4.
+	const size_t COMMAND_CAPACITY = 1024;
+	const size_t RETIRED_CAPACITY = 16;
+
+	const int DECODE_FRAMES = 4096;
+	const int MUSIC_RING_SECONDS = 2;
+	const int MAX_MUSIC_RATIO = 4;					// Source rate over output rate.
+	const int DECODE_SLEEP_MS = 5;
+
+	const double FIXED_ONE = 4294967296.0;		// 1 << 32.
+
+	struct WavFormat {
+		unsigned int channels;
+		unsigned int rate;
+		unsigned int bits;
+		unsigned int dataBytes;
+	};
+
+	template< typename T >
+	bool Read( std::ifstream& stream, T* out, size_t count ) {
+		stream.read( ( char* ) out, sizeof( T ) * count );
+		return !stream.fail();
+	}
+
+	/*
+		Walks the RIFF chunks up to "data", leaving the stream at the first
+		sample.
+	*/
+	bool OpenWav( std::ifstream& stream, const char* file, WavFormat& format ) {
+		char id[ 4 ];
+		unsigned int size;
+		bool hasFormat = false;
+
+		stream.open( file, std::ios::in | std::ios::binary );
+
+		if ( !stream.is_open() ) {
+			fprintf( stderr, "Could not open %s\n", file );
+			return false;
+		}
+
+		if ( !Read( stream, id, 4 ) || memcmp( id, "RIFF", 4 ) != 0 || !Read( stream, &size, 1 ) ||
+			 !Read( stream, id, 4 ) || memcmp( id, "WAVE", 4 ) != 0 ) {
+			fprintf( stderr, "%s is not a WAVE file\n", file );
+			return false;
+		}
+
+		while ( Read( stream, id, 4 ) && Read( stream, &size, 1 ) ) {
+			if ( memcmp( id, "fmt ", 4 ) == 0 && size >= 16 ) {
+				unsigned short fields[ 2 ];		// Format tag, channels.
+				unsigned int rates[ 2 ];		// Sample rate, byte rate.
+				unsigned short block[ 2 ];		// Block align, bits per sample.
+
+				if ( !Read( stream, fields, 2 ) || !Read( stream, rates, 2 ) || !Read( stream, block, 2 ) ) {
+					break;
+				}
+
+				if ( fields[ 0 ] != 1 || fields[ 1 ] == 0 || ( block[ 1 ] != 8 && block[ 1 ] != 16 ) ) {
+					fprintf( stderr, "%s is not 8 or 16 bit PCM\n", file );
+					return false;
+				}
+
+				format.channels = fields[ 1 ];
+				format.rate = rates[ 0 ];
+				format.bits = block[ 1 ];
+				hasFormat = true;
+
+				stream.seekg( size - 16 + ( size & 1 ), std::ios::cur );
+			} else if ( memcmp( id, "data", 4 ) == 0 ) {
+				if ( !hasFormat ) {
+					break;
+				}
+
+				format.dataBytes = size;
+				return true;
+			} else {
+				stream.seekg( size + ( size & 1 ), std::ios::cur );
+			}
+		}
+
+		fprintf( stderr, "%s has no PCM data\n", file );
+		return false;
+	}
+
+	inline float Sample( const unsigned char* raw, unsigned int index, unsigned int bits ) {
+		if ( bits == 8 ) {
+			return ( raw[ index ] - 128 ) * ( 1.0f / 128.0f );
+		}
+
+		short s;
+		memcpy( &s, raw + index * 2, 2 );
+		return s * ( 1.0f / 32768.0f );
+	}
+
+	inline float Clamp( float x, float lo, float hi ) {
+		return x < lo ? lo : ( x > hi ? hi : x );
+	}
+
+}
+
+bool LoadSound( const char* file, Sound& sound ) {
+	MemoryScope scope( MEMORY_AUDIO );
+
+	std::ifstream stream;
+	WavFormat format;
+
+	if ( !OpenWav( stream, file, format ) ) {
+		return false;
+	}
+
+	std::vector< unsigned char > raw( format.dataBytes );
+
+	if ( !raw.empty() && !Read( stream, &raw[ 0 ], raw.size() ) ) {
+		fprintf( stderr, "%s is truncated\n", file );
+		return false;
+	}
+
+	unsigned int frameBytes = format.channels * format.bits / 8;
+	unsigned int frames = format.dataBytes / frameBytes;
+	float scale = 1.0f / format.channels;
+
+	sound.rate = ( int ) format.rate;
+	sound.samples.resize( frames );
+
+	for ( unsigned int f = 0; f < frames; ++f ) {
+		float sum = 0.0f;
+
+		for ( unsigned int c = 0; c < format.channels; ++c ) {
+			sum += Sample( &raw[ 0 ], f * format.channels + c, format.bits );
+		}
+
+		sound.samples[ f ] = sum * scale;
+	}
+
+	return true;
+}
+
+void MakeTone( float frequency, float seconds, int rate, Sound& sound ) {
+	MemoryScope scope( MEMORY_AUDIO );
+
+	unsigned int count = ( unsigned int ) ( seconds * rate );
+	float cycles = floorf( frequency * seconds + 0.5f );
+
+	sound.rate = rate;
+	sound.samples.resize( count );
+
+	for ( unsigned int i = 0; i < count; ++i ) {
+		sound.samples[ i ] = 0.5f * sinf( 2.0f * Math::PI * cycles * i / count );
+	}
+}
+
+VoiceDesc::VoiceDesc( void )
+	: position( 0.0f, 0.0f, 0.0f ), volume( 1.0f ), pitch( 1.0f ), minDistance( 1.0f ), maxDistance( 50.0f ),
+	  positional( true ), loop( false ) {
+}
+
+/*
+	One music track. The decode thread owns the file and fills the ring,
+	the audio thread owns the interpolation state and drains it.
+*/
+struct AudioMixer::MusicStream {
+	std::ifstream file;
+	WavFormat format;
+	std::streampos dataStart;
+	bool loop;
+
+	SpscQueue< float > ring;			// Interleaved stereo frames.
+	std::thread thread;
+	std::atomic< bool > quit;
+	std::atomic< bool > ended;			// The decoder reached the end of a non looping file.
+
+	unsigned long long step;			// Source frames per output frame, 32.32.
+	unsigned long long fraction;		// Position between previous and next, 32.32.
+	float previous[ 2 ];
+	float next[ 2 ];
+};
+
+AudioMixer::AudioMixer( void )
+	: device( 0 ), frequency( 0 ), nextVoice( 0 ), activeVoices( 0 ), droppedCommands( 0 ), musicUnderruns( 0 ),
+	  listener( 0.0f, 0.0f, 0.0f ), listenerRight( 1.0f, 0.0f, 0.0f ), masterVolume( 1.0f ), musicVolume( 1.0f ),
+	  musicPlaying( NULL ), musicFading( NULL ), musicGain( 0.0f ) {
+}
+
+AudioMixer::~AudioMixer( void ) {
+}
+
+bool AudioMixer::Init( int freq, int bufferFrames ) {
+	if ( SDL_InitSubSystem( SDL_INIT_AUDIO ) < 0 ) {
+		fprintf( stderr, "Audio unavailable: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	{
+		MemoryScope scope( MEMORY_AUDIO );
+
+		commands.Init( COMMAND_CAPACITY );
+		retired.Init( RETIRED_CAPACITY );
+
+		Voice empty;
+		empty.id = 0;
+		empty.sound = NULL;
+		empty.cursor = 0;
+		empty.gain[ 0 ] = empty.gain[ 1 ] = 0.0f;
+		empty.fresh = false;
+		voices.assign( MAX_VOICES, empty );
+
+		accumulator.assign( MIX_BLOCK * 2, 0.0f );
+		scratch.assign( MIX_BLOCK, 0.0f );
+		musicScratch.assign( ( MIX_BLOCK * MAX_MUSIC_RATIO + 1 ) * 2, 0.0f );
+	}
+
+	SDL_AudioSpec want;
+	SDL_AudioSpec have;
+
+	memset( &want, 0, sizeof( want ) );
+	want.freq = freq;
+	want.format = AUDIO_S16SYS;
+	want.channels = 2;
+	want.samples = ( Uint16 ) bufferFrames;
+	want.callback = Callback;
+	want.userdata = this;
+
+	device = SDL_OpenAudioDevice( NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE );
+
+	if ( device == 0 ) {
+		fprintf( stderr, "Could not open audio device: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	frequency = have.freq;
+	SDL_PauseAudioDevice( device, 0 );
+
+	return true;
+}
+
+void AudioMixer::Shutdown( void ) {
+	if ( device == 0 ) {
+		return;
+	}
+
+	// Stops the callback, everything below is the game thread's again.
+	SDL_CloseAudioDevice( device );
+	device = 0;
+
+	Command command;
+
+	while ( commands.Pop( command ) ) {
+		if ( command.type == COMMAND_MUSIC ) {
+			Destroy( command.music );
+		}
+	}
+
+	Destroy( musicPlaying );
+	Destroy( musicFading );
+	musicPlaying = musicFading = NULL;
+
+	Update();
+
+	voices.clear();
+	activeVoices = 0;
+}
+
+void AudioMixer::Update( void ) {
+	MusicStream* music;
+
+	while ( retired.Pop( music ) ) {
+		Destroy( music );
+	}
+}
+
+unsigned int AudioMixer::Play( const Sound* sound, const VoiceDesc& desc ) {
+	if ( ++nextVoice == 0 ) {
+		++nextVoice;
+	}
+
+	Command command;
+	command.type = COMMAND_PLAY;
+	command.voice = nextVoice;
+	command.sound = sound;
+	command.desc = desc;
+
+	return Send( command ) ? nextVoice : 0;
+}
+
+void AudioMixer::Stop( unsigned int voice ) {
+	Command command;
+	command.type = COMMAND_STOP;
+	command.voice = voice;
+
+	Send( command );
+}
+
+void AudioMixer::SetPosition( unsigned int voice, const Math::Point3& position ) {
+	Command command;
+	command.type = COMMAND_POSITION;
+	command.voice = voice;
+	command.values[ 0 ] = position.x;
+	command.values[ 1 ] = position.y;
+	command.values[ 2 ] = position.z;
+
+	Send( command );
+}
+
+void AudioMixer::SetVolume( unsigned int voice, float volume ) {
+	Command command;
+	command.type = COMMAND_VOLUME;
+	command.voice = voice;
+	command.values[ 0 ] = volume;
+
+	Send( command );
+}
+
+void AudioMixer::SetPitch( unsigned int voice, float pitch ) {
+	Command command;
+	command.type = COMMAND_PITCH;
+	command.voice = voice;
+	command.values[ 0 ] = pitch;
+
+	Send( command );
+}
+
+void AudioMixer::SetListener( const Math::Point3& position, const Math::Vector3& forward, const Math::Vector3& up ) {
+	Math::Vector3 right = Math::Normalize( Math::Cross( forward, up ) );
+
+	Command command;
+	command.type = COMMAND_LISTENER;
+	command.values[ 0 ] = position.x;
+	command.values[ 1 ] = position.y;
+	command.values[ 2 ] = position.z;
+	command.values[ 3 ] = right.x;
+	command.values[ 4 ] = right.y;
+	command.values[ 5 ] = right.z;
+
+	Send( command );
+}
+
+void AudioMixer::SetMasterVolume( float volume ) {
+	Command command;
+	command.type = COMMAND_MASTER_VOLUME;
+	command.values[ 0 ] = volume;
+
+	Send( command );
+}
+
+bool AudioMixer::PlayMusic( const char* file, bool loop ) {
+	if ( device == 0 ) {
+		return false;
+	}
+
+	MusicStream* music;
+
+	{
+		MemoryScope scope( MEMORY_AUDIO );
+
+		music = new MusicStream();
+
+		if ( !OpenWav( music->file, file, music->format ) ) {
+			delete music;
+			return false;
+		}
+
+		if ( music->format.rate > ( unsigned int ) frequency * MAX_MUSIC_RATIO ) {
+			fprintf( stderr, "%s: %u Hz is too far above the output rate\n", file, music->format.rate );
+			delete music;
+			return false;
+		}
+
+		music->ring.Init( music->format.rate * 2 * MUSIC_RING_SECONDS );
+	}
+
+	music->dataStart = music->file.tellg();
+	music->loop = loop;
+	music->quit = false;
+	music->ended = false;
+	music->step = ( unsigned long long ) ( ( double ) music->format.rate / frequency * FIXED_ONE );
+	music->fraction = 0;
+	music->previous[ 0 ] = music->previous[ 1 ] = 0.0f;
+	music->next[ 0 ] = music->next[ 1 ] = 0.0f;
+	music->thread = std::thread( DecodeMain, music );
+
+	Command command;
+	command.type = COMMAND_MUSIC;
+	command.music = music;
+
+	if ( !Send( command ) ) {
+		Destroy( music );
+		return false;
+	}
+
+	return true;
+}
+
+void AudioMixer::StopMusic( void ) {
+	Command command;
+	command.type = COMMAND_MUSIC;
+	command.music = NULL;
+
+	Send( command );
+}
+
+void AudioMixer::SetMusicVolume( float volume ) {
+	Command command;
+	command.type = COMMAND_MUSIC_VOLUME;
+	command.values[ 0 ] = volume;
+
+	Send( command );
+}
+
+bool AudioMixer::Running( void ) const {
+	return device != 0;
+}
+
+unsigned int AudioMixer::ActiveVoices( void ) const {
+	return activeVoices.load();
+}
+
+unsigned int AudioMixer::DroppedCommands( void ) const {
+	return droppedCommands.load();
+}
+
+unsigned int AudioMixer::MusicUnderruns( void ) const {
+	return musicUnderruns.load();
+}
+
+bool AudioMixer::Send( const Command& command ) {
+	if ( device == 0 ) {
+		return false;
+	}
+
+	if ( !commands.Push( command ) ) {
+		++droppedCommands;
+		return false;
+	}
+
+	return true;
+}
+
+void AudioMixer::Callback( void* userdata, unsigned char* stream, int length ) {
+	static_cast< AudioMixer* >( userdata )->Mix( ( short* ) stream, length / ( int ) ( 2 * sizeof( short ) ) );
+}
+
+void AudioMixer::Mix( short* out, int frames ) {
+	Command command;
+
+	while ( commands.Pop( command ) ) {
+		Execute( command );
+	}
+
+	const __m128 lo = _mm_set1_ps( -1.0f );
+	const __m128 hi = _mm_set1_ps( 1.0f );
+	const __m128 scale = _mm_set1_ps( 32767.0f );
+
+	while ( frames > 0 ) {
+		int count = std::min( frames, MIX_BLOCK );
+		int padded = ( count + 3 ) & ~3;
+
+		memset( &accumulator[ 0 ], 0, sizeof( float ) * padded * 2 );
+
+		for ( unsigned int i = 0; i < voices.size(); ++i ) {
+			if ( voices[ i ].id != 0 ) {
+				MixVoice( voices[ i ], count );
+			}
+		}
+
+		if ( musicFading != NULL ) {
+			MixMusic( musicFading, count, musicGain, 0.0f );
+			Retire( musicFading );
+			musicFading = NULL;
+			musicGain = 0.0f;
+		}
+
+		if ( musicPlaying != NULL ) {
+			MixMusic( musicPlaying, count, musicGain, musicVolume );
+			musicGain = musicVolume;
+
+			if ( musicPlaying->ended && musicPlaying->ring.Size() == 0 ) {
+				Retire( musicPlaying );
+				musicPlaying = NULL;
+				musicGain = 0.0f;
+			}
+		}
+
+		// Clamp, scale and saturate to 16 bits, eight samples at a time.
+		int samples = count * 2;
+		int s = 0;
+
+		for ( ; s + 8 <= samples; s += 8 ) {
+			__m128 a = _mm_mul_ps( _mm_min_ps( _mm_max_ps( _mm_loadu_ps( &accumulator[ s ] ), lo ), hi ), scale );
+			__m128 b = _mm_mul_ps( _mm_min_ps( _mm_max_ps( _mm_loadu_ps( &accumulator[ s + 4 ] ), lo ), hi ), scale );
+
+			_mm_storeu_si128( ( __m128i* ) &out[ s ], _mm_packs_epi32( _mm_cvtps_epi32( a ), _mm_cvtps_epi32( b ) ) );
+		}
+
+		for ( ; s < samples; ++s ) {
+			out[ s ] = ( short ) ( Clamp( accumulator[ s ], -1.0f, 1.0f ) * 32767.0f );
+		}
+
+		out += samples;
+		frames -= count;
+	}
+
+	unsigned int active = 0;
+
+	for ( unsigned int i = 0; i < voices.size(); ++i ) {
+		active += voices[ i ].id != 0 ? 1 : 0;
+	}
+
+	activeVoices.store( active, std::memory_order_relaxed );
+}
+
+void AudioMixer::Execute( const Command& command ) {
+	if ( command.type == COMMAND_PLAY ) {
+		if ( command.sound == NULL || command.sound->samples.empty() ) {
+			return;
+		}
+
+		Voice* slot = NULL;
+		float quietest = 0.0f;
+
+		for ( unsigned int i = 0; i < voices.size(); ++i ) {
+			Voice& v = voices[ i ];
+
+			if ( v.id == 0 ) {
+				slot = &v;
+				break;
+			}
+
+			float loudest = std::max( v.gain[ 0 ], v.gain[ 1 ] );
+
+			if ( slot == NULL || loudest < quietest ) {
+				slot = &v;
+				quietest = loudest;
+			}
+		}
+
+		slot->id = command.voice;
+		slot->sound = command.sound;
+		slot->desc = command.desc;
+		slot->cursor = 0;
+		slot->gain[ 0 ] = slot->gain[ 1 ] = 0.0f;
+		slot->fresh = true;
+		return;
+	}
+
+	if ( command.type == COMMAND_LISTENER ) {
+		listener = Math::Point3( command.values[ 0 ], command.values[ 1 ], command.values[ 2 ] );
+		listenerRight = Math::Vector3( command.values[ 3 ], command.values[ 4 ], command.values[ 5 ] );
+		return;
+	}
+
+	if ( command.type == COMMAND_MASTER_VOLUME ) {
+		masterVolume = command.values[ 0 ];
+		return;
+	}
+
+	if ( command.type == COMMAND_MUSIC_VOLUME ) {
+		musicVolume = command.values[ 0 ];
+		return;
+	}
+
+	if ( command.type == COMMAND_MUSIC ) {
+		// Only one track fades at a time, a third one cuts it short.
+		if ( musicFading != NULL ) {
+			Retire( musicFading );
+		}
+
+		musicFading = musicPlaying;
+		musicPlaying = command.music;
+		return;
+	}
+
+	Voice* voice = FindVoice( command.voice );
+
+	if ( voice == NULL ) {
+		return;			// Already finished or replaced.
+	}
+
+	switch ( command.type ) {
+		case COMMAND_STOP:
+			voice->id = 0;
+			break;
+		case COMMAND_POSITION:
+			voice->desc.position = Math::Point3( command.values[ 0 ], command.values[ 1 ], command.values[ 2 ] );
+			break;
+		case COMMAND_VOLUME:
+			voice->desc.volume = command.values[ 0 ];
+			break;
+		case COMMAND_PITCH:
+			voice->desc.pitch = command.values[ 0 ];
+			break;
+		default:
+			break;
+	}
+}
+
+AudioMixer::Voice* AudioMixer::FindVoice( unsigned int id ) {
+	for ( unsigned int i = 0; i < voices.size(); ++i ) {
+		if ( voices[ i ].id == id ) {
+			return &voices[ i ];
+		}
+	}
+
+	return NULL;
+}
+
+void AudioMixer::TargetGains( const Voice& voice, float* gains ) const {
+	float volume = voice.desc.volume * masterVolume;
+
+	if ( !voice.desc.positional ) {
+		gains[ 0 ] = gains[ 1 ] = volume;
+		return;
+	}
+
+	Math::Vector3 offset = voice.desc.position - listener;
+	float distance = offset.Length();
+
+	if ( distance >= voice.desc.maxDistance ) {
+		gains[ 0 ] = gains[ 1 ] = 0.0f;
+		return;
+	}
+
+	// Inverse distance, flat inside minDistance.
+	float attenuation = voice.desc.minDistance / std::max( distance, voice.desc.minDistance );
+	float pan = distance > 0.0001f ? Clamp( Math::Dot( offset, listenerRight ) / distance, -1.0f, 1.0f ) : 0.0f;
+	float angle = ( pan + 1.0f ) * Math::PI * 0.25f;
+
+	gains[ 0 ] = volume * attenuation * cosf( angle );
+	gains[ 1 ] = volume * attenuation * sinf( angle );
+}
+
+void AudioMixer::MixVoice( Voice& voice, int frames ) {
+	const std::vector< float >& samples = voice.sound->samples;
+	unsigned long long length = samples.size();
+	unsigned long long end = length << 32;
+	unsigned long long step = ( unsigned long long ) ( ( double ) voice.sound->rate / frequency * voice.desc.pitch * FIXED_ONE );
+
+	float target[ 2 ];
+	TargetGains( voice, target );
+
+	if ( voice.fresh ) {
+		voice.gain[ 0 ] = target[ 0 ];
+		voice.gain[ 1 ] = target[ 1 ];
+		voice.fresh = false;
+	}
+
+	bool silent = voice.gain[ 0 ] == 0.0f && voice.gain[ 1 ] == 0.0f && target[ 0 ] == 0.0f && target[ 1 ] == 0.0f;
+
+	if ( silent ) {
+		// Out of range, keep time moving without touching the samples.
+		voice.cursor += step * frames;
+
+		if ( voice.cursor >= end ) {
+			if ( voice.desc.loop ) {
+				voice.cursor %= end;
+			} else {
+				voice.id = 0;
+			}
+		}
+
+		return;
+	}
+
+	int i = 0;
+	bool finished = false;
+
+	// Four frames at a time while all of them and the samples after them
+	// are inside the sound: the source positions are gathered and the four
+	// lerps done at once. The rest, wrapping and ending included, is scalar.
+	const float* source = samples.empty() ? NULL : &samples[ 0 ];
+	const __m128 fractionScale = _mm_set1_ps( ( float ) ( 256.0 / FIXED_ONE ) );
+	unsigned long long last = length > 1 ? ( length - 1 ) << 32 : 0;
+
+	for ( ; i + 4 <= frames && voice.cursor + step * 3 < last; i += 4 ) {
+		unsigned long long c0 = voice.cursor;
+		unsigned long long c1 = c0 + step;
+		unsigned long long c2 = c1 + step;
+		unsigned long long c3 = c2 + step;
+
+		const float* p0 = &source[ c0 >> 32 ];
+		const float* p1 = &source[ c1 >> 32 ];
+		const float* p2 = &source[ c2 >> 32 ];
+		const float* p3 = &source[ c3 >> 32 ];
+
+		__m128 a = _mm_setr_ps( p0[ 0 ], p1[ 0 ], p2[ 0 ], p3[ 0 ] );
+		__m128 b = _mm_setr_ps( p0[ 1 ], p1[ 1 ], p2[ 1 ], p3[ 1 ] );
+
+		// The top 24 bits of each fraction, all a float keeps anyway.
+		__m128i fraction = _mm_setr_epi32( ( int ) ( ( unsigned int ) c0 >> 8 ), ( int ) ( ( unsigned int ) c1 >> 8 ),
+										   ( int ) ( ( unsigned int ) c2 >> 8 ), ( int ) ( ( unsigned int ) c3 >> 8 ) );
+		__m128 t = _mm_mul_ps( _mm_cvtepi32_ps( fraction ), fractionScale );
+
+		_mm_storeu_ps( &scratch[ i ], _mm_add_ps( a, _mm_mul_ps( _mm_sub_ps( b, a ), t ) ) );
+		voice.cursor = c3 + step;
+	}
+
+	for ( ; i < frames; ++i ) {
+		if ( voice.cursor >= end ) {
+			if ( !voice.desc.loop ) {
+				finished = true;
+				break;
+			}
+
+			voice.cursor -= end;
+		}
+
+		unsigned long long index = voice.cursor >> 32;
+		float t = ( float ) ( voice.cursor & 0xFFFFFFFFull ) * ( float ) ( 1.0 / FIXED_ONE );
+		float a = samples[ ( size_t ) index ];
+		float b = index + 1 < length ? samples[ ( size_t ) index + 1 ] : ( voice.desc.loop ? samples[ 0 ] : 0.0f );
+
+		scratch[ i ] = a + ( b - a ) * t;
+		voice.cursor += step;
+	}
+
+	int padded = ( frames + 3 ) & ~3;
+
+	for ( ; i < padded; ++i ) {
+		scratch[ i ] = 0.0f;
+	}
+
+	// Gains ramp linearly from last buffer's to this one's.
+	float dl = ( target[ 0 ] - voice.gain[ 0 ] ) / frames;
+	float dr = ( target[ 1 ] - voice.gain[ 1 ] ) / frames;
+
+	__m128 left = _mm_setr_ps( voice.gain[ 0 ], voice.gain[ 0 ] + dl, voice.gain[ 0 ] + dl * 2.0f, voice.gain[ 0 ] + dl * 3.0f );
+	__m128 right = _mm_setr_ps( voice.gain[ 1 ], voice.gain[ 1 ] + dr, voice.gain[ 1 ] + dr * 2.0f, voice.gain[ 1 ] + dr * 3.0f );
+	__m128 stepLeft = _mm_set1_ps( dl * 4.0f );
+	__m128 stepRight = _mm_set1_ps( dr * 4.0f );
+
+	float* acc = &accumulator[ 0 ];
+
+	for ( int f = 0; f < padded; f += 4 ) {
+		__m128 mono = _mm_loadu_ps( &scratch[ f ] );
+		__m128 l = _mm_mul_ps( mono, left );
+		__m128 r = _mm_mul_ps( mono, right );
+
+		// L0 R0 L1 R1, L2 R2 L3 R3.
+		_mm_storeu_ps( acc + f * 2, _mm_add_ps( _mm_loadu_ps( acc + f * 2 ), _mm_unpacklo_ps( l, r ) ) );
+		_mm_storeu_ps( acc + f * 2 + 4, _mm_add_ps( _mm_loadu_ps( acc + f * 2 + 4 ), _mm_unpackhi_ps( l, r ) ) );
+
+		left = _mm_add_ps( left, stepLeft );
+		right = _mm_add_ps( right, stepRight );
+	}
+
+	voice.gain[ 0 ] = target[ 0 ];
+	voice.gain[ 1 ] = target[ 1 ];
+
+	if ( finished ) {
+		voice.id = 0;
+	}
+}
+
+void AudioMixer::MixMusic( MusicStream* music, int frames, float from, float to ) {
+	unsigned long long needed = ( music->fraction + music->step * frames ) >> 32;
+
+	size_t got = music->ring.Read( &musicScratch[ 0 ], ( size_t ) needed * 2 ) / 2;
+
+	if ( got < needed ) {
+		if ( !music->ended ) {
+			++musicUnderruns;
+		}
+
+		memset( &musicScratch[ got * 2 ], 0, sizeof( float ) * ( size_t ) ( needed - got ) * 2 );
+	}
+
+	float gain = from;
+	float delta = ( to - from ) / frames;
+	size_t k = 0;
+
+	for ( int i = 0; i < frames; ++i ) {
+		float t = ( float ) ( music->fraction & 0xFFFFFFFFull ) * ( float ) ( 1.0 / FIXED_ONE );
+
+		accumulator[ i * 2 ] += ( music->previous[ 0 ] + ( music->next[ 0 ] - music->previous[ 0 ] ) * t ) * gain;
+		accumulator[ i * 2 + 1 ] += ( music->previous[ 1 ] + ( music->next[ 1 ] - music->previous[ 1 ] ) * t ) * gain;
+
+		music->fraction += music->step;
+		gain += delta;
+
+		while ( music->fraction >= ( 1ull << 32 ) ) {
+			music->fraction -= 1ull << 32;
+			music->previous[ 0 ] = music->next[ 0 ];
+			music->previous[ 1 ] = music->next[ 1 ];
+			music->next[ 0 ] = musicScratch[ k * 2 ];
+			music->next[ 1 ] = musicScratch[ k * 2 + 1 ];
+			++k;
+		}
+	}
+}
+
+void AudioMixer::Retire( MusicStream* music ) {
+	// Sized so Update always keeps up; if not, the stream leaks rather
+	// than blocking the audio thread.
+	retired.Push( music );
+}
+
+void AudioMixer::DecodeMain( MusicStream* music ) {
+	const WavFormat& format = music->format;
+	unsigned int frameBytes = format.channels * format.bits / 8;
+	unsigned int remaining = format.dataBytes / frameBytes;
+
+	std::vector< unsigned char > raw( DECODE_FRAMES * frameBytes );
+	std::vector< float > decoded( DECODE_FRAMES * 2 );
+
+	while ( !music->quit ) {
+		// Only the decoder adds to the ring, so free space can only grow.
+		if ( music->ring.Capacity() - music->ring.Size() < decoded.size() ) {
+			std::this_thread::sleep_for( std::chrono::milliseconds( DECODE_SLEEP_MS ) );
+			continue;
+		}
+
+		if ( remaining == 0 ) {
+			if ( !music->loop ) {
+				break;
+			}
+
+			music->file.clear();
+			music->file.seekg( music->dataStart );
+			remaining = format.dataBytes / frameBytes;
+		}
+
+		unsigned int frames = std::min( remaining, ( unsigned int ) DECODE_FRAMES );
+
+		if ( !Read( music->file, &raw[ 0 ], frames * frameBytes ) ) {
+			break;
+		}
+
+		for ( unsigned int f = 0; f < frames; ++f ) {
+			unsigned int first = f * format.channels;
+
+			decoded[ f * 2 ] = Sample( &raw[ 0 ], first, format.bits );
+			decoded[ f * 2 + 1 ] = Sample( &raw[ 0 ], format.channels > 1 ? first + 1 : first, format.bits );
+		}
+
+		music->ring.Write( &decoded[ 0 ], frames * 2 );
+		remaining -= frames;
+	}
+
+	music->ended = true;
+}
+
+void AudioMixer::Destroy( MusicStream* music ) {
+	if ( music == NULL ) {
+		return;
+	}
+
+	music->quit = true;
+	music->thread.join();
+
+	delete music;
+}
+
+}
@@ -0,0 +1,183 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <atomic>
+#include <vector>
+
+#include "Point3.h"
+#include "SpscQueue.h"
+
+namespace DS {
+
+/**
+	DS::Sound - Mono samples in [ -1, 1 ] at their own rate
+
+	The mixer resamples on the fly, so sounds keep the rate they were
+	authored at.
+**/
+struct Sound {
+	std::vector< float > samples;
+	int rate;
+};
+
+/**
+	DS::LoadSound
+
+	Reads a RIFF WAVE file of 8 or 16 bit PCM, mixing multiple channels
+	down to mono.
+**/
+bool LoadSound( const char* file, Sound& sound );
+
+/**
+	DS::MakeTone
+
+	A sine near frequency Hz, tuned to a whole number of cycles over the
+	length so it loops without clicks.
+**/
+void MakeTone( float frequency, float seconds, int rate, Sound& sound );
+
+struct VoiceDesc {
+	VoiceDesc( void );
+
+	Math::Point3 position;
+	float volume;
+	float pitch;				// Playback rate multiplier.
+	float minDistance;			// Full volume inside.
+	float maxDistance;			// Silent outside.
+	bool positional;			// false plays centered at volume.
+	bool loop;
+};
+
+/**
+	DS::AudioMixer - Software mixer on the SDL audio thread
+
+	The game thread never touches mixer state. Play, Stop and the setters
+	push small commands onto a lock-free queue that the audio callback
+	drains at the start of every buffer; if the queue is full the command
+	is dropped and counted rather than waited on. The callback never
+	locks or allocates, so neither side can stall the other.
+
+	Voices are resampled with linear interpolation and mixed four frames
+	at a time with SSE. Positional voices are attenuated by distance to
+	the listener and panned with an equal power law; gains ramp across
+	each buffer so moving sources do not click. When every voice is busy
+	the quietest one is replaced.
+
+	Music is decoded from a PCM WAV file on its own thread into a
+	sample ring the callback reads from. Switching tracks crossfades over
+	one buffer. Finished streams are handed back through a second queue
+	and joined in Update, on the game thread.
+**/
+class AudioMixer {
+public:
+	AudioMixer( void );
+	~AudioMixer( void );
+
+	bool Init( int frequency, int bufferFrames );
+	void Shutdown( void );
+
+	// Game thread, once per frame.
+	void Update( void );
+
+	// sound must outlive the mixer. Returns 0 if the mixer is not running.
+	unsigned int Play( const Sound* sound, const VoiceDesc& desc );
+	void Stop( unsigned int voice );
+	void SetPosition( unsigned int voice, const Math::Point3& position );
+	void SetVolume( unsigned int voice, float volume );
+	void SetPitch( unsigned int voice, float pitch );
+
+	void SetListener( const Math::Point3& position, const Math::Vector3& forward, const Math::Vector3& up );
+	void SetMasterVolume( float volume );
+
+	bool PlayMusic( const char* file, bool loop );
+	void StopMusic( void );
+	void SetMusicVolume( float volume );
+
+	bool Running( void ) const;
+	unsigned int ActiveVoices( void ) const;
+	unsigned int DroppedCommands( void ) const;
+	unsigned int MusicUnderruns( void ) const;
+
+private:
+	enum CommandType {
+		COMMAND_PLAY,
+		COMMAND_STOP,
+		COMMAND_POSITION,
+		COMMAND_VOLUME,
+		COMMAND_PITCH,
+		COMMAND_LISTENER,
+		COMMAND_MASTER_VOLUME,
+		COMMAND_MUSIC,
+		COMMAND_MUSIC_VOLUME
+	};
+
+	struct MusicStream;
+
+	struct Command {
+		CommandType type;
+		unsigned int voice;
+		const Sound* sound;
+		MusicStream* music;
+		VoiceDesc desc;
+		float values[ 9 ];
+	};
+
+	struct Voice {
+		unsigned int id;				// 0 is a free slot.
+		const Sound* sound;
+		VoiceDesc desc;
+
+		unsigned long long cursor;		// 32.32 fixed point sample position.
+		float gain[ 2 ];				// Applied at the end of the last buffer.
+		bool fresh;						// No gain ramp on the first buffer.
+	};
+
+	static void Callback( void* userdata, unsigned char* stream, int length );
+
+	bool Send( const Command& command );
+
+	// Audio thread.
+	void Mix( short* out, int frames );
+	void Execute( const Command& command );
+	Voice* FindVoice( unsigned int id );
+	void TargetGains( const Voice& voice, float* gains ) const;
+	void MixVoice( Voice& voice, int frames );
+	void MixMusic( MusicStream* music, int frames, float from, float to );
+	void Retire( MusicStream* music );
+
+	// Music decode thread.
+	static void DecodeMain( MusicStream* music );
+	static void Destroy( MusicStream* music );
+
+	unsigned int device;
+	int frequency;
+
+	// Game thread.
+	unsigned int nextVoice;
+
+	std::atomic< unsigned int > activeVoices;
+	std::atomic< unsigned int > droppedCommands;
+	std::atomic< unsigned int > musicUnderruns;
+
+	SpscQueue< Command > commands;		// Game thread to audio thread.
+	SpscQueue< MusicStream* > retired;	// Audio thread to game thread.
+
+	// Audio thread.
+	std::vector< Voice > voices;
+	std::vector< float > accumulator;	// Interleaved stereo.
+	std::vector< float > scratch;		// One voice, mono.
+	std::vector< float > musicScratch;	// Source frames for one block.
+
+	Math::Point3 listener;
+	Math::Vector3 listenerRight;
+	float masterVolume;
+	float musicVolume;
+
+	MusicStream* musicPlaying;
+	MusicStream* musicFading;
+	float musicGain;					// Applied at the end of the last buffer.
+};
+
+}
+
+#endif
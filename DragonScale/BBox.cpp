@@ -0,0 +1,123 @@
+#include "BBox.h"
+
+#include <cfloat>
+#include <algorithm>
+
+using namespace Math;
+
+BBox::BBox( void )
+	: pMin( FLT_MAX, FLT_MAX, FLT_MAX ), pMax( -FLT_MAX, -FLT_MAX, -FLT_MAX ) {
+}
+
+BBox::BBox( const Point3& p )
+	: pMin( p ), pMax( p ) {
+}
+
+BBox::BBox( const Point3& p1, const Point3& p2 )
+	: pMin( std::min( p1.x, p2.x ), std::min( p1.y, p2.y ), std::min( p1.z, p2.z ) ),
+	  pMax( std::max( p1.x, p2.x ), std::max( p1.y, p2.y ), std::max( p1.z, p2.z ) ) {
+}
+
+BBox::~BBox( void ) {
+}
+
+bool BBox::IsEmpty( void ) const {
+	return pMin.x > pMax.x || pMin.y > pMax.y || pMin.z > pMax.z;
+}
+
+bool BBox::Overlaps( const BBox& b ) const {
+	bool x = ( pMax.x >= b.pMin.x ) && ( pMin.x <= b.pMax.x );
+	bool y = ( pMax.y >= b.pMin.y ) && ( pMin.y <= b.pMax.y );
+	bool z = ( pMax.z >= b.pMin.z ) && ( pMin.z <= b.pMax.z );
+
+	return x && y && z;
+}
+
+bool BBox::Inside( const Point3& p ) const {
+	return p.x >= pMin.x && p.x <= pMax.x &&
+		   p.y >= pMin.y && p.y <= pMax.y &&
+		   p.z >= pMin.z && p.z <= pMax.z;
+}
+
+Point3 BBox::Center( void ) const {
+	return Point3( ( pMin.x + pMax.x ) * 0.5f,
+				   ( pMin.y + pMax.y ) * 0.5f,
+				   ( pMin.z + pMax.z ) * 0.5f );
+}
+
+Vector3 BBox::Extent( void ) const {
+	return pMax - pMin;
+}
+
+float BBox::Radius( void ) const {
+	return Extent().Length() * 0.5f;
+}
+
+int BBox::MaximumExtent( void ) const {
+	Vector3 d = Extent();
+
+	if ( d.x > d.y && d.x > d.z ) {
+		return 0;
+	} else if ( d.y > d.z ) {
+		return 1;
+	}
+
+	return 2;
+}
+
+void BBox::Expand( float delta ) {
+	pMin -= Vector3( delta, delta, delta );
+	pMax += Vector3( delta, delta, delta );
+}
+
+BBox Math::Union( const BBox& b, const Point3& p ) {
+	BBox r = b;
+
+	r.pMin.x = std::min( b.pMin.x, p.x );
+	r.pMin.y = std::min( b.pMin.y, p.y );
+	r.pMin.z = std::min( b.pMin.z, p.z );
+	r.pMax.x = std::max( b.pMax.x, p.x );
+	r.pMax.y = std::max( b.pMax.y, p.y );
+	r.pMax.z = std::max( b.pMax.z, p.z );
+
+	return r;
+}
+
+BBox Math::Union( const BBox& b1, const BBox& b2 ) {
+	BBox r = b1;
+
+	r.pMin.x = std::min( b1.pMin.x, b2.pMin.x );
+	r.pMin.y = std::min( b1.pMin.y, b2.pMin.y );
+	r.pMin.z = std::min( b1.pMin.z, b2.pMin.z );
+	r.pMax.x = std::max( b1.pMax.x, b2.pMax.x );
+	r.pMax.y = std::max( b1.pMax.y, b2.pMax.y );
+	r.pMax.z = std::max( b1.pMax.z, b2.pMax.z );
+
+	return r;
+}
+
+// Arvo's method: each output axis accumulates the min/max contribution of
+// every input axis instead of transforming all eight corners.
+BBox Math::TransformBounds( const Matrix4& m, const BBox& b ) {
+	if ( b.IsEmpty() ) {
+		return b;
+	}
+
+	float rMin[ 3 ];
+	float rMax[ 3 ];
+
+	for ( int i = 0; i < 3; ++i ) {
+		rMin[ i ] = rMax[ i ] = m.c[ i ][ 3 ];
+
+		for ( int j = 0; j < 3; ++j ) {
+			float e = m.c[ i ][ j ] * b.pMin[ j ];
+			float f = m.c[ i ][ j ] * b.pMax[ j ];
+
+			rMin[ i ] += std::min( e, f );
+			rMax[ i ] += std::max( e, f );
+		}
+	}
+
+	return BBox( Point3( rMin[ 0 ], rMin[ 1 ], rMin[ 2 ] ),
+				 Point3( rMax[ 0 ], rMax[ 1 ], rMax[ 2 ] ) );
+}
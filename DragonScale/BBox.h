@@ -0,0 +1,50 @@
+#ifndef BBOX_H
+#define BBOX_H
+
+#include "Point3.h"
+#include "Matrix4.h"
+
+namespace Math {
+
+/**
+	Math::BBox - Axis Aligned Bounding Box
+
+	An empty box has pMin greater than pMax so the first Union snaps to
+	the point being added.
+**/
+class BBox {
+public:
+	BBox( void );
+	BBox( const Point3& p );
+	BBox( const Point3& p1, const Point3& p2 );
+	~BBox( void );
+
+	bool IsEmpty( void ) const;
+	bool Overlaps( const BBox& b ) const;
+	bool Inside( const Point3& p ) const;
+
+	Point3 Center( void ) const;
+	Vector3 Extent( void ) const;
+	float Radius( void ) const;
+	int MaximumExtent( void ) const;
+
+	void Expand( float delta );
+
+	Point3 pMin;
+	Point3 pMax;
+};
+
+BBox Union( const BBox& b, const Point3& p );
+BBox Union( const BBox& b1, const BBox& b2 );
+
+/**
+	Math::TransformBounds
+
+	Bounds of the box after transformation by m ( column vector convention,
+	translation in m.c[ i ][ 3 ] ).
+**/
+BBox TransformBounds( const Matrix4& m, const BBox& b );
+
+}
+
+#endif
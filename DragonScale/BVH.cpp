@@ -0,0 +1,423 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#include <emmintrin.h>
+
+namespace DS {
+
+namespace {
+
+	const unsigned int MAX_LEAF_TRIANGLES = 4;
+	const int SAH_BINS = 12;
+	const int STACK_SIZE = 64;
+
+	// Traversal pushes at most one node per level. Nodes at MAX_DEPTH become
+	// leaves; ones too big for a leaf split at the median, which for 2^32
+	// triangles takes 16 more levels.
+	const unsigned int MAX_DEPTH = STACK_SIZE - 16;
+
+	const float EPSILON = 1e-8f;
+
+	const unsigned int TRIANGLE_FLOATS = 9;
+
+	float SurfaceArea( const Math::BBox& b ) {
+		if ( b.IsEmpty() ) {
+			return 0.0f;
+		}
+
+		Math::Vector3 d = b.pMax - b.pMin;
+		return 2.0f * ( d.x * d.y + d.y * d.z + d.z * d.x );
+	}
+
+	inline __m128 Select( __m128 mask, __m128 a, __m128 b ) {
+		return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+	}
+
+}
+
+BVH::BVH( void ) {
+}
+
+BVH::~BVH( void ) {
+}
+
+void BVH::Build( const float* positions, const unsigned int* indices, unsigned int triangleCount ) {
+	nodes.clear();
+	triangles.clear();
+	triangleIndex.clear();
+
+	if ( triangleCount == 0 ) {
+		return;
+	}
+
+	std::vector< BuildItem > items( triangleCount );
+
+	for ( unsigned int i = 0; i < triangleCount; ++i ) {
+		BuildItem& item = items[ i ];
+		item.triangle = i;
+
+		for ( int k = 0; k < 3; ++k ) {
+			const float* p = &positions[ indices[ i * 3 + k ] * 3 ];
+			item.bounds = Math::Union( item.bounds, Math::Point3( p[ 0 ], p[ 1 ], p[ 2 ] ) );
+		}
+
+		item.centroid = item.bounds.Center();
+	}
+
+	nodes.reserve( triangleCount * 2 );
+	BuildRecursive( items, 0, triangleCount, 0 );
+
+	// Leaf order, precomputed for Moller-Trumbore.
+	triangles.resize( triangleCount * TRIANGLE_FLOATS );
+	triangleIndex.resize( triangleCount );
+
+	for ( unsigned int i = 0; i < triangleCount; ++i ) {
+		unsigned int tri = items[ i ].triangle;
+		const float* p0 = &positions[ indices[ tri * 3 ] * 3 ];
+		const float* p1 = &positions[ indices[ tri * 3 + 1 ] * 3 ];
+		const float* p2 = &positions[ indices[ tri * 3 + 2 ] * 3 ];
+		float* out = &triangles[ i * TRIANGLE_FLOATS ];
+
+		for ( int k = 0; k < 3; ++k ) {
+			out[ k ] = p0[ k ];
+			out[ 3 + k ] = p1[ k ] - p0[ k ];
+			out[ 6 + k ] = p2[ k ] - p0[ k ];
+		}
+
+		triangleIndex[ i ] = tri;
+	}
+}
+
+unsigned int BVH::BuildRecursive( std::vector< BuildItem >& items, unsigned int begin, unsigned int end, unsigned int depth ) {
+	unsigned int index = ( unsigned int ) nodes.size();
+	nodes.push_back( Node() );
+
+	Math::BBox bounds;
+	Math::BBox centroids;
+
+	for ( unsigned int i = begin; i < end; ++i ) {
+		bounds = Math::Union( bounds, items[ i ].bounds );
+		centroids = Math::Union( centroids, items[ i ].centroid );
+	}
+
+	nodes[ index ].bounds = bounds;
+
+	unsigned int count = end - begin;
+	int axis = centroids.MaximumExtent();
+	float lo = centroids.pMin[ axis ];
+	float extent = centroids.pMax[ axis ] - lo;
+
+	// Coincident centroids cannot be split, keep them together if they fit.
+	if ( count <= MAX_LEAF_TRIANGLES || ( ( extent <= 0.0f || depth >= MAX_DEPTH ) && count <= 0xFFFF ) ) {
+		nodes[ index ].offset = begin;
+		nodes[ index ].count = ( unsigned short ) count;
+		nodes[ index ].axis = 0;
+		return index;
+	}
+
+	unsigned int mid = begin + count / 2;
+
+	if ( extent > 0.0f ) {
+		// Binned SAH along the widest centroid axis.
+		Math::BBox binBounds[ SAH_BINS ];
+		unsigned int binCount[ SAH_BINS ] = { 0 };
+		float scale = SAH_BINS / extent;
+
+		for ( unsigned int i = begin; i < end; ++i ) {
+			int b = std::min( ( int ) ( ( items[ i ].centroid[ axis ] - lo ) * scale ), SAH_BINS - 1 );
+			++binCount[ b ];
+			binBounds[ b ] = Math::Union( binBounds[ b ], items[ i ].bounds );
+		}
+
+		// Sweep from the right once, then from the left evaluating each split.
+		float rightArea[ SAH_BINS ];
+		unsigned int rightCount[ SAH_BINS ];
+		Math::BBox acc;
+		unsigned int n = 0;
+
+		for ( int b = SAH_BINS - 1; b > 0; --b ) {
+			acc = Math::Union( acc, binBounds[ b ] );
+			n += binCount[ b ];
+			rightArea[ b ] = SurfaceArea( acc );
+			rightCount[ b ] = n;
+		}
+
+		float bestCost = FLT_MAX;
+		int bestSplit = -1;
+		acc = Math::BBox();
+		n = 0;
+
+		for ( int b = 1; b < SAH_BINS; ++b ) {
+			acc = Math::Union( acc, binBounds[ b - 1 ] );
+			n += binCount[ b - 1 ];
+
+			if ( n == 0 || rightCount[ b ] == 0 ) {
+				continue;
+			}
+
+			float cost = SurfaceArea( acc ) * n + rightArea[ b ] * rightCount[ b ];
+
+			if ( cost < bestCost ) {
+				bestCost = cost;
+				bestSplit = b;
+			}
+		}
+
+		if ( bestSplit > 0 && depth < MAX_DEPTH ) {
+			float split = lo + bestSplit / scale;
+
+			BuildItem* first = &items[ begin ];
+			BuildItem* last = &items[ 0 ] + end;
+			mid = ( unsigned int ) ( std::partition( first, last, [ axis, split, lo, scale, bestSplit ]( const BuildItem& item ) {
+				return std::min( ( int ) ( ( item.centroid[ axis ] - lo ) * scale ), SAH_BINS - 1 ) < bestSplit;
+			} ) - &items[ 0 ] );
+		} else {
+			std::nth_element( &items[ begin ], &items[ mid ], &items[ 0 ] + end, [ axis ]( const BuildItem& a, const BuildItem& b ) {
+				return a.centroid[ axis ] < b.centroid[ axis ];
+			} );
+		}
+	}
+
+	BuildRecursive( items, begin, mid, depth + 1 );
+	unsigned int second = BuildRecursive( items, mid, end, depth + 1 );
+
+	nodes[ index ].offset = second;
+	nodes[ index ].count = 0;
+	nodes[ index ].axis = ( unsigned short ) axis;
+
+	return index;
+}
+
+bool BVH::Intersect( Math::Ray& ray, RayHit* hit ) const {
+	if ( nodes.empty() ) {
+		return false;
+	}
+
+	float invDir[ 3 ] = { 1.0f / ray.d.x, 1.0f / ray.d.y, 1.0f / ray.d.z };
+	bool dirIsNeg[ 3 ] = { invDir[ 0 ] < 0.0f, invDir[ 1 ] < 0.0f, invDir[ 2 ] < 0.0f };
+
+	unsigned int stack[ STACK_SIZE ];
+	int sp = 0;
+	unsigned int node = 0;
+	bool found = false;
+
+	while ( true ) {
+		const Node& n = nodes[ node ];
+
+		// Slab test.
+		float t0 = ray.mint;
+		float t1 = ray.maxt;
+		bool inside = true;
+
+		for ( int k = 0; k < 3 && inside; ++k ) {
+			float tNear = ( n.bounds.pMin[ k ] - ray.o[ k ] ) * invDir[ k ];
+			float tFar = ( n.bounds.pMax[ k ] - ray.o[ k ] ) * invDir[ k ];
+
+			if ( tNear > tFar ) {
+				std::swap( tNear, tFar );
+			}
+
+			t0 = tNear > t0 ? tNear : t0;
+			t1 = tFar < t1 ? tFar : t1;
+			inside = t0 <= t1;
+		}
+
+		if ( inside ) {
+			if ( n.count > 0 ) {
+				for ( unsigned int i = n.offset; i < n.offset + n.count; ++i ) {
+					const float* tri = &triangles[ i * TRIANGLE_FLOATS ];
+					Math::Vector3 e1( tri[ 3 ], tri[ 4 ], tri[ 5 ] );
+					Math::Vector3 e2( tri[ 6 ], tri[ 7 ], tri[ 8 ] );
+
+					Math::Vector3 p = Math::Cross( ray.d, e2 );
+					float det = Math::Dot( e1, p );
+
+					if ( det > -EPSILON && det < EPSILON ) {
+						continue;
+					}
+
+					float inv = 1.0f / det;
+					Math::Vector3 s( ray.o.x - tri[ 0 ], ray.o.y - tri[ 1 ], ray.o.z - tri[ 2 ] );
+					float u = Math::Dot( s, p ) * inv;
+
+					if ( u < 0.0f || u > 1.0f ) {
+						continue;
+					}
+
+					Math::Vector3 q = Math::Cross( s, e1 );
+					float v = Math::Dot( ray.d, q ) * inv;
+
+					if ( v < 0.0f || u + v > 1.0f ) {
+						continue;
+					}
+
+					float t = Math::Dot( e2, q ) * inv;
+
+					if ( t <= ray.mint || t >= ray.maxt ) {
+						continue;
+					}
+
+					// Without a hit record any hit answers the question.
+					if ( !hit ) {
+						return true;
+					}
+
+					ray.maxt = t;
+					found = true;
+
+					hit->t = t;
+					hit->u = u;
+					hit->v = v;
+					hit->triangle = triangleIndex[ i ];
+				}
+			} else if ( dirIsNeg[ n.axis ] ) {
+				stack[ sp++ ] = node + 1;
+				node = n.offset;
+				continue;
+			} else {
+				stack[ sp++ ] = n.offset;
+				node = node + 1;
+				continue;
+			}
+		}
+
+		if ( sp == 0 ) {
+			break;
+		}
+
+		node = stack[ --sp ];
+	}
+
+	return found;
+}
+
+bool BVH::Occluded( const Math::Ray& ray ) const {
+	Math::Ray r = ray;
+	return Intersect( r, NULL );
+}
+
+void BVH::IntersectPacket( RayPacket& packet, PacketHit* hit ) const {
+	for ( int i = 0; i < 4; ++i ) {
+		hit->triangle[ i ] = NO_HIT;
+		hit->u[ i ] = 0.0f;
+		hit->v[ i ] = 0.0f;
+	}
+
+	if ( nodes.empty() ) {
+		return;
+	}
+
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 idx = _mm_div_ps( one, packet.dx );
+	__m128 idy = _mm_div_ps( one, packet.dy );
+	__m128 idz = _mm_div_ps( one, packet.dz );
+
+	// Children are visited in the order suiting the first ray.
+	float firstDir[ 4 ];
+	_mm_store_ss( &firstDir[ 0 ], packet.dx );
+	_mm_store_ss( &firstDir[ 1 ], packet.dy );
+	_mm_store_ss( &firstDir[ 2 ], packet.dz );
+
+	__m128 bestU = zero;
+	__m128 bestV = zero;
+	__m128 bestTri = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+
+	unsigned int stack[ STACK_SIZE ];
+	int sp = 0;
+	unsigned int node = 0;
+
+	while ( true ) {
+		const Node& n = nodes[ node ];
+
+		__m128 x0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bounds.pMin.x ), packet.ox ), idx );
+		__m128 x1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bounds.pMax.x ), packet.ox ), idx );
+		__m128 y0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bounds.pMin.y ), packet.oy ), idy );
+		__m128 y1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bounds.pMax.y ), packet.oy ), idy );
+		__m128 z0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bounds.pMin.z ), packet.oz ), idz );
+		__m128 z1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bounds.pMax.z ), packet.oz ), idz );
+
+		__m128 tNear = _mm_max_ps( _mm_max_ps( _mm_min_ps( x0, x1 ), _mm_min_ps( y0, y1 ) ), _mm_max_ps( _mm_min_ps( z0, z1 ), packet.tmin ) );
+		__m128 tFar = _mm_min_ps( _mm_min_ps( _mm_max_ps( x0, x1 ), _mm_max_ps( y0, y1 ) ), _mm_min_ps( _mm_max_ps( z0, z1 ), packet.tmax ) );
+
+		if ( _mm_movemask_ps( _mm_cmple_ps( tNear, tFar ) ) != 0 ) {
+			if ( n.count > 0 ) {
+				for ( unsigned int i = n.offset; i < n.offset + n.count; ++i ) {
+					const float* tri = &triangles[ i * TRIANGLE_FLOATS ];
+
+					__m128 e1x = _mm_set1_ps( tri[ 3 ] ), e1y = _mm_set1_ps( tri[ 4 ] ), e1z = _mm_set1_ps( tri[ 5 ] );
+					__m128 e2x = _mm_set1_ps( tri[ 6 ] ), e2y = _mm_set1_ps( tri[ 7 ] ), e2z = _mm_set1_ps( tri[ 8 ] );
+
+					// p = d x e2
+					__m128 px = _mm_sub_ps( _mm_mul_ps( packet.dy, e2z ), _mm_mul_ps( packet.dz, e2y ) );
+					__m128 py = _mm_sub_ps( _mm_mul_ps( packet.dz, e2x ), _mm_mul_ps( packet.dx, e2z ) );
+					__m128 pz = _mm_sub_ps( _mm_mul_ps( packet.dx, e2y ), _mm_mul_ps( packet.dy, e2x ) );
+
+					__m128 det = _mm_add_ps( _mm_add_ps( _mm_mul_ps( e1x, px ), _mm_mul_ps( e1y, py ) ), _mm_mul_ps( e1z, pz ) );
+					__m128 inv = _mm_div_ps( one, det );
+
+					// s = o - v0
+					__m128 sx = _mm_sub_ps( packet.ox, _mm_set1_ps( tri[ 0 ] ) );
+					__m128 sy = _mm_sub_ps( packet.oy, _mm_set1_ps( tri[ 1 ] ) );
+					__m128 sz = _mm_sub_ps( packet.oz, _mm_set1_ps( tri[ 2 ] ) );
+
+					__m128 u = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( sx, px ), _mm_mul_ps( sy, py ) ), _mm_mul_ps( sz, pz ) ), inv );
+
+					// q = s x e1
+					__m128 qx = _mm_sub_ps( _mm_mul_ps( sy, e1z ), _mm_mul_ps( sz, e1y ) );
+					__m128 qy = _mm_sub_ps( _mm_mul_ps( sz, e1x ), _mm_mul_ps( sx, e1z ) );
+					__m128 qz = _mm_sub_ps( _mm_mul_ps( sx, e1y ), _mm_mul_ps( sy, e1x ) );
+
+					__m128 v = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( packet.dx, qx ), _mm_mul_ps( packet.dy, qy ) ), _mm_mul_ps( packet.dz, qz ) ), inv );
+					__m128 t = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( e2x, qx ), _mm_mul_ps( e2y, qy ) ), _mm_mul_ps( e2z, qz ) ), inv );
+
+					__m128 absDet = _mm_andnot_ps( _mm_set1_ps( -0.0f ), det );
+					__m128 mask = _mm_cmpgt_ps( absDet, _mm_set1_ps( EPSILON ) );
+					mask = _mm_and_ps( mask, _mm_cmpge_ps( u, zero ) );
+					mask = _mm_and_ps( mask, _mm_cmpge_ps( v, zero ) );
+					mask = _mm_and_ps( mask, _mm_cmple_ps( _mm_add_ps( u, v ), one ) );
+					mask = _mm_and_ps( mask, _mm_cmpgt_ps( t, packet.tmin ) );
+					mask = _mm_and_ps( mask, _mm_cmplt_ps( t, packet.tmax ) );
+
+					if ( _mm_movemask_ps( mask ) == 0 ) {
+						continue;
+					}
+
+					packet.tmax = Select( mask, t, packet.tmax );
+					bestU = Select( mask, u, bestU );
+					bestV = Select( mask, v, bestV );
+					bestTri = Select( mask, _mm_castsi128_ps( _mm_set1_epi32( ( int ) triangleIndex[ i ] ) ), bestTri );
+				}
+			} else {
+				bool negative = firstDir[ n.axis ] < 0.0f;
+				stack[ sp++ ] = negative ? node + 1 : n.offset;
+				node = negative ? n.offset : node + 1;
+				continue;
+			}
+		}
+
+		if ( sp == 0 ) {
+			break;
+		}
+
+		node = stack[ --sp ];
+	}
+
+	_mm_storeu_ps( hit->u, bestU );
+	_mm_storeu_ps( hit->v, bestV );
+	_mm_storeu_ps( ( float* ) hit->triangle, bestTri );
+}
+
+const Math::BBox& BVH::Bounds( void ) const {
+	static const Math::BBox empty;
+	return nodes.empty() ? empty : nodes[ 0 ].bounds;
+}
+
+unsigned int BVH::NodeCount( void ) const {
+	return ( unsigned int ) nodes.size();
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+
+#include <xmmintrin.h>
+
+#include "BBox.h"
+#include "Ray.h"
+
+namespace DS {
+
+struct RayHit {
+	float t;
+	float u;			// Barycentrics of vertices 1 and 2.
+	float v;
+	unsigned int triangle;
+};
+
+/**
+	Four rays traced together, one per SSE lane. Lanes with tmin above
+	tmax are inactive. tmax shrinks to the closest hit found so far.
+**/
+struct RayPacket {
+	__m128 ox, oy, oz;
+	__m128 dx, dy, dz;
+	__m128 tmin;
+	__m128 tmax;
+};
+
+struct PacketHit {
+	float u[ 4 ];
+	float v[ 4 ];
+	unsigned int triangle[ 4 ];	// BVH::NO_HIT where the lane missed.
+};
+
+/**
+	DS::BVH - Bounding volume hierarchy over a triangle soup
+
+	Built top down with binned surface area heuristic splits and stored
+	depth first in one array, so the left child of a node directly follows
+	it ( as in Physically Based Rendering's LinearBVHNode ).
+
+	Intersect and Occluded trace single rays, meant for incoherent shadow
+	and ambient occlusion rays. Intersect shrinks ray.maxt to the closest
+	hit; with a NULL hit it stops at the first one found. IntersectPacket traces four coherent rays
+	through the tree together: every node is tested against all four with
+	one set of SSE slab tests and every leaf triangle with one SSE
+	Moller-Trumbore test.
+
+	Triangle indices reported are indices into the array Build was given.
+**/
+class BVH {
+public:
+	static const unsigned int NO_HIT = 0xFFFFFFFF;
+
+	BVH( void );
+	~BVH( void );
+
+	void Build( const float* positions, const unsigned int* indices, unsigned int triangleCount );
+
+	bool Intersect( Math::Ray& ray, RayHit* hit ) const;
+	bool Occluded( const Math::Ray& ray ) const;
+	void IntersectPacket( RayPacket& packet, PacketHit* hit ) const;
+
+	const Math::BBox& Bounds( void ) const;			// Empty before anything is built.
+	unsigned int NodeCount( void ) const;
+
+private:
+	struct Node {
+		Math::BBox bounds;
+		unsigned int offset;		// First triangle for leaves, second child otherwise.
+		unsigned short count;		// Triangles, zero for interior nodes.
+		unsigned short axis;
+	};
+
+	struct BuildItem {
+		Math::BBox bounds;
+		Math::Point3 centroid;
+		unsigned int triangle;
+	};
+
+	unsigned int BuildRecursive( std::vector< BuildItem >& items, unsigned int begin, unsigned int end, unsigned int depth );
+
+	std::vector< Node > nodes;
+
+	// Per triangle in leaf order: v0, edge 1, edge 2 and the source index.
+	std::vector< float > triangles;
+	std::vector< unsigned int > triangleIndex;
+};
+
+}
+
+#endif
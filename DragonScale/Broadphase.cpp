@@ -0,0 +1,101 @@
+#include "Broadphase.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace DS {
+
+Broadphase::Broadphase( void ) {
+}
+
+Broadphase::~Broadphase( void ) {
+}
+
+unsigned int Broadphase::Add( const Math::BBox& b ) {
+	unsigned int proxy;
+
+	if ( !freeProxies.empty() ) {
+		proxy = freeProxies.back();
+		freeProxies.pop_back();
+
+		bounds[ proxy ] = b;
+		alive[ proxy ] = true;
+	} else {
+		proxy = ( unsigned int ) bounds.size();
+
+		bounds.push_back( b );
+		alive.push_back( true );
+	}
+
+	OnAdd( proxy );
+
+	return proxy;
+}
+
+void Broadphase::Remove( unsigned int proxy ) {
+	if ( proxy >= alive.size() || !alive[ proxy ] ) {
+		return;
+	}
+
+	OnRemove( proxy );
+
+	alive[ proxy ] = false;
+	pendingFree.push_back( proxy );
+}
+
+void Broadphase::Move( unsigned int proxy, const Math::BBox& b ) {
+	if ( proxy >= alive.size() || !alive[ proxy ] ) {
+		return;
+	}
+
+	bounds[ proxy ] = b;
+	OnMove( proxy );
+}
+
+void Broadphase::Update( void ) {
+	previous.swap( pairs );
+	pairs.clear();
+
+	FindPairs( pairs );
+	std::sort( pairs.begin(), pairs.end() );
+
+	added.clear();
+	removed.clear();
+
+	std::set_difference( pairs.begin(), pairs.end(), previous.begin(), previous.end(), std::back_inserter( added ) );
+	std::set_difference( previous.begin(), previous.end(), pairs.begin(), pairs.end(), std::back_inserter( removed ) );
+
+	// Lost pairs have been reported, the IDs are safe to hand out again.
+	freeProxies.insert( freeProxies.end(), pendingFree.begin(), pendingFree.end() );
+	pendingFree.clear();
+}
+
+const std::vector< BroadphasePair >& Broadphase::Pairs( void ) const {
+	return pairs;
+}
+
+const std::vector< BroadphasePair >& Broadphase::Added( void ) const {
+	return added;
+}
+
+const std::vector< BroadphasePair >& Broadphase::Removed( void ) const {
+	return removed;
+}
+
+const Math::BBox& Broadphase::Bounds( unsigned int proxy ) const {
+	return bounds[ proxy ];
+}
+
+unsigned int Broadphase::ProxyCount( void ) const {
+	return ( unsigned int ) ( bounds.size() - freeProxies.size() - pendingFree.size() );
+}
+
+void Broadphase::AddPair( std::vector< BroadphasePair >& pairs, unsigned int a, unsigned int b ) {
+	BroadphasePair p;
+	p.a = std::min( a, b );
+	p.b = std::max( a, b );
+
+	pairs.push_back( p );
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <vector>
+
+#include "BBox.h"
+
+namespace DS {
+
+struct BroadphasePair {
+	unsigned int a;		// Always the smaller proxy.
+	unsigned int b;
+
+	bool operator<( const BroadphasePair& p ) const {
+		return a < p.a || ( a == p.a && b < p.b );
+	}
+
+	bool operator==( const BroadphasePair& p ) const {
+		return a == p.a && b == p.b;
+	}
+};
+
+/**
+	DS::Broadphase - Overlapping AABB pair finder
+
+	Bodies are registered as proxies and moved every frame; Update then
+	rebuilds the sorted list of overlapping pairs in one batch. Because the
+	previous frame's list is kept, Added and Removed give the pairs that
+	started or stopped overlapping since the last Update, so the narrow phase
+	only needs to set up and tear down contacts for those.
+
+	Proxy IDs of removed bodies are only reused after the next Update, so
+	their lost pairs still come out of Removed.
+
+	See SweepAndPrune and UniformGrid for the two backends.
+**/
+class Broadphase {
+public:
+	Broadphase( void );
+	virtual ~Broadphase( void );
+
+	unsigned int Add( const Math::BBox& bounds );
+	void Remove( unsigned int proxy );
+	void Move( unsigned int proxy, const Math::BBox& bounds );
+
+	void Update( void );
+
+	const std::vector< BroadphasePair >& Pairs( void ) const;
+	const std::vector< BroadphasePair >& Added( void ) const;
+	const std::vector< BroadphasePair >& Removed( void ) const;
+
+	const Math::BBox& Bounds( unsigned int proxy ) const;
+	unsigned int ProxyCount( void ) const;
+
+protected:
+	virtual void OnAdd( unsigned int proxy ) = 0;
+	virtual void OnRemove( unsigned int proxy ) = 0;
+	virtual void OnMove( unsigned int proxy ) = 0;
+	virtual void FindPairs( std::vector< BroadphasePair >& pairs ) = 0;
+
+	static void AddPair( std::vector< BroadphasePair >& pairs, unsigned int a, unsigned int b );
+
+	std::vector< Math::BBox > bounds;
+	std::vector< bool > alive;
+
+private:
+	std::vector< unsigned int > freeProxies;
+	std::vector< unsigned int > pendingFree;
+
+	std::vector< BroadphasePair > pairs;
+	std::vector< BroadphasePair > previous;
+	std::vector< BroadphasePair > added;
+	std::vector< BroadphasePair > removed;
+};
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include "Crowd.h"
+#include "MemoryTracker.h"
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "SIMDMath.h"
+
+namespace DS {
+
+namespace {
+
+	// Attribute locations fixed by simple.vert and skinned.vert.
+	const GLuint A_POSITION = 0;
+	const GLuint A_COLOR = 1;
+	const GLuint A_JOINTS = 2;
+	const GLuint A_WEIGHTS = 3;
+
+	// Characters per job.
+	const int CHARACTER_GRAIN = 4;
+
+}
+
+Crowd::Crowd( void )
+	: jobs( NULL ), skeleton( NULL ), mesh( NULL ), gpuProgram( 0 ), bonesID( -1 ), depthBonesID( -1 ),
+	  cpuVao( 0 ), gpuVao( 0 ), positionBuffer( 0 ), colorBuffer( 0 ), indexBuffer( 0 ),
+	  mode( SKIN_CPU_MATRIX ), staticDirty( false ), skinnedDirty( false ) {
+	for ( int i = 0; i < 4; ++i ) {
+		bindBuffers[ i ] = 0;
+	}
+}
+
+Crowd::~Crowd( void ) {
+}
+
+void Crowd::Init( JobSystem* j, const Skeleton* s, const SkinnedMesh* m, unsigned int program ) {
+	jobs = j;
+	skeleton = s;
+	mesh = m;
+	gpuProgram = program;
+
+	bonesID = glGetUniformLocation( gpuProgram, "BONES" );
+
+	glGenVertexArrays( 1, &cpuVao );
+	glGenVertexArrays( 1, &gpuVao );
+	glGenBuffers( 1, &positionBuffer );
+	glGenBuffers( 1, &colorBuffer );
+	glGenBuffers( 1, &indexBuffer );
+	glGenBuffers( 4, bindBuffers );
+
+	// GPU path: the bind pose plus influences, uploaded once.
+	GL::BindVertexArray( gpuVao );
+
+	glEnableVertexAttribArray( A_POSITION );
+	GL::BindBuffer( GL_ARRAY_BUFFER, bindBuffers[ 0 ] );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * mesh->positions.size(), &mesh->positions[ 0 ], GL_STATIC_DRAW );
+	glVertexAttribPointer( A_POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	glEnableVertexAttribArray( A_COLOR );
+	GL::BindBuffer( GL_ARRAY_BUFFER, bindBuffers[ 1 ] );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * mesh->colors.size(), &mesh->colors[ 0 ], GL_STATIC_DRAW );
+	glVertexAttribPointer( A_COLOR, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	glEnableVertexAttribArray( A_JOINTS );
+	GL::BindBuffer( GL_ARRAY_BUFFER, bindBuffers[ 2 ] );
+	GL::BufferData( GL_ARRAY_BUFFER, mesh->joints.size(), &mesh->joints[ 0 ], GL_STATIC_DRAW );
+	glVertexAttribIPointer( A_JOINTS, SKIN_INFLUENCES, GL_UNSIGNED_BYTE, 0, 0 );
+
+	glEnableVertexAttribArray( A_WEIGHTS );
+	GL::BindBuffer( GL_ARRAY_BUFFER, bindBuffers[ 3 ] );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * mesh->weights.size(), &mesh->weights[ 0 ], GL_STATIC_DRAW );
+	glVertexAttribPointer( A_WEIGHTS, SKIN_INFLUENCES, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	GL::BindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+	GL::BufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( GLuint ) * mesh->indices.size(), &mesh->indices[ 0 ], GL_STATIC_DRAW );
+
+	// CPU path: skinned positions streamed every frame.
+	GL::BindVertexArray( cpuVao );
+
+	glEnableVertexAttribArray( A_POSITION );
+	GL::BindBuffer( GL_ARRAY_BUFFER, positionBuffer );
+	glVertexAttribPointer( A_POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	glEnableVertexAttribArray( A_COLOR );
+	GL::BindBuffer( GL_ARRAY_BUFFER, colorBuffer );
+	glVertexAttribPointer( A_COLOR, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	GL::BindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+
+	GL::BindVertexArray( 0 );
+	GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_ANIMATION, bindBuffers[ 0 ], sizeof( GLfloat ) * mesh->positions.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_ANIMATION, bindBuffers[ 1 ], sizeof( GLfloat ) * mesh->colors.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_ANIMATION, bindBuffers[ 2 ], mesh->joints.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_ANIMATION, bindBuffers[ 3 ], sizeof( GLfloat ) * mesh->weights.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_ANIMATION, indexBuffer, sizeof( GLuint ) * mesh->indices.size() );
+}
+
+void Crowd::Shutdown( void ) {
+	GLuint buffers[] = { positionBuffer, colorBuffer, indexBuffer, bindBuffers[ 0 ], bindBuffers[ 1 ], bindBuffers[ 2 ], bindBuffers[ 3 ] };
+
+	for ( int i = 0; i < 7; ++i ) {
+		Memory::ReleaseGL( MEMORY_GL_BUFFER, buffers[ i ] );
+	}
+
+	GL::DeleteBuffers( 7, buffers );
+	GL::DeleteVertexArrays( 1, &cpuVao );
+	GL::DeleteVertexArrays( 1, &gpuVao );
+
+	cpuVao = gpuVao = positionBuffer = colorBuffer = indexBuffer = 0;
+
+	for ( int i = 0; i < 4; ++i ) {
+		bindBuffers[ i ] = 0;
+	}
+
+	characters.clear();
+}
+
+unsigned int Crowd::AddClip( const AnimationClip* clip ) {
+	clips.push_back( clip );
+	return ( unsigned int ) clips.size() - 1;
+}
+
+unsigned int Crowd::AddCharacter( const CharacterDesc& desc ) {
+	MemoryScope scope( MEMORY_ANIMATION );
+
+	characters.push_back( desc );
+
+	unsigned int count = ( unsigned int ) characters.size();
+
+	palettes.resize( count * MAX_JOINTS );
+	dualPalettes.resize( count * MAX_JOINTS );
+	skinned.resize( count * mesh->VertexCount() * 3 );
+	orientations.resize( count * 3, 0.0f );
+	rotations.resize( count );
+
+	staticDirty = true;
+	skinnedDirty = true;
+
+	return count - 1;
+}
+
+CharacterDesc& Crowd::Character( unsigned int character ) {
+	return characters[ character ];
+}
+
+void Crowd::SetMode( SkinningMode m ) {
+	mode = m;
+}
+
+SkinningMode Crowd::Mode( void ) const {
+	return mode;
+}
+
+void Crowd::UpdateCharacter( unsigned int character, float dt, Pose& a, Pose& b, Pose& pose ) {
+	CharacterDesc& c = characters[ character ];
+	c.time += dt * c.speed;
+
+	const Pose* final = &a;
+	clips[ c.clipA ]->Sample( c.time, a );
+
+	if ( c.blend > 0.0f ) {
+		clips[ c.clipB ]->Sample( c.time, b );
+		BlendPoses( a, b, c.blend, pose );
+		final = &pose;
+	}
+
+	Math::Vector3 position( c.position.x, c.position.y, c.position.z );
+	float* out = &skinned[ character * mesh->VertexCount() * 3 ];
+
+	if ( mode == SKIN_CPU_DUAL_QUATERNION ) {
+		Math::Quaternion heading = Math::AxisAngle( Math::Vector3( 0.0f, 1.0f, 0.0f ), c.heading );
+		Math::DualQuaternion* palette = &dualPalettes[ character * MAX_JOINTS ];
+
+		SkinningDualQuaternions( *skeleton, *final, Math::DualQuaternion( heading, position ), palette );
+		SkinDualQuaternions( *mesh, palette, out );
+		return;
+	}
+
+	Math::Matrix4 world = rotations[ character ];
+	world.c[ 0 ][ 3 ] = position.x;
+	world.c[ 1 ][ 3 ] = position.y;
+	world.c[ 2 ][ 3 ] = position.z;
+
+	Math::Matrix4* palette = &palettes[ character * MAX_JOINTS ];
+	SkinningPalette( *skeleton, *final, world, palette );
+
+	if ( mode == SKIN_CPU_MATRIX ) {
+		SkinMatrices( *mesh, palette, out );
+	}
+}
+
+bool Crowd::Update( float dt ) {
+	bool playing = false;
+
+	for ( size_t i = 0; i < characters.size() && !playing; ++i ) {
+		playing = dt * characters[ i ].speed != 0.0f;
+	}
+
+	jobs->ParallelFor( ( int ) characters.size(), CHARACTER_GRAIN, [ this, dt ]( int begin, int end ) {
+		MemoryScope scope( MEMORY_ANIMATION );
+
+		// Scratch poses, reused across the range.
+		Pose a;
+		Pose b;
+		Pose pose;
+
+		// The matrix modes rotate by the headings four at a time. Each job
+		// only writes its own characters' entries.
+		if ( mode != SKIN_CPU_DUAL_QUATERNION ) {
+			for ( int i = begin; i < end; ++i ) {
+				orientations[ i * 3 + 1 ] = characters[ i ].heading;
+			}
+
+			Math::EulerBatch( &orientations[ begin * 3 ], &rotations[ begin ], end - begin );
+		}
+
+		for ( int i = begin; i < end; ++i ) {
+			UpdateCharacter( ( unsigned int ) i, dt, a, b, pose );
+		}
+	} );
+
+	skinnedDirty = true;
+
+	return playing;
+}
+
+void Crowd::UploadStatic( void ) {
+	MemoryScope scope( MEMORY_ANIMATION );
+
+	unsigned int count = ( unsigned int ) characters.size();
+	std::vector< float > colors;
+	colors.reserve( mesh->colors.size() * count );
+
+	for ( unsigned int i = 0; i < count; ++i ) {
+		colors.insert( colors.end(), mesh->colors.begin(), mesh->colors.end() );
+	}
+
+	GL::BindBuffer( GL_ARRAY_BUFFER, colorBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * colors.size(), &colors[ 0 ], GL_STATIC_DRAW );
+	GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_ANIMATION, colorBuffer, sizeof( GLfloat ) * colors.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_ANIMATION, positionBuffer, sizeof( GLfloat ) * skinned.size() );
+
+	staticDirty = false;
+}
+
+void Crowd::SetDepthProgram( unsigned int program ) {
+	depthBonesID = glGetUniformLocation( program, "BONES" );
+}
+
+void Crowd::Render( void ) {
+	Draw( bonesID );
+}
+
+void Crowd::RenderDepth( void ) {
+	Draw( depthBonesID );
+}
+
+void Crowd::Draw( int bones ) {
+	if ( characters.empty() ) {
+		return;
+	}
+
+	unsigned int count = ( unsigned int ) characters.size();
+	GLsizei indexCount = ( GLsizei ) mesh->indices.size();
+
+	if ( mode == SKIN_GPU ) {
+		GL::BindVertexArray( gpuVao );
+
+		for ( unsigned int i = 0; i < count; ++i ) {
+			// Palettes are column vector matrices, GL transposes them on upload.
+			GL::UniformMatrix4fv( bones, skeleton->JointCount(), GL_TRUE, &palettes[ i * MAX_JOINTS ].c[ 0 ][ 0 ] );
+			GL::DrawElements( GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0 );
+		}
+
+		GL::BindVertexArray( 0 );
+		return;
+	}
+
+	if ( staticDirty ) {
+		UploadStatic();
+	}
+
+	// Shadow passes draw the crowd again, the positions go up once per update.
+	if ( skinnedDirty ) {
+		GL::BindBuffer( GL_ARRAY_BUFFER, positionBuffer );
+		GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * skinned.size(), NULL, GL_STREAM_DRAW );	// Orphan.
+		GL::BufferSubData( GL_ARRAY_BUFFER, 0, sizeof( GLfloat ) * skinned.size(), &skinned[ 0 ] );
+		GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+		skinnedDirty = false;
+	}
+
+	GL::BindVertexArray( cpuVao );
+
+	for ( unsigned int i = 0; i < count; ++i ) {
+		GL::DrawElementsBaseVertex( GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, i * mesh->VertexCount() );
+	}
+
+	GL::BindVertexArray( 0 );
+}
+
+unsigned int Crowd::CharacterCount( void ) const {
+	return ( unsigned int ) characters.size();
+}
+
+}
@@ -0,0 +1,114 @@
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <vector>
+
+#include "Point3.h"
+#include "Animation.h"
+#include "Skinning.h"
+#include "JobSystem.h"
+
+namespace DS {
+
+enum SkinningMode {
+	SKIN_CPU_MATRIX,
+	SKIN_CPU_DUAL_QUATERNION,
+	SKIN_GPU,
+
+	SKIN_MODE_COUNT
+};
+
+struct CharacterDesc {
+	Math::Point3 position;
+	float heading;				// Degrees about +Y.
+
+	unsigned int clipA;
+	unsigned int clipB;
+	float blend;				// 0 plays clipA only, 1 clipB only.
+
+	float time;
+	float speed;
+};
+
+/**
+	DS::Crowd - Animated characters sharing one skeleton and mesh
+
+	Update runs one job per few characters across the JobSystem: advance
+	the clock, sample and blend the clips, build the palette and, in the CPU
+	modes, skin straight into that character's slice of a shared vertex
+	array. Characters never touch each other's data, so this scales with
+	the worker count.
+
+	Render draws every character with glDrawElementsBaseVertex. The CPU
+	modes stream the skinned world space positions into one dynamic buffer
+	and expect a program built from simple.vert with an identity MODEL to
+	be current. SKIN_GPU uploads only the palette per character and expects
+	the program from skinned.vert passed to Init. RenderDepth is the same
+	for shadow casters, with depth.vert in the CPU modes and the program
+	passed to SetDepthProgram in SKIN_GPU.
+**/
+class Crowd {
+public:
+	Crowd( void );
+	~Crowd( void );
+
+	// skeleton and mesh must outlive the crowd.
+	void Init( JobSystem* jobs, const Skeleton* skeleton, const SkinnedMesh* mesh, unsigned int gpuProgram );
+	void Shutdown( void );
+
+	// clip must outlive the crowd.
+	unsigned int AddClip( const AnimationClip* clip );
+	unsigned int AddCharacter( const CharacterDesc& desc );
+	CharacterDesc& Character( unsigned int character );
+
+	void SetMode( SkinningMode mode );
+	SkinningMode Mode( void ) const;
+
+	void SetDepthProgram( unsigned int program );
+
+	// Whether any character's clip played. Positions and headings are the
+	// caller's, it knows when it moved them.
+	bool Update( float dt );
+	void Render( void );
+	void RenderDepth( void );
+
+	unsigned int CharacterCount( void ) const;
+
+private:
+	void UpdateCharacter( unsigned int character, float dt, Pose& a, Pose& b, Pose& pose );
+	void UploadStatic( void );
+	void Draw( int bones );
+
+	JobSystem* jobs;
+	const Skeleton* skeleton;
+	const SkinnedMesh* mesh;
+
+	unsigned int gpuProgram;
+	int bonesID;
+	int depthBonesID;
+
+	unsigned int cpuVao;
+	unsigned int gpuVao;
+	unsigned int positionBuffer;	// Dynamic, every character.
+	unsigned int colorBuffer;		// Colors repeated for every character.
+	unsigned int indexBuffer;
+	unsigned int bindBuffers[ 4 ];	// Positions, colors, joints, weights.
+
+	SkinningMode mode;
+	bool staticDirty;
+	bool skinnedDirty;			// CPU skinned positions not uploaded yet.
+
+	std::vector< const AnimationClip* > clips;
+	std::vector< CharacterDesc > characters;
+
+	std::vector< Math::Matrix4 > palettes;			// MAX_JOINTS per character.
+	std::vector< Math::DualQuaternion > dualPalettes;
+	std::vector< float > skinned;
+
+	std::vector< float > orientations;				// Pitch, yaw and roll per character.
+	std::vector< Math::Matrix4 > rotations;			// Of the headings, see Update.
+};
+
+}
+
+#endif
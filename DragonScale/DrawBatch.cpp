@@ -0,0 +1,310 @@
+#include "DrawBatch.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+namespace DS {
+
+namespace {
+
+	// Attribute locations fixed by batch.vert.
+	const GLuint A_POSITION = 0;
+	const GLuint A_COLOR = 1;
+	const GLuint A_DRAW_ID = 2;
+	const GLuint A_NORMAL = 3;
+	const GLuint A_TEXCOORD = 4;
+
+	// DrawElementsIndirectCommand is five GLuints.
+	const unsigned int COMMAND_SIZE = 5;
+
+	// Per draw, as RGBA32F texels: the model matrix, then the position
+	// scale and bias of the mesh.
+	const unsigned int DRAW_DATA_FLOATS = 24;
+
+}
+
+DrawBatch::DrawBatch( void )
+	: program( 0 ), vao( 0 ),
+	  vertexBuffer( 0 ), indexBuffer( 0 ),
+	  drawIDBuffer( 0 ), drawDataBuffer( 0 ), drawDataTexture( 0 ), indirectBuffer( 0 ),
+	  drawBaseID( -1 ), drawDataID( -1 ),
+	  indirect( false ), geometryDirty( false ), drawCapacity( 0 ), callCount( 0 ), triangleCount( 0 ) {
+}
+
+DrawBatch::~DrawBatch( void ) {
+}
+
+void DrawBatch::Init( unsigned int prog, const VertexFormat& f ) {
+	program = prog;
+	format = f;
+
+	indirect = GLEW_VERSION_4_3 || ( GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance );
+
+	drawBaseID = glGetUniformLocation( program, "DRAW_BASE" );
+	drawDataID = glGetUniformLocation( program, "DRAW_DATA" );
+
+	glGenVertexArrays( 1, &vao );
+	glGenBuffers( 1, &vertexBuffer );
+	glGenBuffers( 1, &indexBuffer );
+	glGenBuffers( 1, &drawIDBuffer );
+	glGenBuffers( 1, &drawDataBuffer );
+	glGenTextures( 1, &drawDataTexture );
+
+	if ( indirect ) {
+		glGenBuffers( 1, &indirectBuffer );
+	}
+
+	GL::BindVertexArray( vao );
+
+	GL::BindBuffer( GL_ARRAY_BUFFER, vertexBuffer );
+	SetVertexAttributes( format, A_POSITION, A_COLOR, A_NORMAL, A_TEXCOORD );
+
+	// 0, 1, 2 ... stepped per instance. With indirect draws baseInstance
+	// offsets into it, so it yields the draw index directly.
+	glEnableVertexAttribArray( A_DRAW_ID );
+	GL::BindBuffer( GL_ARRAY_BUFFER, drawIDBuffer );
+	glVertexAttribIPointer( A_DRAW_ID, 1, GL_UNSIGNED_INT, 0, 0 );
+	glVertexAttribDivisor( A_DRAW_ID, 1 );
+
+	GL::BindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+
+	GL::BindVertexArray( 0 );
+
+	// The last texture unit is kept back for the draw data ( see TextureUnits ),
+	// so it can stay bound for good.
+	GLint units = 0;
+	glGetIntegerv( GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &units );
+	GLint drawDataUnit = units - 1;
+
+	glActiveTexture( GL_TEXTURE0 + drawDataUnit );
+	GL::BindBuffer( GL_TEXTURE_BUFFER, drawDataBuffer );
+	glBindTexture( GL_TEXTURE_BUFFER, drawDataTexture );
+	glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer );
+	GL::BindBuffer( GL_TEXTURE_BUFFER, 0 );
+	glActiveTexture( GL_TEXTURE0 );
+
+	GL::Uniform1i( drawDataID, drawDataUnit );
+}
+
+void DrawBatch::Shutdown( void ) {
+	GLuint buffers[] = { vertexBuffer, indexBuffer, drawIDBuffer, drawDataBuffer, indirectBuffer };
+
+	for ( int i = 0; i < 5; ++i ) {
+		Memory::ReleaseGL( MEMORY_GL_BUFFER, buffers[ i ] );
+	}
+
+	GL::DeleteBuffers( 5, buffers );
+	glDeleteTextures( 1, &drawDataTexture );
+	GL::DeleteVertexArrays( 1, &vao );
+
+	vao = vertexBuffer = indexBuffer = drawIDBuffer = 0;
+	drawDataBuffer = drawDataTexture = indirectBuffer = 0;
+	drawCapacity = 0;
+}
+
+unsigned int DrawBatch::AddMesh( const Mesh& mesh ) {
+	PackedVertices packed = PackVertices( mesh, format );
+
+	MeshRange range;
+	range.baseVertex = ( unsigned int ) ( vertices.size() / format.Stride() );
+	range.firstIndex = ( unsigned int ) indices.size();
+	range.scale = packed.scale;
+	range.bias = packed.bias;
+
+	vertices.insert( vertices.end(), packed.data.begin(), packed.data.end() );
+	indices.insert( indices.end(), mesh.indices.begin(), mesh.indices.end() );
+
+	meshes.push_back( range );
+	geometryDirty = true;
+
+	return ( unsigned int ) meshes.size() - 1;
+}
+
+void DrawBatch::Begin( void ) {
+	draws.clear();
+	models.clear();
+}
+
+void DrawBatch::Draw( unsigned int mesh, const LODLevel& level, const Math::Matrix4& model ) {
+	DrawItem item;
+	item.firstIndex = meshes[ mesh ].firstIndex + level.indexOffset;
+	item.count = level.indexCount;
+	item.baseVertex = meshes[ mesh ].baseVertex;
+	item.mesh = mesh;
+	item.model = ( unsigned int ) models.size();
+
+	draws.push_back( item );
+	models.push_back( model );
+}
+
+void DrawBatch::UploadGeometry( void ) {
+	GL::BindBuffer( GL_ARRAY_BUFFER, vertexBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, vertices.size(), &vertices[ 0 ], GL_STATIC_DRAW );
+
+	GL::BindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+	GL::BufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( GLuint ) * indices.size(), &indices[ 0 ], GL_STATIC_DRAW );
+
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, vertexBuffer, vertices.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, indexBuffer, sizeof( GLuint ) * indices.size() );
+
+	geometryDirty = false;
+}
+
+void DrawBatch::ReserveDraws( unsigned int count ) {
+	if ( count <= drawCapacity ) {
+		return;
+	}
+
+	drawCapacity = std::max( count, drawCapacity * 2 );
+
+	std::vector< GLuint > ids( drawCapacity );
+	for ( unsigned int i = 0; i < drawCapacity; ++i ) {
+		ids[ i ] = i;
+	}
+
+	GL::BindBuffer( GL_ARRAY_BUFFER, drawIDBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLuint ) * drawCapacity, &ids[ 0 ], GL_STATIC_DRAW );
+	GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, drawIDBuffer, sizeof( GLuint ) * drawCapacity );
+}
+
+void DrawBatch::Flush( void ) {
+	callCount = 0;
+
+	if ( draws.empty() ) {
+		return;
+	}
+
+	GL::BindVertexArray( vao );
+
+	if ( geometryDirty ) {
+		UploadGeometry();
+	}
+
+	unsigned int count = ( unsigned int ) draws.size();
+	ReserveDraws( count );
+
+	triangleCount = 0;
+	for ( unsigned int i = 0; i < count; ++i ) {
+		triangleCount += draws[ i ].count / 3;
+	}
+
+	// Group identical ranges so the fallback can instance them.
+	std::sort( draws.begin(), draws.end(), []( const DrawItem& a, const DrawItem& b ) {
+		if ( a.firstIndex != b.firstIndex ) { return a.firstIndex < b.firstIndex; }
+		if ( a.count != b.count ) { return a.count < b.count; }
+		return a.baseVertex < b.baseVertex;
+	} );
+
+	// Per-draw data in submission order.
+	drawData.resize( count * DRAW_DATA_FLOATS );
+	for ( unsigned int i = 0; i < count; ++i ) {
+		float* data = &drawData[ i * DRAW_DATA_FLOATS ];
+		const MeshRange& range = meshes[ draws[ i ].mesh ];
+
+		memcpy( data, &models[ draws[ i ].model ].c[ 0 ][ 0 ], sizeof( float ) * 16 );
+
+		data[ 16 ] = range.scale.x;
+		data[ 17 ] = range.scale.y;
+		data[ 18 ] = range.scale.z;
+		data[ 19 ] = 0.0f;
+		data[ 20 ] = range.bias.x;
+		data[ 21 ] = range.bias.y;
+		data[ 22 ] = range.bias.z;
+		data[ 23 ] = 0.0f;
+	}
+
+	GL::BindBuffer( GL_TEXTURE_BUFFER, drawDataBuffer );
+	GL::BufferData( GL_TEXTURE_BUFFER, sizeof( GLfloat ) * drawData.size(), NULL, GL_STREAM_DRAW );	// Orphan.
+	GL::BufferSubData( GL_TEXTURE_BUFFER, 0, sizeof( GLfloat ) * drawData.size(), &drawData[ 0 ] );
+	GL::BindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, drawDataBuffer, sizeof( GLfloat ) * drawData.size() );
+
+	if ( indirect ) {
+		commands.resize( count * COMMAND_SIZE );
+
+		for ( unsigned int i = 0; i < count; ++i ) {
+			GLuint* cmd = &commands[ i * COMMAND_SIZE ];
+			cmd[ 0 ] = draws[ i ].count;
+			cmd[ 1 ] = 1;						// instanceCount
+			cmd[ 2 ] = draws[ i ].firstIndex;
+			cmd[ 3 ] = draws[ i ].baseVertex;
+			cmd[ 4 ] = i;						// baseInstance, picks the draw ID.
+		}
+
+		GL::BindBuffer( GL_DRAW_INDIRECT_BUFFER, indirectBuffer );
+		GL::BufferData( GL_DRAW_INDIRECT_BUFFER, sizeof( GLuint ) * commands.size(), &commands[ 0 ], GL_STREAM_DRAW );
+		GL::BindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+		Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, indirectBuffer, sizeof( GLuint ) * commands.size() );
+	}
+
+	GL::BindVertexArray( 0 );
+
+	Submit();
+}
+
+void DrawBatch::Submit( void ) {
+	callCount = 0;
+
+	if ( draws.empty() ) {
+		return;
+	}
+
+	unsigned int count = ( unsigned int ) draws.size();
+
+	GL::BindVertexArray( vao );
+
+	if ( indirect ) {
+		GL::Uniform1i( drawBaseID, 0 );
+
+		GL::BindBuffer( GL_DRAW_INDIRECT_BUFFER, indirectBuffer );
+		GL::MultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, 0, count, triangleCount );
+		GL::BindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+
+		callCount = 1;
+	} else {
+		unsigned int first = 0;
+
+		while ( first < count ) {
+			unsigned int last = first + 1;
+
+			while ( last < count &&
+					draws[ last ].firstIndex == draws[ first ].firstIndex &&
+					draws[ last ].count == draws[ first ].count &&
+					draws[ last ].baseVertex == draws[ first ].baseVertex ) {
+				++last;
+			}
+
+			GL::Uniform1i( drawBaseID, first );
+			GL::DrawElementsInstancedBaseVertex( GL_TRIANGLES, draws[ first ].count, GL_UNSIGNED_INT,
+											   ( const GLvoid* ) ( sizeof( GLuint ) * draws[ first ].firstIndex ),
+											   last - first, draws[ first ].baseVertex );
+			++callCount;
+
+			first = last;
+		}
+	}
+
+	GL::BindVertexArray( 0 );
+}
+
+bool DrawBatch::IsIndirect( void ) const {
+	return indirect;
+}
+
+unsigned int DrawBatch::DrawCount( void ) const {
+	return ( unsigned int ) draws.size();
+}
+
+unsigned int DrawBatch::CallCount( void ) const {
+	return callCount;
+}
+
+}
@@ -0,0 +1,104 @@
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+#include <vector>
+
+#include "Mesh.h"
+#include "LOD.h"
+#include "Matrix4.h"
+#include "VertexFormat.h"
+
+namespace DS {
+
+/**
+	DS::DrawBatch - Shared buffer multi-draw submission
+
+	Every mesh added is packed into one vertex/index buffer pair. Each frame
+	the visible objects are queued with Draw and submitted together by Flush:
+	the per-draw model matrices go into a texture buffer indexed by draw ID,
+	and the draws themselves go out as one glMultiDrawElementsIndirect when
+	ARB_multi_draw_indirect is available.
+
+	Vertices are packed to one VertexFormat for the whole batch. Each draw
+	carries its mesh's position scale and bias next to the model matrix, so
+	meshes quantized to different bounds still share the buffer.
+
+	GL 3.3 has no per-draw ID in glMultiDrawElements, so the fallback sorts
+	the queue and issues one instanced draw per distinct mesh/LOD range with
+	the draw ID built from DRAW_BASE + gl_InstanceID instead.
+
+	Expects a program built from batch.vert to be current when Init,
+	Flush and Submit run.
+**/
+class DrawBatch {
+public:
+	DrawBatch( void );
+	~DrawBatch( void );
+
+	void Init( unsigned int program, const VertexFormat& format );
+	void Shutdown( void );
+
+	unsigned int AddMesh( const Mesh& mesh );
+
+	void Begin( void );
+	void Draw( unsigned int mesh, const LODLevel& level, const Math::Matrix4& model );
+	void Flush( void );
+
+	// Draws what the last Flush uploaded again, e.g. after a depth pre-pass.
+	void Submit( void );
+
+	bool IsIndirect( void ) const;
+	unsigned int DrawCount( void ) const;
+	unsigned int CallCount( void ) const;
+
+private:
+	struct MeshRange {
+		unsigned int baseVertex;
+		unsigned int firstIndex;
+		Math::Vector3 scale;
+		Math::Vector3 bias;
+	};
+
+	struct DrawItem {
+		unsigned int firstIndex;
+		unsigned int count;
+		unsigned int baseVertex;
+		unsigned int mesh;
+		unsigned int model;
+	};
+
+	void UploadGeometry( void );
+	void ReserveDraws( unsigned int count );
+
+	unsigned int program;
+	unsigned int vao;
+	unsigned int vertexBuffer;
+	unsigned int indexBuffer;
+	unsigned int drawIDBuffer;
+	unsigned int drawDataBuffer;
+	unsigned int drawDataTexture;
+	unsigned int indirectBuffer;
+
+	int drawBaseID;
+	int drawDataID;
+
+	bool indirect;
+	bool geometryDirty;
+	unsigned int drawCapacity;
+	unsigned int callCount;
+	unsigned int triangleCount;			// Of the last Flush.
+
+	VertexFormat format;
+	std::vector< unsigned char > vertices;
+	std::vector< unsigned int > indices;
+	std::vector< MeshRange > meshes;
+
+	std::vector< DrawItem > draws;
+	std::vector< Math::Matrix4 > models;
+	std::vector< float > drawData;
+	std::vector< unsigned int > commands;
+};
+
+}
+
+#endif
@@ -0,0 +1,282 @@
+#include "FrameCapture.h"
+#include "MemoryTracker.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+#include "Image.h"
+
+namespace DS {
+
+namespace {
+
+	// Frames copied out but not yet written before new ones are dropped.
+	const size_t MAX_QUEUED = 8;
+
+	// Only Shutdown waits, and not forever.
+	const GLuint64 SHUTDOWN_TIMEOUT_NS = 1000000000ull;
+
+}
+
+FrameCapture::FrameCapture( void )
+	: width( 0 ), height( 0 ), oldest( 0 ), inFlight( 0 ), dropped( 0 ), written( 0 ), quit( false ) {
+}
+
+FrameCapture::~FrameCapture( void ) {
+}
+
+void FrameCapture::Init( int w, int h, unsigned int count ) {
+	MemoryScope scope( MEMORY_CAPTURE );
+
+	width = w;
+	height = h;
+	oldest = 0;
+	inFlight = 0;
+
+	slots.resize( count );
+
+	size_t colorBytes = ( size_t ) width * height * 4;
+	size_t depthBytes = ( size_t ) width * height * sizeof( GLfloat );
+
+	for ( unsigned int i = 0; i < count; ++i ) {
+		Slot& slot = slots[ i ];
+
+		glGenBuffers( 1, &slot.color );
+		glGenBuffers( 1, &slot.depth );
+
+		GL::BindBuffer( GL_PIXEL_PACK_BUFFER, slot.color );
+		GL::BufferData( GL_PIXEL_PACK_BUFFER, colorBytes, NULL, GL_STREAM_READ );
+		GL::BindBuffer( GL_PIXEL_PACK_BUFFER, slot.depth );
+		GL::BufferData( GL_PIXEL_PACK_BUFFER, depthBytes, NULL, GL_STREAM_READ );
+
+		Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_CAPTURE, slot.color, colorBytes );
+		Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_CAPTURE, slot.depth, depthBytes );
+
+		slot.fence = NULL;
+		slot.flags = 0;
+	}
+
+	GL::BindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	quit = false;
+	thread = std::thread( &FrameCapture::WriterMain, this );
+}
+
+void FrameCapture::Shutdown( void ) {
+	if ( slots.empty() ) {
+		return;
+	}
+
+	// Whatever is in flight is still written.
+	Collect( true );
+
+	{
+		std::lock_guard< std::mutex > guard( lock );
+		quit = true;
+	}
+
+	wake.notify_one();
+	thread.join();
+
+	for ( size_t i = 0; i < slots.size(); ++i ) {
+		Memory::ReleaseGL( MEMORY_GL_BUFFER, slots[ i ].color );
+		Memory::ReleaseGL( MEMORY_GL_BUFFER, slots[ i ].depth );
+
+		GL::DeleteBuffers( 1, &slots[ i ].color );
+		GL::DeleteBuffers( 1, &slots[ i ].depth );
+	}
+
+	slots.clear();
+}
+
+bool FrameCapture::Readback( const std::string& prefix, unsigned int flags ) {
+	if ( slots.empty() || inFlight == slots.size() ) {
+		++dropped;
+		return false;
+	}
+
+	Slot& slot = slots[ ( oldest + inFlight ) % slots.size() ];
+
+	// The back buffer, or a render target if one is bound.
+	GLint source = 0;
+	glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &source );
+
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	glReadBuffer( source ? GL_COLOR_ATTACHMENT0 : GL_BACK );
+
+	if ( flags & CAPTURE_COLOR ) {
+		GL::BindBuffer( GL_PIXEL_PACK_BUFFER, slot.color );
+		glReadPixels( 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+	}
+
+	if ( flags & CAPTURE_DEPTH ) {
+		GL::BindBuffer( GL_PIXEL_PACK_BUFFER, slot.depth );
+		glReadPixels( 0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, 0 );
+	}
+
+	GL::BindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	slot.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	slot.prefix = prefix;
+	slot.flags = flags;
+
+	++inFlight;
+	return true;
+}
+
+void FrameCapture::Poll( void ) {
+	Collect( false );
+}
+
+void FrameCapture::Collect( bool wait ) {
+	while ( inFlight > 0 ) {
+		Slot& slot = slots[ oldest ];
+		GLsync fence = ( GLsync ) slot.fence;
+
+		// A zero timeout only asks; fences signal in order, so stop at the
+		// first one that is not done.
+		GLenum status = glClientWaitSync( fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? SHUTDOWN_TIMEOUT_NS : 0 );
+
+		if ( status == GL_TIMEOUT_EXPIRED ) {
+			break;
+		}
+
+		glDeleteSync( fence );
+		slot.fence = NULL;
+
+		bool accepted;
+		{
+			std::lock_guard< std::mutex > guard( lock );
+			accepted = status != GL_WAIT_FAILED && queue.size() < MAX_QUEUED;
+		}
+
+		if ( accepted ) {
+			MemoryScope scope( MEMORY_CAPTURE );
+
+			Job* job = new Job();
+			job->prefix = slot.prefix;
+			job->flags = slot.flags;
+
+			size_t pixels = ( size_t ) width * height;
+
+			if ( slot.flags & CAPTURE_COLOR ) {
+				job->color.resize( pixels * 4 );
+
+				GL::BindBuffer( GL_PIXEL_PACK_BUFFER, slot.color );
+				const void* mapped = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, job->color.size(), GL_MAP_READ_BIT );
+
+				if ( mapped ) {
+					memcpy( &job->color[ 0 ], mapped, job->color.size() );
+					glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+				}
+			}
+
+			if ( slot.flags & CAPTURE_DEPTH ) {
+				job->depth.resize( pixels );
+
+				GL::BindBuffer( GL_PIXEL_PACK_BUFFER, slot.depth );
+				const void* mapped = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, sizeof( GLfloat ) * pixels, GL_MAP_READ_BIT );
+
+				if ( mapped ) {
+					memcpy( &job->depth[ 0 ], mapped, sizeof( GLfloat ) * pixels );
+					glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+				}
+			}
+
+			GL::BindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+			{
+				std::lock_guard< std::mutex > guard( lock );
+				queue.push_back( job );
+			}
+
+			wake.notify_one();
+		} else {
+			++dropped;
+		}
+
+		oldest = ( oldest + 1 ) % slots.size();
+		--inFlight;
+	}
+}
+
+void FrameCapture::WriterMain( void ) {
+	MemoryScope scope( MEMORY_CAPTURE );
+
+	for ( ;; ) {
+		Job* job;
+
+		{
+			std::unique_lock< std::mutex > guard( lock );
+			wake.wait( guard, [ this ] { return quit || !queue.empty(); } );
+
+			if ( queue.empty() ) {
+				return;			// Quit, and nothing left to write.
+			}
+
+			job = queue.front();
+			queue.erase( queue.begin() );
+		}
+
+		Write( *job );
+		delete job;
+
+		std::lock_guard< std::mutex > guard( lock );
+		++written;
+	}
+}
+
+void FrameCapture::Write( const Job& job ) {
+	if ( job.flags & CAPTURE_COLOR ) {
+		std::vector< unsigned char > rgb( ( size_t ) width * height * 3 );
+
+		// GL rows start at the bottom.
+		for ( int y = 0; y < height; ++y ) {
+			const unsigned char* in = &job.color[ ( size_t ) ( height - 1 - y ) * width * 4 ];
+			unsigned char* out = &rgb[ ( size_t ) y * width * 3 ];
+
+			for ( int x = 0; x < width; ++x ) {
+				out[ x * 3 ] = in[ x * 4 ];
+				out[ x * 3 + 1 ] = in[ x * 4 + 1 ];
+				out[ x * 3 + 2 ] = in[ x * 4 + 2 ];
+			}
+		}
+
+		WritePPM( ( job.prefix + ".ppm" ).c_str(), width, height, &rgb[ 0 ] );
+	}
+
+	if ( job.flags & CAPTURE_DEPTH ) {
+		std::vector< unsigned short > grey( ( size_t ) width * height );
+
+		for ( int y = 0; y < height; ++y ) {
+			const float* in = &job.depth[ ( size_t ) ( height - 1 - y ) * width ];
+			unsigned short* out = &grey[ ( size_t ) y * width ];
+
+			for ( int x = 0; x < width; ++x ) {
+				out[ x ] = ( unsigned short ) ( in[ x ] * 65535.0f + 0.5f );
+			}
+		}
+
+		WritePGM( ( job.prefix + "_depth.pgm" ).c_str(), width, height, &grey[ 0 ] );
+	}
+}
+
+unsigned int FrameCapture::Pending( void ) const {
+	std::lock_guard< std::mutex > guard( lock );
+	return inFlight + ( unsigned int ) queue.size();
+}
+
+unsigned int FrameCapture::Written( void ) const {
+	std::lock_guard< std::mutex > guard( lock );
+	return written;
+}
+
+unsigned int FrameCapture::Dropped( void ) const {
+	return dropped;
+}
+
+}
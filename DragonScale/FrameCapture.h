@@ -0,0 +1,92 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace DS {
+
+enum CaptureFlags {
+	CAPTURE_COLOR = 1,
+	CAPTURE_DEPTH = 2
+};
+
+/**
+	DS::FrameCapture - Asynchronous back buffer readback
+
+	Readback starts a copy of the back buffer into the next pixel buffer
+	object of a small ring and drops a fence behind it; glReadPixels into a
+	bound PBO returns immediately instead of waiting for the frame to
+	finish. Poll checks the oldest fences without waiting and maps only
+	the buffers the GPU is done with, so frames arrive a few frames late
+	but the pipeline never drains.
+
+	Mapped pixels are copied out and handed to a writer thread, which flips
+	the rows and writes <prefix>.ppm for color and <prefix>_depth.pgm for
+	depth. If every slot is still in flight, or the writer is too far
+	behind, the frame is dropped and counted rather than waited on.
+
+	Depth is written as stored, so with reverse-Z near is white.
+**/
+class FrameCapture {
+public:
+	FrameCapture( void );
+	~FrameCapture( void );
+
+	void Init( int width, int height, unsigned int slots );
+	void Shutdown( void );
+
+	// Call after the frame is drawn, before the swap. Reads the framebuffer
+	// bound to GL_READ_FRAMEBUFFER.
+	bool Readback( const std::string& prefix, unsigned int flags );
+
+	// Collects finished readbacks, never blocks.
+	void Poll( void );
+
+	unsigned int Pending( void ) const;
+	unsigned int Written( void ) const;
+	unsigned int Dropped( void ) const;
+
+private:
+	struct Slot {
+		unsigned int color;			// Pixel pack buffers.
+		unsigned int depth;
+		void* fence;				// GLsync, NULL when free.
+		std::string prefix;
+		unsigned int flags;
+	};
+
+	struct Job {
+		std::string prefix;
+		unsigned int flags;
+		std::vector< unsigned char > color;		// RGBA, bottom row first.
+		std::vector< float > depth;
+	};
+
+	void Collect( bool wait );
+	void WriterMain( void );
+	void Write( const Job& job );
+
+	int width;
+	int height;
+
+	std::vector< Slot > slots;
+	unsigned int oldest;			// First slot in flight.
+	unsigned int inFlight;
+	unsigned int dropped;
+
+	// Shared with the writer thread.
+	std::thread thread;
+	mutable std::mutex lock;
+	std::condition_variable wake;
+	std::vector< Job* > queue;
+	unsigned int written;
+	bool quit;
+};
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "FrameLog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace DS {
+
+FrameLog::FrameLog( void ) {
+}
+
+FrameLog::~FrameLog( void ) {
+}
+
+void FrameLog::Add( const FrameSample& sample ) {
+	samples.push_back( sample );
+}
+
+void FrameLog::Clear( void ) {
+	samples.clear();
+}
+
+unsigned int FrameLog::Count( void ) const {
+	return ( unsigned int ) samples.size();
+}
+
+bool FrameLog::Write( const char* file, const std::string& scene ) const {
+	size_t length = strlen( file );
+
+	if ( length >= 4 && strcmp( file + length - 4, ".csv" ) == 0 ) {
+		return WriteCSV( file );
+	}
+
+	return WriteJSON( file, scene );
+}
+
+bool FrameLog::WriteCSV( const char* file ) const {
+	FILE* fp = fopen( file, "w" );
+
+	if ( !fp ) {
+		fprintf( stderr, "Could not write %s\n", file );
+		return false;
+	}
+
+	fprintf( fp, "frame,dt,update_ms,render_ms,swap_ms,total_ms,draws,particles,draw_calls,triangles,redundant,upload_kb\n" );
+
+	for ( size_t i = 0; i < samples.size(); ++i ) {
+		const FrameSample& s = samples[ i ];
+		fprintf( fp, "%u,%.6f,%.3f,%.3f,%.3f,%.3f,%u,%u,%u,%u,%u,%u\n",
+				 s.frame, s.dt, s.updateMs, s.renderMs, s.swapMs, s.totalMs, s.draws, s.particles,
+				 s.drawCalls, s.triangles, s.redundant, s.uploadKB );
+	}
+
+	fclose( fp );
+
+	return true;
+}
+
+bool FrameLog::WriteJSON( const char* file, const std::string& scene ) const {
+	FILE* fp = fopen( file, "w" );
+
+	if ( !fp ) {
+		fprintf( stderr, "Could not write %s\n", file );
+		return false;
+	}
+
+	fprintf( fp, "{\n\t\"scene\": \"%s\",\n\t\"frames\": [\n", scene.c_str() );
+
+	for ( size_t i = 0; i < samples.size(); ++i ) {
+		const FrameSample& s = samples[ i ];
+		fprintf( fp, "\t\t{ \"frame\": %u, \"dt\": %.6f, \"update_ms\": %.3f, \"render_ms\": %.3f, \"swap_ms\": %.3f, \"total_ms\": %.3f, \"draws\": %u, \"particles\": %u, "
+				 "\"draw_calls\": %u, \"triangles\": %u, \"redundant\": %u, \"upload_kb\": %u }%s\n",
+				 s.frame, s.dt, s.updateMs, s.renderMs, s.swapMs, s.totalMs, s.draws, s.particles,
+				 s.drawCalls, s.triangles, s.redundant, s.uploadKB,
+				 i + 1 < samples.size() ? "," : "" );
+	}
+
+	fprintf( fp, "\t]\n}\n" );
+	fclose( fp );
+
+	return true;
+}
+
+float FrameLog::Percentile( std::vector< float >& sorted, float p ) const {
+	size_t index = ( size_t ) ( p * ( sorted.size() - 1 ) + 0.5f );
+	return sorted[ index ];
+}
+
+void FrameLog::Summary( const std::string& scene ) const {
+	if ( samples.empty() ) {
+		return;
+	}
+
+	std::vector< float > total( samples.size() );
+	float sum = 0.0f;
+
+	for ( size_t i = 0; i < samples.size(); ++i ) {
+		total[ i ] = samples[ i ].totalMs;
+		sum += total[ i ];
+	}
+
+	std::sort( total.begin(), total.end() );
+
+	printf( "%s: %u frames, mean %.2f ms, median %.2f ms, 95%% %.2f ms, 99%% %.2f ms, worst %.2f ms\n",
+			scene.empty() ? "default" : scene.c_str(), Count(), sum / samples.size(),
+			Percentile( total, 0.5f ), Percentile( total, 0.95f ), Percentile( total, 0.99f ), total.back() );
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef FRAMELOG_H
+#define FRAMELOG_H
+
+#include <string>
+#include <vector>
+
+namespace DS {
+
+struct FrameSample {
+	unsigned int frame;
+	float dt;				// Simulated frame time, seconds.
+	float updateMs;			// Input, simulation and streaming.
+	float renderMs;			// Culling and draw submission.
+	float swapMs;			// SwapWindow, includes waiting on the GPU.
+	float totalMs;
+	unsigned int draws;		// Objects submitted.
+	unsigned int particles;
+	unsigned int drawCalls;	// From DS::GL.
+	unsigned int triangles;
+	unsigned int redundant;	// GL state changes that changed nothing.
+	unsigned int uploadKB;
+};
+
+/**
+	DS::FrameLog - Per frame timing for benchmark runs
+
+	Collects one sample per frame and writes them as CSV or JSON, picked by
+	the file extension. Summary prints mean, median, 95th and 99th
+	percentile and worst frame time, which is what regressions are judged
+	on.
+**/
+class FrameLog {
+public:
+	FrameLog( void );
+	~FrameLog( void );
+
+	void Add( const FrameSample& sample );
+	void Clear( void );
+
+	bool Write( const char* file, const std::string& scene ) const;
+	bool WriteCSV( const char* file ) const;
+	bool WriteJSON( const char* file, const std::string& scene ) const;
+
+	void Summary( const std::string& scene ) const;
+
+	unsigned int Count( void ) const;
+
+private:
+	float Percentile( std::vector< float >& sorted, float p ) const;
+
+	std::vector< FrameSample > samples;
+};
+
+}
+
+#endif
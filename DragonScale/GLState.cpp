@@ -0,0 +1,297 @@
+#include "GLState.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace DS {
+
+namespace {
+
+	struct UniformValue {
+		float v[ 16 ];
+		size_t bytes;
+	};
+
+	GLStats current;
+	GLStats last;
+	bool elide = true;
+
+	// Unknown after Invalidate until the next bind.
+	GLuint program = 0;
+	GLuint vao = 0;
+	bool programKnown = false;
+	bool vaoKnown = false;
+
+	// Binding per buffer target, element arrays excluded.
+	std::vector< std::pair< GLenum, GLuint > > buffers;
+
+	// Keyed by program and location.
+	std::unordered_map< unsigned long long, UniformValue > uniforms;
+
+	unsigned int Triangles( GLenum mode, int count ) {
+		switch ( mode ) {
+			case GL_TRIANGLES:
+				return count / 3;
+			case GL_TRIANGLE_STRIP:
+			case GL_TRIANGLE_FAN:
+				return count > 2 ? count - 2 : 0;
+			default:
+				return 0;
+		}
+	}
+
+	/*
+		True if the uniform already holds the value, records it otherwise.
+		Counts the update either way.
+	*/
+	bool SameUniform( GLint location, const void* value, size_t bytes ) {
+		++current.uniforms;
+
+		unsigned long long key = ( ( unsigned long long ) program << 32 ) | ( unsigned int ) location;
+		std::unordered_map< unsigned long long, UniformValue >::iterator it = uniforms.find( key );
+
+		if ( it != uniforms.end() && it->second.bytes == bytes && memcmp( it->second.v, value, bytes ) == 0 ) {
+			++current.redundant;
+			return elide;
+		}
+
+		UniformValue& u = uniforms[ key ];
+		memcpy( u.v, value, bytes );
+		u.bytes = bytes;
+
+		return false;
+	}
+
+	void Draw( GLenum mode, int count, int instances ) {
+		++current.drawCalls;
+		current.triangles += Triangles( mode, count ) * instances;
+	}
+
+}
+
+namespace GL {
+
+	void Invalidate( void ) {
+		programKnown = false;
+		vaoKnown = false;
+		buffers.clear();
+		uniforms.clear();
+	}
+
+	void SetElision( bool on ) {
+		elide = on;
+	}
+
+	bool Elision( void ) {
+		return elide;
+	}
+
+	void UseProgram( unsigned int p ) {
+		++current.programBinds;
+
+		if ( programKnown && p == program ) {
+			++current.redundant;
+
+			if ( elide ) {
+				return;
+			}
+		}
+
+		glUseProgram( p );
+		program = p;
+		programKnown = true;
+	}
+
+	void BindVertexArray( unsigned int v ) {
+		++current.vertexArrayBinds;
+
+		if ( vaoKnown && v == vao ) {
+			++current.redundant;
+
+			if ( elide ) {
+				return;
+			}
+		}
+
+		glBindVertexArray( v );
+		vao = v;
+		vaoKnown = true;
+	}
+
+	void BindBuffer( unsigned int target, unsigned int buffer ) {
+		++current.bufferBinds;
+
+		if ( target != GL_ELEMENT_ARRAY_BUFFER ) {
+			for ( size_t i = 0; i < buffers.size(); ++i ) {
+				if ( buffers[ i ].first != target ) {
+					continue;
+				}
+
+				if ( buffers[ i ].second == buffer ) {
+					++current.redundant;
+
+					if ( elide ) {
+						return;
+					}
+				}
+
+				buffers[ i ].second = buffer;
+				glBindBuffer( target, buffer );
+				return;
+			}
+
+			buffers.push_back( std::make_pair( ( GLenum ) target, ( GLuint ) buffer ) );
+		}
+
+		glBindBuffer( target, buffer );
+	}
+
+	void DeleteBuffers( int count, const unsigned int* names ) {
+		// Deleting unbinds, and the name may come back from glGenBuffers.
+		for ( int i = 0; i < count; ++i ) {
+			for ( size_t j = 0; j < buffers.size(); ++j ) {
+				if ( buffers[ j ].second == names[ i ] ) {
+					buffers[ j ].second = 0;
+				}
+			}
+		}
+
+		glDeleteBuffers( count, names );
+	}
+
+	void DeleteVertexArrays( int count, const unsigned int* names ) {
+		for ( int i = 0; i < count; ++i ) {
+			if ( names[ i ] == vao ) {
+				vao = 0;
+			}
+		}
+
+		glDeleteVertexArrays( count, names );
+	}
+
+	void BufferData( unsigned int target, ptrdiff_t bytes, const void* data, unsigned int usage ) {
+		if ( data ) {
+			current.uploadBytes += bytes;
+		}
+
+		glBufferData( target, bytes, data, usage );
+	}
+
+	void BufferSubData( unsigned int target, ptrdiff_t offset, ptrdiff_t bytes, const void* data ) {
+		current.uploadBytes += bytes;
+		glBufferSubData( target, offset, bytes, data );
+	}
+
+	void Uniform1i( int location, int x ) {
+		if ( location < 0 || SameUniform( location, &x, sizeof( x ) ) ) {
+			return;
+		}
+
+		glUniform1i( location, x );
+	}
+
+	void Uniform2f( int location, float x, float y ) {
+		float v[ 2 ] = { x, y };
+
+		if ( location < 0 || SameUniform( location, v, sizeof( v ) ) ) {
+			return;
+		}
+
+		glUniform2f( location, x, y );
+	}
+
+	void Uniform3f( int location, float x, float y, float z ) {
+		float v[ 3 ] = { x, y, z };
+
+		if ( location < 0 || SameUniform( location, v, sizeof( v ) ) ) {
+			return;
+		}
+
+		glUniform3f( location, x, y, z );
+	}
+
+	void Uniform4f( int location, float x, float y, float z, float w ) {
+		float v[ 4 ] = { x, y, z, w };
+
+		if ( location < 0 || SameUniform( location, v, sizeof( v ) ) ) {
+			return;
+		}
+
+		glUniform4f( location, x, y, z, w );
+	}
+
+	void UniformMatrix4fv( int location, int count, bool transpose, const float* m ) {
+		if ( location < 0 ) {
+			return;
+		}
+
+		// Arrays are counted, not cached.
+		if ( count == 1 ) {
+			if ( SameUniform( location, m, sizeof( float ) * 16 ) ) {
+				return;
+			}
+		} else {
+			++current.uniforms;
+		}
+
+		glUniformMatrix4fv( location, count, transpose ? GL_TRUE : GL_FALSE, m );
+	}
+
+	void DrawElements( unsigned int mode, int count, unsigned int type, const void* offset ) {
+		Draw( mode, count, 1 );
+		glDrawElements( mode, count, type, offset );
+	}
+
+	void DrawElementsBaseVertex( unsigned int mode, int count, unsigned int type, const void* offset, int baseVertex ) {
+		Draw( mode, count, 1 );
+		glDrawElementsBaseVertex( mode, count, type, ( GLvoid* ) offset, baseVertex );
+	}
+
+	void DrawElementsInstancedBaseVertex( unsigned int mode, int count, unsigned int type, const void* offset, int instances, int baseVertex ) {
+		Draw( mode, count, instances );
+		glDrawElementsInstancedBaseVertex( mode, count, type, offset, instances, baseVertex );
+	}
+
+	void DrawArraysInstanced( unsigned int mode, int first, int count, int instances ) {
+		Draw( mode, count, instances );
+		glDrawArraysInstanced( mode, first, count, instances );
+	}
+
+	void MultiDrawElementsIndirect( unsigned int mode, unsigned int type, const void* indirect, int drawCount, unsigned int triangles ) {
+		++current.drawCalls;
+		current.triangles += triangles;
+		glMultiDrawElementsIndirect( mode, type, indirect, drawCount, 0 );
+	}
+
+	void CountUpload( size_t bytes ) {
+		current.uploadBytes += bytes;
+	}
+
+	void CountTextureBind( bool redundant ) {
+		++current.textureBinds;
+
+		if ( redundant ) {
+			++current.redundant;
+		}
+	}
+
+	void EndFrame( void ) {
+		last = current;
+		memset( &current, 0, sizeof( current ) );
+	}
+
+	const GLStats& Current( void ) {
+		return current;
+	}
+
+	const GLStats& Last( void ) {
+		return last;
+	}
+
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <cstddef>
+
+namespace DS {
+
+struct GLStats {
+	unsigned int drawCalls;
+	unsigned int triangles;
+	unsigned int programBinds;
+	unsigned int vertexArrayBinds;
+	unsigned int bufferBinds;
+	unsigned int textureBinds;
+	unsigned int uniforms;
+	unsigned int redundant;			// Calls that changed nothing, skipped while eliding.
+	size_t uploadBytes;				// Buffer and texture data sent to the GL.
+};
+
+/**
+	DS::GL - Counting, state tracking GL calls
+
+	The engine's binds, uniform updates, uploads and draws go through
+	here. Every call is counted for the current frame; EndFrame moves the
+	numbers to Last and starts over. The current program, vertex array
+	and buffer bindings are tracked, and uniform values per program and
+	location, so calls that would change nothing are counted as redundant
+	and, with elision on, not made at all.
+
+	Tracking only holds while nothing binds behind its back: GL code
+	outside the wrappers must call Invalidate afterwards. Element array
+	bindings are vertex array state and never elided, uniform arrays are
+	not cached. Main thread only.
+**/
+namespace GL {
+
+	// Forgets everything tracked, e.g. after raw GL calls.
+	void Invalidate( void );
+
+	void SetElision( bool on );
+	bool Elision( void );
+
+	void UseProgram( unsigned int program );
+	void BindVertexArray( unsigned int vao );
+	void BindBuffer( unsigned int target, unsigned int buffer );
+
+	void DeleteBuffers( int count, const unsigned int* buffers );
+	void DeleteVertexArrays( int count, const unsigned int* vaos );
+
+	// Data of NULL, orphaning, uploads nothing.
+	void BufferData( unsigned int target, ptrdiff_t bytes, const void* data, unsigned int usage );
+	void BufferSubData( unsigned int target, ptrdiff_t offset, ptrdiff_t bytes, const void* data );
+
+	// Set on the current program.
+	void Uniform1i( int location, int x );
+	void Uniform2f( int location, float x, float y );
+	void Uniform3f( int location, float x, float y, float z );
+	void Uniform4f( int location, float x, float y, float z, float w );
+	void UniformMatrix4fv( int location, int count, bool transpose, const float* m );
+
+	void DrawElements( unsigned int mode, int count, unsigned int type, const void* offset );
+	void DrawElementsBaseVertex( unsigned int mode, int count, unsigned int type, const void* offset, int baseVertex );
+	void DrawElementsInstancedBaseVertex( unsigned int mode, int count, unsigned int type, const void* offset, int instances, int baseVertex );
+	void DrawArraysInstanced( unsigned int mode, int first, int count, int instances );
+
+	// The counts are read by the GPU, the caller passes their triangle total.
+	void MultiDrawElementsIndirect( unsigned int mode, unsigned int type, const void* indirect, int drawCount, unsigned int triangles );
+
+	// For what does not go through the wrappers: texture uploads, mapped
+	// writes, TextureUnits' binds.
+	void CountUpload( size_t bytes );
+	void CountTextureBind( bool redundant );
+
+	void EndFrame( void );
+	const GLStats& Current( void );
+	const GLStats& Last( void );
+
+}
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include "Image.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace DS {
+
+bool WritePPM( const char* file, int width, int height, const unsigned char* rgb ) {
+	FILE* fp = fopen( file, "wb" );
+
+	if ( !fp ) {
+		fprintf( stderr, "Could not write %s\n", file );
+		return false;
+	}
+
+	fprintf( fp, "P6\n%d %d\n255\n", width, height );
+
+	size_t bytes = ( size_t ) width * height * 3;
+	bool ok = fwrite( rgb, 1, bytes, fp ) == bytes;
+
+	fclose( fp );
+
+	if ( !ok ) {
+		fprintf( stderr, "Could not write %s\n", file );
+	}
+
+	return ok;
+}
+
+bool WritePGM( const char* file, int width, int height, const unsigned short* grey ) {
+	FILE* fp = fopen( file, "wb" );
+
+	if ( !fp ) {
+		fprintf( stderr, "Could not write %s\n", file );
+		return false;
+	}
+
+	fprintf( fp, "P5\n%d %d\n65535\n", width, height );
+
+	// PGM stores 16-bit samples most significant byte first.
+	std::vector< unsigned char > row( width * 2 );
+	bool ok = true;
+
+	for ( int y = 0; y < height && ok; ++y ) {
+		const unsigned short* in = grey + ( size_t ) y * width;
+
+		for ( int x = 0; x < width; ++x ) {
+			row[ x * 2 ] = ( unsigned char ) ( in[ x ] >> 8 );
+			row[ x * 2 + 1 ] = ( unsigned char ) ( in[ x ] & 0xFF );
+		}
+
+		ok = fwrite( &row[ 0 ], 1, row.size(), fp ) == row.size();
+	}
+
+	fclose( fp );
+
+	if ( !ok ) {
+		fprintf( stderr, "Could not write %s\n", file );
+	}
+
+	return ok;
+}
+
+}
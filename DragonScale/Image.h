@@ -0,0 +1,24 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+namespace DS {
+
+/**
+	DS::WritePPM
+
+	Writes 8-bit RGB pixels, rows top to bottom, as a binary PPM. Returns
+	false if the file cannot be written.
+**/
+bool WritePPM( const char* file, int width, int height, const unsigned char* rgb );
+
+/**
+	DS::WritePGM
+
+	Writes 16-bit grey values, rows top to bottom, as a binary PGM with a
+	maximum of 65535, so depth keeps its precision.
+**/
+bool WritePGM( const char* file, int width, int height, const unsigned short* grey );
+
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include "InputRecord.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace DS {
+
+namespace {
+
+	const unsigned int INPUT_VERSION = 1;
+
+	template< typename T >
+	bool Take( const std::vector< unsigned char >& data, size_t& cursor, T* out ) {
+		if ( cursor + sizeof( T ) > data.size() ) {
+			return false;
+		}
+
+		memcpy( out, &data[ cursor ], sizeof( T ) );
+		cursor += sizeof( T );
+
+		return true;
+	}
+
+}
+
+InputRecorder::InputRecorder( void )
+	: fp( NULL ) {
+}
+
+InputRecorder::~InputRecorder( void ) {
+	Close();
+}
+
+bool InputRecorder::Open( const char* file, const std::string& scene ) {
+	Close();
+
+	fp = fopen( file, "wb" );
+
+	if ( !fp ) {
+		fprintf( stderr, "Could not record to %s\n", file );
+		return false;
+	}
+
+	unsigned char length = ( unsigned char ) std::min< size_t >( scene.size(), 255 );
+
+	fwrite( "DSIN", 1, 4, fp );
+	fwrite( &INPUT_VERSION, sizeof( INPUT_VERSION ), 1, fp );
+	fwrite( &length, 1, 1, fp );
+	fwrite( scene.c_str(), 1, length, fp );
+
+	return true;
+}
+
+void InputRecorder::Close( void ) {
+	if ( fp ) {
+		fclose( fp );
+		fp = NULL;
+	}
+}
+
+bool InputRecorder::IsOpen( void ) const {
+	return fp != NULL;
+}
+
+void InputRecorder::Frame( float dt, const std::vector< InputEvent >& events ) {
+	if ( !fp ) {
+		return;
+	}
+
+	unsigned short count = ( unsigned short ) std::min< size_t >( events.size(), 0xFFFF );
+
+	fwrite( &dt, sizeof( dt ), 1, fp );
+	fwrite( &count, sizeof( count ), 1, fp );
+
+	for ( unsigned short i = 0; i < count; ++i ) {
+		unsigned char down = events[ i ].down ? 1 : 0;
+
+		fwrite( &events[ i ].key, sizeof( events[ i ].key ), 1, fp );
+		fwrite( &down, 1, 1, fp );
+	}
+}
+
+InputPlayer::InputPlayer( void )
+	: cursor( 0 ), open( false ) {
+}
+
+InputPlayer::~InputPlayer( void ) {
+}
+
+bool InputPlayer::Open( const char* file ) {
+	open = false;
+
+	std::ifstream stream( file, std::ios::in | std::ios::binary );
+
+	if ( !stream.is_open() ) {
+		fprintf( stderr, "Could not open recording %s\n", file );
+		return false;
+	}
+
+	stream.seekg( 0, std::ios::end );
+	std::streamoff length = stream.tellg();
+	stream.seekg( 0, std::ios::beg );
+
+	data.resize( ( size_t ) length );
+
+	if ( length > 0 ) {
+		stream.read( ( char* ) &data[ 0 ], length );
+	}
+
+	cursor = 0;
+
+	char magic[ 4 ];
+	unsigned int version = 0;
+	unsigned char nameLength = 0;
+
+	if ( !Take( data, cursor, &magic ) || memcmp( magic, "DSIN", 4 ) != 0 ||
+		 !Take( data, cursor, &version ) || version != INPUT_VERSION ||
+		 !Take( data, cursor, &nameLength ) || cursor + nameLength > data.size() ) {
+		fprintf( stderr, "%s is not a recording\n", file );
+		return false;
+	}
+
+	scene.assign( ( const char* ) &data[ 0 ] + cursor, nameLength );
+	cursor += nameLength;
+
+	open = true;
+
+	return true;
+}
+
+bool InputPlayer::IsOpen( void ) const {
+	return open;
+}
+
+bool InputPlayer::Next( float* dt, std::vector< InputEvent >& events ) {
+	events.clear();
+
+	unsigned short count = 0;
+
+	if ( !open || !Take( data, cursor, dt ) || !Take( data, cursor, &count ) ) {
+		return false;
+	}
+
+	for ( unsigned short i = 0; i < count; ++i ) {
+		InputEvent e;
+		unsigned char down = 0;
+
+		if ( !Take( data, cursor, &e.key ) || !Take( data, cursor, &down ) ) {
+			return false;
+		}
+
+		e.down = down != 0;
+		events.push_back( e );
+	}
+
+	return true;
+}
+
+const std::string& InputPlayer::Scene( void ) const {
+	return scene;
+}
+
+}
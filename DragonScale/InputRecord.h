@@ -0,0 +1,69 @@
+#ifndef INPUTRECORD_H
+#define INPUTRECORD_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace DS {
+
+struct InputEvent {
+	unsigned int key;		// SDL_Keycode
+	bool down;
+};
+
+/**
+	DS::InputRecorder - Session recording
+
+	Writes one record per frame: the frame time and the key events handled
+	that frame. Replaying both through the same code reproduces the
+	session exactly, including anything simulated with the frame time.
+
+	File layout: "DSIN", version and the scene name ( a byte count then the
+	characters ), then per frame a float dt, an unsigned short event count
+	and per event an unsigned int key and a byte for down. An idle frame
+	takes six bytes.
+**/
+class InputRecorder {
+public:
+	InputRecorder( void );
+	~InputRecorder( void );
+
+	bool Open( const char* file, const std::string& scene );
+	void Close( void );
+	bool IsOpen( void ) const;
+
+	void Frame( float dt, const std::vector< InputEvent >& events );
+
+private:
+	FILE* fp;
+};
+
+/**
+	DS::InputPlayer - Session playback
+
+	Reads a whole recording up front so playback never touches the disk.
+**/
+class InputPlayer {
+public:
+	InputPlayer( void );
+	~InputPlayer( void );
+
+	bool Open( const char* file );
+	bool IsOpen( void ) const;
+
+	// False once every frame has been played.
+	bool Next( float* dt, std::vector< InputEvent >& events );
+
+	const std::string& Scene( void ) const;
+
+private:
+	std::vector< unsigned char > data;
+	size_t cursor;
+	std::string scene;
+	bool open;
+};
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+namespace DS {
+
+JobSystem::JobSystem( void )
+	: job( NULL ), jobCount( 0 ), jobGrain( 1 ), generation( 0 ), busy( 0 ), quit( false ) {
+	next = 0;
+}
+
+JobSystem::~JobSystem( void ) {
+	Shutdown();
+}
+
+void JobSystem::Init( int workers ) {
+	if ( workers < 0 ) {
+		workers = std::max( ( int ) std::thread::hardware_concurrency() - 1, 0 );
+	}
+
+	quit = false;
+
+	for ( int i = 0; i < workers; ++i ) {
+		threads.push_back( std::thread( &JobSystem::WorkerMain, this ) );
+	}
+}
+
+void JobSystem::Shutdown( void ) {
+	{
+		std::lock_guard< std::mutex > guard( lock );
+		quit = true;
+	}
+
+	wake.notify_all();
+
+	for ( size_t i = 0; i < threads.size(); ++i ) {
+		threads[ i ].join();
+	}
+
+	threads.clear();
+}
+
+int JobSystem::WorkerCount( void ) const {
+	return ( int ) threads.size();
+}
+
+void JobSystem::RunRanges( void ) {
+	while ( true ) {
+		int begin = next.fetch_add( jobGrain );
+
+		if ( begin >= jobCount ) {
+			break;
+		}
+
+		( *job )( begin, std::min( begin + jobGrain, jobCount ) );
+	}
+}
+
+void JobSystem::WorkerMain( void ) {
+	unsigned int seen = 0;
+
+	while ( true ) {
+		{
+			std::unique_lock< std::mutex > guard( lock );
+
+			while ( !quit && generation == seen ) {
+				wake.wait( guard );
+			}
+
+			if ( quit ) {
+				return;
+			}
+
+			seen = generation;
+		}
+
+		RunRanges();
+
+		{
+			std::lock_guard< std::mutex > guard( lock );
+			--busy;
+		}
+
+		done.notify_one();
+	}
+}
+
+void JobSystem::ParallelFor( int count, int grain, const RangeJob& j ) {
+	if ( count <= 0 ) {
+		return;
+	}
+
+	grain = std::max( grain, 1 );
+
+	// Not worth waking anyone.
+	if ( threads.empty() || count <= grain ) {
+		j( 0, count );
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > guard( lock );
+
+		job = &j;
+		jobCount = count;
+		jobGrain = grain;
+		next = 0;
+		busy = ( int ) threads.size();
+		++generation;
+	}
+
+	wake.notify_all();
+
+	RunRanges();
+
+	std::unique_lock< std::mutex > guard( lock );
+
+	while ( busy > 0 ) {
+		done.wait( guard );
+	}
+
+	job = NULL;
+}
+
+}
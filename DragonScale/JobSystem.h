@@ -0,0 +1,60 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DS {
+
+/**
+	DS::JobSystem - Fork/join worker pool
+
+	ParallelFor hands out [ begin, end ) ranges of grain items to the
+	workers and to the calling thread, and returns once every range is
+	done. Workers sleep between calls. Only one ParallelFor may run at a
+	time and it must not be called from inside a job.
+
+	With zero workers everything runs inline on the caller.
+**/
+class JobSystem {
+public:
+	typedef std::function< void( int begin, int end ) > RangeJob;
+
+	JobSystem( void );
+	~JobSystem( void );
+
+	// workers < 0 picks one less than the hardware thread count.
+	void Init( int workers );
+	void Shutdown( void );
+
+	void ParallelFor( int count, int grain, const RangeJob& job );
+
+	int WorkerCount( void ) const;
+
+private:
+	void WorkerMain( void );
+	void RunRanges( void );
+
+	std::vector< std::thread > threads;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const RangeJob* job;
+	int jobCount;
+	int jobGrain;
+	std::atomic< int > next;
+
+	unsigned int generation;
+	int busy;
+	bool quit;
+};
+
+}
+
+#endif
@@ -0,0 +1,96 @@
+#include "LOD.h"
+
+#include <cfloat>
+#include <algorithm>
+
+#include "Simplify.h"
+
+namespace DS {
+
+namespace {
+
+	// A level has to drop at least this fraction of its parent's triangles
+	// to be worth the index memory.
+	const float MIN_LEVEL_SAVING = 0.1f;
+
+	// Distances are clamped to this so objects around the eye don't divide
+	// by zero.
+	const float MIN_DISTANCE = 0.0001f;
+
+}
+
+LODChain GenerateLODs( Mesh& mesh, unsigned int maxLevels, float reduction ) {
+	LODChain chain;
+
+	LODLevel base;
+	base.indexOffset = 0;
+	base.indexCount = ( unsigned int ) mesh.indices.size();
+	base.error = 0.0f;
+	chain.levels.push_back( base );
+
+	std::vector< std::vector< unsigned int > > coarse;
+	unsigned int triangles = mesh.TriangleCount();
+
+	while ( chain.levels.size() < maxLevels ) {
+		unsigned int target = ( unsigned int ) ( triangles * reduction );
+		float error = 0.0f;
+
+		std::vector< unsigned int > indices = Simplify( mesh, target, FLT_MAX, &error );
+		unsigned int count = ( unsigned int ) indices.size() / 3;
+
+		if ( count == 0 || count > triangles * ( 1.0f - MIN_LEVEL_SAVING ) ) {
+			break;
+		}
+
+		LODLevel level;
+		level.indexOffset = 0;
+		level.indexCount = ( unsigned int ) indices.size();
+		level.error = std::max( error, chain.levels.back().error );
+		chain.levels.push_back( level );
+
+		coarse.push_back( indices );
+		triangles = count;
+	}
+
+	// Simplify always reads mesh.indices, so only append once every level
+	// has been built from the original.
+	for ( size_t i = 0; i < coarse.size(); ++i ) {
+		chain.levels[ i + 1 ].indexOffset = ( unsigned int ) mesh.indices.size();
+		mesh.indices.insert( mesh.indices.end(), coarse[ i ].begin(), coarse[ i ].end() );
+	}
+
+	return chain;
+}
+
+float LODErrorScale( const Math::Matrix4& projection, int viewportHeight ) {
+	return projection.c[ 1 ][ 1 ] * viewportHeight * 0.5f;
+}
+
+unsigned int SelectLOD( const LODChain& chain,
+						unsigned int current,
+						float distance,
+						float errorScale,
+						float threshold,
+						float hysteresis ) {
+	if ( chain.levels.empty() ) {
+		return 0;
+	}
+
+	unsigned int last = ( unsigned int ) chain.levels.size() - 1;
+	unsigned int level = std::min( current, last );
+	float pixels = errorScale / std::max( distance, MIN_DISTANCE );
+
+	// Refine while the current level is clearly too coarse.
+	while ( level > 0 && chain.levels[ level ].error * pixels > threshold * ( 1.0f + hysteresis ) ) {
+		--level;
+	}
+
+	// Coarsen while the next level is clearly good enough.
+	while ( level < last && chain.levels[ level + 1 ].error * pixels <= threshold * ( 1.0f - hysteresis ) ) {
+		++level;
+	}
+
+	return level;
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <vector>
+
+#include "Mesh.h"
+#include "Matrix4.h"
+
+namespace DS {
+
+struct LODLevel {
+	unsigned int indexOffset;	// First index in Mesh::indices.
+	unsigned int indexCount;
+	float error;				// Geometric error in model units.
+};
+
+/**
+	DS::LODChain
+
+	Level 0 is the source mesh, each following level is coarser. All levels
+	index the same vertex buffer and live back to back in Mesh::indices.
+**/
+struct LODChain {
+	std::vector< LODLevel > levels;
+};
+
+/**
+	DS::GenerateLODs
+
+	Simplifies the mesh down to reduction times the previous level's triangle
+	count per level, for up to maxLevels levels ( including level 0 ). Levels
+	that fail to shrink the mesh noticeably are dropped, so the chain may be
+	shorter than requested. Appends the new index ranges to mesh.indices.
+**/
+LODChain GenerateLODs( Mesh& mesh, unsigned int maxLevels, float reduction );
+
+/**
+	DS::LODErrorScale
+
+	Converts a geometric error at distance 1 to pixels. Uses the vertical
+	cotangent stored in a Perspective/Frustum matrix.
+**/
+float LODErrorScale( const Math::Matrix4& projection, int viewportHeight );
+
+/**
+	DS::SelectLOD
+
+	Picks the coarsest level whose projected error stays under threshold
+	pixels. To avoid popping back and forth at a boundary the current level
+	is kept until its error exceeds threshold * ( 1 + hysteresis ), and a
+	coarser level is only taken once it is under threshold * ( 1 - hysteresis ).
+
+	distance is from the eye to the nearest point of the object's bounding
+	sphere.
+**/
+unsigned int SelectLOD( const LODChain& chain,
+						unsigned int current,
+						float distance,
+						float errorScale,
+						float threshold,
+						float hysteresis );
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include "LightClusters.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+namespace DS {
+
+namespace {
+
+	enum {
+		LIGHT_BUFFER,
+		INDEX_BUFFER,
+		CLUSTER_BUFFER
+	};
+
+	const GLenum BUFFER_FORMATS[ 3 ] = { GL_RGBA32F, GL_R32UI, GL_RG32UI };
+	const char* const SAMPLER_NAMES[ 3 ] = { "LIGHTS", "LIGHT_INDICES", "LIGHT_CLUSTERS" };
+
+	const int SLICE_GRAIN = 1;
+
+	/* Squared distance from a point to a box, zero inside. */
+	float DistanceSquared( const float* p, const float* min, const float* max ) {
+		float d = 0.0f;
+
+		for ( int i = 0; i < 3; ++i ) {
+			float v = p[ i ] < min[ i ] ? min[ i ] - p[ i ] : ( p[ i ] > max[ i ] ? p[ i ] - max[ i ] : 0.0f );
+			d += v * v;
+		}
+
+		return d;
+	}
+
+	/* Orphans the buffer and refills it, never with zero bytes. */
+	void Upload( GLuint buffer, const void* data, size_t bytes, size_t minimum ) {
+		size_t size = std::max( bytes, minimum );
+
+		GL::BindBuffer( GL_TEXTURE_BUFFER, buffer );
+		GL::BufferData( GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW );
+
+		if ( bytes > 0 ) {
+			GL::BufferSubData( GL_TEXTURE_BUFFER, 0, bytes, data );
+		}
+
+		GL::BindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+		Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_LIGHTING, buffer, size );
+	}
+
+}
+
+LightClusters::LightClusters( void )
+	: tilesX( 0 ), tilesY( 0 ), slices( 0 ), zNear( 0.1f ), zFar( 100.0f ),
+	  units( NULL ), firstUnit( 0 ), lightCount( 0 ), maxClusterLights( 0 ) {
+	for ( int i = 0; i < 3; ++i ) {
+		buffers[ i ] = 0;
+		textures[ i ] = 0;
+	}
+}
+
+LightClusters::~LightClusters( void ) {
+}
+
+void LightClusters::Init( int x, int y, int z, TextureUnits* u, unsigned int first ) {
+	MemoryScope scope( MEMORY_LIGHTING );
+
+	tilesX = x;
+	tilesY = y;
+	slices = z;
+	units = u;
+	firstUnit = first;
+
+	sliceLists.resize( slices );
+	clusterData.assign( ( size_t ) tilesX * tilesY * slices * 2, 0 );
+
+	glGenBuffers( 3, buffers );
+	glGenTextures( 3, textures );
+
+	for ( int i = 0; i < 3; ++i ) {
+		Upload( buffers[ i ], NULL, 0, 16 );
+
+		units->Bind( firstUnit + i, GL_TEXTURE_BUFFER, textures[ i ] );
+		glTexBuffer( GL_TEXTURE_BUFFER, BUFFER_FORMATS[ i ], buffers[ i ] );
+	}
+}
+
+void LightClusters::Shutdown( void ) {
+	for ( int i = 0; i < 3; ++i ) {
+		Memory::ReleaseGL( MEMORY_GL_BUFFER, buffers[ i ] );
+
+		if ( units ) {
+			units->Invalidate( textures[ i ] );
+		}
+	}
+
+	GL::DeleteBuffers( 3, buffers );
+	glDeleteTextures( 3, textures );
+
+	for ( int i = 0; i < 3; ++i ) {
+		buffers[ i ] = 0;
+		textures[ i ] = 0;
+	}
+
+	bounds.clear();
+	sliceLists.clear();
+	lightCount = 0;
+}
+
+/*
+	Slice depths grow by the same ratio each step. A tile's corners at a
+	given depth scale with that depth, so the box of a cluster is spanned
+	by its corners on the near and far depths.
+*/
+void LightClusters::SetProjection( float fovY, float aspect, float n, float f ) {
+	MemoryScope scope( MEMORY_LIGHTING );
+
+	zNear = n;
+	zFar = f;
+
+	float tanY = tanf( fovY * Math::PI_OVER_360 );
+	float tanX = tanY * aspect;
+
+	bounds.resize( ( size_t ) tilesX * tilesY * slices );
+
+	for ( int z = 0; z < slices; ++z ) {
+		float depths[ 2 ] = {
+			zNear * powf( zFar / zNear, ( float ) z / slices ),
+			zNear * powf( zFar / zNear, ( float ) ( z + 1 ) / slices )
+		};
+
+		for ( int y = 0; y < tilesY; ++y ) {
+			float y0 = -1.0f + 2.0f * y / tilesY;
+			float y1 = -1.0f + 2.0f * ( y + 1 ) / tilesY;
+
+			for ( int x = 0; x < tilesX; ++x ) {
+				float x0 = -1.0f + 2.0f * x / tilesX;
+				float x1 = -1.0f + 2.0f * ( x + 1 ) / tilesX;
+
+				Bounds& b = bounds[ ( ( size_t ) z * tilesY + y ) * tilesX + x ];
+
+				b.min[ 0 ] = b.min[ 1 ] = 1e30f;
+				b.max[ 0 ] = b.max[ 1 ] = -1e30f;
+
+				for ( int d = 0; d < 2; ++d ) {
+					float sx = depths[ d ] * tanX;
+					float sy = depths[ d ] * tanY;
+
+					b.min[ 0 ] = std::min( b.min[ 0 ], std::min( x0 * sx, x1 * sx ) );
+					b.max[ 0 ] = std::max( b.max[ 0 ], std::max( x0 * sx, x1 * sx ) );
+					b.min[ 1 ] = std::min( b.min[ 1 ], std::min( y0 * sy, y1 * sy ) );
+					b.max[ 1 ] = std::max( b.max[ 1 ], std::max( y0 * sy, y1 * sy ) );
+				}
+
+				// View space looks down -Z.
+				b.min[ 2 ] = -depths[ 1 ];
+				b.max[ 2 ] = -depths[ 0 ];
+			}
+		}
+	}
+
+	// The last slice runs on to infinity, matching the shader's clamp.
+	if ( slices > 0 ) {
+		for ( int i = 0; i < tilesX * tilesY; ++i ) {
+			bounds[ ( size_t ) ( slices - 1 ) * tilesX * tilesY + i ].min[ 2 ] = -1e30f;
+		}
+	}
+}
+
+void LightClusters::SetupProgram( unsigned int program, int width, int height ) const {
+	GL::UseProgram( program );
+
+	for ( int i = 0; i < 3; ++i ) {
+		GL::Uniform1i( glGetUniformLocation( program, SAMPLER_NAMES[ i ] ), firstUnit + i );
+	}
+
+	// slice = log( depth ) * scale + bias.
+	float scale = slices / logf( zFar / zNear );
+	float bias = -logf( zNear ) * scale;
+
+	GL::Uniform3f( glGetUniformLocation( program, "CLUSTER_GRID" ), ( float ) tilesX, ( float ) tilesY, ( float ) slices );
+	GL::Uniform2f( glGetUniformLocation( program, "CLUSTER_SIZE" ), ( float ) width / tilesX, ( float ) height / tilesY );
+	GL::Uniform2f( glGetUniformLocation( program, "CLUSTER_DEPTH" ), scale, bias );
+}
+
+/*
+	The jobs only write their own slice's lists; joining them into one
+	index list and the uploads stay on the calling thread.
+*/
+void LightClusters::Update( const Math::Matrix4& view, const PointLight* lights, unsigned int count, JobSystem& jobs ) {
+	MemoryScope scope( MEMORY_LIGHTING );
+
+	lightCount = count;
+	viewLights.resize( ( size_t ) count * 4 );
+	lightData.resize( ( size_t ) count * 8 );
+
+	for ( unsigned int i = 0; i < count; ++i ) {
+		const PointLight& light = lights[ i ];
+		const Math::Point3& p = light.position;
+		float* v = &viewLights[ i * 4 ];
+
+		for ( int r = 0; r < 3; ++r ) {
+			v[ r ] = view.c[ 0 ][ r ] * p.x + view.c[ 1 ][ r ] * p.y + view.c[ 2 ][ r ] * p.z + view.c[ 3 ][ r ];
+		}
+
+		v[ 3 ] = light.radius;
+
+		float* d = &lightData[ i * 8 ];
+		d[ 0 ] = p.x;
+		d[ 1 ] = p.y;
+		d[ 2 ] = p.z;
+		d[ 3 ] = light.radius;
+		d[ 4 ] = light.color.x;
+		d[ 5 ] = light.color.y;
+		d[ 6 ] = light.color.z;
+		d[ 7 ] = 0.0f;
+	}
+
+	jobs.ParallelFor( slices, SLICE_GRAIN, [ this ]( int begin, int end ) {
+		for ( int z = begin; z < end; ++z ) {
+			AssignSlice( z );
+		}
+	} );
+
+	indexData.clear();
+	maxClusterLights = 0;
+
+	unsigned int perSlice = ( unsigned int ) ( tilesX * tilesY );
+
+	for ( int z = 0; z < slices; ++z ) {
+		const Slice& slice = sliceLists[ z ];
+		unsigned int base = ( unsigned int ) indexData.size();
+
+		for ( unsigned int c = 0; c < perSlice; ++c ) {
+			unsigned int* range = &clusterData[ ( ( size_t ) z * perSlice + c ) * 2 ];
+			range[ 0 ] = base + slice.ranges[ c * 2 ];
+			range[ 1 ] = slice.ranges[ c * 2 + 1 ];
+
+			maxClusterLights = std::max( maxClusterLights, range[ 1 ] );
+		}
+
+		indexData.insert( indexData.end(), slice.indices.begin(), slice.indices.end() );
+	}
+
+	Upload( buffers[ LIGHT_BUFFER ], lightData.empty() ? NULL : &lightData[ 0 ], lightData.size() * sizeof( float ), 16 );
+	Upload( buffers[ INDEX_BUFFER ], indexData.empty() ? NULL : &indexData[ 0 ], indexData.size() * sizeof( unsigned int ), 16 );
+	Upload( buffers[ CLUSTER_BUFFER ], &clusterData[ 0 ], clusterData.size() * sizeof( unsigned int ), 16 );
+}
+
+/*
+	Lights are first kept to the ones reaching the slice's depth range,
+	which rules most of them out before the per cluster box tests.
+*/
+void LightClusters::AssignSlice( int z ) {
+	Slice& slice = sliceLists[ z ];
+	unsigned int perSlice = ( unsigned int ) ( tilesX * tilesY );
+	const Bounds* sliceBounds = &bounds[ ( size_t ) z * perSlice ];
+
+	slice.candidates.clear();
+	slice.indices.clear();
+	slice.ranges.resize( perSlice * 2 );
+
+	for ( unsigned int i = 0; i < lightCount; ++i ) {
+		const float* v = &viewLights[ i * 4 ];
+
+		if ( v[ 2 ] - v[ 3 ] <= sliceBounds[ 0 ].max[ 2 ] && v[ 2 ] + v[ 3 ] >= sliceBounds[ 0 ].min[ 2 ] ) {
+			slice.candidates.push_back( i );
+		}
+	}
+
+	for ( unsigned int c = 0; c < perSlice; ++c ) {
+		const Bounds& b = sliceBounds[ c ];
+
+		slice.ranges[ c * 2 ] = ( unsigned int ) slice.indices.size();
+
+		for ( size_t i = 0; i < slice.candidates.size(); ++i ) {
+			unsigned int light = slice.candidates[ i ];
+			const float* v = &viewLights[ light * 4 ];
+
+			if ( DistanceSquared( v, b.min, b.max ) <= v[ 3 ] * v[ 3 ] ) {
+				slice.indices.push_back( light );
+			}
+		}
+
+		slice.ranges[ c * 2 + 1 ] = ( unsigned int ) slice.indices.size() - slice.ranges[ c * 2 ];
+	}
+}
+
+void LightClusters::Bind( void ) {
+	for ( int i = 0; i < 3; ++i ) {
+		units->Bind( firstUnit + i, GL_TEXTURE_BUFFER, textures[ i ] );
+	}
+}
+
+unsigned int LightClusters::LightCount( void ) const {
+	return lightCount;
+}
+
+unsigned int LightClusters::IndexCount( void ) const {
+	return ( unsigned int ) indexData.size();
+}
+
+unsigned int LightClusters::MaxClusterLights( void ) const {
+	return maxClusterLights;
+}
+
+}
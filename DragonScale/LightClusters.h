@@ -0,0 +1,101 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <vector>
+
+#include "Point3.h"
+#include "Vector3.h"
+#include "Matrix4.h"
+#include "JobSystem.h"
+#include "TextureUnits.h"
+
+namespace DS {
+
+struct PointLight {
+	Math::Point3 position;
+	float radius;				// Falls off to zero here.
+	Math::Vector3 color;
+};
+
+/**
+	DS::LightClusters - Clustered forward light assignment
+
+	The view frustum is cut into a grid of screen tiles and depth slices,
+	the slices spaced exponentially between zNear and zFar so clusters stay
+	roughly cube shaped; everything past zFar falls into the last slice.
+	Each frame the lights are moved into view space and every slice is
+	handed to the JobSystem as one job, which keeps the lights reaching its
+	depth range and tests them against each cluster's view space box. The
+	per slice lists are then joined and uploaded as three texture buffers:
+	the lights, the light indices, and each cluster's offset and count into
+	those indices. simple.frag finds its cluster from gl_FragCoord and its
+	view depth and only loops over that cluster's lights, so the shading
+	cost follows the lights touching a pixel, not the lights in the scene.
+**/
+class LightClusters {
+public:
+	LightClusters( void );
+	~LightClusters( void );
+
+	// Uses the three units from firstUnit up.
+	void Init( int tilesX, int tilesY, int slices, TextureUnits* units, unsigned int firstUnit );
+	void Shutdown( void );
+
+	// The cluster boxes follow the projection.
+	void SetProjection( float fovY, float aspect, float zNear, float zFar );
+
+	// Sets the cluster uniforms and samplers of a program built with
+	// simple.frag, after SetProjection. Leaves the program current.
+	void SetupProgram( unsigned int program, int width, int height ) const;
+
+	void Update( const Math::Matrix4& view, const PointLight* lights, unsigned int count, JobSystem& jobs );
+
+	// Before drawing with any program SetupProgram was called on.
+	void Bind( void );
+
+	unsigned int LightCount( void ) const;
+	unsigned int IndexCount( void ) const;			// Light references over all clusters.
+	unsigned int MaxClusterLights( void ) const;
+
+private:
+	struct Bounds {
+		float min[ 3 ];
+		float max[ 3 ];
+	};
+
+	struct Slice {
+		std::vector< unsigned int > candidates;
+		std::vector< unsigned int > indices;
+		std::vector< unsigned int > ranges;			// Offset into indices and count, per cluster.
+	};
+
+	void AssignSlice( int slice );
+
+	int tilesX;
+	int tilesY;
+	int slices;
+
+	float zNear;
+	float zFar;
+
+	TextureUnits* units;
+	unsigned int firstUnit;
+
+	unsigned int buffers[ 3 ];			// Lights, indices, clusters.
+	unsigned int textures[ 3 ];
+
+	std::vector< Bounds > bounds;		// View space, per cluster.
+	std::vector< float > viewLights;	// Center, radius.
+	std::vector< Slice > sliceLists;
+
+	std::vector< float > lightData;
+	std::vector< unsigned int > indexData;
+	std::vector< unsigned int > clusterData;
+
+	unsigned int lightCount;
+	unsigned int maxClusterLights;
+};
+
+}
+
+#endif
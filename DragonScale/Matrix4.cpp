@@ -28,7 +28,7 @@ Matrix4::Matrix4( float t00, float t01, float t02, float t03,
 	c[ 0 ][ 0 ] = t00; c[ 0 ][ 1 ] = t01; c[ 0 ][ 2 ] = t02; c[ 0 ][ 3 ] = t03;
 	c[ 1 ][ 0 ] = t10; c[ 1 ][ 1 ] = t11; c[ 1 ][ 2 ] = t12; c[ 1 ][ 3 ] = t13;
 	c[ 2 ][ 0 ] = t20; c[ 2 ][ 1 ] = t21; c[ 2 ][ 2 ] = t22; c[ 2 ][ 3 ] = t23;
-	c[ 3 ][ 0 ] = t30; c[ 3 ][ 1 ] = t31; c[ 3 ][ 2 ] = t23; c[ 3 ][ 3 ] = t33;
+	c[ 3 ][ 0 ] = t30; c[ 3 ][ 1 ] = t31; c[ 3 ][ 2 ] = t32; c[ 3 ][ 3 ] = t33;
 }
 
 Matrix4::~Matrix4( void ) {
@@ -121,12 +121,12 @@ inline Matrix4 Euler( const float angleX, const float angleY, const float angleZ
 	float radY = angleY * PI_OVER_180;
 	float radZ = angleZ * PI_OVER_180;
 
-	float a = cosf( angleX );
-	float b = sinf( angleX );
-	float c = cosf( angleY );
-	float d = sinf( angleY );
-	float e = cosf( angleZ );
-	float f = sinf( angleZ );
+	float a = cosf( radX );
+	float b = sinf( radX );
+	float c = cosf( radY );
+	float d = sinf( radY );
+	float e = cosf( radZ );
+	float f = sinf( radZ );
 
 	float ad = a * d;
 	float bd = b * d;
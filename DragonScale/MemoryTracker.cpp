@@ -0,0 +1,358 @@
+#include "MemoryTracker.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <utility>
+
+#include <xmmintrin.h>
+
+#ifdef _MSC_VER
+#define DS_THREAD_LOCAL __declspec( thread )
+#else
+#define DS_THREAD_LOCAL __thread
+#endif
+
+namespace DS {
+
+namespace {
+
+	// Keeps the user pointer 16 byte aligned.
+	const size_t HEADER_SIZE = 16;
+
+	struct BlockHeader {
+		size_t bytes;
+		unsigned int tag;
+	};
+
+	struct Counters {
+		std::atomic< size_t > current;
+		std::atomic< size_t > peak;
+		std::atomic< unsigned int > allocations;
+		std::atomic< unsigned int > frees;
+		std::atomic< unsigned int > histogram[ MEMORY_HISTOGRAM_BUCKETS ];
+	};
+
+	struct GLObject {
+		MemoryTag tag;
+		size_t bytes;
+	};
+
+	// Static storage, so all of this is zero before the first allocation.
+	Counters counters[ MEMORY_KIND_COUNT ][ MEMORY_TAG_COUNT ];
+	std::atomic< size_t > kindCurrent[ MEMORY_KIND_COUNT ];
+	std::atomic< size_t > kindPeak[ MEMORY_KIND_COUNT ];
+	size_t budgets[ MEMORY_KIND_COUNT ][ MEMORY_TAG_COUNT ];
+
+	std::mutex glLock;
+	std::unordered_map< unsigned long long, GLObject > glObjects;
+
+	DS_THREAD_LOCAL int currentTag = MEMORY_GENERAL;
+
+	const char* TAG_NAMES[ MEMORY_TAG_COUNT ] = {
+		"general", "mesh", "shader", "texture", "batch",
+		"culling", "particles", "physics", "streaming", "raytrace",
+		"animation", "audio", "capture", "terrain",
+		"navigation", "tasks", "lighting"
+	};
+
+	const char* KIND_NAMES[ MEMORY_KIND_COUNT ] = {
+		"heap", "gl buffers", "gl textures", "gl renderbuffers"
+	};
+
+	int Bucket( size_t bytes ) {
+		int bucket = 0;
+		size_t limit = 16;
+
+		while ( bytes > limit && bucket < MEMORY_HISTOGRAM_BUCKETS - 1 ) {
+			limit <<= 1;
+			++bucket;
+		}
+
+		return bucket;
+	}
+
+	void RaisePeak( std::atomic< size_t >& peak, size_t value ) {
+		size_t seen = peak.load( std::memory_order_relaxed );
+
+		while ( value > seen && !peak.compare_exchange_weak( seen, value, std::memory_order_relaxed ) ) {
+		}
+	}
+
+	void Charge( MemoryKind kind, int tag, size_t bytes, bool fresh ) {
+		Counters& c = counters[ kind ][ tag ];
+
+		RaisePeak( c.peak, c.current.fetch_add( bytes, std::memory_order_relaxed ) + bytes );
+		RaisePeak( kindPeak[ kind ], kindCurrent[ kind ].fetch_add( bytes, std::memory_order_relaxed ) + bytes );
+
+		if ( fresh ) {
+			c.allocations.fetch_add( 1, std::memory_order_relaxed );
+			c.histogram[ Bucket( bytes ) ].fetch_add( 1, std::memory_order_relaxed );
+		}
+	}
+
+	void Discharge( MemoryKind kind, int tag, size_t bytes, bool release ) {
+		Counters& c = counters[ kind ][ tag ];
+
+		c.current.fetch_sub( bytes, std::memory_order_relaxed );
+		kindCurrent[ kind ].fetch_sub( bytes, std::memory_order_relaxed );
+
+		if ( release ) {
+			c.frees.fetch_add( 1, std::memory_order_relaxed );
+		}
+	}
+
+	unsigned long long GLKey( MemoryKind kind, unsigned int name ) {
+		return ( ( unsigned long long ) kind << 32 ) | name;
+	}
+
+	double Kilobytes( size_t bytes ) {
+		return bytes / 1024.0;
+	}
+
+}
+
+MemoryScope::MemoryScope( MemoryTag tag )
+	: previous( ( MemoryTag ) currentTag ) {
+	currentTag = tag;
+}
+
+MemoryScope::~MemoryScope( void ) {
+	currentTag = previous;
+}
+
+namespace Memory {
+
+void* Allocate( size_t bytes, MemoryTag tag ) {
+	unsigned char* base = ( unsigned char* ) _mm_malloc( bytes + HEADER_SIZE, 16 );
+
+	if ( !base ) {
+		return NULL;
+	}
+
+	BlockHeader* header = ( BlockHeader* ) base;
+	header->bytes = bytes;
+	header->tag = tag;
+
+	Charge( MEMORY_HEAP, tag, bytes, true );
+
+	return base + HEADER_SIZE;
+}
+
+void Free( void* p ) {
+	if ( !p ) {
+		return;
+	}
+
+	unsigned char* base = ( unsigned char* ) p - HEADER_SIZE;
+	BlockHeader* header = ( BlockHeader* ) base;
+
+	Discharge( MEMORY_HEAP, header->tag, header->bytes, true );
+
+	_mm_free( base );
+}
+
+void TrackGL( MemoryKind kind, MemoryTag tag, unsigned int name, size_t bytes ) {
+	if ( name == 0 ) {
+		return;
+	}
+
+	std::lock_guard< std::mutex > lock( glLock );
+
+	std::pair< std::unordered_map< unsigned long long, GLObject >::iterator, bool > slot = glObjects.insert( std::make_pair( GLKey( kind, name ), GLObject() ) );
+	GLObject& object = slot.first->second;
+	bool fresh = slot.second;
+
+	// Respecified storage ( orphaning, mip uploads ) replaces the old size.
+	if ( !fresh ) {
+		Discharge( kind, object.tag, object.bytes, false );
+	}
+
+	object.tag = tag;
+	object.bytes = bytes;
+
+	Charge( kind, tag, bytes, fresh );
+}
+
+void ReleaseGL( MemoryKind kind, unsigned int name ) {
+	std::lock_guard< std::mutex > lock( glLock );
+
+	std::unordered_map< unsigned long long, GLObject >::iterator it = glObjects.find( GLKey( kind, name ) );
+
+	if ( it == glObjects.end() ) {
+		return;
+	}
+
+	Discharge( kind, it->second.tag, it->second.bytes, true );
+	glObjects.erase( it );
+}
+
+MemoryTag CurrentTag( void ) {
+	return ( MemoryTag ) currentTag;
+}
+
+MemoryStats Stats( MemoryKind kind, MemoryTag tag ) {
+	const Counters& c = counters[ kind ][ tag ];
+	MemoryStats s;
+
+	s.current = c.current.load( std::memory_order_relaxed );
+	s.peak = c.peak.load( std::memory_order_relaxed );
+	s.allocations = c.allocations.load( std::memory_order_relaxed );
+	s.frees = c.frees.load( std::memory_order_relaxed );
+
+	for ( int i = 0; i < MEMORY_HISTOGRAM_BUCKETS; ++i ) {
+		s.histogram[ i ] = c.histogram[ i ].load( std::memory_order_relaxed );
+	}
+
+	return s;
+}
+
+size_t Current( MemoryKind kind ) {
+	return kindCurrent[ kind ].load( std::memory_order_relaxed );
+}
+
+size_t Peak( MemoryKind kind ) {
+	return kindPeak[ kind ].load( std::memory_order_relaxed );
+}
+
+void SetBudget( MemoryKind kind, MemoryTag tag, size_t bytes ) {
+	budgets[ kind ][ tag ] = bytes;
+}
+
+bool CheckBudgets( void ) {
+	bool ok = true;
+
+	for ( int k = 0; k < MEMORY_KIND_COUNT; ++k ) {
+		for ( int t = 0; t < MEMORY_TAG_COUNT; ++t ) {
+			size_t peak = counters[ k ][ t ].peak.load( std::memory_order_relaxed );
+
+			if ( budgets[ k ][ t ] > 0 && peak > budgets[ k ][ t ] ) {
+				fprintf( stderr, "Memory: %s %s peaked at %.1f KB, budget is %.1f KB\n",
+						 TAG_NAMES[ t ], KIND_NAMES[ k ], Kilobytes( peak ), Kilobytes( budgets[ k ][ t ] ) );
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+const char* TagName( MemoryTag tag ) {
+	return TAG_NAMES[ tag ];
+}
+
+const char* KindName( MemoryKind kind ) {
+	return KIND_NAMES[ kind ];
+}
+
+void Report( FILE* fp ) {
+	for ( int k = 0; k < MEMORY_KIND_COUNT; ++k ) {
+		MemoryKind kind = ( MemoryKind ) k;
+
+		fprintf( fp, "%s: %.1f KB current, %.1f KB peak\n", KIND_NAMES[ k ], Kilobytes( Current( kind ) ), Kilobytes( Peak( kind ) ) );
+		fprintf( fp, "  %-10s %12s %12s %10s %10s %10s %12s\n", "tag", "current KB", "peak KB", "allocs", "frees", "live", "budget KB" );
+
+		unsigned int histogram[ MEMORY_HISTOGRAM_BUCKETS ] = { 0 };
+
+		for ( int t = 0; t < MEMORY_TAG_COUNT; ++t ) {
+			MemoryStats s = Stats( kind, ( MemoryTag ) t );
+
+			for ( int i = 0; i < MEMORY_HISTOGRAM_BUCKETS; ++i ) {
+				histogram[ i ] += s.histogram[ i ];
+			}
+
+			if ( s.allocations == 0 ) {
+				continue;
+			}
+
+			char budget[ 32 ] = "-";
+
+			if ( budgets[ k ][ t ] > 0 ) {
+				sprintf( budget, "%.1f%s", Kilobytes( budgets[ k ][ t ] ), s.peak > budgets[ k ][ t ] ? " OVER" : "" );
+			}
+
+			fprintf( fp, "  %-10s %12.1f %12.1f %10u %10u %10u %12s\n",
+					 TAG_NAMES[ t ], Kilobytes( s.current ), Kilobytes( s.peak ),
+					 s.allocations, s.frees, s.allocations - s.frees, budget );
+		}
+
+		fprintf( fp, "  allocation sizes:\n" );
+
+		size_t limit = 16;
+
+		for ( int i = 0; i < MEMORY_HISTOGRAM_BUCKETS; ++i, limit <<= 1 ) {
+			if ( histogram[ i ] == 0 ) {
+				continue;
+			}
+
+			if ( i == MEMORY_HISTOGRAM_BUCKETS - 1 ) {
+				fprintf( fp, "    > %10lu B %10u\n", ( unsigned long ) ( limit >> 1 ), histogram[ i ] );
+			} else {
+				fprintf( fp, "   <= %10lu B %10u\n", ( unsigned long ) limit, histogram[ i ] );
+			}
+		}
+
+		fprintf( fp, "\n" );
+	}
+}
+
+bool Dump( const char* file ) {
+	FILE* fp = fopen( file, "w" );
+
+	if ( !fp ) {
+		fprintf( stderr, "Memory: Cannot write %s\n", file );
+		return false;
+	}
+
+	Report( fp );
+	fclose( fp );
+
+	return true;
+}
+
+}
+
+}
+
+/**
+	Global allocation functions. Everything the engine and the standard
+	library allocate is charged to the calling thread's MemoryScope.
+**/
+void* operator new( size_t bytes ) {
+	void* p = DS::Memory::Allocate( bytes, DS::Memory::CurrentTag() );
+
+	if ( !p ) {
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new[]( size_t bytes ) {
+	return operator new( bytes );
+}
+
+void* operator new( size_t bytes, const std::nothrow_t& ) throw() {
+	return DS::Memory::Allocate( bytes, DS::Memory::CurrentTag() );
+}
+
+void* operator new[]( size_t bytes, const std::nothrow_t& ) throw() {
+	return DS::Memory::Allocate( bytes, DS::Memory::CurrentTag() );
+}
+
+void operator delete( void* p ) throw() {
+	DS::Memory::Free( p );
+}
+
+void operator delete[]( void* p ) throw() {
+	DS::Memory::Free( p );
+}
+
+void operator delete( void* p, const std::nothrow_t& ) throw() {
+	DS::Memory::Free( p );
+}
+
+void operator delete[]( void* p, const std::nothrow_t& ) throw() {
+	DS::Memory::Free( p );
+}
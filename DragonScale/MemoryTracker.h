@@ -0,0 +1,110 @@
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <cstddef>
+#include <cstdio>
+
+namespace DS {
+
+enum MemoryTag {
+	MEMORY_GENERAL,
+	MEMORY_MESH,
+	MEMORY_SHADER,
+	MEMORY_TEXTURE,
+	MEMORY_BATCH,
+	MEMORY_CULLING,
+	MEMORY_PARTICLES,
+	MEMORY_PHYSICS,
+	MEMORY_STREAMING,
+	MEMORY_RAYTRACE,
+	MEMORY_ANIMATION,
+	MEMORY_AUDIO,
+	MEMORY_CAPTURE,
+	MEMORY_TERRAIN,
+	MEMORY_NAVIGATION,
+	MEMORY_TASKS,
+	MEMORY_LIGHTING,
+
+	MEMORY_TAG_COUNT
+};
+
+enum MemoryKind {
+	MEMORY_HEAP,
+	MEMORY_GL_BUFFER,
+	MEMORY_GL_TEXTURE,
+	MEMORY_GL_RENDERBUFFER,
+
+	MEMORY_KIND_COUNT
+};
+
+// Bucket 0 holds sizes up to 16 bytes, each next bucket doubles, the last
+// takes everything above 64MB.
+const int MEMORY_HISTOGRAM_BUCKETS = 24;
+
+struct MemoryStats {
+	size_t current;
+	size_t peak;
+	unsigned int allocations;
+	unsigned int frees;
+	unsigned int histogram[ MEMORY_HISTOGRAM_BUCKETS ];
+};
+
+/**
+	DS::MemoryScope - Tags the heap allocations of the current thread
+
+	Every operator new goes through Memory::Allocate and is charged to the
+	innermost scope on the calling thread, MEMORY_GENERAL outside of any.
+	Frees are charged back to the tag the block was allocated under, so
+	memory handed between subsystems is still accounted correctly.
+**/
+class MemoryScope {
+public:
+	explicit MemoryScope( MemoryTag tag );
+	~MemoryScope( void );
+
+private:
+	MemoryScope( const MemoryScope& );
+	MemoryScope& operator=( const MemoryScope& );
+
+	MemoryTag previous;
+};
+
+/**
+	DS::Memory - Per subsystem allocation statistics
+
+	Heap memory is tracked by a small header in front of every block, GL
+	memory by reporting the size of each buffer or texture name whenever its
+	storage is (re)specified and releasing it when the name is deleted.
+	Statistics are safe to read from any thread while others allocate.
+**/
+namespace Memory {
+
+	// 16 byte aligned, charged to tag.
+	void* Allocate( size_t bytes, MemoryTag tag );
+	void Free( void* p );
+
+	// Sets the size of a GL object, replacing what was reported before.
+	void TrackGL( MemoryKind kind, MemoryTag tag, unsigned int name, size_t bytes );
+	void ReleaseGL( MemoryKind kind, unsigned int name );
+
+	MemoryTag CurrentTag( void );
+
+	MemoryStats Stats( MemoryKind kind, MemoryTag tag );
+	size_t Current( MemoryKind kind );
+	size_t Peak( MemoryKind kind );
+
+	// Zero is no budget. Checked against the peak, not the current size.
+	void SetBudget( MemoryKind kind, MemoryTag tag, size_t bytes );
+	bool CheckBudgets( void );
+
+	const char* TagName( MemoryTag tag );
+	const char* KindName( MemoryKind kind );
+
+	void Report( FILE* fp );
+	bool Dump( const char* file );
+
+}
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#include "Mesh.h"
+
+#include <map>
+#include <cstring>
+
+#include "Vector3.h"
+
+namespace DS {
+
+namespace {
+
+	struct VertexKey {
+		float v[ 11 ];
+
+		bool operator<( const VertexKey& k ) const {
+			return memcmp( v, k.v, sizeof( v ) ) < 0;
+		}
+	};
+
+}
+
+unsigned int Mesh::VertexCount( void ) const {
+	return ( unsigned int ) positions.size() / 3;
+}
+
+unsigned int Mesh::TriangleCount( void ) const {
+	return ( unsigned int ) indices.size() / 3;
+}
+
+Mesh ImportTriangles( const float* positions, const float* colors, unsigned int vertexCount, const float* texCoords ) {
+	Mesh mesh;
+	std::map< VertexKey, unsigned int > welded;
+
+	mesh.indices.reserve( vertexCount );
+
+	for ( unsigned int i = 0; i < vertexCount; ++i ) {
+		const float* t = &positions[ ( i - i % 3 ) * 3 ];
+
+		Math::Vector3 e1( t[ 3 ] - t[ 0 ], t[ 4 ] - t[ 1 ], t[ 5 ] - t[ 2 ] );
+		Math::Vector3 e2( t[ 6 ] - t[ 0 ], t[ 7 ] - t[ 1 ], t[ 8 ] - t[ 2 ] );
+		Math::Vector3 n = Math::Cross( e1, e2 );
+
+		// Degenerate triangles still need something that encodes.
+		n = n.LengthSquared() > 0.0f ? Math::Normalize( n ) : Math::Vector3( 0.0f, 1.0f, 0.0f );
+
+		VertexKey key;
+		memcpy( &key.v[ 0 ], &positions[ i * 3 ], 3 * sizeof( float ) );
+		memcpy( &key.v[ 3 ], &colors[ i * 3 ], 3 * sizeof( float ) );
+		key.v[ 6 ] = n.x;
+		key.v[ 7 ] = n.y;
+		key.v[ 8 ] = n.z;
+		key.v[ 9 ] = texCoords ? texCoords[ i * 2 ] : 0.0f;
+		key.v[ 10 ] = texCoords ? texCoords[ i * 2 + 1 ] : 0.0f;
+
+		std::map< VertexKey, unsigned int >::iterator it = welded.find( key );
+
+		if ( it != welded.end() ) {
+			mesh.indices.push_back( it->second );
+			continue;
+		}
+
+		unsigned int index = mesh.VertexCount();
+		mesh.positions.insert( mesh.positions.end(), &key.v[ 0 ], &key.v[ 3 ] );
+		mesh.colors.insert( mesh.colors.end(), &key.v[ 3 ], &key.v[ 6 ] );
+		mesh.normals.insert( mesh.normals.end(), &key.v[ 6 ], &key.v[ 9 ] );
+
+		if ( texCoords ) {
+			mesh.texCoords.insert( mesh.texCoords.end(), &key.v[ 9 ], &key.v[ 11 ] );
+		}
+
+		mesh.indices.push_back( index );
+
+		welded[ key ] = index;
+	}
+
+	mesh.bounds = ComputeBounds( &mesh.positions[ 0 ], mesh.VertexCount() );
+
+	return mesh;
+}
+
+Math::BBox ComputeBounds( const float* positions, unsigned int vertexCount ) {
+	Math::BBox b;
+
+	for ( unsigned int i = 0; i < vertexCount; ++i ) {
+		b = Math::Union( b, Math::Point3( positions[ i * 3 ], positions[ i * 3 + 1 ], positions[ i * 3 + 2 ] ) );
+	}
+
+	return b;
+}
+
+}
@@ -0,0 +1,45 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+
+#include "BBox.h"
+
+namespace DS {
+
+/**
+	DS::Mesh - Indexed triangle mesh
+
+	Positions, colors and normals are tightly packed float triplets, one of
+	each per vertex, and texture coordinates float pairs. This is the import
+	format; PackVertices converts it to whatever VertexFormat goes to the
+	GPU. normals and texCoords may be empty.
+**/
+struct Mesh {
+	std::vector< float > positions;
+	std::vector< float > colors;
+	std::vector< float > normals;
+	std::vector< float > texCoords;
+	std::vector< unsigned int > indices;
+
+	Math::BBox bounds;
+
+	unsigned int VertexCount( void ) const;
+	unsigned int TriangleCount( void ) const;
+};
+
+/**
+	DS::ImportTriangles
+
+	Builds an indexed mesh from a non-indexed triangle list by welding
+	vertices whose position, color, face normal and texture coordinates
+	match exactly, so hard edges and UV seams keep their own vertices.
+	texCoords may be NULL.
+**/
+Mesh ImportTriangles( const float* positions, const float* colors, unsigned int vertexCount, const float* texCoords = NULL );
+
+Math::BBox ComputeBounds( const float* positions, unsigned int vertexCount );
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "NavGrid.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace DS {
+
+NavGrid::NavGrid( void )
+	: width( 0 ), depth( 0 ), cellSize( 1.0f ) {
+}
+
+NavGrid::~NavGrid( void ) {
+}
+
+void NavGrid::Init( int w, int d, float size, const Math::Point3& o ) {
+	MemoryScope scope( MEMORY_NAVIGATION );
+
+	width = w;
+	depth = d;
+	cellSize = size;
+	origin = o;
+
+	blocked.assign( ( size_t ) width * depth, 0 );
+}
+
+void NavGrid::Block( const Math::BBox& bounds ) {
+	if ( bounds.IsEmpty() ) {
+		return;
+	}
+
+	int x0 = std::max( 0, ( int ) floorf( ( bounds.pMin.x - origin.x ) / cellSize ) );
+	int z0 = std::max( 0, ( int ) floorf( ( bounds.pMin.z - origin.z ) / cellSize ) );
+	int x1 = std::min( width - 1, ( int ) floorf( ( bounds.pMax.x - origin.x ) / cellSize ) );
+	int z1 = std::min( depth - 1, ( int ) floorf( ( bounds.pMax.z - origin.z ) / cellSize ) );
+
+	for ( int z = z0; z <= z1; ++z ) {
+		for ( int x = x0; x <= x1; ++x ) {
+			blocked[ ( size_t ) z * width + x ] = 1;
+		}
+	}
+}
+
+void NavGrid::SetBlocked( int x, int z, bool b ) {
+	if ( x >= 0 && z >= 0 && x < width && z < depth ) {
+		blocked[ ( size_t ) z * width + x ] = b ? 1 : 0;
+	}
+}
+
+bool NavGrid::Walkable( int x, int z ) const {
+	return x >= 0 && z >= 0 && x < width && z < depth && !blocked[ ( size_t ) z * width + x ];
+}
+
+bool NavGrid::CellAt( const Math::Point3& p, int& x, int& z ) const {
+	x = ( int ) floorf( ( p.x - origin.x ) / cellSize );
+	z = ( int ) floorf( ( p.z - origin.z ) / cellSize );
+
+	return x >= 0 && z >= 0 && x < width && z < depth;
+}
+
+Math::Point3 NavGrid::CellCenter( int x, int z ) const {
+	return Math::Point3( origin.x + ( x + 0.5f ) * cellSize, origin.y, origin.z + ( z + 0.5f ) * cellSize );
+}
+
+int NavGrid::Width( void ) const {
+	return width;
+}
+
+int NavGrid::Depth( void ) const {
+	return depth;
+}
+
+float NavGrid::CellSize( void ) const {
+	return cellSize;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef NAVGRID_H
+#define NAVGRID_H
+
+#include <vector>
+
+#include "BBox.h"
+#include "Point3.h"
+
+namespace DS {
+
+/**
+	DS::NavGrid - Walkable cells on the XZ plane
+
+	Cell ( x, z ) covers origin + ( x, 0, z ) * cellSize up to the next
+	cell. Everything is walkable until blocked. Use Pathfinder::SetBlocked
+	once a Pathfinder has been built on the grid, so it can repair its
+	graph.
+**/
+class NavGrid {
+public:
+	NavGrid( void );
+	~NavGrid( void );
+
+	void Init( int width, int depth, float cellSize, const Math::Point3& origin );
+
+	// Blocks every cell the box covers in XZ.
+	void Block( const Math::BBox& bounds );
+	void SetBlocked( int x, int z, bool blocked );
+
+	// False outside the grid.
+	bool Walkable( int x, int z ) const;
+
+	// False when p is outside the grid.
+	bool CellAt( const Math::Point3& p, int& x, int& z ) const;
+	Math::Point3 CellCenter( int x, int z ) const;
+
+	int Width( void ) const;
+	int Depth( void ) const;
+	float CellSize( void ) const;
+
+private:
+	int width;
+	int depth;
+	float cellSize;
+	Math::Point3 origin;
+
+	std::vector< unsigned char > blocked;
+};
+
+}
+
+#endif
@@ -0,0 +1,392 @@
+#include "OcclusionCuller.h"
+#include "MemoryTracker.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include <xmmintrin.h>
+
+namespace DS {
+
+namespace {
+
+	// Tile width has to be a multiple of the SSE width.
+	const int TILE_WIDTH = 32;
+	const int TILE_HEIGHT = 16;
+
+	const float FAR_DEPTH = 1.0f;
+
+	// Homogeneous point times a matrix in upload layout ( row vector ).
+	void TransformPoint( const Math::Matrix4& m, float x, float y, float z, float out[ 4 ] ) {
+		for ( int j = 0; j < 4; ++j ) {
+			out[ j ] = x * m.c[ 0 ][ j ] + y * m.c[ 1 ][ j ] + z * m.c[ 2 ][ j ] + m.c[ 3 ][ j ];
+		}
+	}
+
+	// Distance to the GL near plane, z >= -w.
+	inline float NearDistance( const float v[ 4 ] ) {
+		return v[ 2 ] + v[ 3 ];
+	}
+
+}
+
+OcclusionCuller::OcclusionCuller( int w, int h ) {
+	// Round up so tiles cover the whole buffer exactly.
+	tilesX = ( w + TILE_WIDTH - 1 ) / TILE_WIDTH;
+	tilesY = ( h + TILE_HEIGHT - 1 ) / TILE_HEIGHT;
+	width = tilesX * TILE_WIDTH;
+	height = tilesY * TILE_HEIGHT;
+
+	MemoryScope scope( MEMORY_CULLING );
+
+	depth = ( float* ) Memory::Allocate( sizeof( float ) * width * height, MEMORY_CULLING );
+	bins.resize( tilesX * tilesY );
+
+	for ( int i = 0; i < width * height; ++i ) {
+		depth[ i ] = FAR_DEPTH;
+	}
+}
+
+OcclusionCuller::~OcclusionCuller( void ) {
+	Memory::Free( depth );
+}
+
+void OcclusionCuller::Begin( const Math::Matrix4& vp ) {
+	viewProjection = vp;
+	triangles.clear();
+
+	for ( size_t i = 0; i < bins.size(); ++i ) {
+		bins[ i ].clear();
+	}
+}
+
+void OcclusionCuller::AddOccluder( const float* positions,
+								   const unsigned int* indices, unsigned int indexCount,
+								   const Math::Matrix4& model ) {
+	MemoryScope scope( MEMORY_CULLING );
+	Math::Matrix4 mvp = Math::Multiply( model, viewProjection );
+
+	for ( unsigned int i = 0; i + 2 < indexCount; i += 3 ) {
+		float clip[ 3 ][ 4 ];
+
+		for ( int k = 0; k < 3; ++k ) {
+			const float* p = &positions[ indices[ i + k ] * 3 ];
+			TransformPoint( mvp, p[ 0 ], p[ 1 ], p[ 2 ], clip[ k ] );
+		}
+
+		int inside = 0;
+		for ( int k = 0; k < 3; ++k ) {
+			if ( NearDistance( clip[ k ] ) > 0.0f ) { ++inside; }
+		}
+
+		if ( inside == 3 ) {
+			BinTriangle( clip );
+			continue;
+		} else if ( inside == 0 ) {
+			continue;
+		}
+
+		// Sutherland-Hodgman against the near plane, at most a quad comes out.
+		float poly[ 4 ][ 4 ];
+		int count = 0;
+
+		for ( int k = 0; k < 3; ++k ) {
+			const float* a = clip[ k ];
+			const float* b = clip[ ( k + 1 ) % 3 ];
+			float da = NearDistance( a );
+			float db = NearDistance( b );
+
+			if ( da > 0.0f ) {
+				for ( int c = 0; c < 4; ++c ) { poly[ count ][ c ] = a[ c ]; }
+				++count;
+			}
+
+			if ( ( da > 0.0f ) != ( db > 0.0f ) ) {
+				float t = da / ( da - db );
+				for ( int c = 0; c < 4; ++c ) { poly[ count ][ c ] = a[ c ] + ( b[ c ] - a[ c ] ) * t; }
+				++count;
+			}
+		}
+
+		for ( int k = 1; k + 1 < count; ++k ) {
+			float tri[ 3 ][ 4 ];
+
+			for ( int c = 0; c < 4; ++c ) {
+				tri[ 0 ][ c ] = poly[ 0 ][ c ];
+				tri[ 1 ][ c ] = poly[ k ][ c ];
+				tri[ 2 ][ c ] = poly[ k + 1 ][ c ];
+			}
+
+			BinTriangle( tri );
+		}
+	}
+}
+
+void OcclusionCuller::BinTriangle( const float v[ 3 ][ 4 ] ) {
+	ScreenTriangle tri;
+
+	for ( int k = 0; k < 3; ++k ) {
+		float invW = 1.0f / v[ k ][ 3 ];
+
+		tri.x[ k ] = ( v[ k ][ 0 ] * invW * 0.5f + 0.5f ) * width;
+		tri.y[ k ] = ( v[ k ][ 1 ] * invW * 0.5f + 0.5f ) * height;
+		tri.z[ k ] = v[ k ][ 2 ] * invW;
+	}
+
+	// Occluders are drawn double sided; wind everything counter clockwise.
+	float area = ( tri.x[ 1 ] - tri.x[ 0 ] ) * ( tri.y[ 2 ] - tri.y[ 0 ] ) -
+				 ( tri.x[ 2 ] - tri.x[ 0 ] ) * ( tri.y[ 1 ] - tri.y[ 0 ] );
+
+	if ( fabsf( area ) < 1e-6f ) {
+		return;
+	}
+
+	if ( area < 0.0f ) {
+		std::swap( tri.x[ 1 ], tri.x[ 2 ] );
+		std::swap( tri.y[ 1 ], tri.y[ 2 ] );
+		std::swap( tri.z[ 1 ], tri.z[ 2 ] );
+	}
+
+	float minX = std::min( tri.x[ 0 ], std::min( tri.x[ 1 ], tri.x[ 2 ] ) );
+	float maxX = std::max( tri.x[ 0 ], std::max( tri.x[ 1 ], tri.x[ 2 ] ) );
+	float minY = std::min( tri.y[ 0 ], std::min( tri.y[ 1 ], tri.y[ 2 ] ) );
+	float maxY = std::max( tri.y[ 0 ], std::max( tri.y[ 1 ], tri.y[ 2 ] ) );
+
+	if ( maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height ) {
+		return;
+	}
+
+	int tx0 = ( int ) std::max( 0.0f, minX ) / TILE_WIDTH;
+	int tx1 = ( int ) std::min( ( float ) ( width - 1 ), maxX ) / TILE_WIDTH;
+	int ty0 = ( int ) std::max( 0.0f, minY ) / TILE_HEIGHT;
+	int ty1 = ( int ) std::min( ( float ) ( height - 1 ), maxY ) / TILE_HEIGHT;
+
+	unsigned int index = ( unsigned int ) triangles.size();
+	triangles.push_back( tri );
+
+	for ( int ty = ty0; ty <= ty1; ++ty ) {
+		for ( int tx = tx0; tx <= tx1; ++tx ) {
+			bins[ ty * tilesX + tx ].push_back( index );
+		}
+	}
+}
+
+int OcclusionCuller::TileCount( void ) const {
+	return tilesX * tilesY;
+}
+
+void OcclusionCuller::RasterizeTile( int tile ) {
+	int tileX0 = ( tile % tilesX ) * TILE_WIDTH;
+	int tileY0 = ( tile / tilesX ) * TILE_HEIGHT;
+	int tileX1 = tileX0 + TILE_WIDTH - 1;
+	int tileY1 = tileY0 + TILE_HEIGHT - 1;
+
+	// Clear.
+	__m128 far4 = _mm_set1_ps( FAR_DEPTH );
+	for ( int y = tileY0; y <= tileY1; ++y ) {
+		float* row = &depth[ y * width ];
+		for ( int x = tileX0; x <= tileX1; x += 4 ) {
+			_mm_store_ps( &row[ x ], far4 );
+		}
+	}
+
+	const __m128 pixelOffsets = _mm_set_ps( 3.5f, 2.5f, 1.5f, 0.5f );
+	const std::vector< unsigned int >& bin = bins[ tile ];
+
+	for ( size_t t = 0; t < bin.size(); ++t ) {
+		const ScreenTriangle& tri = triangles[ bin[ t ] ];
+
+		// Edge equations, positive inside.
+		float a[ 3 ], b[ 3 ], c[ 3 ];
+		for ( int k = 0; k < 3; ++k ) {
+			int n = ( k + 1 ) % 3;
+			a[ k ] = tri.y[ k ] - tri.y[ n ];
+			b[ k ] = tri.x[ n ] - tri.x[ k ];
+			c[ k ] = tri.x[ k ] * tri.y[ n ] - tri.x[ n ] * tri.y[ k ];
+		}
+
+		// Depth plane.
+		float x10 = tri.x[ 1 ] - tri.x[ 0 ], y10 = tri.y[ 1 ] - tri.y[ 0 ];
+		float x20 = tri.x[ 2 ] - tri.x[ 0 ], y20 = tri.y[ 2 ] - tri.y[ 0 ];
+		float z10 = tri.z[ 1 ] - tri.z[ 0 ], z20 = tri.z[ 2 ] - tri.z[ 0 ];
+		float invArea = 1.0f / ( x10 * y20 - x20 * y10 );
+		float dzdx = ( z10 * y20 - z20 * y10 ) * invArea;
+		float dzdy = ( z20 * x10 - z10 * x20 ) * invArea;
+		float z0 = tri.z[ 0 ] - dzdx * tri.x[ 0 ] - dzdy * tri.y[ 0 ];
+
+		float minX = std::min( tri.x[ 0 ], std::min( tri.x[ 1 ], tri.x[ 2 ] ) );
+		float maxX = std::max( tri.x[ 0 ], std::max( tri.x[ 1 ], tri.x[ 2 ] ) );
+		float minY = std::min( tri.y[ 0 ], std::min( tri.y[ 1 ], tri.y[ 2 ] ) );
+		float maxY = std::max( tri.y[ 0 ], std::max( tri.y[ 1 ], tri.y[ 2 ] ) );
+
+		// Clamp in float first, clipped triangles can land far off screen.
+		int x0 = ( int ) std::max( ( float ) tileX0, minX ) & ~3;
+		int x1 = ( int ) std::min( ( float ) tileX1, maxX );
+		int y0 = ( int ) std::max( ( float ) tileY0, minY );
+		int y1 = ( int ) std::min( ( float ) tileY1, maxY );
+
+		__m128 a0 = _mm_set1_ps( a[ 0 ] ), a1 = _mm_set1_ps( a[ 1 ] ), a2 = _mm_set1_ps( a[ 2 ] );
+		__m128 dzdx4 = _mm_set1_ps( dzdx );
+		__m128 zero = _mm_setzero_ps();
+
+		for ( int y = y0; y <= y1; ++y ) {
+			float py = y + 0.5f;
+			__m128 r0 = _mm_set1_ps( b[ 0 ] * py + c[ 0 ] );
+			__m128 r1 = _mm_set1_ps( b[ 1 ] * py + c[ 1 ] );
+			__m128 r2 = _mm_set1_ps( b[ 2 ] * py + c[ 2 ] );
+			__m128 rz = _mm_set1_ps( z0 + dzdy * py );
+			float* row = &depth[ y * width ];
+
+			for ( int x = x0; x <= x1; x += 4 ) {
+				__m128 px = _mm_add_ps( _mm_set1_ps( ( float ) x ), pixelOffsets );
+
+				__m128 e0 = _mm_add_ps( _mm_mul_ps( a0, px ), r0 );
+				__m128 e1 = _mm_add_ps( _mm_mul_ps( a1, px ), r1 );
+				__m128 e2 = _mm_add_ps( _mm_mul_ps( a2, px ), r2 );
+
+				__m128 mask = _mm_and_ps( _mm_and_ps( _mm_cmpgt_ps( e0, zero ),
+														_mm_cmpgt_ps( e1, zero ) ),
+											_mm_cmpgt_ps( e2, zero ) );
+
+				if ( _mm_movemask_ps( mask ) == 0 ) {
+					continue;
+				}
+
+				__m128 z = _mm_add_ps( _mm_mul_ps( dzdx4, px ), rz );
+				__m128 d = _mm_load_ps( &row[ x ] );
+				__m128 nearer = _mm_min_ps( d, z );
+
+				_mm_store_ps( &row[ x ], _mm_or_ps( _mm_and_ps( mask, nearer ), _mm_andnot_ps( mask, d ) ) );
+			}
+		}
+	}
+}
+
+void OcclusionCuller::Rasterize( void ) {
+	for ( int i = 0; i < TileCount(); ++i ) {
+		RasterizeTile( i );
+	}
+}
+
+void OcclusionCuller::BuildPyramid( void ) {
+	MemoryScope scope( MEMORY_CULLING );
+
+	pyramid.clear();
+
+	Level base;
+	base.width = width;
+	base.height = height;
+	base.minZ.assign( depth, depth + width * height );
+	base.maxZ = base.minZ;
+	pyramid.push_back( base );
+
+	while ( pyramid.back().width > 1 || pyramid.back().height > 1 ) {
+		const Level& src = pyramid.back();
+
+		Level dst;
+		dst.width = std::max( 1, ( src.width + 1 ) / 2 );
+		dst.height = std::max( 1, ( src.height + 1 ) / 2 );
+		dst.minZ.resize( dst.width * dst.height );
+		dst.maxZ.resize( dst.width * dst.height );
+
+		for ( int y = 0; y < dst.height; ++y ) {
+			for ( int x = 0; x < dst.width; ++x ) {
+				float lo = FLT_MAX;
+				float hi = -FLT_MAX;
+
+				for ( int sy = y * 2; sy <= std::min( y * 2 + 1, src.height - 1 ); ++sy ) {
+					for ( int sx = x * 2; sx <= std::min( x * 2 + 1, src.width - 1 ); ++sx ) {
+						lo = std::min( lo, src.minZ[ sy * src.width + sx ] );
+						hi = std::max( hi, src.maxZ[ sy * src.width + sx ] );
+					}
+				}
+
+				dst.minZ[ y * dst.width + x ] = lo;
+				dst.maxZ[ y * dst.width + x ] = hi;
+			}
+		}
+
+		pyramid.push_back( dst );
+	}
+}
+
+bool OcclusionCuller::IsVisible( const Math::BBox& bounds ) const {
+	if ( pyramid.empty() ) {
+		return true;
+	}
+
+	float minX = FLT_MAX, maxX = -FLT_MAX;
+	float minY = FLT_MAX, maxY = -FLT_MAX;
+	float minZ = FLT_MAX;
+
+	for ( int i = 0; i < 8; ++i ) {
+		float clip[ 4 ];
+		TransformPoint( viewProjection,
+						( i & 1 ) ? bounds.pMax.x : bounds.pMin.x,
+						( i & 2 ) ? bounds.pMax.y : bounds.pMin.y,
+						( i & 4 ) ? bounds.pMax.z : bounds.pMin.z,
+						clip );
+
+		if ( NearDistance( clip ) <= 0.0f ) {
+			return true;
+		}
+
+		float invW = 1.0f / clip[ 3 ];
+		float sx = ( clip[ 0 ] * invW * 0.5f + 0.5f ) * width;
+		float sy = ( clip[ 1 ] * invW * 0.5f + 0.5f ) * height;
+
+		minX = std::min( minX, sx ); maxX = std::max( maxX, sx );
+		minY = std::min( minY, sy ); maxY = std::max( maxY, sy );
+		minZ = std::min( minZ, clip[ 2 ] * invW );
+	}
+
+	if ( maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height ) {
+		return true;
+	}
+
+	// Nearer than every occluder.
+	if ( minZ <= pyramid.back().minZ[ 0 ] ) {
+		return true;
+	}
+
+	int x0 = ( int ) std::max( 0.0f, minX );
+	int x1 = ( int ) std::min( ( float ) ( width - 1 ), maxX );
+	int y0 = ( int ) std::max( 0.0f, minY );
+	int y1 = ( int ) std::min( ( float ) ( height - 1 ), maxY );
+
+	// Coarsest level where the rectangle spans at most 2x2 texels.
+	size_t level = 0;
+	while ( level + 1 < pyramid.size() && ( ( x1 >> level ) - ( x0 >> level ) > 1 || ( y1 >> level ) - ( y0 >> level ) > 1 ) ) {
+		++level;
+	}
+
+	const Level& l = pyramid[ level ];
+	int lx0 = x0 >> level, lx1 = std::min( x1 >> level, l.width - 1 );
+	int ly0 = y0 >> level, ly1 = std::min( y1 >> level, l.height - 1 );
+
+	for ( int y = ly0; y <= ly1; ++y ) {
+		for ( int x = lx0; x <= lx1; ++x ) {
+			// Some pixel here is further away than the box's nearest point.
+			if ( minZ <= l.maxZ[ y * l.width + x ] ) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+int OcclusionCuller::Width( void ) const {
+	return width;
+}
+
+int OcclusionCuller::Height( void ) const {
+	return height;
+}
+
+const float* OcclusionCuller::Depth( void ) const {
+	return depth;
+}
+
+}
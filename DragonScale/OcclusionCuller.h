@@ -0,0 +1,87 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <vector>
+
+#include "BBox.h"
+#include "Matrix4.h"
+
+namespace DS {
+
+/**
+	DS::OcclusionCuller - Software depth buffer occlusion culling
+
+	Occluder triangles are transformed with the same view/projection the GL
+	draws use, clipped to the near plane and binned into screen tiles. Each
+	tile is then rasterized 4 pixels at a time with SSE into a low resolution
+	depth buffer, and a min/max depth pyramid is built on top of it to test
+	object bounds against.
+
+	Tiles never share pixels, so RasterizeTile can be handed out to worker
+	threads; Rasterize just runs them all in order.
+
+	Matrices are in the layout they are uploaded in ( see main.cpp ), so the
+	view projection is Math::Multiply( view, projection ) and model is the
+	transposed model matrix.
+**/
+class OcclusionCuller {
+public:
+	OcclusionCuller( int width, int height );
+	~OcclusionCuller( void );
+
+	void Begin( const Math::Matrix4& viewProjection );
+
+	void AddOccluder( const float* positions,
+					  const unsigned int* indices, unsigned int indexCount,
+					  const Math::Matrix4& model );
+
+	int TileCount( void ) const;
+	void RasterizeTile( int tile );
+	void Rasterize( void );
+
+	void BuildPyramid( void );
+
+	/**
+		True unless the box is entirely behind occluder depth. Boxes that
+		cross the near plane or leave the screen are reported visible, this
+		only answers occlusion, not frustum containment.
+	**/
+	bool IsVisible( const Math::BBox& bounds ) const;
+
+	int Width( void ) const;
+	int Height( void ) const;
+	const float* Depth( void ) const;
+
+private:
+	struct ScreenTriangle {
+		float x[ 3 ];
+		float y[ 3 ];
+		float z[ 3 ];
+	};
+
+	struct Level {
+		int width;
+		int height;
+		std::vector< float > minZ;
+		std::vector< float > maxZ;
+	};
+
+	void BinTriangle( const float v[ 3 ][ 4 ] );
+
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+
+	float* depth;
+
+	Math::Matrix4 viewProjection;
+
+	std::vector< ScreenTriangle > triangles;
+	std::vector< std::vector< unsigned int > > bins;
+	std::vector< Level > pyramid;
+};
+
+}
+
+#endif
@@ -0,0 +1,293 @@
+#include "ParticleSystem.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+
+#include <xmmintrin.h>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+namespace DS {
+
+namespace {
+
+	// Attribute locations fixed by particle.vert.
+	const GLuint A_CORNER = 0;
+	const GLuint A_POSITION_SIZE = 1;
+	const GLuint A_COLOR = 2;
+
+	// x, y, z, size, r, g, b, a
+	const unsigned int INSTANCE_FLOATS = 8;
+
+}
+
+ParticleSystem::ParticleSystem( void )
+	: program( 0 ), vao( 0 ), cornerBuffer( 0 ), instanceBuffer( 0 ),
+	  count( 0 ), capacity( 0 ), gravity( 0.0f, -9.81f, 0.0f ), seed( 1 ) {
+}
+
+ParticleSystem::~ParticleSystem( void ) {
+}
+
+void ParticleSystem::Init( unsigned int prog, unsigned int maxParticles ) {
+	MemoryScope scope( MEMORY_PARTICLES );
+
+	program = prog;
+	capacity = maxParticles;
+	count = 0;
+
+	unsigned int padded = ( capacity + 3 ) & ~3;
+	std::vector< float >* arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &life, &invLife, &size, &cr, &cg, &cb, &ca };
+
+	for ( int i = 0; i < 13; ++i ) {
+		arrays[ i ]->assign( padded, 0.0f );
+	}
+
+	static const GLfloat corners[] = {
+		-1.0f, -1.0f,
+		 1.0f, -1.0f,
+		-1.0f,  1.0f,
+		 1.0f,  1.0f
+	};
+
+	glGenVertexArrays( 1, &vao );
+	glGenBuffers( 1, &cornerBuffer );
+	glGenBuffers( 1, &instanceBuffer );
+
+	GL::BindVertexArray( vao );
+
+	glEnableVertexAttribArray( A_CORNER );
+	GL::BindBuffer( GL_ARRAY_BUFFER, cornerBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( corners ), corners, GL_STATIC_DRAW );
+	glVertexAttribPointer( A_CORNER, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	GLsizei stride = sizeof( GLfloat ) * INSTANCE_FLOATS;
+
+	GL::BindBuffer( GL_ARRAY_BUFFER, instanceBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, stride * capacity, NULL, GL_STREAM_DRAW );
+
+	glEnableVertexAttribArray( A_POSITION_SIZE );
+	glVertexAttribPointer( A_POSITION_SIZE, 4, GL_FLOAT, GL_FALSE, stride, 0 );
+	glVertexAttribDivisor( A_POSITION_SIZE, 1 );
+
+	glEnableVertexAttribArray( A_COLOR );
+	glVertexAttribPointer( A_COLOR, 4, GL_FLOAT, GL_FALSE, stride, ( const GLvoid* ) ( sizeof( GLfloat ) * 4 ) );
+	glVertexAttribDivisor( A_COLOR, 1 );
+
+	GL::BindVertexArray( 0 );
+	GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_PARTICLES, cornerBuffer, sizeof( corners ) );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_PARTICLES, instanceBuffer, stride * capacity );
+}
+
+void ParticleSystem::Shutdown( void ) {
+	GLuint buffers[] = { cornerBuffer, instanceBuffer };
+
+	Memory::ReleaseGL( MEMORY_GL_BUFFER, cornerBuffer );
+	Memory::ReleaseGL( MEMORY_GL_BUFFER, instanceBuffer );
+
+	GL::DeleteBuffers( 2, buffers );
+	GL::DeleteVertexArrays( 1, &vao );
+
+	vao = cornerBuffer = instanceBuffer = 0;
+	count = 0;
+}
+
+unsigned int ParticleSystem::AddEmitter( const EmitterDesc& desc ) {
+	emitters.push_back( desc );
+	emitCarry.push_back( 0.0f );
+
+	return ( unsigned int ) emitters.size() - 1;
+}
+
+EmitterDesc& ParticleSystem::Emitter( unsigned int emitter ) {
+	return emitters[ emitter ];
+}
+
+void ParticleSystem::SetGravity( const Math::Vector3& g ) {
+	gravity = g;
+}
+
+unsigned int ParticleSystem::Count( void ) const {
+	return count;
+}
+
+unsigned int ParticleSystem::Capacity( void ) const {
+	return capacity;
+}
+
+float ParticleSystem::Random( void ) {
+	seed = seed * 1664525u + 1013904223u;
+
+	// Top 23 bits as a float in [ -1, 1 ).
+	return ( float ) ( seed >> 9 ) * ( 2.0f / 8388608.0f ) - 1.0f;
+}
+
+void ParticleSystem::Emit( const EmitterDesc& desc, unsigned int n ) {
+	n = std::min( n, capacity - count );
+
+	for ( unsigned int k = 0; k < n; ++k ) {
+		unsigned int i = count++;
+
+		px[ i ] = desc.origin.x;
+		py[ i ] = desc.origin.y;
+		pz[ i ] = desc.origin.z;
+		vx[ i ] = desc.velocity.x + desc.spread * Random();
+		vy[ i ] = desc.velocity.y + desc.spread * Random();
+		vz[ i ] = desc.velocity.z + desc.spread * Random();
+		life[ i ] = desc.life;
+		invLife[ i ] = 1.0f / desc.life;
+		size[ i ] = desc.size;
+		cr[ i ] = desc.color[ 0 ];
+		cg[ i ] = desc.color[ 1 ];
+		cb[ i ] = desc.color[ 2 ];
+		ca[ i ] = desc.color[ 3 ];
+	}
+}
+
+void ParticleSystem::Simulate( float dt ) {
+	const __m128 step = _mm_set1_ps( dt );
+	const __m128 gx = _mm_set1_ps( gravity.x * dt );
+	const __m128 gy = _mm_set1_ps( gravity.y * dt );
+	const __m128 gz = _mm_set1_ps( gravity.z * dt );
+
+	// Lanes past count are padding or dead, updating them is harmless.
+	for ( unsigned int i = 0; i < count; i += 4 ) {
+		__m128 x = _mm_add_ps( _mm_loadu_ps( &vx[ i ] ), gx );
+		__m128 y = _mm_add_ps( _mm_loadu_ps( &vy[ i ] ), gy );
+		__m128 z = _mm_add_ps( _mm_loadu_ps( &vz[ i ] ), gz );
+
+		_mm_storeu_ps( &vx[ i ], x );
+		_mm_storeu_ps( &vy[ i ], y );
+		_mm_storeu_ps( &vz[ i ], z );
+
+		_mm_storeu_ps( &px[ i ], _mm_add_ps( _mm_loadu_ps( &px[ i ] ), _mm_mul_ps( x, step ) ) );
+		_mm_storeu_ps( &py[ i ], _mm_add_ps( _mm_loadu_ps( &py[ i ] ), _mm_mul_ps( y, step ) ) );
+		_mm_storeu_ps( &pz[ i ], _mm_add_ps( _mm_loadu_ps( &pz[ i ] ), _mm_mul_ps( z, step ) ) );
+
+		_mm_storeu_ps( &life[ i ], _mm_sub_ps( _mm_loadu_ps( &life[ i ] ), step ) );
+	}
+}
+
+void ParticleSystem::Compact( void ) {
+	const __m128 zero = _mm_setzero_ps();
+	std::vector< float >* arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &life, &invLife, &size, &cr, &cg, &cb, &ca };
+
+	unsigned int i = 0;
+
+	while ( i < count ) {
+		// Skip whole groups of live particles.
+		if ( i + 4 <= count && _mm_movemask_ps( _mm_cmple_ps( _mm_loadu_ps( &life[ i ] ), zero ) ) == 0 ) {
+			i += 4;
+			continue;
+		}
+
+		if ( life[ i ] > 0.0f ) {
+			++i;
+			continue;
+		}
+
+		// Last particle fills the hole, then gets checked itself.
+		--count;
+
+		for ( int k = 0; k < 13; ++k ) {
+			( *arrays[ k ] )[ i ] = ( *arrays[ k ] )[ count ];
+		}
+	}
+}
+
+bool ParticleSystem::Update( float dt ) {
+	bool alive = count > 0;
+
+	Simulate( dt );
+	Compact();
+
+	for ( size_t i = 0; i < emitters.size(); ++i ) {
+		float owed = emitCarry[ i ] + emitters[ i ].rate * dt;
+		unsigned int n = ( unsigned int ) owed;
+
+		emitCarry[ i ] = owed - ( float ) n;
+		Emit( emitters[ i ], n );
+	}
+
+	return dt > 0.0f && ( alive || count > 0 );
+}
+
+void ParticleSystem::Render( void ) {
+	if ( count == 0 ) {
+		return;
+	}
+
+	GLsizeiptr bytes = sizeof( GLfloat ) * INSTANCE_FLOATS * count;
+
+	// Invalidating the whole buffer lets the driver hand back fresh storage
+	// instead of waiting on last frame's draw.
+	GL::BindBuffer( GL_ARRAY_BUFFER, instanceBuffer );
+	float* out = ( float* ) glMapBufferRange( GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+
+	if ( !out ) {
+		GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+		return;
+	}
+
+	unsigned int full = count & ~3;
+
+	// Four particles at a time, transposed from arrays to instances.
+	for ( unsigned int i = 0; i < full; i += 4 ) {
+		__m128 x = _mm_loadu_ps( &px[ i ] );
+		__m128 y = _mm_loadu_ps( &py[ i ] );
+		__m128 z = _mm_loadu_ps( &pz[ i ] );
+		__m128 s = _mm_loadu_ps( &size[ i ] );
+
+		__m128 r = _mm_loadu_ps( &cr[ i ] );
+		__m128 g = _mm_loadu_ps( &cg[ i ] );
+		__m128 b = _mm_loadu_ps( &cb[ i ] );
+		__m128 a = _mm_mul_ps( _mm_loadu_ps( &ca[ i ] ), _mm_mul_ps( _mm_loadu_ps( &life[ i ] ), _mm_loadu_ps( &invLife[ i ] ) ) );
+
+		_MM_TRANSPOSE4_PS( x, y, z, s );
+		_MM_TRANSPOSE4_PS( r, g, b, a );
+
+		float* dst = &out[ i * INSTANCE_FLOATS ];
+		_mm_storeu_ps( dst, x );
+		_mm_storeu_ps( dst + 4, r );
+		_mm_storeu_ps( dst + 8, y );
+		_mm_storeu_ps( dst + 12, g );
+		_mm_storeu_ps( dst + 16, z );
+		_mm_storeu_ps( dst + 20, b );
+		_mm_storeu_ps( dst + 24, s );
+		_mm_storeu_ps( dst + 28, a );
+	}
+
+	for ( unsigned int i = full; i < count; ++i ) {
+		float* dst = &out[ i * INSTANCE_FLOATS ];
+		dst[ 0 ] = px[ i ];
+		dst[ 1 ] = py[ i ];
+		dst[ 2 ] = pz[ i ];
+		dst[ 3 ] = size[ i ];
+		dst[ 4 ] = cr[ i ];
+		dst[ 5 ] = cg[ i ];
+		dst[ 6 ] = cb[ i ];
+		dst[ 7 ] = ca[ i ] * life[ i ] * invLife[ i ];
+	}
+
+	glUnmapBuffer( GL_ARRAY_BUFFER );
+	GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+	GL::CountUpload( bytes );
+
+	// Additive, order independent. Particles test depth but do not write it.
+	glEnable( GL_BLEND );
+	glBlendFunc( GL_SRC_ALPHA, GL_ONE );
+	glDepthMask( GL_FALSE );
+
+	GL::BindVertexArray( vao );
+	GL::DrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, count );
+	GL::BindVertexArray( 0 );
+
+	glDepthMask( GL_TRUE );
+	glDisable( GL_BLEND );
+}
+
+}
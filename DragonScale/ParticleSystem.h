@@ -0,0 +1,88 @@
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H
+
+#include <vector>
+
+#include "Point3.h"
+#include "Vector3.h"
+
+namespace DS {
+
+struct EmitterDesc {
+	Math::Point3 origin;
+	Math::Vector3 velocity;		// Mean launch velocity.
+	float spread;				// Random +- added to each velocity component.
+	float rate;					// Particles per second.
+	float life;					// Seconds.
+	float size;					// Quad half size in world units.
+	float color[ 4 ];			// Alpha fades to zero over the life.
+};
+
+/**
+	DS::ParticleSystem - CPU simulated, GPU instanced particles
+
+	Particles of every emitter share one fixed size pool of per-component
+	arrays, allocated once by Init. Update simulates four particles per SSE
+	instruction and compacts dead ones by moving the last live particle
+	into their slot, so the pool never allocates and the live particles
+	are always packed at the front.
+
+	Render streams the live particles into an orphaned buffer as one
+	instance each and draws them all as camera facing quads in one
+	instanced call. Blending is additive, so no sorting is needed.
+
+	Expects a program built from particle.vert / particle.frag to be
+	current when Init and Render run.
+**/
+class ParticleSystem {
+public:
+	ParticleSystem( void );
+	~ParticleSystem( void );
+
+	void Init( unsigned int program, unsigned int maxParticles );
+	void Shutdown( void );
+
+	unsigned int AddEmitter( const EmitterDesc& desc );
+	EmitterDesc& Emitter( unsigned int emitter );
+
+	// Whether any particle was alive before or after, i.e. anything moved.
+	bool Update( float dt );
+	void Render( void );
+
+	void SetGravity( const Math::Vector3& g );
+
+	unsigned int Count( void ) const;
+	unsigned int Capacity( void ) const;
+
+private:
+	void Emit( const EmitterDesc& desc, unsigned int n );
+	void Simulate( float dt );
+	void Compact( void );
+	float Random( void );
+
+	unsigned int program;
+	unsigned int vao;
+	unsigned int cornerBuffer;
+	unsigned int instanceBuffer;
+
+	unsigned int count;
+	unsigned int capacity;
+
+	// Padded to a multiple of four.
+	std::vector< float > px, py, pz;
+	std::vector< float > vx, vy, vz;
+	std::vector< float > life;
+	std::vector< float > invLife;
+	std::vector< float > size;
+	std::vector< float > cr, cg, cb, ca;
+
+	std::vector< EmitterDesc > emitters;
+	std::vector< float > emitCarry;		// Fractional particles owed per emitter.
+
+	Math::Vector3 gravity;
+	unsigned int seed;
+};
+
+}
+
+#endif
@@ -0,0 +1,789 @@
+#include "Pathfinder.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace DS {
+
+namespace {
+
+	// Runs of open border cells at least this long get an entrance at each end.
+	const int ENTRANCE_SPLIT = 6;
+
+	// Missed queries per job.
+	const int PATH_GRAIN = 8;
+
+	const float DIAGONAL = 1.41421356f;
+	const float UNREACHED = 1e30f;
+
+	const int STEP_X[ 8 ] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	const int STEP_Z[ 8 ] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	typedef std::pair< float, int > OpenEntry;
+
+	void PushOpen( std::vector< OpenEntry >& open, float f, int id ) {
+		open.push_back( OpenEntry( f, id ) );
+		std::push_heap( open.begin(), open.end(), std::greater< OpenEntry >() );
+	}
+
+	OpenEntry PopOpen( std::vector< OpenEntry >& open ) {
+		std::pop_heap( open.begin(), open.end(), std::greater< OpenEntry >() );
+		OpenEntry top = open.back();
+		open.pop_back();
+		return top;
+	}
+
+}
+
+Path::Path( void )
+	: found( false ), cost( 0.0f ) {
+}
+
+Pathfinder::Pathfinder( void )
+	: grid( NULL ), clusterSize( 1 ), clustersX( 0 ), clustersZ( 0 ), anyDirty( false ),
+	  cacheSize( 0 ), hits( 0 ), misses( 0 ) {
+}
+
+Pathfinder::~Pathfinder( void ) {
+}
+
+void Pathfinder::Init( NavGrid* g, int size, unsigned int cache ) {
+	MemoryScope scope( MEMORY_NAVIGATION );
+
+	grid = g;
+	clusterSize = size;
+	cacheSize = cache;
+
+	clustersX = ( grid->Width() + clusterSize - 1 ) / clusterSize;
+	clustersZ = ( grid->Depth() + clusterSize - 1 ) / clusterSize;
+
+	size_t count = ( size_t ) clustersX * clustersZ;
+
+	nodes.clear();
+	clusterNodes.assign( count, std::vector< int >() );
+	bordersX.assign( count, std::vector< Entrance >() );
+	bordersZ.assign( count, std::vector< Entrance >() );
+	versions.assign( count, 0 );
+
+	// Building from scratch is a repair of every cluster.
+	dirty.assign( count, 1 );
+	anyDirty = true;
+
+	Repair();
+}
+
+void Pathfinder::Shutdown( void ) {
+	nodes.clear();
+	clusterNodes.clear();
+	bordersX.clear();
+	bordersZ.clear();
+	versions.clear();
+	dirty.clear();
+
+	cache.clear();
+	cacheIndex.clear();
+}
+
+void Pathfinder::SetBlocked( int x, int z, bool blocked ) {
+	if ( x < 0 || z < 0 || x >= grid->Width() || z >= grid->Depth() || grid->Walkable( x, z ) != blocked ) {
+		return;
+	}
+
+	grid->SetBlocked( x, z, blocked );
+
+	dirty[ ClusterOf( z * grid->Width() + x ) ] = 1;
+	anyDirty = true;
+}
+
+void Pathfinder::Repair( void ) {
+	if ( !anyDirty ) {
+		return;
+	}
+
+	MemoryScope scope( MEMORY_NAVIGATION );
+
+	int count = clustersX * clustersZ;
+	std::vector< unsigned char > affected( count, 0 );
+
+	// Entrances on the borders of a dirty cluster may have moved, which
+	// changes the nodes on both sides.
+	for ( int c = 0; c < count; ++c ) {
+		if ( !dirty[ c ] ) {
+			continue;
+		}
+
+		int cx = c % clustersX;
+		int cz = c / clustersX;
+
+		affected[ c ] = 1;
+
+		if ( cx + 1 < clustersX ) {
+			BuildBorder( bordersX[ c ], c, true );
+			affected[ c + 1 ] = 1;
+		}
+
+		if ( cx > 0 ) {
+			BuildBorder( bordersX[ c - 1 ], c - 1, true );
+			affected[ c - 1 ] = 1;
+		}
+
+		if ( cz + 1 < clustersZ ) {
+			BuildBorder( bordersZ[ c ], c, false );
+			affected[ c + clustersX ] = 1;
+		}
+
+		if ( cz > 0 ) {
+			BuildBorder( bordersZ[ c - clustersX ], c - clustersX, false );
+			affected[ c - clustersX ] = 1;
+		}
+	}
+
+	for ( int c = 0; c < count; ++c ) {
+		if ( affected[ c ] ) {
+			for ( size_t i = 0; i < clusterNodes[ c ].size(); ++i ) {
+				nodes.erase( clusterNodes[ c ][ i ] );
+			}
+
+			clusterNodes[ c ].clear();
+		}
+	}
+
+	// Recreate the nodes of affected clusters with their edges across the
+	// borders. Unaffected neighbours keep theirs, the entrances between
+	// them did not change.
+	for ( int c = 0; c < count; ++c ) {
+		if ( !affected[ c ] ) {
+			continue;
+		}
+
+		for ( int side = 0; side < 4; ++side ) {
+			bool vertical;
+			int border = BorderIndex( c, side, vertical );
+
+			if ( border < 0 ) {
+				continue;
+			}
+
+			const std::vector< Entrance >& entrances = vertical ? bordersX[ border ] : bordersZ[ border ];
+
+			for ( size_t i = 0; i < entrances.size(); ++i ) {
+				int mine = border == c ? entrances[ i ].a : entrances[ i ].b;
+				int other = border == c ? entrances[ i ].b : entrances[ i ].a;
+
+				std::unordered_map< int, Node >::iterator it = nodes.find( mine );
+
+				if ( it == nodes.end() ) {
+					it = nodes.insert( std::make_pair( mine, Node() ) ).first;
+					it->second.cluster = c;
+					clusterNodes[ c ].push_back( mine );
+				}
+
+				Edge edge;
+				edge.to = other;
+				edge.cost = 1.0f;
+				it->second.edges.push_back( edge );
+			}
+		}
+	}
+
+	for ( int c = 0; c < count; ++c ) {
+		if ( affected[ c ] ) {
+			BuildEdges( c, scratch );
+		}
+
+		if ( dirty[ c ] ) {
+			++versions[ c ];
+			dirty[ c ] = 0;
+		}
+	}
+
+	anyDirty = false;
+}
+
+int Pathfinder::ClusterOf( int cell ) const {
+	int x = cell % grid->Width();
+	int z = cell / grid->Width();
+
+	return ( z / clusterSize ) * clustersX + x / clusterSize;
+}
+
+void Pathfinder::ClusterRect( int cluster, int& x0, int& z0, int& x1, int& z1 ) const {
+	x0 = ( cluster % clustersX ) * clusterSize;
+	z0 = ( cluster / clustersX ) * clusterSize;
+	x1 = std::min( x0 + clusterSize, grid->Width() ) - 1;
+	z1 = std::min( z0 + clusterSize, grid->Depth() ) - 1;
+}
+
+/*
+	Sides are +X, -X, +Z, -Z. Borders are stored with the cluster on their
+	-X or -Z side, so for the first two sides that is this cluster.
+*/
+int Pathfinder::BorderIndex( int cluster, int side, bool& vertical ) const {
+	int cx = cluster % clustersX;
+	int cz = cluster / clustersX;
+
+	vertical = side < 2;
+
+	switch ( side ) {
+		case 0: return cx + 1 < clustersX ? cluster : -1;
+		case 1: return cx > 0 ? cluster - 1 : -1;
+		case 2: return cz + 1 < clustersZ ? cluster : -1;
+		default: return cz > 0 ? cluster - clustersX : -1;
+	}
+}
+
+/*
+	Entrances between cluster and its neighbour at +X ( vertical ) or +Z.
+*/
+void Pathfinder::BuildBorder( std::vector< Entrance >& entrances, int cluster, bool vertical ) {
+	int x0, z0, x1, z1;
+	ClusterRect( cluster, x0, z0, x1, z1 );
+
+	int width = grid->Width();
+	int length = vertical ? z1 - z0 + 1 : x1 - x0 + 1;
+
+	entrances.clear();
+
+	int run = -1;
+
+	for ( int i = 0; i <= length; ++i ) {
+		int ax = vertical ? x1 : x0 + i;
+		int az = vertical ? z0 + i : z1;
+		int bx = vertical ? x1 + 1 : ax;
+		int bz = vertical ? az : z1 + 1;
+
+		bool open = i < length && grid->Walkable( ax, az ) && grid->Walkable( bx, bz );
+
+		if ( open && run < 0 ) {
+			run = i;
+		}
+
+		if ( open || run < 0 ) {
+			continue;
+		}
+
+		// The run ended at i - 1.
+		int picks[ 2 ] = { ( run + i - 1 ) / 2, -1 };
+
+		if ( i - run >= ENTRANCE_SPLIT ) {
+			picks[ 0 ] = run;
+			picks[ 1 ] = i - 1;
+		}
+
+		for ( int p = 0; p < 2 && picks[ p ] >= 0; ++p ) {
+			Entrance e;
+
+			if ( vertical ) {
+				e.a = ( z0 + picks[ p ] ) * width + x1;
+				e.b = e.a + 1;
+			} else {
+				e.a = z1 * width + x0 + picks[ p ];
+				e.b = e.a + width;
+			}
+
+			entrances.push_back( e );
+		}
+
+		run = -1;
+	}
+}
+
+/*
+	Shortest paths inside the cluster between every pair of its nodes.
+*/
+void Pathfinder::BuildEdges( int cluster, Scratch& s ) {
+	int x0, z0, x1, z1;
+	ClusterRect( cluster, x0, z0, x1, z1 );
+
+	int w = x1 - x0 + 1;
+	int width = grid->Width();
+
+	const std::vector< int >& members = clusterNodes[ cluster ];
+
+	for ( size_t i = 0; i < members.size(); ++i ) {
+		SearchCluster( cluster, members[ i ], s.startCost, s.startParent, s.open );
+
+		Node& node = nodes[ members[ i ] ];
+
+		for ( size_t j = 0; j < members.size(); ++j ) {
+			int to = members[ j ];
+			int local = ( to / width - z0 ) * w + to % width - x0;
+
+			if ( j == i || s.startCost[ local ] >= UNREACHED ) {
+				continue;
+			}
+
+			Edge edge;
+			edge.to = to;
+			edge.cost = s.startCost[ local ];
+
+			for ( int l = local; s.startParent[ l ] >= 0; l = s.startParent[ l ] ) {
+				edge.cells.push_back( ( z0 + l / w ) * width + x0 + l % w );
+			}
+
+			std::reverse( edge.cells.begin(), edge.cells.end() );
+			node.edges.push_back( edge );
+		}
+	}
+}
+
+void Pathfinder::SearchCluster( int cluster, int source, std::vector< float >& cost, std::vector< int >& parent, std::vector< OpenEntry >& open ) const {
+	int x0, z0, x1, z1;
+	ClusterRect( cluster, x0, z0, x1, z1 );
+
+	SearchRect( x0, z0, x1, z1, source, cost, parent, open );
+}
+
+/*
+	Dijkstra from source over the cells of a rectangle. cost and parent are
+	indexed by the cell's position in it, parent is -1 at source.
+*/
+void Pathfinder::SearchRect( int x0, int z0, int x1, int z1, int source, std::vector< float >& cost, std::vector< int >& parent, std::vector< OpenEntry >& open ) const {
+	int w = x1 - x0 + 1;
+	int h = z1 - z0 + 1;
+	int width = grid->Width();
+
+	cost.assign( w * h, UNREACHED );
+	parent.assign( w * h, -1 );
+	open.clear();
+
+	int start = ( source / width - z0 ) * w + source % width - x0;
+	cost[ start ] = 0.0f;
+	PushOpen( open, 0.0f, start );
+
+	while ( !open.empty() ) {
+		OpenEntry top = PopOpen( open );
+		int l = top.second;
+
+		if ( top.first > cost[ l ] ) {
+			continue;
+		}
+
+		int lx = l % w;
+		int lz = l / w;
+
+		for ( int d = 0; d < 8; ++d ) {
+			int nx = lx + STEP_X[ d ];
+			int nz = lz + STEP_Z[ d ];
+
+			if ( nx < 0 || nz < 0 || nx >= w || nz >= h || !grid->Walkable( x0 + nx, z0 + nz ) ) {
+				continue;
+			}
+
+			// No cutting corners past blocked cells.
+			if ( d >= 4 && ( !grid->Walkable( x0 + nx, z0 + lz ) || !grid->Walkable( x0 + lx, z0 + nz ) ) ) {
+				continue;
+			}
+
+			int n = nz * w + nx;
+			float c = top.first + ( d >= 4 ? DIAGONAL : 1.0f );
+
+			if ( c < cost[ n ] ) {
+				cost[ n ] = c;
+				parent[ n ] = l;
+				PushOpen( open, c, n );
+			}
+		}
+	}
+}
+
+bool Pathfinder::Search( int start, int goal, Scratch& s, Path& path ) const {
+	int width = grid->Width();
+	int startCluster = ClusterOf( start );
+	int goalCluster = ClusterOf( goal );
+
+	int sx0, sz0, sx1, sz1;
+	int gx0, gz0, gx1, gz1;
+	ClusterRect( startCluster, sx0, sz0, sx1, sz1 );
+	ClusterRect( goalCluster, gx0, gz0, gx1, gz1 );
+
+	int sw = sx1 - sx0 + 1;
+	int gw = gx1 - gx0 + 1;
+	int gx = goal % width;
+	int gz = goal / width;
+
+	SearchCluster( startCluster, start, s.startCost, s.startParent, s.open );
+	SearchCluster( goalCluster, goal, s.goalCost, s.goalParent, s.open );
+
+	// Close by, a search over both clusters may beat any route through
+	// the entrances, which can lie well off the straight line.
+	float best = UNREACHED;
+	int wx0 = std::min( sx0, gx0 );
+	int wz0 = std::min( sz0, gz0 );
+	int wx1 = std::max( sx1, gx1 );
+	int wz1 = std::max( sz1, gz1 );
+	int ww = wx1 - wx0 + 1;
+	bool near = wx1 - wx0 < 2 * clusterSize && wz1 - wz0 < 2 * clusterSize;
+
+	if ( startCluster == goalCluster ) {
+		best = s.startCost[ ( gz - sz0 ) * sw + gx - sx0 ];
+	} else if ( near ) {
+		SearchRect( wx0, wz0, wx1, wz1, start, s.windowCost, s.windowParent, s.open );
+		best = s.windowCost[ ( gz - wz0 ) * ww + gx - wx0 ];
+	}
+
+	// Octile distance, never more than the real cost.
+	auto heuristic = [ width, gx, gz ]( int cell ) {
+		float dx = fabsf( ( float ) ( cell % width - gx ) );
+		float dz = fabsf( ( float ) ( cell / width - gz ) );
+		return std::max( dx, dz ) + ( DIAGONAL - 1.0f ) * std::min( dx, dz );
+	};
+
+	s.cost.clear();
+	s.parent.clear();
+	s.open.clear();
+
+	const std::vector< int >& startNodes = clusterNodes[ startCluster ];
+
+	for ( size_t i = 0; i < startNodes.size(); ++i ) {
+		int n = startNodes[ i ];
+		float c = s.startCost[ ( n / width - sz0 ) * sw + n % width - sx0 ];
+
+		if ( c < UNREACHED ) {
+			s.cost[ n ] = c;
+			s.parent[ n ] = -1;
+			PushOpen( s.open, c + heuristic( n ), n );
+		}
+	}
+
+	int via = -1;
+
+	while ( !s.open.empty() ) {
+		OpenEntry top = PopOpen( s.open );
+		int n = top.second;
+
+		if ( top.first >= best ) {
+			break;
+		}
+
+		float g = s.cost[ n ];
+
+		if ( top.first > g + heuristic( n ) + 1e-3f ) {
+			continue;
+		}
+
+		const Node& node = nodes.find( n )->second;
+
+		if ( node.cluster == goalCluster ) {
+			float c = g + s.goalCost[ ( n / width - gz0 ) * gw + n % width - gx0 ];
+
+			if ( c < best ) {
+				best = c;
+				via = n;
+			}
+		}
+
+		for ( size_t i = 0; i < node.edges.size(); ++i ) {
+			const Edge& e = node.edges[ i ];
+			float c = g + e.cost;
+
+			std::unordered_map< int, float >::iterator it = s.cost.find( e.to );
+
+			if ( it == s.cost.end() || c < it->second ) {
+				s.cost[ e.to ] = c;
+				s.parent[ e.to ] = n;
+				PushOpen( s.open, c + heuristic( e.to ), e.to );
+			}
+		}
+	}
+
+	if ( best >= UNREACHED ) {
+		path = Path();
+		return false;
+	}
+
+	std::vector< int > cells;
+
+	if ( via < 0 && startCluster == goalCluster ) {
+		for ( int l = ( gz - sz0 ) * sw + gx - sx0; l >= 0; l = s.startParent[ l ] ) {
+			cells.push_back( ( sz0 + l / sw ) * width + sx0 + l % sw );
+		}
+
+		std::reverse( cells.begin(), cells.end() );
+	} else if ( via < 0 ) {
+		for ( int l = ( gz - wz0 ) * ww + gx - wx0; l >= 0; l = s.windowParent[ l ] ) {
+			cells.push_back( ( wz0 + l / ww ) * width + wx0 + l % ww );
+		}
+
+		std::reverse( cells.begin(), cells.end() );
+	} else {
+		std::vector< int > chain;
+
+		for ( int n = via; n >= 0; n = s.parent[ n ] ) {
+			chain.push_back( n );
+		}
+
+		std::reverse( chain.begin(), chain.end() );
+
+		// Start to the first node.
+		for ( int l = ( chain[ 0 ] / width - sz0 ) * sw + chain[ 0 ] % width - sx0; l >= 0; l = s.startParent[ l ] ) {
+			cells.push_back( ( sz0 + l / sw ) * width + sx0 + l % sw );
+		}
+
+		std::reverse( cells.begin(), cells.end() );
+
+		// Stored edge cells between nodes.
+		for ( size_t i = 1; i < chain.size(); ++i ) {
+			const Node& node = nodes.find( chain[ i - 1 ] )->second;
+			const Edge* edge = NULL;
+
+			for ( size_t j = 0; j < node.edges.size(); ++j ) {
+				if ( node.edges[ j ].to == chain[ i ] && ( !edge || node.edges[ j ].cost < edge->cost ) ) {
+					edge = &node.edges[ j ];
+				}
+			}
+
+			if ( edge->cells.empty() ) {
+				cells.push_back( chain[ i ] );
+			} else {
+				cells.insert( cells.end(), edge->cells.begin(), edge->cells.end() );
+			}
+		}
+
+		// The goal search ran outwards from the goal, so its parents lead there.
+		for ( int l = s.goalParent[ ( via / width - gz0 ) * gw + via % width - gx0 ]; l >= 0; l = s.goalParent[ l ] ) {
+			cells.push_back( ( gz0 + l / gw ) * width + gx0 + l % gw );
+		}
+	}
+
+	Finish( cells, path );
+	path.cost = best;
+	return true;
+}
+
+/*
+	Keeps the cells where the direction changes and stamps the clusters.
+*/
+void Pathfinder::Finish( const std::vector< int >& cells, Path& path ) const {
+	int width = grid->Width();
+
+	path.found = true;
+	path.waypoints.clear();
+	path.clusters.clear();
+
+	for ( size_t i = 0; i < cells.size(); ++i ) {
+		int x = cells[ i ] % width;
+		int z = cells[ i ] / width;
+
+		if ( i > 0 && i + 1 < cells.size() ) {
+			int inX = x - cells[ i - 1 ] % width;
+			int inZ = z - cells[ i - 1 ] / width;
+			int outX = cells[ i + 1 ] % width - x;
+			int outZ = cells[ i + 1 ] / width - z;
+
+			if ( inX == outX && inZ == outZ ) {
+				continue;
+			}
+		}
+
+		path.waypoints.push_back( grid->CellCenter( x, z ) );
+	}
+
+	for ( size_t i = 0; i < cells.size(); ++i ) {
+		int c = ClusterOf( cells[ i ] );
+
+		if ( path.clusters.empty() || path.clusters.back().first != c ) {
+			path.clusters.push_back( std::make_pair( c, versions[ c ] ) );
+		}
+	}
+}
+
+bool Pathfinder::FindPath( const Math::Point3& start, const Math::Point3& goal, Path& path ) {
+	MemoryScope scope( MEMORY_NAVIGATION );
+
+	Repair();
+
+	PathRequest request;
+	request.start = start;
+	request.goal = goal;
+
+	CacheKey key;
+	int startCell, goalCell;
+
+	if ( !Key( request, key, startCell, goalCell ) ) {
+		path = Path();
+		return false;
+	}
+
+	if ( Lookup( key, path ) ) {
+		return true;
+	}
+
+	if ( !Search( startCell, goalCell, scratch, path ) ) {
+		return false;
+	}
+
+	Store( key, path );
+	return true;
+}
+
+void Pathfinder::FindPaths( const PathRequest* requests, unsigned int count, Path* paths, JobSystem& jobs ) {
+	MemoryScope scope( MEMORY_NAVIGATION );
+
+	Repair();
+
+	struct Work {
+		unsigned int request;
+		CacheKey key;
+		int start;
+		int goal;
+	};
+
+	std::vector< Work > work;
+	std::vector< std::pair< unsigned int, unsigned int > > repeats;	// Request, work item.
+	std::unordered_map< CacheKey, unsigned int > queued;
+
+	// The cache is only touched here, never from the jobs.
+	for ( unsigned int i = 0; i < count; ++i ) {
+		Work w;
+		w.request = i;
+
+		if ( !Key( requests[ i ], w.key, w.start, w.goal ) ) {
+			paths[ i ] = Path();
+			continue;
+		}
+
+		std::unordered_map< CacheKey, unsigned int >::iterator it = queued.find( w.key );
+
+		if ( it != queued.end() ) {
+			repeats.push_back( std::make_pair( i, it->second ) );
+			++hits;
+			continue;
+		}
+
+		if ( Lookup( w.key, paths[ i ] ) ) {
+			continue;
+		}
+
+		queued[ w.key ] = ( unsigned int ) work.size();
+		work.push_back( w );
+	}
+
+	jobs.ParallelFor( ( int ) work.size(), PATH_GRAIN, [ this, &work, paths ]( int begin, int end ) {
+		MemoryScope scope( MEMORY_NAVIGATION );
+		Scratch local;
+
+		for ( int i = begin; i < end; ++i ) {
+			Search( work[ i ].start, work[ i ].goal, local, paths[ work[ i ].request ] );
+		}
+	} );
+
+	for ( size_t i = 0; i < work.size(); ++i ) {
+		const Path& path = paths[ work[ i ].request ];
+
+		if ( path.found ) {
+			Store( work[ i ].key, path );
+		}
+	}
+
+	for ( size_t i = 0; i < repeats.size(); ++i ) {
+		paths[ repeats[ i ].first ] = paths[ work[ repeats[ i ].second ].request ];
+	}
+}
+
+bool Pathfinder::Valid( const Path& path ) const {
+	if ( !path.found ) {
+		return false;
+	}
+
+	for ( size_t i = 0; i < path.clusters.size(); ++i ) {
+		if ( dirty[ path.clusters[ i ].first ] || versions[ path.clusters[ i ].first ] != path.clusters[ i ].second ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Pathfinder::Key( const PathRequest& request, CacheKey& key, int& start, int& goal ) const {
+	int sx, sz, gx, gz;
+
+	if ( !grid->CellAt( request.start, sx, sz ) || !grid->CellAt( request.goal, gx, gz ) ||
+		 !grid->Walkable( sx, sz ) || !grid->Walkable( gx, gz ) ) {
+		return false;
+	}
+
+	start = sz * grid->Width() + sx;
+	goal = gz * grid->Width() + gx;
+	key = ( ( CacheKey ) start << 32 ) | ( unsigned int ) goal;
+
+	return true;
+}
+
+/*
+	Failed searches are never stored: an unreachable goal can open up
+	without any cluster on the way changing.
+*/
+bool Pathfinder::Lookup( CacheKey key, Path& path ) {
+	std::unordered_map< CacheKey, std::list< CacheEntry >::iterator >::iterator it = cacheIndex.find( key );
+
+	if ( it == cacheIndex.end() ) {
+		++misses;
+		return false;
+	}
+
+	if ( !Valid( it->second->path ) ) {
+		cache.erase( it->second );
+		cacheIndex.erase( it );
+		++misses;
+		return false;
+	}
+
+	cache.splice( cache.begin(), cache, it->second );
+	path = cache.front().path;
+	++hits;
+
+	return true;
+}
+
+void Pathfinder::Store( CacheKey key, const Path& path ) {
+	if ( cacheSize == 0 ) {
+		return;
+	}
+
+	std::unordered_map< CacheKey, std::list< CacheEntry >::iterator >::iterator it = cacheIndex.find( key );
+
+	if ( it != cacheIndex.end() ) {
+		it->second->path = path;
+		cache.splice( cache.begin(), cache, it->second );
+		return;
+	}
+
+	CacheEntry entry;
+	entry.key = key;
+	entry.path = path;
+
+	cache.push_front( entry );
+	cacheIndex[ key ] = cache.begin();
+
+	if ( cache.size() > cacheSize ) {
+		cacheIndex.erase( cache.back().key );
+		cache.pop_back();
+	}
+}
+
+unsigned int Pathfinder::NodeCount( void ) const {
+	return ( unsigned int ) nodes.size();
+}
+
+unsigned int Pathfinder::EdgeCount( void ) const {
+	unsigned int count = 0;
+
+	for ( std::unordered_map< int, Node >::const_iterator it = nodes.begin(); it != nodes.end(); ++it ) {
+		count += ( unsigned int ) it->second.edges.size();
+	}
+
+	return count;
+}
+
+unsigned int Pathfinder::CacheHits( void ) const {
+	return hits;
+}
+
+unsigned int Pathfinder::CacheMisses( void ) const {
+	return misses;
+}
+
+}
@@ -0,0 +1,159 @@
+#ifndef PATHFINDER_H
+#define PATHFINDER_H
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Point3.h"
+#include "NavGrid.h"
+#include "JobSystem.h"
+
+namespace DS {
+
+struct PathRequest {
+	Math::Point3 start;
+	Math::Point3 goal;
+};
+
+struct Path {
+	Path( void );
+
+	bool found;
+	float cost;							// In cells, diagonals cost sqrt( 2 ).
+	std::vector< Math::Point3 > waypoints;	// Cell centers at the turns, start and goal included.
+
+	// Version of every cluster the path crosses, see Pathfinder::Valid.
+	std::vector< std::pair< int, unsigned int > > clusters;
+};
+
+/**
+	DS::Pathfinder - Hierarchical A* over a NavGrid
+
+	The grid is cut into square clusters. Every run of open cells along a
+	cluster border gets one entrance, two for long runs, and the cells on
+	either side of it become nodes of an abstract graph. Nodes in the same
+	cluster are joined by edges holding the cost and cells of the shortest
+	path between them inside the cluster, found once when the graph is
+	built. A query searches the start and goal clusters, A* walks the small
+	abstract graph between them and the stored edge cells are stitched
+	together, so the cost grows with the number of clusters crossed, not
+	with the area of the grid. Paths come out close to, not exactly,
+	shortest; neighbouring clusters are also searched cell by cell so
+	short hops do not detour through an entrance.
+
+	SetBlocked only marks the cell's cluster dirty. Repair, also run by
+	the next query, rebuilds the borders of dirty clusters and the edges of
+	those clusters and their neighbours, and bumps the dirty clusters'
+	versions. A Path records the versions it was built with, so Valid tells
+	an agent whether an obstacle appeared along its way.
+
+	Results are cached by start and goal cell, least recently used first
+	out; a cached path is dropped once one of its clusters changes.
+	FindPaths answers a batch from the cache on the calling thread, then
+	spreads the misses over the JobSystem, each job with its own search
+	scratch. The graph is only read during a batch.
+**/
+class Pathfinder {
+public:
+	Pathfinder( void );
+	~Pathfinder( void );
+
+	// grid must outlive the pathfinder.
+	void Init( NavGrid* grid, int clusterSize, unsigned int cacheSize );
+	void Shutdown( void );
+
+	void SetBlocked( int x, int z, bool blocked );
+	void Repair( void );
+
+	bool FindPath( const Math::Point3& start, const Math::Point3& goal, Path& path );
+	void FindPaths( const PathRequest* requests, unsigned int count, Path* paths, JobSystem& jobs );
+
+	// False once an obstacle changed in a cluster the path crosses.
+	bool Valid( const Path& path ) const;
+
+	unsigned int NodeCount( void ) const;
+	unsigned int EdgeCount( void ) const;
+	unsigned int CacheHits( void ) const;
+	unsigned int CacheMisses( void ) const;
+
+private:
+	typedef unsigned long long CacheKey;
+
+	struct Edge {
+		int to;							// Cell index of the node.
+		float cost;
+		std::vector< int > cells;		// Excluding this node, ending with to. Empty across a border.
+	};
+
+	struct Node {
+		int cluster;
+		std::vector< Edge > edges;
+	};
+
+	// A transition between two neighbouring cells on either side of a border.
+	struct Entrance {
+		int a;
+		int b;
+	};
+
+	struct Scratch {
+		std::vector< float > startCost;		// Per cell of a cluster.
+		std::vector< int > startParent;
+		std::vector< float > goalCost;
+		std::vector< int > goalParent;
+		std::vector< float > windowCost;	// Start and goal clusters together.
+		std::vector< int > windowParent;
+		std::vector< std::pair< float, int > > open;
+
+		std::unordered_map< int, float > cost;			// Abstract search.
+		std::unordered_map< int, int > parent;
+	};
+
+	struct CacheEntry {
+		CacheKey key;
+		Path path;
+	};
+
+	int ClusterOf( int cell ) const;
+	void ClusterRect( int cluster, int& x0, int& z0, int& x1, int& z1 ) const;
+	int BorderIndex( int cluster, int side, bool& vertical ) const;
+
+	void BuildBorder( std::vector< Entrance >& entrances, int cluster, bool vertical );
+	void BuildEdges( int cluster, Scratch& scratch );
+	void SearchCluster( int cluster, int source, std::vector< float >& cost, std::vector< int >& parent, std::vector< std::pair< float, int > >& open ) const;
+	void SearchRect( int x0, int z0, int x1, int z1, int source, std::vector< float >& cost, std::vector< int >& parent, std::vector< std::pair< float, int > >& open ) const;
+
+	bool Search( int start, int goal, Scratch& scratch, Path& path ) const;
+	void Finish( const std::vector< int >& cells, Path& path ) const;
+
+	bool Lookup( CacheKey key, Path& path );
+	void Store( CacheKey key, const Path& path );
+	bool Key( const PathRequest& request, CacheKey& key, int& start, int& goal ) const;
+
+	NavGrid* grid;
+	int clusterSize;
+	int clustersX;
+	int clustersZ;
+
+	std::unordered_map< int, Node > nodes;
+	std::vector< std::vector< int > > clusterNodes;
+	std::vector< std::vector< Entrance > > bordersX;	// Between cluster i and the one at +X.
+	std::vector< std::vector< Entrance > > bordersZ;	// Between cluster i and the one at +Z.
+	std::vector< unsigned int > versions;
+	std::vector< unsigned char > dirty;
+	bool anyDirty;
+
+	unsigned int cacheSize;
+	std::list< CacheEntry > cache;			// Most recent first.
+	std::unordered_map< CacheKey, std::list< CacheEntry >::iterator > cacheIndex;
+	unsigned int hits;
+	unsigned int misses;
+
+	Scratch scratch;					// For the calling thread.
+};
+
+}
+
+#endif
@@ -0,0 +1,451 @@
+#include "PhysicsWorld.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <xmmintrin.h>
+
+namespace DS {
+
+namespace {
+
+	const float BAUMGARTE = 0.2f;			// Fraction of penetration removed per step.
+	const float SLOP = 0.01f;				// Penetration left alone to keep contacts alive.
+	const float FRICTION = 0.5f;
+	const float MAX_STEP = 1.0f / 30.0f;	// Variable steps are clamped to this.
+	const int MAX_SUBSTEPS = 4;				// Fixed steps per call before dropping time.
+
+	const unsigned int NO_BODY = 0xFFFFFFFF;
+
+	inline float Dot( const float* a, float x, float y, float z ) {
+		return a[ 0 ] * x + a[ 1 ] * y + a[ 2 ] * z;
+	}
+
+	// Two unit tangents orthogonal to n.
+	void TangentBasis( const float* n, float* t1, float* t2 ) {
+		if ( std::fabs( n[ 0 ] ) > 0.57735f ) {
+			float inv = 1.0f / std::sqrt( n[ 0 ] * n[ 0 ] + n[ 1 ] * n[ 1 ] );
+			t1[ 0 ] = n[ 1 ] * inv;
+			t1[ 1 ] = -n[ 0 ] * inv;
+			t1[ 2 ] = 0.0f;
+		} else {
+			float inv = 1.0f / std::sqrt( n[ 1 ] * n[ 1 ] + n[ 2 ] * n[ 2 ] );
+			t1[ 0 ] = 0.0f;
+			t1[ 1 ] = n[ 2 ] * inv;
+			t1[ 2 ] = -n[ 1 ] * inv;
+		}
+
+		t2[ 0 ] = n[ 1 ] * t1[ 2 ] - n[ 2 ] * t1[ 1 ];
+		t2[ 1 ] = n[ 2 ] * t1[ 0 ] - n[ 0 ] * t1[ 2 ];
+		t2[ 2 ] = n[ 0 ] * t1[ 1 ] - n[ 1 ] * t1[ 0 ];
+	}
+
+}
+
+PhysicsWorld::PhysicsWorld( void )
+	: jobs( NULL ), broadphase( NULL ), count( 0 ), gravity( 0.0f, -9.81f, 0.0f ), ground( 0.0f ),
+	  iterations( 8 ), deterministic( false ), fixedStep( 1.0f / 60.0f ), accumulator( 0.0f ) {
+}
+
+PhysicsWorld::~PhysicsWorld( void ) {
+}
+
+void PhysicsWorld::Init( JobSystem* j, Broadphase* b ) {
+	jobs = j;
+	broadphase = b;
+}
+
+unsigned int PhysicsWorld::AddBody( const Math::Point3& p, float r, float mass ) {
+	MemoryScope scope( MEMORY_PHYSICS );
+	unsigned int body = count++;
+	unsigned int padded = ( count + 3 ) & ~3;
+
+	// Padding lanes stay static and at rest.
+	if ( px.size() < padded ) {
+		std::vector< float >* arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &fx, &fy, &fz, &invMass, &radius };
+
+		for ( int i = 0; i < 11; ++i ) {
+			arrays[ i ]->resize( padded, 0.0f );
+		}
+	}
+
+	px[ body ] = p.x;
+	py[ body ] = p.y;
+	pz[ body ] = p.z;
+	invMass[ body ] = mass > 0.0f ? 1.0f / mass : 0.0f;
+	radius[ body ] = r;
+
+	Math::Vector3 extent( r, r, r );
+	unsigned int proxy = broadphase->Add( Math::BBox( p - extent, p + extent ) );
+
+	proxies.push_back( proxy );
+
+	if ( proxyBody.size() <= proxy ) {
+		proxyBody.resize( proxy + 1, NO_BODY );
+	}
+
+	proxyBody[ proxy ] = body;
+
+	return body;
+}
+
+void PhysicsWorld::SetVelocity( unsigned int body, const Math::Vector3& v ) {
+	vx[ body ] = v.x;
+	vy[ body ] = v.y;
+	vz[ body ] = v.z;
+}
+
+void PhysicsWorld::ApplyForce( unsigned int body, const Math::Vector3& f ) {
+	fx[ body ] += f.x;
+	fy[ body ] += f.y;
+	fz[ body ] += f.z;
+}
+
+Math::Point3 PhysicsWorld::Position( unsigned int body ) const {
+	return Math::Point3( px[ body ], py[ body ], pz[ body ] );
+}
+
+Math::Vector3 PhysicsWorld::Velocity( unsigned int body ) const {
+	return Math::Vector3( vx[ body ], vy[ body ], vz[ body ] );
+}
+
+float PhysicsWorld::Radius( unsigned int body ) const {
+	return radius[ body ];
+}
+
+void PhysicsWorld::SetGravity( const Math::Vector3& g ) {
+	gravity = g;
+}
+
+void PhysicsWorld::SetGround( float height ) {
+	ground = height;
+}
+
+void PhysicsWorld::SetIterations( int i ) {
+	iterations = std::max( i, 1 );
+}
+
+void PhysicsWorld::SetDeterministic( bool on, float step ) {
+	deterministic = on;
+	fixedStep = step;
+	accumulator = 0.0f;
+}
+
+int PhysicsWorld::Step( float dt ) {
+	MemoryScope scope( MEMORY_PHYSICS );
+
+	// Two frames in the same tick; contact bias divides by the step.
+	if ( dt <= 0.0f ) {
+		return 0;
+	}
+
+	if ( !deterministic ) {
+		Simulate( std::min( dt, MAX_STEP ) );
+		return 1;
+	}
+
+	accumulator += dt;
+
+	int steps = 0;
+	while ( accumulator >= fixedStep && steps < MAX_SUBSTEPS ) {
+		Simulate( fixedStep );
+		accumulator -= fixedStep;
+		++steps;
+	}
+
+	// Too far behind, slow down rather than spiral.
+	if ( steps == MAX_SUBSTEPS ) {
+		accumulator = std::min( accumulator, fixedStep );
+	}
+
+	return steps;
+}
+
+void PhysicsWorld::Simulate( float dt ) {
+	IntegrateVelocities( dt );
+	FindContacts( dt );
+	BuildIslands();
+
+	unsigned int islands = IslandCount();
+
+	jobs->ParallelFor( ( int ) islands, 8, [ this ]( int begin, int end ) {
+		for ( int i = begin; i < end; ++i ) {
+			SolveIsland( ( unsigned int ) i );
+		}
+	} );
+
+	IntegratePositions( dt );
+}
+
+void PhysicsWorld::IntegrateVelocities( float dt ) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 step = _mm_set1_ps( dt );
+	const __m128 gx = _mm_set1_ps( gravity.x * dt );
+	const __m128 gy = _mm_set1_ps( gravity.y * dt );
+	const __m128 gz = _mm_set1_ps( gravity.z * dt );
+
+	for ( size_t i = 0; i < px.size(); i += 4 ) {
+		__m128 im = _mm_loadu_ps( &invMass[ i ] );
+		__m128 dynamic = _mm_cmpgt_ps( im, zero );
+		__m128 scale = _mm_mul_ps( im, step );
+
+		// v += ( g + f / m ) * dt, static bodies get nothing.
+		__m128 dvx = _mm_add_ps( _mm_and_ps( dynamic, gx ), _mm_mul_ps( _mm_loadu_ps( &fx[ i ] ), scale ) );
+		__m128 dvy = _mm_add_ps( _mm_and_ps( dynamic, gy ), _mm_mul_ps( _mm_loadu_ps( &fy[ i ] ), scale ) );
+		__m128 dvz = _mm_add_ps( _mm_and_ps( dynamic, gz ), _mm_mul_ps( _mm_loadu_ps( &fz[ i ] ), scale ) );
+
+		_mm_storeu_ps( &vx[ i ], _mm_add_ps( _mm_loadu_ps( &vx[ i ] ), dvx ) );
+		_mm_storeu_ps( &vy[ i ], _mm_add_ps( _mm_loadu_ps( &vy[ i ] ), dvy ) );
+		_mm_storeu_ps( &vz[ i ], _mm_add_ps( _mm_loadu_ps( &vz[ i ] ), dvz ) );
+
+		_mm_storeu_ps( &fx[ i ], zero );
+		_mm_storeu_ps( &fy[ i ], zero );
+		_mm_storeu_ps( &fz[ i ], zero );
+	}
+}
+
+void PhysicsWorld::IntegratePositions( float dt ) {
+	const __m128 step = _mm_set1_ps( dt );
+
+	for ( size_t i = 0; i < px.size(); i += 4 ) {
+		_mm_storeu_ps( &px[ i ], _mm_add_ps( _mm_loadu_ps( &px[ i ] ), _mm_mul_ps( _mm_loadu_ps( &vx[ i ] ), step ) ) );
+		_mm_storeu_ps( &py[ i ], _mm_add_ps( _mm_loadu_ps( &py[ i ] ), _mm_mul_ps( _mm_loadu_ps( &vy[ i ] ), step ) ) );
+		_mm_storeu_ps( &pz[ i ], _mm_add_ps( _mm_loadu_ps( &pz[ i ] ), _mm_mul_ps( _mm_loadu_ps( &vz[ i ] ), step ) ) );
+	}
+}
+
+void PhysicsWorld::FindContacts( float dt ) {
+	for ( unsigned int i = 0; i < count; ++i ) {
+		Math::Vector3 extent( radius[ i ], radius[ i ], radius[ i ] );
+		Math::Point3 p( px[ i ], py[ i ], pz[ i ] );
+
+		broadphase->Move( proxies[ i ], Math::BBox( p - extent, p + extent ) );
+	}
+
+	broadphase->Update();
+
+	contacts.clear();
+
+	const std::vector< BroadphasePair >& pairs = broadphase->Pairs();
+	float biasScale = BAUMGARTE / dt;
+
+	for ( size_t i = 0; i < pairs.size(); ++i ) {
+		unsigned int a = proxyBody[ pairs[ i ].a ];
+		unsigned int b = proxyBody[ pairs[ i ].b ];
+		float invSum = invMass[ a ] + invMass[ b ];
+
+		if ( invSum == 0.0f ) {
+			continue;
+		}
+
+		float dx = px[ a ] - px[ b ];
+		float dy = py[ a ] - py[ b ];
+		float dz = pz[ a ] - pz[ b ];
+		float r = radius[ a ] + radius[ b ];
+		float d2 = dx * dx + dy * dy + dz * dz;
+
+		if ( d2 >= r * r ) {
+			continue;
+		}
+
+		Contact c;
+		c.a = a;
+		c.b = b;
+
+		float d = std::sqrt( d2 );
+		if ( d > 1e-6f ) {
+			c.normal[ 0 ] = dx / d;
+			c.normal[ 1 ] = dy / d;
+			c.normal[ 2 ] = dz / d;
+		} else {
+			c.normal[ 0 ] = 0.0f;
+			c.normal[ 1 ] = 1.0f;
+			c.normal[ 2 ] = 0.0f;
+		}
+
+		c.depth = r - d;
+		c.mass = 1.0f / invSum;
+		c.bias = biasScale * std::max( c.depth - SLOP, 0.0f );
+		contacts.push_back( c );
+	}
+
+	// Ground plane.
+	for ( unsigned int i = 0; i < count; ++i ) {
+		float depth = ground - ( py[ i ] - radius[ i ] );
+
+		if ( invMass[ i ] == 0.0f || depth <= 0.0f ) {
+			continue;
+		}
+
+		Contact c;
+		c.a = i;
+		c.b = NO_BODY;
+		c.normal[ 0 ] = 0.0f;
+		c.normal[ 1 ] = 1.0f;
+		c.normal[ 2 ] = 0.0f;
+		c.depth = depth;
+		c.mass = 1.0f / invMass[ i ];
+		c.bias = biasScale * std::max( depth - SLOP, 0.0f );
+		contacts.push_back( c );
+	}
+
+	for ( size_t i = 0; i < contacts.size(); ++i ) {
+		Contact& c = contacts[ i ];
+
+		TangentBasis( c.normal, c.tangent[ 0 ], c.tangent[ 1 ] );
+		c.normalImpulse = 0.0f;
+		c.tangentImpulse[ 0 ] = 0.0f;
+		c.tangentImpulse[ 1 ] = 0.0f;
+	}
+}
+
+unsigned int PhysicsWorld::Root( unsigned int body ) {
+	while ( parent[ body ] != body ) {
+		parent[ body ] = parent[ parent[ body ] ];
+		body = parent[ body ];
+	}
+
+	return body;
+}
+
+void PhysicsWorld::BuildIslands( void ) {
+	parent.resize( count );
+	islandOf.assign( count, NO_BODY );
+
+	for ( unsigned int i = 0; i < count; ++i ) {
+		parent[ i ] = i;
+	}
+
+	// Static bodies never join islands, they only take impulses from one side.
+	for ( size_t i = 0; i < contacts.size(); ++i ) {
+		const Contact& c = contacts[ i ];
+
+		if ( c.b == NO_BODY || invMass[ c.a ] == 0.0f || invMass[ c.b ] == 0.0f ) {
+			continue;
+		}
+
+		unsigned int ra = Root( c.a );
+		unsigned int rb = Root( c.b );
+
+		if ( ra != rb ) {
+			parent[ std::max( ra, rb ) ] = std::min( ra, rb );
+		}
+	}
+
+	// Number islands by their lowest body so the order is fixed.
+	unsigned int islands = 0;
+
+	for ( unsigned int i = 0; i < count; ++i ) {
+		unsigned int root = Root( i );
+
+		if ( islandOf[ root ] == NO_BODY ) {
+			islandOf[ root ] = islands++;
+		}
+
+		islandOf[ i ] = islandOf[ root ];
+	}
+
+	// Stable counting sort of the contacts by island.
+	islandStart.assign( islands + 1, 0 );
+
+	for ( size_t i = 0; i < contacts.size(); ++i ) {
+		const Contact& c = contacts[ i ];
+		unsigned int body = invMass[ c.a ] > 0.0f ? c.a : c.b;
+
+		++islandStart[ islandOf[ body ] + 1 ];
+	}
+
+	for ( unsigned int i = 0; i < islands; ++i ) {
+		islandStart[ i + 1 ] += islandStart[ i ];
+	}
+
+	sorted.resize( contacts.size() );
+	std::vector< unsigned int > cursor( islandStart.begin(), islandStart.end() - 1 );
+
+	for ( size_t i = 0; i < contacts.size(); ++i ) {
+		const Contact& c = contacts[ i ];
+		unsigned int body = invMass[ c.a ] > 0.0f ? c.a : c.b;
+
+		sorted[ cursor[ islandOf[ body ] ]++ ] = c;
+	}
+
+	contacts.swap( sorted );
+}
+
+void PhysicsWorld::SolveIsland( unsigned int island ) {
+	unsigned int begin = islandStart[ island ];
+	unsigned int end = islandStart[ island + 1 ];
+
+	for ( int it = 0; it < iterations; ++it ) {
+		for ( unsigned int i = begin; i < end; ++i ) {
+			Contact& c = contacts[ i ];
+
+			unsigned int a = c.a;
+			unsigned int b = c.b;
+			bool hasB = b != NO_BODY;
+
+			float ima = invMass[ a ];
+			float imb = hasB ? invMass[ b ] : 0.0f;
+
+			// Relative velocity of a with respect to b.
+			float rvx = vx[ a ] - ( hasB ? vx[ b ] : 0.0f );
+			float rvy = vy[ a ] - ( hasB ? vy[ b ] : 0.0f );
+			float rvz = vz[ a ] - ( hasB ? vz[ b ] : 0.0f );
+
+			// Normal, accumulated and clamped so the contact only pushes.
+			float vn = Dot( c.normal, rvx, rvy, rvz );
+			float impulse = c.mass * ( c.bias - vn );
+			float total = std::max( c.normalImpulse + impulse, 0.0f );
+			impulse = total - c.normalImpulse;
+			c.normalImpulse = total;
+
+			float jx = c.normal[ 0 ] * impulse;
+			float jy = c.normal[ 1 ] * impulse;
+			float jz = c.normal[ 2 ] * impulse;
+
+			// Friction, inside the cone of the current normal impulse.
+			float limit = FRICTION * c.normalImpulse;
+
+			for ( int k = 0; k < 2; ++k ) {
+				const float* t = c.tangent[ k ];
+
+				float vt = Dot( t, rvx + jx * ( ima + imb ), rvy + jy * ( ima + imb ), rvz + jz * ( ima + imb ) );
+				float tangentTotal = std::min( std::max( c.tangentImpulse[ k ] - c.mass * vt, -limit ), limit );
+				float ti = tangentTotal - c.tangentImpulse[ k ];
+				c.tangentImpulse[ k ] = tangentTotal;
+
+				jx += t[ 0 ] * ti;
+				jy += t[ 1 ] * ti;
+				jz += t[ 2 ] * ti;
+			}
+
+			// Static bodies are shared between islands, never write them.
+			if ( ima > 0.0f ) {
+				vx[ a ] += jx * ima;
+				vy[ a ] += jy * ima;
+				vz[ a ] += jz * ima;
+			}
+
+			if ( imb > 0.0f ) {
+				vx[ b ] -= jx * imb;
+				vy[ b ] -= jy * imb;
+				vz[ b ] -= jz * imb;
+			}
+		}
+	}
+}
+
+unsigned int PhysicsWorld::BodyCount( void ) const {
+	return count;
+}
+
+unsigned int PhysicsWorld::ContactCount( void ) const {
+	return ( unsigned int ) contacts.size();
+}
+
+unsigned int PhysicsWorld::IslandCount( void ) const {
+	return islandStart.empty() ? 0 : ( unsigned int ) islandStart.size() - 1;
+}
+
+}
@@ -0,0 +1,114 @@
+#ifndef PHYSICSWORLD_H
+#define PHYSICSWORLD_H
+
+#include <vector>
+
+#include "Point3.h"
+#include "Vector3.h"
+#include "Broadphase.h"
+#include "JobSystem.h"
+
+namespace DS {
+
+/**
+	DS::PhysicsWorld - Sphere body simulation
+
+	Bodies are spheres without rotation, stored as parallel arrays ( one
+	per component ) padded to a multiple of four so integration runs four
+	bodies per SSE instruction. A mass of zero makes a body static.
+
+	Each step integrates velocities ( semi-implicit Euler ), finds contacts
+	through the broadphase plus a ground plane, splits the bodies into
+	islands that share no contacts and solves the islands in parallel with
+	sequential impulses, then integrates positions.
+
+	Contacts and islands are built in body order and each island is solved
+	by a single thread, so the result never depends on the worker count.
+	Deterministic mode adds a fixed internal time step, making a run
+	depend only on the sequence of inputs and not on the frame rate.
+**/
+class PhysicsWorld {
+public:
+	PhysicsWorld( void );
+	~PhysicsWorld( void );
+
+	// The broadphase must be empty and used by this world only.
+	void Init( JobSystem* jobs, Broadphase* broadphase );
+
+	unsigned int AddBody( const Math::Point3& position, float radius, float mass );
+
+	void SetVelocity( unsigned int body, const Math::Vector3& v );
+	void ApplyForce( unsigned int body, const Math::Vector3& f );	// For the next step only.
+
+	Math::Point3 Position( unsigned int body ) const;
+	Math::Vector3 Velocity( unsigned int body ) const;
+	float Radius( unsigned int body ) const;
+
+	void SetGravity( const Math::Vector3& g );
+	void SetGround( float height );
+	void SetIterations( int iterations );
+	void SetDeterministic( bool on, float fixedStep );
+
+	// Returns the number of steps taken, none for a dt of zero or less.
+	int Step( float dt );
+
+	unsigned int BodyCount( void ) const;
+	unsigned int ContactCount( void ) const;
+	unsigned int IslandCount( void ) const;
+
+private:
+	struct Contact {
+		unsigned int a;
+		unsigned int b;		// NO_BODY for the ground.
+
+		float normal[ 3 ];	// From b to a.
+		float tangent[ 2 ][ 3 ];
+		float depth;
+
+		float mass;
+		float bias;
+		float normalImpulse;
+		float tangentImpulse[ 2 ];
+	};
+
+	void Simulate( float dt );
+	void IntegrateVelocities( float dt );
+	void IntegratePositions( float dt );
+	void FindContacts( float dt );
+	void BuildIslands( void );
+	void SolveIsland( unsigned int island );
+
+	unsigned int Root( unsigned int body );
+
+	JobSystem* jobs;
+	Broadphase* broadphase;
+
+	unsigned int count;
+
+	std::vector< float > px, py, pz;
+	std::vector< float > vx, vy, vz;
+	std::vector< float > fx, fy, fz;
+	std::vector< float > invMass;
+	std::vector< float > radius;
+
+	std::vector< unsigned int > proxies;
+	std::vector< unsigned int > proxyBody;
+
+	std::vector< Contact > contacts;
+	std::vector< Contact > sorted;
+	std::vector< unsigned int > parent;
+	std::vector< unsigned int > islandOf;
+	std::vector< unsigned int > islandStart;
+
+	Math::Vector3 gravity;
+	float ground;
+	int iterations;
+
+	bool deterministic;
+	float fixedStep;
+	float accumulator;
+};
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#include "Quaternion.h"
+
+using namespace Math;
+
+Quaternion::Quaternion( void )
+	: x( 0.0f ), y( 0.0f ), z( 0.0f ), w( 1.0f ) {
+}
+
+Quaternion::Quaternion( float xx, float yy, float zz, float ww )
+	: x( xx ), y( yy ), z( zz ), w( ww ) {
+}
+
+Quaternion::~Quaternion( void ) {
+}
+
+float Quaternion::LengthSquared( void ) const {
+	return x * x + y * y + z * z + w * w;
+}
+
+float Quaternion::Length( void ) const {
+	return sqrtf( LengthSquared() );
+}
+
+Quaternion Quaternion::Conjugate( void ) const {
+	return Quaternion( -x, -y, -z, w );
+}
+
+Quaternion Quaternion::operator+( const Quaternion& q ) const {
+	return Quaternion( x + q.x, y + q.y, z + q.z, w + q.w );
+}
+
+Quaternion Quaternion::operator-( const Quaternion& q ) const {
+	return Quaternion( x - q.x, y - q.y, z - q.z, w - q.w );
+}
+
+Quaternion Quaternion::operator*( const Quaternion& q ) const {
+	return Quaternion( w * q.x + x * q.w + y * q.z - z * q.y,
+					   w * q.y - x * q.z + y * q.w + z * q.x,
+					   w * q.z + x * q.y - y * q.x + z * q.w,
+					   w * q.w - x * q.x - y * q.y - z * q.z );
+}
+
+Quaternion Quaternion::operator*( const float s ) const {
+	return Quaternion( x * s, y * s, z * s, w * s );
+}
+
+Quaternion& Quaternion::operator+=( const Quaternion& q ) {
+	x += q.x;
+	y += q.y;
+	z += q.z;
+	w += q.w;
+
+	return *this;
+}
+
+Quaternion& Quaternion::operator*=( const float s ) {
+	x *= s;
+	y *= s;
+	z *= s;
+	w *= s;
+
+	return *this;
+}
+
+Quaternion Quaternion::operator-( void ) const {
+	return Quaternion( -x, -y, -z, -w );
+}
@@ -0,0 +1,135 @@
+#ifndef QUATERNION_H
+#define QUATERNION_H
+
+#include <cmath>
+
+#include "Vector3.h"
+#include "Matrix4.h"
+
+namespace Math {
+
+class Quaternion {
+public:
+	Quaternion( void );
+	Quaternion( float xx, float yy, float zz, float ww );
+	~Quaternion( void );
+
+	float LengthSquared( void ) const;
+	float Length( void ) const;
+	Quaternion Conjugate( void ) const;
+
+	Quaternion operator+( const Quaternion& q ) const;
+	Quaternion operator-( const Quaternion& q ) const;
+	Quaternion operator*( const Quaternion& q ) const;
+	Quaternion operator*( const float s ) const;
+
+	Quaternion& operator+=( const Quaternion& q );
+	Quaternion& operator*=( const float s );
+
+	Quaternion operator-( void ) const;
+
+	float x;
+	float y;
+	float z;
+	float w;
+};
+
+inline float Dot( const Quaternion& q1, const Quaternion& q2 ) {
+	return q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w;
+}
+
+inline Quaternion Normalize( const Quaternion& q ) {
+	return q * ( 1.0f / q.Length() );
+}
+
+/**
+	Math::AxisAngle
+
+	Rotation by degrees about a unit axis, same handedness as Math::Euler.
+**/
+inline Quaternion AxisAngle( const Vector3& axis, float degrees ) {
+	float half = degrees * PI_OVER_360;
+	float s = sinf( half );
+
+	return Quaternion( axis.x * s, axis.y * s, axis.z * s, cosf( half ) );
+}
+
+/**
+	Math::Nlerp
+
+	Normalized linear interpolation along the shorter arc. Not constant
+	speed, but close enough for keys a frame or two apart and far cheaper
+	than Slerp.
+**/
+inline Quaternion Nlerp( const Quaternion& q1, const Quaternion& q2, float t ) {
+	float sign = Dot( q1, q2 ) < 0.0f ? -1.0f : 1.0f;
+
+	return Normalize( q1 * ( 1.0f - t ) + q2 * ( t * sign ) );
+}
+
+inline Vector3 Rotate( const Quaternion& q, const Vector3& v ) {
+	// v + 2w( u x v ) + 2u x ( u x v )
+	Vector3 u( q.x, q.y, q.z );
+	Vector3 t = Cross( u, v ) * 2.0f;
+
+	return v + t * q.w + Cross( u, t );
+}
+
+/**
+	Math::ToMatrix
+
+	Rotation matrix for a unit quaternion ( column vectors ).
+**/
+inline Matrix4 ToMatrix( const Quaternion& q ) {
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	return Matrix4( 1.0f - 2.0f * ( yy + zz ), 2.0f * ( xy - wz ), 2.0f * ( xz + wy ), 0.0f,
+					2.0f * ( xy + wz ), 1.0f - 2.0f * ( xx + zz ), 2.0f * ( yz - wx ), 0.0f,
+					2.0f * ( xz - wy ), 2.0f * ( yz + wx ), 1.0f - 2.0f * ( xx + yy ), 0.0f,
+					0.0f, 0.0f, 0.0f, 1.0f );
+}
+
+/**
+	Math::DualQuaternion - Rigid transform as real + dual part
+
+	Blending unit dual quaternions and renormalizing gives a rigid result,
+	so skinning with them does not collapse volume at twisting joints the
+	way linearly blended matrices do. Scale cannot be represented.
+**/
+class DualQuaternion {
+public:
+	DualQuaternion( void )
+		: real( 0.0f, 0.0f, 0.0f, 1.0f ), dual( 0.0f, 0.0f, 0.0f, 0.0f ) {
+	}
+
+	DualQuaternion( const Quaternion& r, const Quaternion& d )
+		: real( r ), dual( d ) {
+	}
+
+	// Rotation first, then translation.
+	DualQuaternion( const Quaternion& rotation, const Vector3& translation )
+		: real( rotation ), dual( Quaternion( translation.x, translation.y, translation.z, 0.0f ) * rotation * 0.5f ) {
+	}
+
+	DualQuaternion operator*( const DualQuaternion& q ) const {
+		return DualQuaternion( real * q.real, real * q.dual + dual * q.real );
+	}
+
+	Vector3 Translation( void ) const {
+		Quaternion t = dual * real.Conjugate() * 2.0f;
+		return Vector3( t.x, t.y, t.z );
+	}
+
+	Vector3 Transform( const Vector3& p ) const {
+		return Rotate( real, p ) + Translation();
+	}
+
+	Quaternion real;
+	Quaternion dual;
+};
+
+}
+
+#endif
@@ -0,0 +1,20 @@
+#include "Ray.h"
+
+#include <cfloat>
+
+using namespace Math;
+
+Ray::Ray( void )
+	: o( 0.0f, 0.0f, 0.0f ), d( 0.0f, 0.0f, 1.0f ), mint( 0.0f ), maxt( FLT_MAX ) {
+}
+
+Ray::Ray( const Point3& origin, const Vector3& direction, float start, float end )
+	: o( origin ), d( direction ), mint( start ), maxt( end ) {
+}
+
+Ray::~Ray( void ) {
+}
+
+Point3 Ray::operator()( float t ) const {
+	return o + d * t;
+}
@@ -0,0 +1,31 @@
+#ifndef RAY_H
+#define RAY_H
+
+#include "Point3.h"
+#include "Vector3.h"
+
+namespace Math {
+
+/**
+	Math::Ray - Semi-infinite line
+
+	Only the segment between mint and maxt is considered by intersection
+	routines; hits shrink maxt.
+**/
+class Ray {
+public:
+	Ray( void );
+	Ray( const Point3& origin, const Vector3& direction, float start, float end );
+	~Ray( void );
+
+	Point3 operator()( float t ) const;
+
+	Point3 o;
+	Vector3 d;
+	float mint;
+	float maxt;
+};
+
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include "RayTracer.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace DS {
+
+namespace {
+
+	const int TILE_SIZE = 16;
+
+	inline unsigned int Hash( unsigned int x ) {
+		x ^= x >> 16;
+		x *= 0x7feb352d;
+		x ^= x >> 15;
+		x *= 0x846ca68b;
+		x ^= x >> 16;
+		return x;
+	}
+
+	// [ 0, 1 )
+	inline float NextRandom( unsigned int& state ) {
+		state = state * 1664525u + 1013904223u;
+		return ( state >> 8 ) * ( 1.0f / 16777216.0f );
+	}
+
+	inline unsigned char ToByte( float v ) {
+		return ( unsigned char ) ( std::min( std::max( v, 0.0f ), 1.0f ) * 255.0f + 0.5f );
+	}
+
+}
+
+RayTracer::RayTracer( void )
+	: bias( 1e-4f ) {
+	settings.sunDirection = Math::Normalize( Math::Vector3( 0.3f, 1.0f, 0.5f ) );
+	settings.sunIntensity = 0.8f;
+	settings.skyIntensity = 0.4f;
+	settings.aoSamples = 16;
+	settings.aoDistance = 10.0f;
+	settings.background[ 0 ] = 0.0f;
+	settings.background[ 1 ] = 0.0f;
+	settings.background[ 2 ] = 1.0f;
+}
+
+RayTracer::~RayTracer( void ) {
+}
+
+TraceSettings& RayTracer::Settings( void ) {
+	return settings;
+}
+
+unsigned int RayTracer::AddMesh( const Mesh& mesh, const LODLevel& level, const Math::Matrix4& m ) {
+	MemoryScope scope( MEMORY_RAYTRACE );
+
+	Instance inst;
+	inst.firstVertex = ( unsigned int ) positions.size() / 3;
+	inst.vertexCount = mesh.VertexCount();
+	inst.firstTriangle = ( unsigned int ) indices.size() / 3;
+
+	for ( unsigned int i = 0; i < inst.vertexCount; ++i ) {
+		const float* p = &mesh.positions[ i * 3 ];
+
+		for ( int r = 0; r < 3; ++r ) {
+			positions.push_back( m.c[ r ][ 0 ] * p[ 0 ] + m.c[ r ][ 1 ] * p[ 1 ] + m.c[ r ][ 2 ] * p[ 2 ] + m.c[ r ][ 3 ] );
+		}
+	}
+
+	colors.insert( colors.end(), mesh.colors.begin(), mesh.colors.end() );
+
+	for ( unsigned int i = 0; i < level.indexCount; ++i ) {
+		indices.push_back( mesh.indices[ level.indexOffset + i ] + inst.firstVertex );
+	}
+
+	inst.triangleCount = level.indexCount / 3;
+	instances.push_back( inst );
+
+	return ( unsigned int ) instances.size() - 1;
+}
+
+void RayTracer::Build( void ) {
+	MemoryScope scope( MEMORY_RAYTRACE );
+
+	// Nothing added, every ray misses.
+	if ( indices.empty() ) {
+		bvh.Build( NULL, NULL, 0 );
+		return;
+	}
+
+	bvh.Build( &positions[ 0 ], &indices[ 0 ], ( unsigned int ) indices.size() / 3 );
+
+	// Self intersection offset relative to the scene size.
+	if ( bvh.NodeCount() > 0 ) {
+		bias = std::max( bvh.Bounds().Radius() * 1e-5f, 1e-5f );
+	}
+}
+
+void RayTracer::Clear( void ) {
+	positions.clear();
+	colors.clear();
+	indices.clear();
+	instances.clear();
+	bvh.Build( NULL, NULL, 0 );
+}
+
+Math::Vector3 RayTracer::TriangleNormal( unsigned int triangle ) const {
+	const float* p0 = &positions[ indices[ triangle * 3 ] * 3 ];
+	const float* p1 = &positions[ indices[ triangle * 3 + 1 ] * 3 ];
+	const float* p2 = &positions[ indices[ triangle * 3 + 2 ] * 3 ];
+
+	Math::Vector3 e1( p1[ 0 ] - p0[ 0 ], p1[ 1 ] - p0[ 1 ], p1[ 2 ] - p0[ 2 ] );
+	Math::Vector3 e2( p2[ 0 ] - p0[ 0 ], p2[ 1 ] - p0[ 1 ], p2[ 2 ] - p0[ 2 ] );
+
+	return Math::Cross( e1, e2 );
+}
+
+float RayTracer::Irradiance( const Math::Point3& p, const Math::Vector3& n, unsigned int seed ) const {
+	Math::Point3 origin = p + n * bias;
+	float light = 0.0f;
+
+	float sun = Math::Dot( n, settings.sunDirection );
+	if ( sun > 0.0f && !bvh.Occluded( Math::Ray( origin, settings.sunDirection, 0.0f, FLT_MAX ) ) ) {
+		light += settings.sunIntensity * sun;
+	}
+
+	if ( settings.aoSamples > 0 ) {
+		Math::Vector3 t1( 0.0f, 0.0f, 0.0f );
+		Math::Vector3 t2( 0.0f, 0.0f, 0.0f );
+		Math::CoordinateSystem( n, &t1, &t2 );
+
+		unsigned int state = Hash( seed );
+		int open = 0;
+
+		for ( int i = 0; i < settings.aoSamples; ++i ) {
+			// Cosine weighted, so the plain hit ratio is the estimate.
+			float phi = 2.0f * Math::PI * NextRandom( state );
+			float r2 = NextRandom( state );
+			float r = std::sqrt( r2 );
+
+			Math::Vector3 d = t1 * ( r * std::cos( phi ) ) + t2 * ( r * std::sin( phi ) ) + n * std::sqrt( 1.0f - r2 );
+
+			if ( !bvh.Occluded( Math::Ray( origin, d, 0.0f, settings.aoDistance ) ) ) {
+				++open;
+			}
+		}
+
+		light += settings.skyIntensity * open / settings.aoSamples;
+	}
+
+	return light;
+}
+
+void RayTracer::Render( const Math::Vector3& eye, const Math::Vector3& target, const Math::Vector3& up,
+						float fovY, int width, int height, JobSystem& jobs, std::vector< unsigned char >& rgb ) const {
+	rgb.resize( ( size_t ) width * height * 3 );
+
+	Math::Vector3 forward = Math::Normalize( target - eye );
+	Math::Vector3 right = Math::Normalize( Math::Cross( forward, up ) );
+	Math::Vector3 trueUp = Math::Cross( right, forward );
+
+	float tanHalf = std::tan( fovY * Math::PI_OVER_360 );
+	float aspect = ( float ) width / height;
+
+	Math::Vector3 du = right * ( 2.0f * tanHalf * aspect / width );
+	Math::Vector3 dv = trueUp * ( -2.0f * tanHalf / height );
+	Math::Vector3 corner = forward - right * ( tanHalf * aspect ) + trueUp * tanHalf;
+
+	int tilesX = ( width + TILE_SIZE - 1 ) / TILE_SIZE;
+	int tilesY = ( height + TILE_SIZE - 1 ) / TILE_SIZE;
+
+	jobs.ParallelFor( tilesX * tilesY, 1, [ & ]( int begin, int end ) {
+		for ( int tile = begin; tile < end; ++tile ) {
+			int x0 = ( tile % tilesX ) * TILE_SIZE;
+			int y0 = ( tile / tilesX ) * TILE_SIZE;
+			int x1 = std::min( x0 + TILE_SIZE, width );
+			int y1 = std::min( y0 + TILE_SIZE, height );
+
+			for ( int y = y0; y < y1; y += 2 ) {
+				for ( int x = x0; x < x1; x += 2 ) {
+					// 2x2 pixels, lanes off the image edge are disabled.
+					float dx[ 4 ], dy[ 4 ], dz[ 4 ], tmin[ 4 ], tmax[ 4 ];
+					int px[ 4 ], py[ 4 ];
+
+					for ( int k = 0; k < 4; ++k ) {
+						px[ k ] = x + ( k & 1 );
+						py[ k ] = y + ( k >> 1 );
+
+						Math::Vector3 d = Math::Normalize( corner + du * ( px[ k ] + 0.5f ) + dv * ( py[ k ] + 0.5f ) );
+						dx[ k ] = d.x;
+						dy[ k ] = d.y;
+						dz[ k ] = d.z;
+
+						bool valid = px[ k ] < x1 && py[ k ] < y1;
+						tmin[ k ] = valid ? 0.0f : 1.0f;
+						tmax[ k ] = valid ? FLT_MAX : 0.0f;
+					}
+
+					RayPacket packet;
+					packet.ox = _mm_set1_ps( eye.x );
+					packet.oy = _mm_set1_ps( eye.y );
+					packet.oz = _mm_set1_ps( eye.z );
+					packet.dx = _mm_loadu_ps( dx );
+					packet.dy = _mm_loadu_ps( dy );
+					packet.dz = _mm_loadu_ps( dz );
+					packet.tmin = _mm_loadu_ps( tmin );
+					packet.tmax = _mm_loadu_ps( tmax );
+
+					PacketHit hit;
+					bvh.IntersectPacket( packet, &hit );
+					_mm_storeu_ps( tmax, packet.tmax );
+
+					for ( int k = 0; k < 4; ++k ) {
+						if ( px[ k ] >= x1 || py[ k ] >= y1 ) {
+							continue;
+						}
+
+						unsigned char* out = &rgb[ ( ( size_t ) py[ k ] * width + px[ k ] ) * 3 ];
+
+						if ( hit.triangle[ k ] == BVH::NO_HIT ) {
+							for ( int c = 0; c < 3; ++c ) {
+								out[ c ] = ToByte( settings.background[ c ] );
+							}
+
+							continue;
+						}
+
+						unsigned int tri = hit.triangle[ k ];
+						Math::Vector3 d( dx[ k ], dy[ k ], dz[ k ] );
+						Math::Vector3 n = Math::Normalize( TriangleNormal( tri ) );
+
+						if ( Math::Dot( n, d ) > 0.0f ) {
+							n = -n;
+						}
+
+						Math::Point3 p = Math::Point3( eye.x, eye.y, eye.z ) + d * tmax[ k ];
+						float light = Irradiance( p, n, ( unsigned int ) ( py[ k ] * width + px[ k ] ) );
+
+						float u = hit.u[ k ];
+						float v = hit.v[ k ];
+						float w = 1.0f - u - v;
+
+						for ( int c = 0; c < 3; ++c ) {
+							float base = w * colors[ indices[ tri * 3 ] * 3 + c ] +
+										 u * colors[ indices[ tri * 3 + 1 ] * 3 + c ] +
+										 v * colors[ indices[ tri * 3 + 2 ] * 3 + c ];
+
+							out[ c ] = ToByte( base * light );
+						}
+					}
+				}
+			}
+		}
+	} );
+}
+
+void RayTracer::BakeVertexColors( unsigned int instance, JobSystem& jobs, std::vector< float >& out ) const {
+	const Instance& inst = instances[ instance ];
+
+	// Area weighted vertex normals from the instance's own triangles.
+	std::vector< Math::Vector3 > normals( inst.vertexCount, Math::Vector3( 0.0f, 0.0f, 0.0f ) );
+
+	for ( unsigned int t = inst.firstTriangle; t < inst.firstTriangle + inst.triangleCount; ++t ) {
+		Math::Vector3 n = TriangleNormal( t );
+
+		for ( int k = 0; k < 3; ++k ) {
+			normals[ indices[ t * 3 + k ] - inst.firstVertex ] += n;
+		}
+	}
+
+	out.resize( inst.vertexCount * 3 );
+
+	jobs.ParallelFor( ( int ) inst.vertexCount, 64, [ & ]( int begin, int end ) {
+		for ( int i = begin; i < end; ++i ) {
+			unsigned int vertex = inst.firstVertex + i;
+			const float* p = &positions[ vertex * 3 ];
+
+			float light = 0.0f;
+			float length = normals[ i ].Length();
+
+			if ( length > 0.0f ) {
+				light = Irradiance( Math::Point3( p[ 0 ], p[ 1 ], p[ 2 ] ), normals[ i ] / length, Hash( vertex ) );
+			}
+
+			for ( int c = 0; c < 3; ++c ) {
+				out[ i * 3 + c ] = colors[ vertex * 3 + c ] * light;
+			}
+		}
+	} );
+}
+
+}
@@ -0,0 +1,80 @@
+#ifndef RAYTRACER_H
+#define RAYTRACER_H
+
+#include <vector>
+
+#include "Mesh.h"
+#include "LOD.h"
+#include "BVH.h"
+#include "JobSystem.h"
+#include "Matrix4.h"
+
+namespace DS {
+
+struct TraceSettings {
+	Math::Vector3 sunDirection;		// Towards the sun, unit length.
+	float sunIntensity;
+	float skyIntensity;
+	int aoSamples;					// Sky visibility rays per shading point.
+	float aoDistance;				// Occluders further away are ignored.
+	float background[ 3 ];
+};
+
+/**
+	DS::RayTracer - Offline reference renderer and light baker
+
+	Meshes are flattened into world space and put in one BVH. Lighting is
+	vertex color times direct light from a sun with hard shadows plus sky
+	light, estimated with cosine weighted ambient occlusion rays.
+
+	Render cuts the image into 16x16 tiles handed out through the job
+	system. Primary rays go through the BVH as 2x2 pixel packets;
+	shadow and sky rays are traced one at a time. Random numbers are
+	seeded per pixel, so an image does not depend on the thread count.
+
+	BakeVertexColors evaluates the same lighting at each vertex of one
+	instance and returns its colors with the light multiplied in.
+**/
+class RayTracer {
+public:
+	RayTracer( void );
+	~RayTracer( void );
+
+	// transform is column vector convention, as Math::Translate returns.
+	unsigned int AddMesh( const Mesh& mesh, const LODLevel& level, const Math::Matrix4& transform );
+	void Build( void );
+	void Clear( void );
+
+	TraceSettings& Settings( void );
+
+	// rgb is resized to width * height * 3, rows top to bottom.
+	void Render( const Math::Vector3& eye, const Math::Vector3& target, const Math::Vector3& up,
+				 float fovY, int width, int height, JobSystem& jobs, std::vector< unsigned char >& rgb ) const;
+
+	// colors gets three floats per vertex of the instance.
+	void BakeVertexColors( unsigned int instance, JobSystem& jobs, std::vector< float >& colors ) const;
+
+private:
+	struct Instance {
+		unsigned int firstVertex;
+		unsigned int vertexCount;
+		unsigned int firstTriangle;
+		unsigned int triangleCount;
+	};
+
+	float Irradiance( const Math::Point3& p, const Math::Vector3& n, unsigned int seed ) const;
+	Math::Vector3 TriangleNormal( unsigned int triangle ) const;
+
+	std::vector< float > positions;
+	std::vector< float > colors;
+	std::vector< unsigned int > indices;
+	std::vector< Instance > instances;
+
+	BVH bvh;
+	TraceSettings settings;
+	float bias;
+};
+
+}
+
+#endif
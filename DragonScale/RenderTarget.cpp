@@ -0,0 +1,80 @@
+#include "RenderTarget.h"
+#include "MemoryTracker.h"
+
+#include <cstdio>
+
+#include <GL/glew.h>
+
+namespace DS {
+
+RenderTarget::RenderTarget( void )
+	: width( 0 ), height( 0 ), framebuffer( 0 ), color( 0 ), depth( 0 ) {
+}
+
+RenderTarget::~RenderTarget( void ) {
+}
+
+bool RenderTarget::Init( int w, int h, bool floatDepth ) {
+	width = w;
+	height = h;
+
+	glGenFramebuffers( 1, &framebuffer );
+	glGenRenderbuffers( 1, &color );
+	glGenRenderbuffers( 1, &depth );
+
+	glBindRenderbuffer( GL_RENDERBUFFER, color );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+
+	glBindRenderbuffer( GL_RENDERBUFFER, depth );
+	glRenderbufferStorage( GL_RENDERBUFFER, floatDepth ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24, width, height );
+
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth );
+
+	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+	size_t pixels = ( size_t ) width * height;
+
+	Memory::TrackGL( MEMORY_GL_RENDERBUFFER, MEMORY_GENERAL, color, pixels * 4 );
+	Memory::TrackGL( MEMORY_GL_RENDERBUFFER, MEMORY_GENERAL, depth, pixels * 4 );
+
+	if ( status != GL_FRAMEBUFFER_COMPLETE ) {
+		fprintf( stderr, "Render target incomplete: 0x%x\n", status );
+		Shutdown();
+		return false;
+	}
+
+	return true;
+}
+
+void RenderTarget::Shutdown( void ) {
+	if ( framebuffer == 0 ) {
+		return;
+	}
+
+	Memory::ReleaseGL( MEMORY_GL_RENDERBUFFER, color );
+	Memory::ReleaseGL( MEMORY_GL_RENDERBUFFER, depth );
+
+	glDeleteFramebuffers( 1, &framebuffer );
+	glDeleteRenderbuffers( 1, &color );
+	glDeleteRenderbuffers( 1, &depth );
+
+	framebuffer = color = depth = 0;
+}
+
+void RenderTarget::Bind( void ) {
+	glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+}
+
+void RenderTarget::Present( void ) {
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, framebuffer );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+	glBlitFramebuffer( 0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST );
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+}
@@ -0,0 +1,39 @@
+#ifndef RENDERTARGET_H
+#define RENDERTARGET_H
+
+namespace DS {
+
+/**
+	DS::RenderTarget - Offscreen color and depth
+
+	The default framebuffer's depth format is whatever the window system
+	hands out, usually 24-bit fixed point. Rendering into this instead gets
+	a 32-bit float depth buffer, which is what reverse-Z needs to keep its
+	precision far away. Present copies the color to the back buffer.
+**/
+class RenderTarget {
+public:
+	RenderTarget( void );
+	~RenderTarget( void );
+
+	bool Init( int width, int height, bool floatDepth );
+	void Shutdown( void );
+
+	// For drawing and reading, FrameCapture included.
+	void Bind( void );
+
+	// Blits the color to the default framebuffer and binds that again.
+	void Present( void );
+
+private:
+	int width;
+	int height;
+
+	unsigned int framebuffer;
+	unsigned int color;			// Renderbuffers.
+	unsigned int depth;
+};
+
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include "SIMDMath.h"
+
+namespace Math {
+
+namespace {
+
+	// Loads up to four floats, padding the rest with pad.
+	inline __m128 LoadPartial( const float* p, int n, float pad ) {
+		if ( n >= 4 ) {
+			return _mm_loadu_ps( p );
+		}
+
+		float tmp[ 4 ] = { pad, pad, pad, pad };
+		for ( int i = 0; i < n; ++i ) { tmp[ i ] = p[ i ]; }
+
+		return _mm_loadu_ps( tmp );
+	}
+
+	inline void StorePartial( float* p, __m128 v, int n ) {
+		if ( n >= 4 ) {
+			_mm_storeu_ps( p, v );
+			return;
+		}
+
+		float tmp[ 4 ];
+		_mm_storeu_ps( tmp, v );
+
+		for ( int i = 0; i < n; ++i ) { p[ i ] = tmp[ i ]; }
+	}
+
+	// Pulls component k out of up to four xyz triplets.
+	inline __m128 LoadComponent( const float* triplets, int k, int n ) {
+		float tmp[ 4 ] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for ( int i = 0; i < n && i < 4; ++i ) { tmp[ i ] = triplets[ i * 3 + k ]; }
+
+		return _mm_loadu_ps( tmp );
+	}
+
+	// Writes a 3x3 rotation held as nine lane vectors into up to four matrices.
+	void StoreRotations( const __m128 r[ 3 ][ 3 ], Matrix4* out, int n ) {
+		float lanes[ 3 ][ 3 ][ 4 ];
+
+		for ( int i = 0; i < 3; ++i ) {
+			for ( int j = 0; j < 3; ++j ) {
+				_mm_storeu_ps( lanes[ i ][ j ], r[ i ][ j ] );
+			}
+		}
+
+		for ( int k = 0; k < n && k < 4; ++k ) {
+			Matrix4& m = out[ k ];
+
+			for ( int i = 0; i < 3; ++i ) {
+				for ( int j = 0; j < 3; ++j ) {
+					m.c[ i ][ j ] = lanes[ i ][ j ][ k ];
+				}
+
+				m.c[ i ][ 3 ] = 0.0f;
+				m.c[ 3 ][ i ] = 0.0f;
+			}
+
+			m.c[ 3 ][ 3 ] = 1.0f;
+		}
+	}
+
+}
+
+void SinCos( const float* x, float* sinOut, float* cosOut, int count ) {
+	for ( int i = 0; i < count; i += 4 ) {
+		int n = count - i;
+		__m128 c;
+		__m128 s = SinCos4( LoadPartial( &x[ i ], n, 0.0f ), &c );
+
+		StorePartial( &sinOut[ i ], s, n );
+		StorePartial( &cosOut[ i ], c, n );
+	}
+}
+
+void Tan( const float* x, float* out, int count ) {
+	for ( int i = 0; i < count; i += 4 ) {
+		int n = count - i;
+		StorePartial( &out[ i ], Tan4( LoadPartial( &x[ i ], n, 0.0f ) ), n );
+	}
+}
+
+void Atan2( const float* y, const float* x, float* out, int count ) {
+	for ( int i = 0; i < count; i += 4 ) {
+		int n = count - i;
+		StorePartial( &out[ i ], Atan2_4( LoadPartial( &y[ i ], n, 0.0f ), LoadPartial( &x[ i ], n, 1.0f ) ), n );
+	}
+}
+
+void Rsqrt( const float* x, float* out, int count ) {
+	for ( int i = 0; i < count; i += 4 ) {
+		int n = count - i;
+		StorePartial( &out[ i ], Rsqrt4( LoadPartial( &x[ i ], n, 1.0f ) ), n );
+	}
+}
+
+void EulerBatch( const float* angles, Matrix4* out, int count ) {
+	const __m128 toRadians = _mm_set1_ps( PI_OVER_180 );
+
+	for ( int i = 0; i < count; i += 4 ) {
+		int n = count - i;
+		const float* src = &angles[ i * 3 ];
+
+		__m128 a, c, e;
+		__m128 b = SinCos4( _mm_mul_ps( LoadComponent( src, 0, n ), toRadians ), &a );
+		__m128 d = SinCos4( _mm_mul_ps( LoadComponent( src, 1, n ), toRadians ), &c );
+		__m128 f = SinCos4( _mm_mul_ps( LoadComponent( src, 2, n ), toRadians ), &e );
+
+		__m128 ad = _mm_mul_ps( a, d );
+		__m128 bd = _mm_mul_ps( b, d );
+
+		__m128 r[ 3 ][ 3 ];
+		r[ 0 ][ 0 ] = _mm_mul_ps( c, e );
+		r[ 0 ][ 1 ] = _mm_sub_ps( _mm_setzero_ps(), _mm_mul_ps( c, f ) );
+		r[ 0 ][ 2 ] = d;
+		r[ 1 ][ 0 ] = _mm_add_ps( _mm_mul_ps( bd, e ), _mm_mul_ps( a, f ) );
+		r[ 1 ][ 1 ] = _mm_sub_ps( _mm_mul_ps( a, e ), _mm_mul_ps( bd, f ) );
+		r[ 1 ][ 2 ] = _mm_sub_ps( _mm_setzero_ps(), _mm_mul_ps( b, c ) );
+		r[ 2 ][ 0 ] = _mm_sub_ps( _mm_mul_ps( b, f ), _mm_mul_ps( ad, e ) );
+		r[ 2 ][ 1 ] = _mm_add_ps( _mm_mul_ps( ad, f ), _mm_mul_ps( b, e ) );
+		r[ 2 ][ 2 ] = _mm_mul_ps( a, c );
+
+		StoreRotations( r, &out[ i ], n );
+	}
+}
+
+}
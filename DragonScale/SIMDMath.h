@@ -0,0 +1,149 @@
+#ifndef SIMDMATH_H
+#define SIMDMATH_H
+
+#include <emmintrin.h>
+
+#include "Vector3.h"
+#include "Matrix4.h"
+
+namespace Math {
+
+/**
+	SSE transcendental kernels, four lanes at a time.
+
+	Polynomials and range reduction follow Cephes' single precision
+	routines. Measured against double precision libm over the stated
+	ranges:
+
+	SinCos4 - |x| <= 8192, absolute error < 1e-7. Accuracy falls off
+			  beyond that as the range reduction runs out of bits.
+	Tan4    - sin / cos, so relative error is about 1e-7 / |cos x|:
+			  < 2e-5 wherever |cos x| > 0.01.
+	Atan2_4 - All finite inputs, absolute error < 3e-7 radians.
+			  Atan2_4( 0, 0 ) is 0.
+	Rsqrt4  - x > 0, relative error < 3e-7 ( rsqrtps plus one Newton step ).
+**/
+inline __m128 SinCos4( __m128 x, __m128* cosOut ) {
+	const __m128 signMask = _mm_castsi128_ps( _mm_set1_epi32( 0x80000000 ) );
+
+	__m128 sinSign = _mm_and_ps( x, signMask );
+	x = _mm_andnot_ps( signMask, x );
+
+	// j = ( int ) ( x * 4 / PI ), rounded up to even.
+	__m128i j = _mm_cvttps_epi32( _mm_mul_ps( x, _mm_set1_ps( 1.27323954473516f ) ) );
+	j = _mm_add_epi32( j, _mm_set1_epi32( 1 ) );
+	j = _mm_and_si128( j, _mm_set1_epi32( ~1 ) );
+	__m128 y = _mm_cvtepi32_ps( j );
+
+	// Octant decides the swap between the polynomials and the signs.
+	__m128i swapSin = _mm_cmpeq_epi32( _mm_and_si128( j, _mm_set1_epi32( 2 ) ), _mm_setzero_si128() );
+	__m128 sinFlip = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( j, _mm_set1_epi32( 4 ) ), 29 ) );
+	__m128 cosFlip = _mm_castsi128_ps( _mm_slli_epi32( _mm_andnot_si128( _mm_sub_epi32( j, _mm_set1_epi32( 2 ) ), _mm_set1_epi32( 4 ) ), 29 ) );
+	__m128 polyMask = _mm_castsi128_ps( swapSin );
+
+	sinSign = _mm_xor_ps( sinSign, sinFlip );
+
+	// Extended precision modular arithmetic ( Cody-Waite ).
+	x = _mm_sub_ps( x, _mm_mul_ps( y, _mm_set1_ps( 0.78515625f ) ) );
+	x = _mm_sub_ps( x, _mm_mul_ps( y, _mm_set1_ps( 2.4187564849853515625e-4f ) ) );
+	x = _mm_sub_ps( x, _mm_mul_ps( y, _mm_set1_ps( 3.77489497744594108e-8f ) ) );
+
+	__m128 z = _mm_mul_ps( x, x );
+
+	// cos( x ) on [ -PI/4, PI/4 ]
+	__m128 c = _mm_set1_ps( 2.443315711809948e-5f );
+	c = _mm_add_ps( _mm_mul_ps( c, z ), _mm_set1_ps( -1.388731625493765e-3f ) );
+	c = _mm_add_ps( _mm_mul_ps( c, z ), _mm_set1_ps( 4.166664568298827e-2f ) );
+	c = _mm_mul_ps( _mm_mul_ps( c, z ), z );
+	c = _mm_sub_ps( c, _mm_mul_ps( z, _mm_set1_ps( 0.5f ) ) );
+	c = _mm_add_ps( c, _mm_set1_ps( 1.0f ) );
+
+	// sin( x ) on [ -PI/4, PI/4 ]
+	__m128 s = _mm_set1_ps( -1.9515295891e-4f );
+	s = _mm_add_ps( _mm_mul_ps( s, z ), _mm_set1_ps( 8.3321608736e-3f ) );
+	s = _mm_add_ps( _mm_mul_ps( s, z ), _mm_set1_ps( -1.6666654611e-1f ) );
+	s = _mm_mul_ps( _mm_mul_ps( s, z ), x );
+	s = _mm_add_ps( s, x );
+
+	__m128 sinResult = _mm_or_ps( _mm_and_ps( polyMask, s ), _mm_andnot_ps( polyMask, c ) );
+	__m128 cosResult = _mm_or_ps( _mm_and_ps( polyMask, c ), _mm_andnot_ps( polyMask, s ) );
+
+	*cosOut = _mm_xor_ps( cosResult, cosFlip );
+
+	return _mm_xor_ps( sinResult, sinSign );
+}
+
+inline __m128 Tan4( __m128 x ) {
+	__m128 c;
+	__m128 s = SinCos4( x, &c );
+
+	return _mm_div_ps( s, c );
+}
+
+inline __m128 Atan2_4( __m128 y, __m128 x ) {
+	const __m128 signMask = _mm_castsi128_ps( _mm_set1_epi32( 0x80000000 ) );
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 ax = _mm_andnot_ps( signMask, x );
+	__m128 ay = _mm_andnot_ps( signMask, y );
+
+	// atan of t = min / max in [ 0, 1 ], then mirror.
+	__m128 lo = _mm_min_ps( ax, ay );
+	__m128 hi = _mm_max_ps( ax, ay );
+	__m128 t = _mm_div_ps( lo, _mm_max_ps( hi, _mm_set1_ps( 1e-30f ) ) );
+
+	// Reduce to [ 0, tan( PI/8 ) ].
+	__m128 big = _mm_cmpgt_ps( t, _mm_set1_ps( 0.4142135623730950f ) );
+	__m128 reduced = _mm_div_ps( _mm_sub_ps( t, _mm_set1_ps( 1.0f ) ), _mm_add_ps( t, _mm_set1_ps( 1.0f ) ) );
+	t = _mm_or_ps( _mm_and_ps( big, reduced ), _mm_andnot_ps( big, t ) );
+	__m128 base = _mm_and_ps( big, _mm_set1_ps( PI * 0.25f ) );
+
+	__m128 z = _mm_mul_ps( t, t );
+	__m128 p = _mm_set1_ps( 8.05374449538e-2f );
+	p = _mm_add_ps( _mm_mul_ps( p, z ), _mm_set1_ps( -1.38776856032e-1f ) );
+	p = _mm_add_ps( _mm_mul_ps( p, z ), _mm_set1_ps( 1.99777106478e-1f ) );
+	p = _mm_add_ps( _mm_mul_ps( p, z ), _mm_set1_ps( -3.33329491539e-1f ) );
+	p = _mm_add_ps( _mm_mul_ps( _mm_mul_ps( p, z ), t ), t );
+
+	__m128 r = _mm_add_ps( base, p );
+
+	// |y| > |x|: PI/2 - r
+	__m128 steep = _mm_cmpgt_ps( ay, ax );
+	r = _mm_or_ps( _mm_and_ps( steep, _mm_sub_ps( _mm_set1_ps( PI * 0.5f ), r ) ), _mm_andnot_ps( steep, r ) );
+
+	// x < 0: PI - r
+	__m128 left = _mm_cmplt_ps( x, zero );
+	r = _mm_or_ps( _mm_and_ps( left, _mm_sub_ps( _mm_set1_ps( PI ), r ) ), _mm_andnot_ps( left, r ) );
+
+	// Take the sign of y.
+	return _mm_or_ps( r, _mm_and_ps( y, signMask ) );
+}
+
+inline __m128 Rsqrt4( __m128 x ) {
+	__m128 r = _mm_rsqrt_ps( x );
+
+	// r' = r * ( 1.5 - 0.5 * x * r * r )
+	__m128 halfXrr = _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 0.5f ), x ), _mm_mul_ps( r, r ) );
+	return _mm_mul_ps( r, _mm_sub_ps( _mm_set1_ps( 1.5f ), halfXrr ) );
+}
+
+/**
+	Batched versions over plain float arrays. Arrays need no alignment and
+	count need not be a multiple of four.
+**/
+void SinCos( const float* x, float* sinOut, float* cosOut, int count );
+void Tan( const float* x, float* out, int count );
+void Atan2( const float* y, const float* x, float* out, int count );
+void Rsqrt( const float* x, float* out, int count );
+
+/**
+	Math::EulerBatch
+
+	Same matrices as Math::Euler for count ( pitch, yaw, roll ) triplets in
+	degrees, four at a time.
+**/
+void EulerBatch( const float* angles, Matrix4* out, int count );
+
+}
+
+#endif
@@ -0,0 +1,406 @@
+#include "ShadowCascades.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+namespace DS {
+
+namespace {
+
+	// Polygon offset while drawing casters, on top of the normal offset
+	// simple.frag applies.
+	const float SLOPE_BIAS = 1.5f;
+	const float CONSTANT_BIAS = 2.0f;
+
+	float Project( const Math::Vector3& axis, const Math::Point3& p ) {
+		return axis.x * p.x + axis.y * p.y + axis.z * p.z;
+	}
+
+	/* Inverse of a rigid, column major view matrix. */
+	Math::Point3 ViewToWorld( const Math::Matrix4& view, float x, float y, float z ) {
+		float v[ 3 ] = { x - view.c[ 3 ][ 0 ], y - view.c[ 3 ][ 1 ], z - view.c[ 3 ][ 2 ] };
+		float p[ 3 ];
+
+		for ( int k = 0; k < 3; ++k ) {
+			p[ k ] = view.c[ k ][ 0 ] * v[ 0 ] + view.c[ k ][ 1 ] * v[ 1 ] + view.c[ k ][ 2 ] * v[ 2 ];
+		}
+
+		return Math::Point3( p[ 0 ], p[ 1 ], p[ 2 ] );
+	}
+
+	GLuint CreateDepthArray( int resolution, int layers, bool compare, bool reversed ) {
+		GLuint texture;
+		glGenTextures( 1, &texture );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, texture );
+
+		glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL );
+
+		// Linear filtering on a comparison gives 2x2 PCF per lookup.
+		GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+
+		glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter );
+		glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter );
+		glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+		if ( compare ) {
+			glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE );
+			glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, reversed ? GL_GEQUAL : GL_LEQUAL );
+		}
+
+		Memory::TrackGL( MEMORY_GL_TEXTURE, MEMORY_LIGHTING, texture, ( size_t ) resolution * resolution * layers * 4 );
+
+		return texture;
+	}
+
+}
+
+ShadowDesc::ShadowDesc( void )
+	: cascades( 4 ), resolution( 1024 ), distance( 80.0f ), splitBlend( 0.75f ), firstCached( 2 ),
+	  cacheMargin( 0.25f ), cacheAngle( 2.0f ), reversed( false ) {
+}
+
+ShadowCascades::ShadowCascades( void )
+	: units( NULL ), unit( 0 ), texture( 0 ), cacheTexture( 0 ), staticRedraws( 0 ), staticReuses( 0 ) {
+	framebuffers[ 0 ] = framebuffers[ 1 ] = 0;
+
+	for ( int i = 0; i < MAX_SHADOW_CASCADES; ++i ) {
+		cascades[ i ].x = cascades[ i ].y = cascades[ i ].z = 0.0f;
+		cascades[ i ].extent = 1.0f;
+		cascades[ i ].split = 0.0f;
+		cascades[ i ].fitted = false;
+		cascades[ i ].staticDirty = true;
+	}
+}
+
+ShadowCascades::~ShadowCascades( void ) {
+}
+
+bool ShadowCascades::Init( const ShadowDesc& d, TextureUnits* u, unsigned int first ) {
+	desc = d;
+	desc.cascades = std::max( 1, std::min( desc.cascades, MAX_SHADOW_CASCADES ) );
+	desc.firstCached = std::max( 0, std::min( desc.firstCached, desc.cascades ) );
+
+	units = u;
+	unit = first;
+
+	// Set up through the unit the shadow map is sampled from.
+	units->Bind( unit, GL_TEXTURE_2D_ARRAY, 0 );
+
+	texture = CreateDepthArray( desc.resolution, desc.cascades, true, desc.reversed );
+
+	if ( desc.firstCached < desc.cascades ) {
+		cacheTexture = CreateDepthArray( desc.resolution, desc.cascades - desc.firstCached, false, desc.reversed );
+	}
+
+	glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+
+	glGenFramebuffers( 2, framebuffers );
+
+	GLuint attached[ 2 ] = { texture, cacheTexture };
+	GLenum status = GL_FRAMEBUFFER_COMPLETE;
+
+	for ( int i = 0; i < 2 && attached[ i ] != 0; ++i ) {
+		glBindFramebuffer( GL_FRAMEBUFFER, framebuffers[ i ] );
+		glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, attached[ i ], 0, 0 );
+		glDrawBuffer( GL_NONE );
+		glReadBuffer( GL_NONE );
+
+		if ( status == GL_FRAMEBUFFER_COMPLETE ) {
+			status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+		}
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+	if ( status != GL_FRAMEBUFFER_COMPLETE ) {
+		fprintf( stderr, "Shadow map incomplete: 0x%x\n", status );
+		Shutdown();
+		return false;
+	}
+
+	units->Bind( unit, GL_TEXTURE_2D_ARRAY, texture );
+
+	return true;
+}
+
+void ShadowCascades::Shutdown( void ) {
+	if ( framebuffers[ 0 ] == 0 ) {
+		return;
+	}
+
+	GLuint textures[ 2 ] = { texture, cacheTexture };
+
+	for ( int i = 0; i < 2; ++i ) {
+		Memory::ReleaseGL( MEMORY_GL_TEXTURE, textures[ i ] );
+		units->Invalidate( textures[ i ] );
+	}
+
+	glDeleteFramebuffers( 2, framebuffers );
+	glDeleteTextures( 2, textures );
+
+	framebuffers[ 0 ] = framebuffers[ 1 ] = 0;
+	texture = cacheTexture = 0;
+	programs.clear();
+}
+
+void ShadowCascades::SetupProgram( unsigned int program ) {
+	GL::UseProgram( program );
+	GL::Uniform1i( glGetUniformLocation( program, "SHADOW_MAP" ), unit );
+	GL::Uniform1i( glGetUniformLocation( program, "SHADOW_CASCADES" ), desc.cascades );
+
+	ProgramUniforms uniforms;
+	uniforms.program = program;
+	uniforms.matrices = glGetUniformLocation( program, "SHADOW_MATRICES" );
+	uniforms.splits = glGetUniformLocation( program, "SHADOW_SPLITS" );
+	uniforms.texels = glGetUniformLocation( program, "SHADOW_TEXELS" );
+
+	programs.push_back( uniforms );
+}
+
+/*
+	Each slice's bounding sphere sits on the view axis, where the near and
+	far corners are equally far away, or at the far plane for slices too
+	wide for that. It only depends on the projection and the split depths,
+	so the cascades keep their size whichever way the camera looks.
+*/
+void ShadowCascades::Update( const Math::Matrix4& view, float fovY, float aspect, float zNear, const Math::Vector3& direction ) {
+	Math::Vector3 toLight = Math::Normalize( direction );
+
+	float tanY = tanf( fovY * Math::PI_OVER_360 );
+	float tanX = tanY * aspect;
+	float k2 = tanX * tanX + tanY * tanY;
+	float turnLimit = cosf( desc.cacheAngle * Math::PI / 180.0f );
+
+	float previous = zNear;
+
+	for ( int i = 0; i < desc.cascades; ++i ) {
+		Cascade& c = cascades[ i ];
+
+		float t = ( float ) ( i + 1 ) / desc.cascades;
+		float logSplit = zNear * powf( desc.distance / zNear, t );
+		float evenSplit = zNear + ( desc.distance - zNear ) * t;
+
+		float n = previous;
+		float f = desc.splitBlend * logSplit + ( 1.0f - desc.splitBlend ) * evenSplit;
+		float z = std::min( 0.5f * ( f + n ) * ( 1.0f + k2 ), f );
+		float radius = std::max( sqrtf( ( z - n ) * ( z - n ) + n * n * k2 ), sqrtf( ( f - z ) * ( f - z ) + f * f * k2 ) );
+
+		Math::Point3 center = ViewToWorld( view, 0.0f, 0.0f, -z );
+
+		c.split = f;
+		previous = f;
+
+		if ( i < desc.firstCached ) {
+			Fit( c, toLight, center, radius );
+			continue;
+		}
+
+		// A cached cascade stays put while the sphere is inside it, in its
+		// own light space from when it was fitted.
+		bool keep = c.fitted && Math::Dot( -c.forward, toLight ) >= turnLimit;
+
+		if ( keep ) {
+			keep = fabsf( Project( c.right, center ) - c.x ) + radius <= c.extent &&
+				   fabsf( Project( c.up, center ) - c.y ) + radius <= c.extent &&
+				   fabsf( Project( c.forward, center ) - c.z ) + radius <= c.extent;
+		}
+
+		if ( !keep ) {
+			Fit( c, toLight, center, radius * ( 1.0f + desc.cacheMargin ) );
+			c.staticDirty = true;
+		}
+	}
+}
+
+/*
+	The center moves in whole texels across the light's view, so the
+	texels stay put on the ground. Depth runs from the near side of the
+	cube around the sphere, nearer casters are clamped onto it.
+*/
+void ShadowCascades::Fit( Cascade& c, const Math::Vector3& toLight, const Math::Point3& center, float extent ) {
+	c.forward = -toLight;
+
+	Math::Vector3 reference = fabsf( c.forward.y ) > 0.99f ? Math::Vector3( 1.0f, 0.0f, 0.0f ) : Math::Vector3( 0.0f, 1.0f, 0.0f );
+	c.right = Math::Normalize( Math::Cross( c.forward, reference ) );
+	c.up = Math::Cross( c.right, c.forward );
+
+	float texel = 2.0f * extent / desc.resolution;
+
+	c.extent = extent;
+	c.x = floorf( Project( c.right, center ) / texel + 0.5f ) * texel;
+	c.y = floorf( Project( c.up, center ) / texel + 0.5f ) * texel;
+	c.z = Project( c.forward, center );
+	c.fitted = true;
+
+	// Window depth w, 0 at the near side and 1 at the far one.
+	float depthScale = 1.0f / ( 2.0f * extent );
+	float depthBias = -( c.z - extent ) * depthScale;
+
+	// Reverse-Z clips to 1 - w in [ 0, 1 ], which is also what it stores;
+	// otherwise clip depth is 2w - 1 and w is stored.
+	float clipScale = desc.reversed ? -depthScale : 2.0f * depthScale;
+	float clipBias = desc.reversed ? 1.0f - depthBias : 2.0f * depthBias - 1.0f;
+	float mapScale = desc.reversed ? -depthScale : depthScale;
+	float mapBias = desc.reversed ? 1.0f - depthBias : depthBias;
+
+	Math::Matrix4 clip;
+	Math::Matrix4 shadow;
+
+	for ( int k = 0; k < 3; ++k ) {
+		clip.c[ k ][ 0 ] = c.right[ k ] / extent;
+		clip.c[ k ][ 1 ] = c.up[ k ] / extent;
+		clip.c[ k ][ 2 ] = c.forward[ k ] * clipScale;
+
+		shadow.c[ k ][ 0 ] = 0.5f * c.right[ k ] / extent;
+		shadow.c[ k ][ 1 ] = 0.5f * c.up[ k ] / extent;
+		shadow.c[ k ][ 2 ] = c.forward[ k ] * mapScale;
+	}
+
+	clip.c[ 3 ][ 0 ] = -c.x / extent;
+	clip.c[ 3 ][ 1 ] = -c.y / extent;
+	clip.c[ 3 ][ 2 ] = clipBias;
+
+	shadow.c[ 3 ][ 0 ] = 0.5f - 0.5f * c.x / extent;
+	shadow.c[ 3 ][ 1 ] = 0.5f - 0.5f * c.y / extent;
+	shadow.c[ 3 ][ 2 ] = mapBias;
+
+	c.clip = clip;
+	c.shadow = shadow;
+}
+
+void ShadowCascades::Invalidate( void ) {
+	for ( int i = desc.firstCached; i < desc.cascades; ++i ) {
+		cascades[ i ].staticDirty = true;
+	}
+}
+
+const Math::Matrix4& ShadowCascades::Matrix( int cascade ) const {
+	return cascades[ cascade ].clip;
+}
+
+bool ShadowCascades::Overlaps( int cascade, const Math::BBox& bounds ) const {
+	if ( bounds.IsEmpty() ) {
+		return false;
+	}
+
+	const Cascade& c = cascades[ cascade ];
+	Math::Point3 center = bounds.Center();
+	Math::Vector3 half = bounds.Extent() * 0.5f;
+
+	// The box's half size along each light space axis.
+	float rx = fabsf( c.right.x ) * half.x + fabsf( c.right.y ) * half.y + fabsf( c.right.z ) * half.z;
+	float ry = fabsf( c.up.x ) * half.x + fabsf( c.up.y ) * half.y + fabsf( c.up.z ) * half.z;
+	float rz = fabsf( c.forward.x ) * half.x + fabsf( c.forward.y ) * half.y + fabsf( c.forward.z ) * half.z;
+
+	return fabsf( Project( c.right, center ) - c.x ) <= c.extent + rx &&
+		   fabsf( Project( c.up, center ) - c.y ) <= c.extent + ry &&
+		   Project( c.forward, center ) - rz <= c.z + c.extent;
+}
+
+void ShadowCascades::Render( const CasterDraw& drawStatic, const CasterDraw& drawDynamic ) {
+	if ( framebuffers[ 0 ] == 0 ) {
+		return;
+	}
+
+	// The lit programs sample the shadow map, it must not be bound while
+	// it is drawn into.
+	units->Bind( unit, GL_TEXTURE_2D_ARRAY, 0 );
+
+	GLsizei size = desc.resolution;
+	glViewport( 0, 0, size, size );
+
+	glEnable( GL_DEPTH_CLAMP );
+	glEnable( GL_POLYGON_OFFSET_FILL );
+
+	// Away from the light, whichever way depth runs.
+	float sign = desc.reversed ? -1.0f : 1.0f;
+	glPolygonOffset( sign * SLOPE_BIAS, sign * CONSTANT_BIAS );
+
+	for ( int i = 0; i < desc.cascades; ++i ) {
+		Cascade& c = cascades[ i ];
+
+		if ( i < desc.firstCached ) {
+			glBindFramebuffer( GL_FRAMEBUFFER, framebuffers[ 0 ] );
+			glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i );
+			glClear( GL_DEPTH_BUFFER_BIT );
+
+			drawStatic( i );
+			drawDynamic( i );
+			continue;
+		}
+
+		GLint layer = i - desc.firstCached;
+
+		if ( c.staticDirty ) {
+			glBindFramebuffer( GL_FRAMEBUFFER, framebuffers[ 1 ] );
+			glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cacheTexture, 0, layer );
+			glClear( GL_DEPTH_BUFFER_BIT );
+
+			drawStatic( i );
+
+			c.staticDirty = false;
+			++staticRedraws;
+		} else {
+			++staticReuses;
+		}
+
+		// The static depth is copied, the dynamic casters go on top of it.
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, framebuffers[ 1 ] );
+		glFramebufferTextureLayer( GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cacheTexture, 0, layer );
+		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, framebuffers[ 0 ] );
+		glFramebufferTextureLayer( GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i );
+		glBlitFramebuffer( 0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST );
+
+		glBindFramebuffer( GL_FRAMEBUFFER, framebuffers[ 0 ] );
+		drawDynamic( i );
+	}
+
+	glDisable( GL_POLYGON_OFFSET_FILL );
+	glDisable( GL_DEPTH_CLAMP );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+void ShadowCascades::Bind( void ) {
+	units->Bind( unit, GL_TEXTURE_2D_ARRAY, texture );
+
+	Math::Matrix4 matrices[ MAX_SHADOW_CASCADES ];
+	float splits[ MAX_SHADOW_CASCADES ] = { 0.0f };
+	float texels[ MAX_SHADOW_CASCADES ] = { 0.0f };
+
+	for ( int i = 0; i < desc.cascades; ++i ) {
+		matrices[ i ] = cascades[ i ].shadow;
+		splits[ i ] = cascades[ i ].split;
+		texels[ i ] = 2.0f * cascades[ i ].extent / desc.resolution;
+	}
+
+	for ( size_t i = 0; i < programs.size(); ++i ) {
+		const ProgramUniforms& p = programs[ i ];
+
+		GL::UseProgram( p.program );
+		GL::UniformMatrix4fv( p.matrices, desc.cascades, GL_FALSE, &matrices[ 0 ].c[ 0 ][ 0 ] );
+		GL::Uniform4f( p.splits, splits[ 0 ], splits[ 1 ], splits[ 2 ], splits[ 3 ] );
+		GL::Uniform4f( p.texels, texels[ 0 ], texels[ 1 ], texels[ 2 ], texels[ 3 ] );
+	}
+}
+
+int ShadowCascades::CascadeCount( void ) const {
+	return desc.cascades;
+}
+
+unsigned int ShadowCascades::StaticRedraws( void ) const {
+	return staticRedraws;
+}
+
+unsigned int ShadowCascades::StaticReuses( void ) const {
+	return staticReuses;
+}
+
+}
@@ -0,0 +1,136 @@
+#ifndef SHADOWCASCADES_H
+#define SHADOWCASCADES_H
+
+#include <functional>
+#include <vector>
+
+#include "BBox.h"
+#include "Matrix4.h"
+#include "Vector3.h"
+#include "TextureUnits.h"
+
+namespace DS {
+
+// The size of simple.frag's cascade arrays.
+const int MAX_SHADOW_CASCADES = 4;
+
+struct ShadowDesc {
+	ShadowDesc( void );
+
+	int cascades;				// Up to MAX_SHADOW_CASCADES.
+	int resolution;				// Texels per cascade side.
+	float distance;				// View depth the last cascade ends at.
+	float splitBlend;			// 0 spaces the splits evenly, 1 logarithmically.
+	int firstCached;			// Cascades from this one on keep their static casters.
+	float cacheMargin;			// Fraction a cached cascade is grown by so it can stay put.
+	float cacheAngle;			// Degrees the light may turn before cached cascades refit.
+	bool reversed;				// Reverse-Z and [ 0, 1 ] clip depth, like the camera.
+};
+
+/**
+	DS::ShadowCascades - Cascaded shadow maps for a directional light
+
+	The view frustum up to the shadow distance is split between the
+	cascades, blending even and logarithmic spacing. Each cascade is fitted
+	around the bounding sphere of its slice of the frustum rather than the
+	slice itself, so its size never changes as the camera turns, and its
+	center is snapped to whole texels in light space; together that keeps
+	the edges of shadows from shimmering as the camera moves. Depth is
+	clamped while rendering, casters between the light and a cascade are
+	flattened onto its near plane instead of clipped, so Overlaps only
+	limits the far side.
+
+	The near cascades are redrawn every frame. From firstCached on the
+	cascades are grown by cacheMargin and only refit once the camera's
+	sphere would leave them or the light turns by more than cacheAngle.
+	Their static casters are drawn into a second texture array only when
+	they refit or after Invalidate; every frame that depth is copied into
+	the shadow map and just the dynamic casters are drawn on top.
+
+	simple.frag picks the cascade by view depth and filters four
+	comparisons; the geometry is offset along its normal by about a texel.
+**/
+class ShadowCascades {
+public:
+	// Draws the casters of one cascade, at Matrix( cascade ).
+	typedef std::function< void( int cascade ) > CasterDraw;
+
+	ShadowCascades( void );
+	~ShadowCascades( void );
+
+	bool Init( const ShadowDesc& desc, TextureUnits* units, unsigned int unit );
+	void Shutdown( void );
+
+	// For a program built with simple.frag. Bind keeps its uniforms current.
+	void SetupProgram( unsigned int program );
+
+	// direction points towards the light.
+	void Update( const Math::Matrix4& view, float fovY, float aspect, float zNear, const Math::Vector3& direction );
+
+	// Static casters changed, cached cascades redraw them on the next Render.
+	void Invalidate( void );
+
+	// Clip space of a cascade, to draw the casters with. Column major.
+	const Math::Matrix4& Matrix( int cascade ) const;
+
+	// Whether bounds can cast into the cascade.
+	bool Overlaps( int cascade, const Math::BBox& bounds ) const;
+
+	// Leaves the default framebuffer bound, and the viewport at the shadow
+	// map's size.
+	void Render( const CasterDraw& drawStatic, const CasterDraw& drawDynamic );
+
+	// After Render, before drawing with any program SetupProgram was called on.
+	void Bind( void );
+
+	int CascadeCount( void ) const;
+	unsigned int StaticRedraws( void ) const;		// Cached cascades that drew their static casters.
+	unsigned int StaticReuses( void ) const;		// Cached cascades that copied them instead.
+
+private:
+	struct Cascade {
+		Math::Vector3 right;			// Light space axes when fitted.
+		Math::Vector3 up;
+		Math::Vector3 forward;			// Away from the light.
+
+		float x;						// Center in light space.
+		float y;
+		float z;
+		float extent;					// Half the side.
+		float split;					// View depth the cascade ends at.
+
+		Math::Matrix4 clip;				// World to clip, column major.
+		Math::Matrix4 shadow;			// World to shadow map coordinates, column major.
+
+		bool fitted;
+		bool staticDirty;
+	};
+
+	struct ProgramUniforms {
+		unsigned int program;
+		int matrices;
+		int splits;
+		int texels;
+	};
+
+	void Fit( Cascade& cascade, const Math::Vector3& direction, const Math::Point3& center, float extent );
+
+	ShadowDesc desc;
+
+	TextureUnits* units;
+	unsigned int unit;
+
+	unsigned int framebuffers[ 2 ];		// Shadow map, static cache.
+	unsigned int texture;				// One layer per cascade.
+	unsigned int cacheTexture;			// One layer per cached cascade.
+
+	Cascade cascades[ MAX_SHADOW_CASCADES ];
+	std::vector< ProgramUniforms > programs;
+
+	unsigned int staticRedraws;
+	unsigned int staticReuses;
+};
+
+}
+
+#endif
@@ -0,0 +1,363 @@
+#include "Simplify.h"
+
+#include <cmath>
+#include <map>
+#include <queue>
+#include <utility>
+#include <algorithm>
+
+#include "Vector3.h"
+
+namespace DS {
+
+namespace {
+
+	// Open edges get a perpendicular plane scaled by this so the border of
+	// the mesh ( and any color seam left by welding ) holds its shape.
+	const double BOUNDARY_WEIGHT = 100.0;
+
+	// Symmetric 4x4 matrix stored as its upper triangle, plus the summed
+	// plane weight so costs can be normalised back to a distance.
+	struct Quadric {
+		double a[ 10 ];
+		double w;
+
+		Quadric( void ) : w( 0.0 ) {
+			for ( int i = 0; i < 10; ++i ) { a[ i ] = 0.0; }
+		}
+
+		void AddPlane( double nx, double ny, double nz, double d, double weight ) {
+			a[ 0 ] += weight * nx * nx; a[ 1 ] += weight * nx * ny; a[ 2 ] += weight * nx * nz; a[ 3 ] += weight * nx * d;
+			a[ 4 ] += weight * ny * ny; a[ 5 ] += weight * ny * nz; a[ 6 ] += weight * ny * d;
+			a[ 7 ] += weight * nz * nz; a[ 8 ] += weight * nz * d;
+			a[ 9 ] += weight * d * d;
+			w += weight;
+		}
+
+		Quadric& operator+=( const Quadric& q ) {
+			for ( int i = 0; i < 10; ++i ) { a[ i ] += q.a[ i ]; }
+			w += q.w;
+			return *this;
+		}
+
+		double Evaluate( double x, double y, double z ) const {
+			return a[ 0 ] * x * x + 2.0 * a[ 1 ] * x * y + 2.0 * a[ 2 ] * x * z + 2.0 * a[ 3 ] * x
+				 + a[ 4 ] * y * y + 2.0 * a[ 5 ] * y * z + 2.0 * a[ 6 ] * y
+				 + a[ 7 ] * z * z + 2.0 * a[ 8 ] * z
+				 + a[ 9 ];
+		}
+	};
+
+	struct Collapse {
+		double cost;
+		unsigned int from;
+		unsigned int to;
+		unsigned int stampFrom;
+		unsigned int stampTo;
+
+		bool operator>( const Collapse& c ) const {
+			return cost > c.cost;
+		}
+	};
+
+	typedef std::priority_queue< Collapse, std::vector< Collapse >, std::greater< Collapse > > CollapseQueue;
+
+	class Simplifier {
+	public:
+		Simplifier( const Mesh& mesh );
+
+		void Run( unsigned int targetTriangles, double maxError );
+		std::vector< unsigned int > Result( void ) const;
+
+		double error;
+
+	private:
+		Math::Vector3 Position( unsigned int v ) const;
+		Math::Vector3 FaceNormal( unsigned int t, unsigned int moved, const Math::Vector3& p ) const;
+		double Cost( unsigned int from, unsigned int to ) const;
+		void PushEdge( unsigned int u, unsigned int v );
+		bool Flips( unsigned int from, unsigned int to ) const;
+		void Apply( unsigned int from, unsigned int to );
+
+		const Mesh& mesh;
+		std::vector< unsigned int > tris;
+		std::vector< bool > triAlive;
+		std::vector< bool > vertAlive;
+		std::vector< unsigned int > stamps;
+		std::vector< Quadric > quadrics;
+		std::vector< std::vector< unsigned int > > adjacency;
+		CollapseQueue queue;
+		unsigned int liveTriangles;
+	};
+
+	Simplifier::Simplifier( const Mesh& m )
+		: error( 0.0 ), mesh( m ), tris( m.indices ), liveTriangles( m.TriangleCount() ) {
+		unsigned int vertexCount = mesh.VertexCount();
+
+		triAlive.assign( liveTriangles, true );
+		vertAlive.assign( vertexCount, true );
+		stamps.assign( vertexCount, 0 );
+		quadrics.resize( vertexCount );
+		adjacency.resize( vertexCount );
+
+		// Face planes, area weighted.
+		std::map< std::pair< unsigned int, unsigned int >, int > edgeUse;
+
+		for ( unsigned int t = 0; t < liveTriangles; ++t ) {
+			unsigned int* v = &tris[ t * 3 ];
+			Math::Vector3 p0 = Position( v[ 0 ] );
+			Math::Vector3 n = Math::Cross( Position( v[ 1 ] ) - p0, Position( v[ 2 ] ) - p0 );
+			float area = n.Length();
+
+			for ( int k = 0; k < 3; ++k ) {
+				adjacency[ v[ k ] ].push_back( t );
+
+				unsigned int a = v[ k ];
+				unsigned int b = v[ ( k + 1 ) % 3 ];
+				++edgeUse[ std::make_pair( std::min( a, b ), std::max( a, b ) ) ];
+			}
+
+			if ( area <= 0.0f ) {
+				continue;
+			}
+
+			n /= area;
+			double d = -Math::Dot( n, p0 );
+
+			for ( int k = 0; k < 3; ++k ) {
+				quadrics[ v[ k ] ].AddPlane( n.x, n.y, n.z, d, area * 0.5 );
+			}
+		}
+
+		// Boundary constraint planes.
+		for ( unsigned int t = 0; t < liveTriangles; ++t ) {
+			const unsigned int* v = &tris[ t * 3 ];
+			Math::Vector3 p0 = Position( v[ 0 ] );
+			Math::Vector3 faceN = Math::Cross( Position( v[ 1 ] ) - p0, Position( v[ 2 ] ) - p0 );
+
+			if ( faceN.LengthSquared() <= 0.0f ) {
+				continue;
+			}
+
+			for ( int k = 0; k < 3; ++k ) {
+				unsigned int a = v[ k ];
+				unsigned int b = v[ ( k + 1 ) % 3 ];
+
+				if ( edgeUse[ std::make_pair( std::min( a, b ), std::max( a, b ) ) ] != 1 ) {
+					continue;
+				}
+
+				Math::Vector3 edge = Position( b ) - Position( a );
+				Math::Vector3 n = Math::Cross( edge, faceN );
+				float len = n.Length();
+
+				if ( len <= 0.0f ) {
+					continue;
+				}
+
+				n /= len;
+				double d = -Math::Dot( n, Position( a ) );
+				double weight = BOUNDARY_WEIGHT * edge.LengthSquared();
+
+				quadrics[ a ].AddPlane( n.x, n.y, n.z, d, weight );
+				quadrics[ b ].AddPlane( n.x, n.y, n.z, d, weight );
+			}
+		}
+
+		for ( std::map< std::pair< unsigned int, unsigned int >, int >::const_iterator it = edgeUse.begin();
+			  it != edgeUse.end(); ++it ) {
+			PushEdge( it->first.first, it->first.second );
+		}
+	}
+
+	Math::Vector3 Simplifier::Position( unsigned int v ) const {
+		return Math::Vector3( mesh.positions[ v * 3 ], mesh.positions[ v * 3 + 1 ], mesh.positions[ v * 3 + 2 ] );
+	}
+
+	Math::Vector3 Simplifier::FaceNormal( unsigned int t, unsigned int moved, const Math::Vector3& p ) const {
+		Math::Vector3 q[ 3 ];
+
+		for ( int k = 0; k < 3; ++k ) {
+			unsigned int v = tris[ t * 3 + k ];
+			q[ k ] = ( v == moved ) ? p : Position( v );
+		}
+
+		return Math::Cross( q[ 1 ] - q[ 0 ], q[ 2 ] - q[ 0 ] );
+	}
+
+	double Simplifier::Cost( unsigned int from, unsigned int to ) const {
+		Quadric q = quadrics[ from ];
+		q += quadrics[ to ];
+
+		if ( q.w <= 0.0 ) {
+			return 0.0;
+		}
+
+		Math::Vector3 p = Position( to );
+		return std::max( q.Evaluate( p.x, p.y, p.z ), 0.0 ) / q.w;
+	}
+
+	void Simplifier::PushEdge( unsigned int u, unsigned int v ) {
+		double uv = Cost( u, v );
+		double vu = Cost( v, u );
+
+		Collapse c;
+		c.from = ( uv <= vu ) ? u : v;
+		c.to = ( uv <= vu ) ? v : u;
+		c.cost = std::min( uv, vu );
+		c.stampFrom = stamps[ c.from ];
+		c.stampTo = stamps[ c.to ];
+
+		queue.push( c );
+	}
+
+	bool Simplifier::Flips( unsigned int from, unsigned int to ) const {
+		Math::Vector3 target = Position( to );
+		const std::vector< unsigned int >& adj = adjacency[ from ];
+
+		for ( size_t i = 0; i < adj.size(); ++i ) {
+			unsigned int t = adj[ i ];
+
+			if ( !triAlive[ t ] ) {
+				continue;
+			}
+
+			const unsigned int* v = &tris[ t * 3 ];
+
+			if ( v[ 0 ] == to || v[ 1 ] == to || v[ 2 ] == to ) {
+				continue;	// Removed by the collapse.
+			}
+
+			Math::Vector3 before = FaceNormal( t, from, Position( from ) );
+			Math::Vector3 after = FaceNormal( t, from, target );
+
+			if ( Math::Dot( before, after ) <= 0.0f ) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void Simplifier::Apply( unsigned int from, unsigned int to ) {
+		std::vector< unsigned int >& adj = adjacency[ from ];
+
+		for ( size_t i = 0; i < adj.size(); ++i ) {
+			unsigned int t = adj[ i ];
+
+			if ( !triAlive[ t ] ) {
+				continue;
+			}
+
+			unsigned int* v = &tris[ t * 3 ];
+
+			if ( v[ 0 ] == to || v[ 1 ] == to || v[ 2 ] == to ) {
+				triAlive[ t ] = false;
+				--liveTriangles;
+				continue;
+			}
+
+			for ( int k = 0; k < 3; ++k ) {
+				if ( v[ k ] == from ) { v[ k ] = to; }
+			}
+
+			adjacency[ to ].push_back( t );
+		}
+
+		adj.clear();
+		vertAlive[ from ] = false;
+		quadrics[ to ] += quadrics[ from ];
+		++stamps[ to ];
+
+		// Re-queue every edge touching the surviving vertex.
+		std::vector< unsigned int >& around = adjacency[ to ];
+		std::vector< unsigned int > live;
+
+		for ( size_t i = 0; i < around.size(); ++i ) {
+			unsigned int t = around[ i ];
+
+			if ( !triAlive[ t ] ) {
+				continue;
+			}
+
+			live.push_back( t );
+
+			for ( int k = 0; k < 3; ++k ) {
+				unsigned int w = tris[ t * 3 + k ];
+
+				if ( w != to ) {
+					++stamps[ w ];
+				}
+			}
+		}
+
+		around.swap( live );
+
+		for ( size_t i = 0; i < around.size(); ++i ) {
+			for ( int k = 0; k < 3; ++k ) {
+				unsigned int w = tris[ around[ i ] * 3 + k ];
+
+				if ( w != to ) {
+					PushEdge( to, w );
+				}
+			}
+		}
+	}
+
+	void Simplifier::Run( unsigned int targetTriangles, double maxError ) {
+		double maxCost = maxError * maxError;
+
+		while ( liveTriangles > targetTriangles && !queue.empty() ) {
+			Collapse c = queue.top();
+			queue.pop();
+
+			if ( !vertAlive[ c.from ] || !vertAlive[ c.to ] ||
+				 stamps[ c.from ] != c.stampFrom || stamps[ c.to ] != c.stampTo ) {
+				continue;	// Stale entry.
+			}
+
+			if ( c.cost > maxCost ) {
+				break;
+			}
+
+			if ( Flips( c.from, c.to ) ) {
+				continue;
+			}
+
+			Apply( c.from, c.to );
+			error = std::max( error, c.cost );
+		}
+
+		error = sqrt( error );
+	}
+
+	std::vector< unsigned int > Simplifier::Result( void ) const {
+		std::vector< unsigned int > result;
+		result.reserve( liveTriangles * 3 );
+
+		for ( size_t t = 0; t < triAlive.size(); ++t ) {
+			if ( triAlive[ t ] ) {
+				result.insert( result.end(), &tris[ t * 3 ], &tris[ t * 3 ] + 3 );
+			}
+		}
+
+		return result;
+	}
+
+}
+
+std::vector< unsigned int > Simplify( const Mesh& mesh,
+									  unsigned int targetTriangles,
+									  float maxError,
+									  float* resultError ) {
+	Simplifier s( mesh );
+	s.Run( targetTriangles, maxError );
+
+	if ( resultError ) {
+		*resultError = ( float ) s.error;
+	}
+
+	return s.Result();
+}
+
+}
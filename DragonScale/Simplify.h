@@ -0,0 +1,28 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+
+#include "Mesh.h"
+
+namespace DS {
+
+/**
+	DS::Simplify - Quadric Error Metric simplification
+
+	Garland and Heckbert edge collapse. Vertices are only ever collapsed onto
+	one of their neighbours ( half edge collapse ) so the result indexes the
+	same vertex buffer as the source mesh, which lets every LOD share it.
+
+	Collapsing stops once the mesh is down to targetTriangles or the next
+	collapse would move the surface further than maxError. The largest error
+	introduced, as an RMS distance in model units, is written to resultError.
+**/
+std::vector< unsigned int > Simplify( const Mesh& mesh,
+									  unsigned int targetTriangles,
+									  float maxError,
+									  float* resultError );
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+#include "Skinning.h"
+
+#include <xmmintrin.h>
+
+namespace DS {
+
+unsigned int SkinnedMesh::VertexCount( void ) const {
+	return ( unsigned int ) positions.size() / 3;
+}
+
+void SkinMatrices( const SkinnedMesh& mesh, const Math::Matrix4* palette, float* out ) {
+	const __m128 zero = _mm_setzero_ps();
+	unsigned int count = mesh.VertexCount();
+
+	for ( unsigned int v = 0; v < count; ++v ) {
+		const float* weights = &mesh.weights[ v * SKIN_INFLUENCES ];
+		const unsigned char* joints = &mesh.joints[ v * SKIN_INFLUENCES ];
+
+		// Top three rows of the blended matrix.
+		__m128 r0 = zero;
+		__m128 r1 = zero;
+		__m128 r2 = zero;
+
+		for ( int k = 0; k < SKIN_INFLUENCES; ++k ) {
+			if ( weights[ k ] == 0.0f ) {
+				continue;
+			}
+
+			const float* m = &palette[ joints[ k ] ].c[ 0 ][ 0 ];
+			__m128 w = _mm_set1_ps( weights[ k ] );
+
+			r0 = _mm_add_ps( r0, _mm_mul_ps( _mm_loadu_ps( m ), w ) );
+			r1 = _mm_add_ps( r1, _mm_mul_ps( _mm_loadu_ps( m + 4 ), w ) );
+			r2 = _mm_add_ps( r2, _mm_mul_ps( _mm_loadu_ps( m + 8 ), w ) );
+		}
+
+		const float* p = &mesh.positions[ v * 3 ];
+		__m128 position = _mm_setr_ps( p[ 0 ], p[ 1 ], p[ 2 ], 1.0f );
+
+		// Three dot products at once: transpose the products and add.
+		__m128 x = _mm_mul_ps( r0, position );
+		__m128 y = _mm_mul_ps( r1, position );
+		__m128 z = _mm_mul_ps( r2, position );
+		__m128 w = zero;
+
+		_MM_TRANSPOSE4_PS( x, y, z, w );
+		__m128 result = _mm_add_ps( _mm_add_ps( x, y ), _mm_add_ps( z, w ) );
+
+		// The fourth lane spills into the next vertex, which overwrites it.
+		// The last one must not write past the mesh.
+		if ( v + 1 < count ) {
+			_mm_storeu_ps( &out[ v * 3 ], result );
+		} else {
+			float last[ 4 ];
+			_mm_storeu_ps( last, result );
+
+			out[ v * 3 ] = last[ 0 ];
+			out[ v * 3 + 1 ] = last[ 1 ];
+			out[ v * 3 + 2 ] = last[ 2 ];
+		}
+	}
+}
+
+void SkinDualQuaternions( const SkinnedMesh& mesh, const Math::DualQuaternion* palette, float* out ) {
+	const __m128 zero = _mm_setzero_ps();
+	unsigned int count = mesh.VertexCount();
+
+	for ( unsigned int v = 0; v < count; ++v ) {
+		const float* weights = &mesh.weights[ v * SKIN_INFLUENCES ];
+		const unsigned char* joints = &mesh.joints[ v * SKIN_INFLUENCES ];
+		const Math::Quaternion& pivot = palette[ joints[ 0 ] ].real;
+
+		__m128 real = zero;
+		__m128 dual = zero;
+
+		for ( int k = 0; k < SKIN_INFLUENCES; ++k ) {
+			if ( weights[ k ] == 0.0f ) {
+				continue;
+			}
+
+			const Math::DualQuaternion& q = palette[ joints[ k ] ];
+
+			// q and -q are the same transform, blend on one hemisphere.
+			__m128 w = _mm_set1_ps( Math::Dot( q.real, pivot ) < 0.0f ? -weights[ k ] : weights[ k ] );
+
+			real = _mm_add_ps( real, _mm_mul_ps( _mm_loadu_ps( &q.real.x ), w ) );
+			dual = _mm_add_ps( dual, _mm_mul_ps( _mm_loadu_ps( &q.dual.x ), w ) );
+		}
+
+		float r[ 4 ];
+		float d[ 4 ];
+		_mm_storeu_ps( r, real );
+		_mm_storeu_ps( d, dual );
+
+		float inv = 1.0f / sqrtf( r[ 0 ] * r[ 0 ] + r[ 1 ] * r[ 1 ] + r[ 2 ] * r[ 2 ] + r[ 3 ] * r[ 3 ] );
+
+		Math::Vector3 rv( r[ 0 ] * inv, r[ 1 ] * inv, r[ 2 ] * inv );
+		Math::Vector3 dv( d[ 0 ] * inv, d[ 1 ] * inv, d[ 2 ] * inv );
+		float rw = r[ 3 ] * inv;
+		float dw = d[ 3 ] * inv;
+
+		const float* p = &mesh.positions[ v * 3 ];
+		Math::Vector3 position( p[ 0 ], p[ 1 ], p[ 2 ] );
+
+		// Rotate, then translate by 2 * dual * conjugate( real ).
+		Math::Vector3 t = Math::Cross( rv, position ) * 2.0f;
+		Math::Vector3 rotated = position + t * rw + Math::Cross( rv, t );
+		Math::Vector3 translation = ( dv * rw - rv * dw + Math::Cross( rv, dv ) ) * 2.0f;
+
+		Math::Vector3 result = rotated + translation;
+
+		out[ v * 3 ] = result.x;
+		out[ v * 3 + 1 ] = result.y;
+		out[ v * 3 + 2 ] = result.z;
+	}
+}
+
+}
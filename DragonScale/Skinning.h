@@ -0,0 +1,56 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <vector>
+
+#include "BBox.h"
+#include "Matrix4.h"
+#include "Quaternion.h"
+
+namespace DS {
+
+// Joint influences per vertex.
+const int SKIN_INFLUENCES = 4;
+
+/**
+	DS::SkinnedMesh - Indexed mesh bound to a skeleton
+
+	Same layout as DS::Mesh plus four joint indices and four weights per
+	vertex. Weights of a vertex sum to one; unused influences have weight
+	zero.
+**/
+struct SkinnedMesh {
+	std::vector< float > positions;
+	std::vector< float > colors;
+	std::vector< unsigned int > indices;
+
+	std::vector< unsigned char > joints;
+	std::vector< float > weights;
+
+	Math::BBox bounds;				// Bind pose.
+
+	unsigned int VertexCount( void ) const;
+};
+
+/**
+	DS::SkinMatrices
+
+	Linear blend skinning with SSE: the weighted sum of the palette rows
+	is built four floats at a time and applied to the bind position.
+	Writes three floats per vertex to out.
+**/
+void SkinMatrices( const SkinnedMesh& mesh, const Math::Matrix4* palette, float* out );
+
+/**
+	DS::SkinDualQuaternions
+
+	Dual quaternion skinning. Influences are blended on the same
+	hemisphere as the first one, renormalized and applied as a rigid
+	transform, so twisting joints keep their volume. Same output layout
+	as SkinMatrices.
+**/
+void SkinDualQuaternions( const SkinnedMesh& mesh, const Math::DualQuaternion* palette, float* out );
+
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace DS {
+
+/**
+	DS::SpscQueue - Lock-free single producer, single consumer ring
+
+	One thread pushes, one other thread pops; neither ever waits on the
+	other. Capacity is rounded up to a power of two. Push fails when the
+	ring is full and Pop when it is empty, the caller decides whether to
+	drop, retry or output silence.
+
+	Read and Write move runs of items with a single pair of atomic
+	operations, for sample streams.
+**/
+template< typename T >
+class SpscQueue {
+public:
+	SpscQueue( void )
+		: mask( 0 ), head( 0 ), tail( 0 ) {
+	}
+
+	// Not thread safe, call before either side starts.
+	void Init( size_t capacity ) {
+		size_t size = 1;
+
+		while ( size < capacity ) {
+			size <<= 1;
+		}
+
+		items.assign( size, T() );
+		mask = size - 1;
+		head.store( 0 );
+		tail.store( 0 );
+	}
+
+	bool Push( const T& item ) {
+		size_t h = head.load( std::memory_order_relaxed );
+
+		if ( h - tail.load( std::memory_order_acquire ) > mask ) {
+			return false;
+		}
+
+		items[ h & mask ] = item;
+		head.store( h + 1, std::memory_order_release );
+		return true;
+	}
+
+	bool Pop( T& item ) {
+		size_t t = tail.load( std::memory_order_relaxed );
+
+		if ( t == head.load( std::memory_order_acquire ) ) {
+			return false;
+		}
+
+		item = items[ t & mask ];
+		tail.store( t + 1, std::memory_order_release );
+		return true;
+	}
+
+	// Returns how many of count items fitted.
+	size_t Write( const T* in, size_t count ) {
+		size_t h = head.load( std::memory_order_relaxed );
+		size_t space = mask + 1 - ( h - tail.load( std::memory_order_acquire ) );
+
+		if ( count > space ) {
+			count = space;
+		}
+
+		for ( size_t i = 0; i < count; ++i ) {
+			items[ ( h + i ) & mask ] = in[ i ];
+		}
+
+		head.store( h + count, std::memory_order_release );
+		return count;
+	}
+
+	// Returns how many of count items were available.
+	size_t Read( T* out, size_t count ) {
+		size_t t = tail.load( std::memory_order_relaxed );
+		size_t available = head.load( std::memory_order_acquire ) - t;
+
+		if ( count > available ) {
+			count = available;
+		}
+
+		for ( size_t i = 0; i < count; ++i ) {
+			out[ i ] = items[ ( t + i ) & mask ];
+		}
+
+		tail.store( t + count, std::memory_order_release );
+		return count;
+	}
+
+	// Approximate unless called from one of the two sides.
+	size_t Size( void ) const {
+		return head.load( std::memory_order_acquire ) - tail.load( std::memory_order_acquire );
+	}
+
+	size_t Capacity( void ) const {
+		return mask + 1;
+	}
+
+private:
+	SpscQueue( const SpscQueue& );
+	SpscQueue& operator=( const SpscQueue& );
+
+	std::vector< T > items;
+	size_t mask;
+
+	std::atomic< size_t > head;		// Written by the producer.
+	std::atomic< size_t > tail;		// Written by the consumer.
+};
+
+}
+
+#endif
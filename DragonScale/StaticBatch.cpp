@@ -0,0 +1,260 @@
+#include "StaticBatch.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+namespace DS {
+
+StaticBatch::StaticBatch( void )
+	: vao( 0 ), positionBuffer( 0 ), colorBuffer( 0 ), texCoordBuffer( 0 ), indexBuffer( 0 ), vertexCount( 0 ) {
+}
+
+StaticBatch::~StaticBatch( void ) {
+}
+
+void StaticBatch::Add( const Mesh& mesh, const LODLevel& level, const Math::Matrix4& transform, unsigned int material ) {
+	Source s;
+	s.mesh = &mesh;
+	s.level = level;
+	s.transform = transform;
+	s.bounds = Math::TransformBounds( transform, mesh.bounds );
+	s.centroid = s.bounds.Center();
+	s.material = material;
+
+	sources.push_back( s );
+}
+
+void StaticBatch::Build( unsigned int maxVertices, float maxExtent ) {
+	MemoryScope scope( MEMORY_BATCH );
+
+	clusters.clear();
+	positions.clear();
+	colors.clear();
+	texCoords.clear();
+	indices.clear();
+
+	std::stable_sort( sources.begin(), sources.end(), []( const Source& a, const Source& b ) {
+		return a.material < b.material;
+	} );
+
+	unsigned int begin = 0;
+
+	while ( begin < sources.size() ) {
+		unsigned int end = begin + 1;
+
+		while ( end < sources.size() && sources[ end ].material == sources[ begin ].material ) {
+			++end;
+		}
+
+		Split( begin, end, maxVertices, maxExtent );
+		begin = end;
+	}
+
+	vertexCount = ( unsigned int ) positions.size() / 3;
+
+	std::vector< Source > none;
+	sources.swap( none );
+}
+
+void StaticBatch::Split( unsigned int begin, unsigned int end, unsigned int maxVertices, float maxExtent ) {
+	Math::BBox bounds;
+	Math::BBox centroids;
+	unsigned int vertices = 0;
+
+	for ( unsigned int i = begin; i < end; ++i ) {
+		bounds = Math::Union( bounds, sources[ i ].bounds );
+		centroids = Math::Union( centroids, sources[ i ].centroid );
+		vertices += sources[ i ].mesh->VertexCount();
+	}
+
+	Math::Vector3 extent = bounds.Extent();
+	bool small = vertices <= maxVertices && extent.x <= maxExtent && extent.y <= maxExtent && extent.z <= maxExtent;
+
+	if ( small || end - begin == 1 ) {
+		Emit( begin, end );
+		return;
+	}
+
+	// Median cut along the widest spread of centers.
+	int axis = centroids.MaximumExtent();
+	unsigned int mid = ( begin + end ) / 2;
+
+	std::nth_element( sources.begin() + begin, sources.begin() + mid, sources.begin() + end, [ axis ]( const Source& a, const Source& b ) {
+		return a.centroid[ axis ] < b.centroid[ axis ];
+	} );
+
+	Split( begin, mid, maxVertices, maxExtent );
+	Split( mid, end, maxVertices, maxExtent );
+}
+
+void StaticBatch::Emit( unsigned int begin, unsigned int end ) {
+	StaticCluster cluster;
+	cluster.material = sources[ begin ].material;
+	cluster.firstIndex = ( unsigned int ) indices.size();
+	cluster.objectCount = end - begin;
+
+	std::vector< int > remap;
+
+	for ( unsigned int i = begin; i < end; ++i ) {
+		const Source& s = sources[ i ];
+		const Mesh& mesh = *s.mesh;
+		const Math::Matrix4& m = s.transform;
+
+		// Coarse levels only touch some of the vertices, keep just those.
+		remap.assign( mesh.VertexCount(), -1 );
+
+		for ( unsigned int j = 0; j < s.level.indexCount; ++j ) {
+			unsigned int v = mesh.indices[ s.level.indexOffset + j ];
+
+			if ( remap[ v ] < 0 ) {
+				remap[ v ] = ( int ) positions.size() / 3;
+
+				const float* p = &mesh.positions[ v * 3 ];
+				Math::Point3 world;
+
+				for ( int r = 0; r < 3; ++r ) {
+					world[ r ] = m.c[ r ][ 0 ] * p[ 0 ] + m.c[ r ][ 1 ] * p[ 1 ] + m.c[ r ][ 2 ] * p[ 2 ] + m.c[ r ][ 3 ];
+					positions.push_back( world[ r ] );
+				}
+
+				colors.insert( colors.end(), &mesh.colors[ v * 3 ], &mesh.colors[ v * 3 ] + 3 );
+
+				if ( mesh.texCoords.empty() ) {
+					texCoords.push_back( 0.0f );
+					texCoords.push_back( 0.0f );
+				} else {
+					texCoords.insert( texCoords.end(), &mesh.texCoords[ v * 2 ], &mesh.texCoords[ v * 2 ] + 2 );
+				}
+
+				cluster.bounds = Math::Union( cluster.bounds, world );
+			}
+
+			indices.push_back( ( unsigned int ) remap[ v ] );
+		}
+	}
+
+	cluster.indexCount = ( unsigned int ) indices.size() - cluster.firstIndex;
+	clusters.push_back( cluster );
+}
+
+void StaticBatch::Upload( unsigned int positionAttrib, unsigned int colorAttrib, unsigned int texCoordAttrib ) {
+	if ( indices.empty() ) {
+		return;
+	}
+
+	glGenVertexArrays( 1, &vao );
+	glGenBuffers( 1, &positionBuffer );
+	glGenBuffers( 1, &colorBuffer );
+	glGenBuffers( 1, &texCoordBuffer );
+	glGenBuffers( 1, &indexBuffer );
+
+	GL::BindVertexArray( vao );
+
+	glEnableVertexAttribArray( positionAttrib );
+	GL::BindBuffer( GL_ARRAY_BUFFER, positionBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * positions.size(), &positions[ 0 ], GL_STATIC_DRAW );
+	glVertexAttribPointer( positionAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	glEnableVertexAttribArray( colorAttrib );
+	GL::BindBuffer( GL_ARRAY_BUFFER, colorBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * colors.size(), &colors[ 0 ], GL_STATIC_DRAW );
+	glVertexAttribPointer( colorAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	glEnableVertexAttribArray( texCoordAttrib );
+	GL::BindBuffer( GL_ARRAY_BUFFER, texCoordBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * texCoords.size(), &texCoords[ 0 ], GL_STATIC_DRAW );
+	glVertexAttribPointer( texCoordAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	GL::BindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+	GL::BufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( GLuint ) * indices.size(), &indices[ 0 ], GL_STATIC_DRAW );
+
+	GL::BindVertexArray( 0 );
+	GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, positionBuffer, sizeof( GLfloat ) * positions.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, colorBuffer, sizeof( GLfloat ) * colors.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, texCoordBuffer, sizeof( GLfloat ) * texCoords.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_BATCH, indexBuffer, sizeof( GLuint ) * indices.size() );
+
+	// The GPU copy is all that is drawn from.
+	std::vector< float > noPositions;
+	std::vector< float > noColors;
+	std::vector< float > noTexCoords;
+	std::vector< unsigned int > noIndices;
+
+	positions.swap( noPositions );
+	colors.swap( noColors );
+	texCoords.swap( noTexCoords );
+	indices.swap( noIndices );
+}
+
+void StaticBatch::Shutdown( void ) {
+	GLuint buffers[] = { positionBuffer, colorBuffer, texCoordBuffer, indexBuffer };
+
+	for ( int i = 0; i < 4; ++i ) {
+		Memory::ReleaseGL( MEMORY_GL_BUFFER, buffers[ i ] );
+	}
+
+	GL::DeleteBuffers( 4, buffers );
+	GL::DeleteVertexArrays( 1, &vao );
+
+	vao = positionBuffer = colorBuffer = texCoordBuffer = indexBuffer = 0;
+	vertexCount = 0;
+	clusters.clear();
+}
+
+const std::vector< StaticCluster >& StaticBatch::Clusters( void ) const {
+	return clusters;
+}
+
+unsigned int StaticBatch::Draw( const std::vector< unsigned int >& visible ) const {
+	if ( visible.empty() || vao == 0 ) {
+		return 0;
+	}
+
+	GL::BindVertexArray( vao );
+
+	unsigned int calls = 0;
+	size_t i = 0;
+
+	while ( i < visible.size() ) {
+		const StaticCluster& first = clusters[ visible[ i ] ];
+		unsigned int count = first.indexCount;
+		size_t j = i + 1;
+
+		// Consecutive clusters are consecutive in the index buffer.
+		while ( j < visible.size() && visible[ j ] == visible[ j - 1 ] + 1 && clusters[ visible[ j ] ].material == first.material ) {
+			count += clusters[ visible[ j ] ].indexCount;
+			++j;
+		}
+
+		GL::DrawElements( GL_TRIANGLES, count, GL_UNSIGNED_INT, ( const GLvoid* ) ( sizeof( GLuint ) * first.firstIndex ) );
+		++calls;
+
+		i = j;
+	}
+
+	GL::BindVertexArray( 0 );
+
+	return calls;
+}
+
+unsigned int StaticBatch::ObjectCount( void ) const {
+	unsigned int count = 0;
+
+	for ( size_t i = 0; i < clusters.size(); ++i ) {
+		count += clusters[ i ].objectCount;
+	}
+
+	return count;
+}
+
+unsigned int StaticBatch::VertexCount( void ) const {
+	return vertexCount;
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef STATICBATCH_H
+#define STATICBATCH_H
+
+#include <vector>
+
+#include "Mesh.h"
+#include "LOD.h"
+#include "Matrix4.h"
+
+namespace DS {
+
+struct StaticCluster {
+	Math::BBox bounds;			// World space.
+	unsigned int material;
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned int objectCount;
+};
+
+/**
+	DS::StaticBatch - Load time merging of non-moving geometry
+
+	Objects that never move are added once with their transform and a
+	material key. Build bakes them into world space and merges each material
+	into shared vertex/index buffers, split into spatial clusters by
+	recursive median cuts so every cluster stays small enough to cull on its
+	own. The clusters come out material by material and, within one
+	material, in split order, so neighbours in space are neighbours in the
+	index buffer and Draw can merge consecutive visible clusters into a
+	single glDrawElements.
+
+	Everything is drawn at the LOD level it was added with. Vertices are
+	already in world space, so the model matrix must be identity.
+**/
+class StaticBatch {
+public:
+	StaticBatch( void );
+	~StaticBatch( void );
+
+	// transform is in math layout ( column vectors ). mesh must stay alive
+	// until Build.
+	void Add( const Mesh& mesh, const LODLevel& level, const Math::Matrix4& transform, unsigned int material );
+
+	// A cluster is split until it holds at most maxVertices vertices and
+	// its bounds are no larger than maxExtent along any axis, or it is down
+	// to a single object.
+	void Build( unsigned int maxVertices, float maxExtent );
+
+	// Uploads the merged buffers, vertex attributes at the given locations.
+	// Meshes without texture coordinates get ( 0, 0 ).
+	void Upload( unsigned int positionAttrib, unsigned int colorAttrib, unsigned int texCoordAttrib );
+	void Shutdown( void );
+
+	const std::vector< StaticCluster >& Clusters( void ) const;
+
+	// visible lists cluster indices in increasing order. Runs are never
+	// merged across materials. Returns the number of draw calls issued.
+	unsigned int Draw( const std::vector< unsigned int >& visible ) const;
+
+	unsigned int ObjectCount( void ) const;
+	unsigned int VertexCount( void ) const;
+
+private:
+	struct Source {
+		const Mesh* mesh;
+		LODLevel level;
+		Math::Matrix4 transform;
+		Math::BBox bounds;
+		Math::Point3 centroid;
+		unsigned int material;
+	};
+
+	void Split( unsigned int begin, unsigned int end, unsigned int maxVertices, float maxExtent );
+	void Emit( unsigned int begin, unsigned int end );
+
+	unsigned int vao;
+	unsigned int positionBuffer;
+	unsigned int colorBuffer;
+	unsigned int texCoordBuffer;
+	unsigned int indexBuffer;
+	unsigned int vertexCount;
+
+	std::vector< Source > sources;
+	std::vector< StaticCluster > clusters;
+
+	std::vector< float > positions;
+	std::vector< float > colors;
+	std::vector< float > texCoords;
+	std::vector< unsigned int > indices;
+};
+
+}
+
+#endif
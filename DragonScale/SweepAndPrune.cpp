@@ -0,0 +1,121 @@
+#include "SweepAndPrune.h"
+
+namespace DS {
+
+namespace {
+
+	// activeSlot of a proxy that is not in the sweep's active list.
+	const unsigned int INACTIVE = ~0u;
+
+}
+
+SweepAndPrune::SweepAndPrune( int a )
+	: axis( a ) {
+}
+
+SweepAndPrune::~SweepAndPrune( void ) {
+}
+
+void SweepAndPrune::OnAdd( unsigned int proxy ) {
+	Endpoint e;
+
+	// Values are refreshed before sorting, append is enough.
+	e.value = bounds[ proxy ].pMin[ axis ];
+	e.data = proxy << 1;
+	endpoints.push_back( e );
+
+	e.value = bounds[ proxy ].pMax[ axis ];
+	e.data = ( proxy << 1 ) | 1;
+	endpoints.push_back( e );
+
+	if ( activeSlot.size() < bounds.size() ) {
+		activeSlot.resize( bounds.size(), INACTIVE );
+	}
+}
+
+void SweepAndPrune::OnRemove( unsigned int proxy ) {
+	size_t out = 0;
+
+	for ( size_t i = 0; i < endpoints.size(); ++i ) {
+		if ( ( endpoints[ i ].data >> 1 ) != proxy ) {
+			endpoints[ out++ ] = endpoints[ i ];
+		}
+	}
+
+	endpoints.resize( out );
+}
+
+void SweepAndPrune::OnMove( unsigned int ) {
+}
+
+void SweepAndPrune::FindPairs( std::vector< BroadphasePair >& pairs ) {
+	size_t count = endpoints.size();
+
+	for ( size_t i = 0; i < count; ++i ) {
+		Endpoint& e = endpoints[ i ];
+		const Math::BBox& b = bounds[ e.data >> 1 ];
+
+		e.value = ( e.data & 1 ) ? b.pMax[ axis ] : b.pMin[ axis ];
+	}
+
+	// Nearly sorted from last frame. Mins go ahead of maxes at the same
+	// value so touching boxes overlap, matching BBox::Overlaps.
+	for ( size_t i = 1; i < count; ++i ) {
+		Endpoint e = endpoints[ i ];
+		size_t j = i;
+
+		while ( j > 0 ) {
+			const Endpoint& prev = endpoints[ j - 1 ];
+
+			if ( prev.value < e.value || ( prev.value == e.value && ( prev.data & 1 ) <= ( e.data & 1 ) ) ) {
+				break;
+			}
+
+			endpoints[ j ] = endpoints[ j - 1 ];
+			--j;
+		}
+
+		endpoints[ j ] = e;
+	}
+
+	active.clear();
+
+	for ( size_t i = 0; i < count; ++i ) {
+		unsigned int proxy = endpoints[ i ].data >> 1;
+
+		if ( endpoints[ i ].data & 1 ) {
+			unsigned int slot = activeSlot[ proxy ];
+
+			// An empty or inverted box ends before it starts.
+			if ( slot == INACTIVE ) {
+				continue;
+			}
+
+			unsigned int last = active.back();
+
+			active[ slot ] = last;
+			activeSlot[ last ] = slot;
+			activeSlot[ proxy ] = INACTIVE;
+			active.pop_back();
+		} else {
+			const Math::BBox& b = bounds[ proxy ];
+
+			// Everything active overlaps on the sort axis already.
+			for ( size_t k = 0; k < active.size(); ++k ) {
+				if ( b.Overlaps( bounds[ active[ k ] ] ) ) {
+					AddPair( pairs, proxy, active[ k ] );
+				}
+			}
+
+			activeSlot[ proxy ] = ( unsigned int ) active.size();
+			active.push_back( proxy );
+		}
+	}
+
+	// Those inverted boxes started after they ended and are still open.
+	for ( size_t k = 0; k < active.size(); ++k ) {
+		activeSlot[ active[ k ] ] = INACTIVE;
+	}
+}
+
+}
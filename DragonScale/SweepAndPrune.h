@@ -0,0 +1,46 @@
+#ifndef SWEEPANDPRUNE_H
+#define SWEEPANDPRUNE_H
+
+#include "Broadphase.h"
+
+namespace DS {
+
+/**
+	DS::SweepAndPrune - Broadphase over sorted AABB endpoints
+
+	Keeps the min and max of every proxy on one axis in a single sorted
+	array. Bodies move little between frames, so the array stays nearly
+	sorted and an insertion sort brings it back in close to linear time.
+	A sweep over it then only tests boxes whose intervals overlap on that
+	axis.
+
+	Pick the axis the bodies are most spread out along; it cannot change
+	after construction without losing the frame to frame ordering.
+**/
+class SweepAndPrune : public Broadphase {
+public:
+	SweepAndPrune( int axis );
+	~SweepAndPrune( void );
+
+protected:
+	void OnAdd( unsigned int proxy );
+	void OnRemove( unsigned int proxy );
+	void OnMove( unsigned int proxy );
+	void FindPairs( std::vector< BroadphasePair >& pairs );
+
+private:
+	struct Endpoint {
+		float value;
+		unsigned int data;	// proxy << 1 | isMax
+	};
+
+	int axis;
+
+	std::vector< Endpoint > endpoints;
+	std::vector< unsigned int > active;
+	std::vector< unsigned int > activeSlot;
+};
+
+}
+
+#endif
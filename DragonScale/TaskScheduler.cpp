@@ -0,0 +1,418 @@
+#include "TaskScheduler.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+
+namespace DS {
+
+namespace {
+
+	// An ID is the slot index plus one in the low bits, the slot's
+	// generation above.
+	const unsigned int INDEX_BITS = 20;
+	const unsigned int INDEX_MASK = ( 1u << INDEX_BITS ) - 1;
+	const unsigned int GENERATION_MASK = ( 1u << ( 32 - INDEX_BITS ) ) - 1;
+
+	unsigned int MakeID( unsigned int index, unsigned int generation ) {
+		return ( ( generation & GENERATION_MASK ) << INDEX_BITS ) | ( index + 1 );
+	}
+
+	unsigned int IndexOf( unsigned int id ) {
+		return ( id & INDEX_MASK ) - 1;
+	}
+
+	unsigned int GenerationOf( unsigned int id ) {
+		return id >> INDEX_BITS;
+	}
+
+	struct WakesLater {
+		template< typename T >
+		bool operator()( const T& a, const T& b ) const {
+			return a.wake > b.wake;
+		}
+	};
+
+}
+
+TaskWait TaskDone( void ) {
+	TaskWait wait = { TASK_DONE, 0.0f, 0 };
+	return wait;
+}
+
+TaskWait TaskNextFrame( void ) {
+	TaskWait wait = { TASK_NEXT_FRAME, 0.0f, 0 };
+	return wait;
+}
+
+TaskWait TaskSleep( float seconds ) {
+	TaskWait wait = { TASK_SLEEP, seconds, 0 };
+	return wait;
+}
+
+TaskWait TaskWaitFor( SignalID signal ) {
+	TaskWait wait = { TASK_SIGNAL, 0.0f, signal };
+	return wait;
+}
+
+TaskScheduler::TaskScheduler( void )
+	: taskCount( 0 ), jobs( NULL ), time( 0.0f ), dt( 0.0f ), resumed( 0 ), quit( false ) {
+}
+
+TaskScheduler::~TaskScheduler( void ) {
+	Shutdown();
+}
+
+void TaskScheduler::Init( unsigned int capacity, JobSystem* j ) {
+	MemoryScope scope( MEMORY_TASKS );
+
+	jobs = j;
+
+	freeTasks.reserve( capacity );
+	timers.reserve( capacity );
+	ready.reserve( capacity );
+	nextFrame.reserve( capacity );
+
+	quit = false;
+	worker = std::thread( &TaskScheduler::WorkerMain, this );
+}
+
+void TaskScheduler::Shutdown( void ) {
+	if ( worker.joinable() ) {
+		{
+			std::lock_guard< std::mutex > guard( workLock );
+			quit = true;
+		}
+
+		wake.notify_all();
+		worker.join();
+	}
+
+	work.clear();
+	tasks.clear();
+	freeTasks.clear();
+	signals.clear();
+	freeSignals.clear();
+	timers.clear();
+	ready.clear();
+	nextFrame.clear();
+	batches.clear();
+	running.clear();
+	fired.clear();
+	taskCount = 0;
+}
+
+TaskID TaskScheduler::Spawn( const TaskStep& step ) {
+	MemoryScope scope( MEMORY_TASKS );
+
+	unsigned int index;
+
+	if ( !freeTasks.empty() ) {
+		index = freeTasks.back();
+		freeTasks.pop_back();
+	} else {
+		index = ( unsigned int ) tasks.size();
+		tasks.push_back( Task() );
+		tasks.back().generation = 0;
+	}
+
+	Task& task = tasks[ index ];
+	task.step = step;
+	task.state.resume = 0;
+	task.state.time = time;
+	task.state.dt = 0.0f;
+	task.alive = true;
+
+	++taskCount;
+
+	TaskID id = MakeID( index, task.generation );
+	ready.push_back( id );
+
+	return id;
+}
+
+void TaskScheduler::Kill( TaskID id ) {
+	Task* task = FindTask( id );
+
+	if ( !task ) {
+		return;
+	}
+
+	// A running step is not in its slot, see Resume.
+	task->step = TaskStep();
+	task->alive = false;
+	task->generation = ( task->generation + 1 ) & GENERATION_MASK;
+
+	freeTasks.push_back( IndexOf( id ) );
+	--taskCount;
+}
+
+bool TaskScheduler::IsAlive( TaskID id ) const {
+	return FindTask( id ) != NULL;
+}
+
+TaskScheduler::Task* TaskScheduler::FindTask( TaskID id ) {
+	unsigned int index = IndexOf( id );
+
+	if ( id == 0 || index >= tasks.size() || !tasks[ index ].alive || tasks[ index ].generation != GenerationOf( id ) ) {
+		return NULL;
+	}
+
+	return &tasks[ index ];
+}
+
+const TaskScheduler::Task* TaskScheduler::FindTask( TaskID id ) const {
+	return const_cast< TaskScheduler* >( this )->FindTask( id );
+}
+
+SignalID TaskScheduler::CreateSignal( void ) {
+	MemoryScope scope( MEMORY_TASKS );
+
+	unsigned int index;
+
+	if ( !freeSignals.empty() ) {
+		index = freeSignals.back();
+		freeSignals.pop_back();
+	} else {
+		index = ( unsigned int ) signals.size();
+		signals.push_back( SignalSlot() );
+		signals.back().generation = 0;
+	}
+
+	SignalSlot& slot = signals[ index ];
+	slot.fired = false;
+	slot.used = true;
+
+	return MakeID( index, slot.generation );
+}
+
+void TaskScheduler::Signal( SignalID signal ) {
+	std::lock_guard< std::mutex > guard( firedLock );
+	fired.push_back( signal );
+}
+
+bool TaskScheduler::IsSignaled( SignalID signal ) const {
+	const SignalSlot* slot = FindSignal( signal );
+	return slot && slot->fired;
+}
+
+void TaskScheduler::ReleaseSignal( SignalID signal ) {
+	SignalSlot* slot = FindSignal( signal );
+
+	if ( !slot ) {
+		return;
+	}
+
+	ready.insert( ready.end(), slot->waiters.begin(), slot->waiters.end() );
+	slot->waiters.clear();
+
+	slot->used = false;
+	slot->generation = ( slot->generation + 1 ) & GENERATION_MASK;
+	freeSignals.push_back( IndexOf( signal ) );
+}
+
+TaskScheduler::SignalSlot* TaskScheduler::FindSignal( SignalID signal ) {
+	unsigned int index = IndexOf( signal );
+
+	if ( signal == 0 || index >= signals.size() || !signals[ index ].used || signals[ index ].generation != GenerationOf( signal ) ) {
+		return NULL;
+	}
+
+	return &signals[ index ];
+}
+
+const TaskScheduler::SignalSlot* TaskScheduler::FindSignal( SignalID signal ) const {
+	return const_cast< TaskScheduler* >( this )->FindSignal( signal );
+}
+
+SignalID TaskScheduler::Background( const std::function< void( void ) >& job ) {
+	SignalID signal = CreateSignal();
+
+	{
+		std::lock_guard< std::mutex > guard( workLock );
+		work.push_back( Work( job, signal ) );
+	}
+
+	wake.notify_one();
+
+	return signal;
+}
+
+SignalID TaskScheduler::ParallelFor( int count, int grain, const JobSystem::RangeJob& job ) {
+	MemoryScope scope( MEMORY_TASKS );
+
+	Batch batch;
+	batch.job = job;
+	batch.count = count;
+	batch.grain = grain;
+	batch.signal = CreateSignal();
+
+	batches.push_back( batch );
+
+	return batch.signal;
+}
+
+void TaskScheduler::WorkerMain( void ) {
+	MemoryScope scope( MEMORY_TASKS );
+
+	while ( true ) {
+		Work next;
+
+		{
+			std::unique_lock< std::mutex > guard( workLock );
+
+			while ( !quit && work.empty() ) {
+				wake.wait( guard );
+			}
+
+			if ( quit ) {
+				return;
+			}
+
+			next = work.front();
+			work.pop_front();
+		}
+
+		next.first();
+		Signal( next.second );
+	}
+}
+
+void TaskScheduler::Fire( SignalID signal ) {
+	SignalSlot* slot = FindSignal( signal );
+
+	if ( !slot || slot->fired ) {
+		return;
+	}
+
+	slot->fired = true;
+
+	ready.insert( ready.end(), slot->waiters.begin(), slot->waiters.end() );
+	slot->waiters.clear();
+}
+
+void TaskScheduler::Update( float elapsed ) {
+	MemoryScope scope( MEMORY_TASKS );
+
+	time += elapsed;
+	dt = elapsed;
+	resumed = 0;
+
+	std::vector< SignalID > signaled;
+
+	{
+		std::lock_guard< std::mutex > guard( firedLock );
+		signaled.swap( fired );
+	}
+
+	for ( size_t i = 0; i < signaled.size(); ++i ) {
+		Fire( signaled[ i ] );
+	}
+
+	while ( !timers.empty() && timers.front().wake <= time ) {
+		ready.push_back( timers.front().task );
+		std::pop_heap( timers.begin(), timers.end(), WakesLater() );
+		timers.pop_back();
+	}
+
+	ready.insert( ready.end(), nextFrame.begin(), nextFrame.end() );
+	nextFrame.clear();
+
+	ResumeReady();
+
+	// Once, so a task queueing a batch after every one cannot hold Update.
+	RunBatches();
+	ResumeReady();
+}
+
+void TaskScheduler::ResumeReady( void ) {
+	// By index, steps may append to ready.
+	for ( size_t i = 0; i < ready.size(); ++i ) {
+		Resume( ready[ i ] );
+	}
+
+	ready.clear();
+}
+
+/*
+	In the order they were queued. Fire only puts the waiters on ready, and
+	ignores a signal released meanwhile.
+*/
+void TaskScheduler::RunBatches( void ) {
+	running.swap( batches );
+
+	for ( size_t i = 0; i < running.size(); ++i ) {
+		const Batch& batch = running[ i ];
+
+		jobs->ParallelFor( batch.count, batch.grain, batch.job );
+		Fire( batch.signal );
+	}
+
+	running.clear();
+}
+
+void TaskScheduler::Resume( TaskID id ) {
+	Task* task = FindTask( id );
+
+	if ( !task ) {
+		return;
+	}
+
+	++resumed;
+
+	task->state.time = time;
+	task->state.dt = dt;
+
+	// The deque never moves a task, but a step that kills itself frees its
+	// slot for reuse, so the step is kept alive on the stack while it runs.
+	TaskStep step;
+	step.swap( task->step );
+	TaskWait wait = step( task->state );
+
+	if ( !FindTask( id ) ) {
+		return;
+	}
+
+	task->step.swap( step );
+
+	switch ( wait.type ) {
+		case TASK_DONE:
+			Kill( id );
+			break;
+
+		case TASK_NEXT_FRAME:
+			nextFrame.push_back( id );
+			break;
+
+		case TASK_SLEEP: {
+			Timer timer;
+			timer.wake = time + std::max( wait.seconds, 0.0f );
+			timer.task = id;
+
+			timers.push_back( timer );
+			std::push_heap( timers.begin(), timers.end(), WakesLater() );
+			break;
+		}
+
+		case TASK_SIGNAL: {
+			SignalSlot* slot = FindSignal( wait.signal );
+
+			// Already fired or gone: carry on this Update.
+			if ( !slot || slot->fired ) {
+				ready.push_back( id );
+			} else {
+				slot->waiters.push_back( id );
+			}
+			break;
+		}
+	}
+}
+
+unsigned int TaskScheduler::TaskCount( void ) const {
+	return taskCount;
+}
+
+unsigned int TaskScheduler::ResumedCount( void ) const {
+	return resumed;
+}
+
+}
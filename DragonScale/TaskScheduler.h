@@ -0,0 +1,186 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "JobSystem.h"
+
+namespace DS {
+
+typedef unsigned int TaskID;		// 0 is no task.
+typedef unsigned int SignalID;		// 0 is no signal.
+
+enum TaskWaitType {
+	TASK_DONE,
+	TASK_NEXT_FRAME,
+	TASK_SLEEP,
+	TASK_SIGNAL
+};
+
+/**
+	DS::TaskWait - What a task step waits for before it runs again
+**/
+struct TaskWait {
+	TaskWaitType type;
+	float seconds;
+	SignalID signal;
+};
+
+TaskWait TaskDone( void );
+TaskWait TaskNextFrame( void );
+TaskWait TaskSleep( float seconds );
+TaskWait TaskWaitFor( SignalID signal );
+
+/**
+	DS::TaskState
+
+	Handed to every step of a task. resume starts at 0 and is the task's
+	own to keep: a step switches on it to pick up where the last one
+	left off, and sets it before returning.
+**/
+struct TaskState {
+	int resume;
+	float time;						// Scheduler clock, in seconds.
+	float dt;						// Of the Update running the step.
+};
+
+typedef std::function< TaskWait( TaskState& state ) > TaskStep;
+
+/**
+	DS::TaskScheduler - Resumable gameplay tasks
+
+	A task is a step function the scheduler calls again whenever what it
+	last waited for has happened: the next frame, a time on the scheduler
+	clock, or a signal. Between steps a task costs nothing. Sleepers sit
+	in a heap ordered by wake time and signal waiters in their signal's
+	list, so Update only touches tasks that are due, and resumes those in
+	one pass.
+
+	Tasks live in a pooled deque, slots are reused and never move, so a
+	step may spawn or kill tasks, itself included. IDs carry a generation:
+	a stale ID, e.g. of a killed task still in the heap, is ignored.
+
+	Signals are one-shot latches. Signal may be called from any thread,
+	waiters wake on the next Update; waiting for a signal that already
+	fired resumes the task within the same Update. Background runs work on
+	the scheduler's own thread and fires the returned signal when it is
+	done, for file loads and similar. That work must not touch the
+	JobSystem, whose ParallelFor belongs to the main thread.
+
+	ParallelFor queues a batch for the JobSystem instead and returns the
+	signal it latches. The batches queued by one pass over the ready
+	tasks all run after it, and their waiters resume within the same
+	Update; batches queued by those waiters run in the next Update.
+
+	Everything else, Update and every step included, runs on the thread
+	that calls Update.
+**/
+class TaskScheduler {
+public:
+	TaskScheduler( void );
+	~TaskScheduler( void );
+
+	void Init( unsigned int capacity, JobSystem* jobs );
+	void Shutdown( void );
+
+	// Runs first in the next Update, or in this one when spawned by a step.
+	TaskID Spawn( const TaskStep& step );
+	void Kill( TaskID task );
+	bool IsAlive( TaskID task ) const;
+
+	SignalID CreateSignal( void );
+	void Signal( SignalID signal );
+	bool IsSignaled( SignalID signal ) const;
+
+	// Wakes anything still waiting on the signal.
+	void ReleaseSignal( SignalID signal );
+
+	// The signal is the caller's to release.
+	SignalID Background( const std::function< void( void ) >& work );
+
+	// Runs in Update, on jobs. The signal is the caller's to release.
+	SignalID ParallelFor( int count, int grain, const JobSystem::RangeJob& job );
+
+	void Update( float dt );
+
+	unsigned int TaskCount( void ) const;
+	unsigned int ResumedCount( void ) const;	// In the last Update.
+
+private:
+	struct Task {
+		TaskStep step;
+		TaskState state;
+		unsigned int generation;
+		bool alive;
+	};
+
+	struct SignalSlot {
+		std::vector< TaskID > waiters;
+		unsigned int generation;
+		bool fired;
+		bool used;
+	};
+
+	struct Timer {
+		float wake;
+		TaskID task;
+	};
+
+	typedef std::pair< std::function< void( void ) >, SignalID > Work;
+
+	struct Batch {
+		JobSystem::RangeJob job;
+		int count;
+		int grain;
+		SignalID signal;
+	};
+
+	Task* FindTask( TaskID task );
+	const Task* FindTask( TaskID task ) const;
+	SignalSlot* FindSignal( SignalID signal );
+	const SignalSlot* FindSignal( SignalID signal ) const;
+
+	void Fire( SignalID signal );
+	void Resume( TaskID task );
+	void ResumeReady( void );
+	void RunBatches( void );
+	void WorkerMain( void );
+
+	std::deque< Task > tasks;
+	std::vector< unsigned int > freeTasks;
+	unsigned int taskCount;
+
+	std::vector< SignalSlot > signals;
+	std::vector< unsigned int > freeSignals;
+
+	std::vector< Timer > timers;		// Min-heap on wake.
+	std::vector< TaskID > ready;
+	std::vector< TaskID > nextFrame;
+
+	JobSystem* jobs;
+	std::vector< Batch > batches;
+	std::vector< Batch > running;
+
+	float time;
+	float dt;
+	unsigned int resumed;
+
+	std::mutex firedLock;
+	std::vector< SignalID > fired;		// From any thread, handled by Update.
+
+	std::thread worker;
+	std::mutex workLock;
+	std::condition_variable wake;
+	std::deque< Work > work;
+	bool quit;
+};
+
+}
+
+#endif
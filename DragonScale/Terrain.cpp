@@ -0,0 +1,660 @@
+#include "Terrain.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+namespace DS {
+
+namespace {
+
+	const unsigned int HEIGHT_VERSION = 1;
+	const int NOISE_OCTAVES = 5;
+	const float NOISE_SCALE = 1.0f / 96.0f;		// Features per world unit at the first octave.
+	const float NO_MORPH = 1e30f;				// Morph start, beyond any distance.
+
+	struct Candidate {
+		int x;
+		int z;
+		float distance;
+	};
+
+	template< typename T >
+	bool Read( std::ifstream& stream, T* out, size_t count ) {
+		stream.read( ( char* ) out, sizeof( T ) * count );
+		return !stream.fail();
+	}
+
+	// Row vector convention, as OcclusionCuller.
+	void TransformPoint( const Math::Matrix4& m, float x, float y, float z, float out[ 4 ] ) {
+		for ( int j = 0; j < 4; ++j ) {
+			out[ j ] = x * m.c[ 0 ][ j ] + y * m.c[ 1 ][ j ] + z * m.c[ 2 ][ j ] + m.c[ 3 ][ j ];
+		}
+	}
+
+	/*
+		Conservative: only boxes with every corner outside the same clip
+		plane are rejected.
+	*/
+	bool InFrustum( const Math::Matrix4& viewProjection, const float* bmin, const float* bmax ) {
+		int outside[ 6 ] = { 0, 0, 0, 0, 0, 0 };
+
+		for ( int i = 0; i < 8; ++i ) {
+			float clip[ 4 ];
+			TransformPoint( viewProjection,
+							( i & 1 ) ? bmax[ 0 ] : bmin[ 0 ],
+							( i & 2 ) ? bmax[ 1 ] : bmin[ 1 ],
+							( i & 4 ) ? bmax[ 2 ] : bmin[ 2 ],
+							clip );
+
+			for ( int axis = 0; axis < 3; ++axis ) {
+				outside[ axis * 2 ] += clip[ axis ] < -clip[ 3 ] ? 1 : 0;
+				outside[ axis * 2 + 1 ] += clip[ axis ] > clip[ 3 ] ? 1 : 0;
+			}
+		}
+
+		for ( int p = 0; p < 6; ++p ) {
+			if ( outside[ p ] == 8 ) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool SphereTouchesBox( const Math::Point3& center, float radius, const float* bmin, const float* bmax ) {
+		float d = 0.0f;
+
+		for ( int axis = 0; axis < 3; ++axis ) {
+			float c = center[ axis ];
+			float e = c < bmin[ axis ] ? bmin[ axis ] - c : ( c > bmax[ axis ] ? c - bmax[ axis ] : 0.0f );
+			d += e * e;
+		}
+
+		return d <= radius * radius;
+	}
+
+	// Distance on the XZ plane from p to a square.
+	float SquareDistance( float px, float pz, float x0, float z0, float size ) {
+		float dx = std::max( std::max( x0 - px, px - ( x0 + size ) ), 0.0f );
+		float dz = std::max( std::max( z0 - pz, pz - ( z0 + size ) ), 0.0f );
+		return sqrtf( dx * dx + dz * dz );
+	}
+
+	float Lattice( int x, int z ) {
+		unsigned int h = ( unsigned int ) x * 374761393u + ( unsigned int ) z * 668265263u;
+		h = ( h ^ ( h >> 13 ) ) * 1274126177u;
+		return ( h ^ ( h >> 16 ) ) * ( 1.0f / 4294967295.0f );
+	}
+
+	float ValueNoise( float x, float z ) {
+		int ix = ( int ) floorf( x );
+		int iz = ( int ) floorf( z );
+		float fx = x - ix;
+		float fz = z - iz;
+
+		// Smoothstep, so the slope is continuous across lattice cells.
+		fx = fx * fx * ( 3.0f - 2.0f * fx );
+		fz = fz * fz * ( 3.0f - 2.0f * fz );
+
+		float a = Lattice( ix, iz ) + ( Lattice( ix + 1, iz ) - Lattice( ix, iz ) ) * fx;
+		float b = Lattice( ix, iz + 1 ) + ( Lattice( ix + 1, iz + 1 ) - Lattice( ix, iz + 1 ) ) * fx;
+
+		return a + ( b - a ) * fz;
+	}
+
+}
+
+bool LoadHeightTile( const char* directory, int x, int z, int resolution, std::vector< float >& heights ) {
+	char path[ 512 ];
+	sprintf( path, "%s/tile_%d_%d.height", directory, x, z );
+
+	std::ifstream stream( path, std::ios::in | std::ios::binary );
+
+	if ( !stream.is_open() ) {
+		return false;
+	}
+
+	char magic[ 4 ];
+	unsigned int header[ 2 ];
+	float range[ 2 ];
+
+	if ( !Read( stream, magic, 4 ) || memcmp( magic, "DSHT", 4 ) != 0 || !Read( stream, header, 2 ) || !Read( stream, range, 2 ) ) {
+		fprintf( stderr, "%s is not a height tile\n", path );
+		return false;
+	}
+
+	if ( header[ 0 ] != HEIGHT_VERSION || header[ 1 ] != ( unsigned int ) resolution ) {
+		fprintf( stderr, "%s has version %u, resolution %u\n", path, header[ 0 ], header[ 1 ] );
+		return false;
+	}
+
+	std::vector< unsigned short > samples( resolution * resolution );
+
+	if ( !Read( stream, &samples[ 0 ], samples.size() ) ) {
+		fprintf( stderr, "%s is truncated\n", path );
+		return false;
+	}
+
+	float scale = ( range[ 1 ] - range[ 0 ] ) / 65535.0f;
+	heights.resize( samples.size() );
+
+	for ( size_t i = 0; i < samples.size(); ++i ) {
+		heights[ i ] = range[ 0 ] + samples[ i ] * scale;
+	}
+
+	return true;
+}
+
+void GenerateHeightTile( int x, int z, int resolution, float tileSize, float base, float amplitude, std::vector< float >& heights ) {
+	heights.resize( resolution * resolution );
+
+	float spacing = tileSize / ( resolution - 1 );
+
+	for ( int j = 0; j < resolution; ++j ) {
+		for ( int i = 0; i < resolution; ++i ) {
+			float wx = ( x * tileSize + i * spacing ) * NOISE_SCALE;
+			float wz = ( z * tileSize + j * spacing ) * NOISE_SCALE;
+
+			float sum = 0.0f;
+			float weight = 0.5f;
+
+			for ( int o = 0; o < NOISE_OCTAVES; ++o ) {
+				sum += ValueNoise( wx, wz ) * weight;
+				wx *= 2.0f;
+				wz *= 2.0f;
+				weight *= 0.5f;
+			}
+
+			heights[ j * resolution + i ] = base + sum * amplitude;
+		}
+	}
+}
+
+TerrainDesc::TerrainDesc( void )
+	: tileSize( 128.0f ), tileResolution( 129 ), patchResolution( 32 ), depth( 5 ), lodDistance( 16.0f ), morphRatio( 0.7f ),
+	  viewDistance( 400.0f ), maxTiles( 64 ), maxUploads( 2 ), minHeight( 0.0f ), maxHeight( 1.0f ) {
+}
+
+Terrain::Terrain( void )
+	: units( NULL ), unit( 0 ), program( 0 ), nodeID( -1 ), tileID( -1 ), morphID( -1 ), cameraID( -1 ), heightRangeID( -1 ), heightsID( -1 ),
+	  vao( 0 ), vertexBuffer( 0 ), indexBuffer( 0 ), heightTexture( 0 ), quadrantIndices( 0 ),
+	  selectCamera( 0.0f, 0.0f, 0.0f ), inFlight( 0 ), busy( false ), quit( false ) {
+}
+
+Terrain::~Terrain( void ) {
+}
+
+void Terrain::Init( const TerrainDesc& d, const HeightLoader& l, unsigned int p, TextureUnits* u, unsigned int textureUnit ) {
+	MemoryScope scope( MEMORY_TERRAIN );
+
+	desc = d;
+	loader = l;
+	program = p;
+	units = u;
+	unit = textureUnit;
+
+	ranges.resize( desc.depth );
+
+	for ( int lod = 0; lod < desc.depth; ++lod ) {
+		ranges[ lod ] = desc.lodDistance * ( float ) ( 1 << lod );
+	}
+
+	nodeID = glGetUniformLocation( program, "NODE" );
+	tileID = glGetUniformLocation( program, "TILE" );
+	morphID = glGetUniformLocation( program, "MORPH" );
+	cameraID = glGetUniformLocation( program, "CAMERA" );
+	heightRangeID = glGetUniformLocation( program, "HEIGHT_RANGE" );
+	heightsID = glGetUniformLocation( program, "HEIGHTS" );
+
+	// One patch, grid coordinates in [ 0, 1 ].
+	int n = desc.patchResolution;
+	int half = n / 2;
+	std::vector< float > grid;
+	std::vector< unsigned int > indices;
+
+	for ( int z = 0; z <= n; ++z ) {
+		for ( int x = 0; x <= n; ++x ) {
+			grid.push_back( ( float ) x / n );
+			grid.push_back( ( float ) z / n );
+		}
+	}
+
+	// Quadrant by quadrant, so a quarter of the patch is one index range.
+	for ( int q = 0; q < 4; ++q ) {
+		int x0 = ( q & 1 ) * half;
+		int z0 = ( q >> 1 ) * half;
+
+		for ( int z = z0; z < z0 + half; ++z ) {
+			for ( int x = x0; x < x0 + half; ++x ) {
+				unsigned int a = z * ( n + 1 ) + x;
+				unsigned int b = a + n + 1;
+				unsigned int quad[ 6 ] = { a, b, a + 1, a + 1, b, b + 1 };
+
+				indices.insert( indices.end(), quad, quad + 6 );
+			}
+		}
+	}
+
+	quadrantIndices = ( unsigned int ) indices.size() / 4;
+
+	glGenVertexArrays( 1, &vao );
+	glGenBuffers( 1, &vertexBuffer );
+	glGenBuffers( 1, &indexBuffer );
+
+	GL::BindVertexArray( vao );
+
+	glEnableVertexAttribArray( 0 );
+	GL::BindBuffer( GL_ARRAY_BUFFER, vertexBuffer );
+	GL::BufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * grid.size(), &grid[ 0 ], GL_STATIC_DRAW );
+	glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	GL::BindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+	GL::BufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( GLuint ) * indices.size(), &indices[ 0 ], GL_STATIC_DRAW );
+
+	GL::BindVertexArray( 0 );
+	GL::BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_TERRAIN, vertexBuffer, sizeof( GLfloat ) * grid.size() );
+	Memory::TrackGL( MEMORY_GL_BUFFER, MEMORY_TERRAIN, indexBuffer, sizeof( GLuint ) * indices.size() );
+
+	// One layer per resident tile, sampled in the vertex shader.
+	glGenTextures( 1, &heightTexture );
+	units->Bind( unit, GL_TEXTURE_2D_ARRAY, heightTexture );
+
+	glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_R32F, desc.tileResolution, desc.tileResolution, desc.maxTiles, 0, GL_RED, GL_FLOAT, NULL );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+	Memory::TrackGL( MEMORY_GL_TEXTURE, MEMORY_TERRAIN, heightTexture,
+					 sizeof( GLfloat ) * desc.tileResolution * desc.tileResolution * desc.maxTiles );
+
+	for ( int layer = ( int ) desc.maxTiles - 1; layer >= 0; --layer ) {
+		freeLayers.push_back( layer );
+	}
+
+	quit = false;
+	thread = std::thread( &Terrain::StreamMain, this );
+}
+
+void Terrain::Shutdown( void ) {
+	if ( vao == 0 ) {
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > guard( lock );
+		quit = true;
+		pending.clear();
+	}
+
+	wake.notify_one();
+	thread.join();
+
+	for ( std::unordered_map< TileKey, Tile* >::iterator it = resident.begin(); it != resident.end(); ++it ) {
+		delete it->second;
+	}
+
+	for ( size_t i = 0; i < arrived.size(); ++i ) {
+		delete arrived[ i ];
+	}
+
+	for ( size_t i = 0; i < finished.size(); ++i ) {
+		delete finished[ i ];
+	}
+
+	resident.clear();
+	arrived.clear();
+	finished.clear();
+	desired.clear();
+	freeLayers.clear();
+	nodes.clear();
+
+	Memory::ReleaseGL( MEMORY_GL_BUFFER, vertexBuffer );
+	Memory::ReleaseGL( MEMORY_GL_BUFFER, indexBuffer );
+	Memory::ReleaseGL( MEMORY_GL_TEXTURE, heightTexture );
+
+	units->Invalidate( heightTexture );
+
+	GL::DeleteBuffers( 1, &vertexBuffer );
+	GL::DeleteBuffers( 1, &indexBuffer );
+	glDeleteTextures( 1, &heightTexture );
+	GL::DeleteVertexArrays( 1, &vao );
+
+	vao = vertexBuffer = indexBuffer = heightTexture = 0;
+}
+
+Terrain::TileKey Terrain::Key( int x, int z ) {
+	return ( ( TileKey ) ( unsigned int ) x << 32 ) | ( unsigned int ) z;
+}
+
+void Terrain::Update( const Math::Point3& camera ) {
+	MemoryScope scope( MEMORY_TERRAIN );
+
+	// Every tile in reach, nearest first, as many as there are layers.
+	std::vector< Candidate > candidates;
+
+	int x0 = ( int ) floorf( ( camera.x - desc.viewDistance ) / desc.tileSize );
+	int x1 = ( int ) floorf( ( camera.x + desc.viewDistance ) / desc.tileSize );
+	int z0 = ( int ) floorf( ( camera.z - desc.viewDistance ) / desc.tileSize );
+	int z1 = ( int ) floorf( ( camera.z + desc.viewDistance ) / desc.tileSize );
+
+	for ( int z = z0; z <= z1; ++z ) {
+		for ( int x = x0; x <= x1; ++x ) {
+			float distance = SquareDistance( camera.x, camera.z, x * desc.tileSize, z * desc.tileSize, desc.tileSize );
+
+			if ( distance <= desc.viewDistance ) {
+				Candidate c = { x, z, distance };
+				candidates.push_back( c );
+			}
+		}
+	}
+
+	std::sort( candidates.begin(), candidates.end(), []( const Candidate& a, const Candidate& b ) {
+		return a.distance < b.distance;
+	} );
+
+	if ( candidates.size() > desc.maxTiles ) {
+		candidates.resize( desc.maxTiles );
+	}
+
+	desired.clear();
+
+	for ( size_t i = 0; i < candidates.size(); ++i ) {
+		desired[ Key( candidates[ i ].x, candidates[ i ].z ) ] = true;
+	}
+
+	// Whatever fell out of reach gives its layer back first.
+	for ( std::unordered_map< TileKey, Tile* >::iterator it = resident.begin(); it != resident.end(); ) {
+		if ( desired.count( it->first ) == 0 ) {
+			if ( it->second->layer >= 0 ) {
+				freeLayers.push_back( it->second->layer );
+			}
+
+			delete it->second;
+			it = resident.erase( it );
+		} else {
+			++it;
+		}
+	}
+
+	std::vector< Tile* > done;
+	{
+		std::lock_guard< std::mutex > guard( lock );
+		done.swap( finished );
+	}
+
+	arrived.insert( arrived.end(), done.begin(), done.end() );
+
+	unsigned int uploads = 0;
+
+	for ( size_t i = 0; i < arrived.size(); ) {
+		Tile* tile = arrived[ i ];
+		TileKey key = Key( tile->x, tile->z );
+
+		if ( desired.count( key ) == 0 || resident.count( key ) != 0 ) {
+			delete tile;
+		} else if ( tile->heights.empty() ) {
+			resident[ key ] = tile;		// A hole, kept so it is not asked for again.
+		} else if ( uploads < desc.maxUploads && !freeLayers.empty() ) {
+			Upload( tile );
+			resident[ key ] = tile;
+			++uploads;
+		} else {
+			++i;
+			continue;
+		}
+
+		arrived.erase( arrived.begin() + i );
+	}
+
+	// Everything still missing, best last.
+	std::unordered_map< TileKey, bool > waiting;
+
+	for ( size_t i = 0; i < arrived.size(); ++i ) {
+		waiting[ Key( arrived[ i ]->x, arrived[ i ]->z ) ] = true;
+	}
+
+	std::lock_guard< std::mutex > guard( lock );
+	pending.clear();
+
+	for ( size_t i = candidates.size(); i-- > 0; ) {
+		TileKey key = Key( candidates[ i ].x, candidates[ i ].z );
+
+		if ( resident.count( key ) || waiting.count( key ) || ( busy && inFlight == key ) ) {
+			continue;
+		}
+
+		Request request = { candidates[ i ].x, candidates[ i ].z, candidates[ i ].distance };
+		pending.push_back( request );
+	}
+
+	if ( !pending.empty() ) {
+		wake.notify_one();
+	}
+}
+
+void Terrain::Upload( Tile* tile ) {
+	tile->layer = freeLayers.back();
+	freeLayers.pop_back();
+
+	units->Bind( unit, GL_TEXTURE_2D_ARRAY, heightTexture );
+	glTexSubImage3D( GL_TEXTURE_2D_ARRAY, 0, 0, 0, tile->layer, desc.tileResolution, desc.tileResolution, 1, GL_RED, GL_FLOAT, &tile->heights[ 0 ] );
+	GL::CountUpload( sizeof( float ) * tile->heights.size() );
+
+	// The GPU has its copy, only the node bounds stay on the CPU.
+	std::vector< float >().swap( tile->heights );
+}
+
+void Terrain::StreamMain( void ) {
+	MemoryScope scope( MEMORY_TERRAIN );
+
+	for ( ;; ) {
+		Request request;
+
+		{
+			std::unique_lock< std::mutex > guard( lock );
+			wake.wait( guard, [ this ] { return quit || !pending.empty(); } );
+
+			if ( quit ) {
+				return;
+			}
+
+			request = pending.back();
+			pending.pop_back();
+			inFlight = Key( request.x, request.z );
+			busy = true;
+		}
+
+		Tile* tile = new Tile();
+		tile->x = request.x;
+		tile->z = request.z;
+		tile->layer = -1;
+
+		if ( loader( request.x, request.z, desc.tileResolution, tile->heights ) &&
+			 tile->heights.size() == ( size_t ) desc.tileResolution * desc.tileResolution ) {
+			BuildBounds( *tile );
+		} else {
+			tile->heights.clear();
+		}
+
+		std::lock_guard< std::mutex > guard( lock );
+		finished.push_back( tile );
+		busy = false;
+	}
+}
+
+void Terrain::BuildBounds( Tile& tile ) const {
+	int leaves = 1 << ( desc.depth - 1 );
+	int step = ( desc.tileResolution - 1 ) / leaves;
+
+	tile.bounds.resize( desc.depth );
+	std::vector< float >& leaf = tile.bounds[ desc.depth - 1 ];
+	leaf.resize( leaves * leaves * 2 );
+
+	// Leaves share their edge samples with their neighbours.
+	for ( int nz = 0; nz < leaves; ++nz ) {
+		for ( int nx = 0; nx < leaves; ++nx ) {
+			float lo = FLT_MAX;
+			float hi = -FLT_MAX;
+
+			for ( int j = nz * step; j <= ( nz + 1 ) * step; ++j ) {
+				for ( int i = nx * step; i <= ( nx + 1 ) * step; ++i ) {
+					float h = tile.heights[ j * desc.tileResolution + i ];
+					lo = std::min( lo, h );
+					hi = std::max( hi, h );
+				}
+			}
+
+			leaf[ ( nz * leaves + nx ) * 2 ] = lo;
+			leaf[ ( nz * leaves + nx ) * 2 + 1 ] = hi;
+		}
+	}
+
+	for ( int depth = desc.depth - 2; depth >= 0; --depth ) {
+		int count = 1 << depth;
+		const std::vector< float >& below = tile.bounds[ depth + 1 ];
+		std::vector< float >& level = tile.bounds[ depth ];
+		level.resize( count * count * 2 );
+
+		for ( int nz = 0; nz < count; ++nz ) {
+			for ( int nx = 0; nx < count; ++nx ) {
+				float lo = FLT_MAX;
+				float hi = -FLT_MAX;
+
+				for ( int c = 0; c < 4; ++c ) {
+					int child = ( ( nz * 2 + ( c >> 1 ) ) * count * 2 + nx * 2 + ( c & 1 ) ) * 2;
+					lo = std::min( lo, below[ child ] );
+					hi = std::max( hi, below[ child + 1 ] );
+				}
+
+				level[ ( nz * count + nx ) * 2 ] = lo;
+				level[ ( nz * count + nx ) * 2 + 1 ] = hi;
+			}
+		}
+	}
+}
+
+void Terrain::Select( const Math::Point3& camera, const Math::Matrix4& viewProjection ) {
+	selectCamera = camera;
+	selectViewProjection = viewProjection;
+	nodes.clear();
+
+	for ( std::unordered_map< TileKey, Tile* >::const_iterator it = resident.begin(); it != resident.end(); ++it ) {
+		const Tile& tile = *it->second;
+
+		if ( tile.layer >= 0 ) {
+			SelectNode( tile, 0, 0, 0 );
+		}
+	}
+}
+
+void Terrain::SelectNode( const Tile& tile, int depth, int nx, int nz ) {
+	int count = 1 << depth;
+	float size = desc.tileSize / count;
+	float x = tile.x * desc.tileSize + nx * size;
+	float z = tile.z * desc.tileSize + nz * size;
+	const float* heights = &tile.bounds[ depth ][ ( nz * count + nx ) * 2 ];
+
+	float bmin[ 3 ] = { x, heights[ 0 ], z };
+	float bmax[ 3 ] = { x + size, heights[ 1 ], z + size };
+
+	if ( !InFrustum( selectViewProjection, bmin, bmax ) ) {
+		return;
+	}
+
+	int lod = desc.depth - 1 - depth;
+
+	if ( lod == 0 || !SphereTouchesBox( selectCamera, ranges[ lod - 1 ], bmin, bmax ) ) {
+		Node node = { x, z, size, lod, -1, &tile };
+		nodes.push_back( node );
+		return;
+	}
+
+	// Children in range of the finer level refine, the rest are drawn as
+	// quarters of this patch.
+	const float* below = &tile.bounds[ depth + 1 ][ 0 ];
+	float half = size * 0.5f;
+
+	for ( int q = 0; q < 4; ++q ) {
+		int cx = nx * 2 + ( q & 1 );
+		int cz = nz * 2 + ( q >> 1 );
+		int child = ( cz * count * 2 + cx ) * 2;
+
+		float cmin[ 3 ] = { x + ( q & 1 ) * half, below[ child ], z + ( q >> 1 ) * half };
+		float cmax[ 3 ] = { cmin[ 0 ] + half, below[ child + 1 ], cmin[ 2 ] + half };
+
+		if ( SphereTouchesBox( selectCamera, ranges[ lod - 1 ], cmin, cmax ) ) {
+			SelectNode( tile, depth + 1, cx, cz );
+		} else if ( InFrustum( selectViewProjection, cmin, cmax ) ) {
+			Node node = { x, z, size, lod, q, &tile };
+			nodes.push_back( node );
+		}
+	}
+}
+
+void Terrain::Render( void ) {
+	if ( nodes.empty() ) {
+		return;
+	}
+
+	units->Bind( unit, GL_TEXTURE_2D_ARRAY, heightTexture );
+
+	GL::Uniform1i( heightsID, unit );
+	GL::Uniform3f( cameraID, selectCamera.x, selectCamera.y, selectCamera.z );
+	GL::Uniform2f( heightRangeID, desc.minHeight, desc.maxHeight );
+
+	GL::BindVertexArray( vao );
+
+	for ( size_t i = 0; i < nodes.size(); ++i ) {
+		const Node& node = nodes[ i ];
+
+		// Morph toward the next coarser grid over the end of this range,
+		// the coarsest level has nothing to morph to.
+		float morphStart = NO_MORPH;
+		float morphEnd = NO_MORPH * 2.0f;
+
+		if ( node.lod < desc.depth - 1 ) {
+			float previous = node.lod > 0 ? ranges[ node.lod - 1 ] : 0.0f;
+			morphEnd = ranges[ node.lod ];
+			morphStart = previous + ( morphEnd - previous ) * desc.morphRatio;
+		}
+
+		GL::Uniform4f( nodeID, node.x, node.z, node.size, ( float ) desc.patchResolution );
+		GL::Uniform4f( tileID, node.tile->x * desc.tileSize, node.tile->z * desc.tileSize, desc.tileSize, ( float ) node.tile->layer );
+		GL::Uniform2f( morphID, morphStart, morphEnd );
+
+		if ( node.quadrant < 0 ) {
+			GL::DrawElements( GL_TRIANGLES, quadrantIndices * 4, GL_UNSIGNED_INT, 0 );
+		} else {
+			GL::DrawElements( GL_TRIANGLES, quadrantIndices, GL_UNSIGNED_INT, ( void* ) ( sizeof( GLuint ) * quadrantIndices * node.quadrant ) );
+		}
+	}
+
+	GL::BindVertexArray( 0 );
+}
+
+unsigned int Terrain::NodeCount( void ) const {
+	return ( unsigned int ) nodes.size();
+}
+
+unsigned int Terrain::ResidentTiles( void ) const {
+	return desc.maxTiles - ( unsigned int ) freeLayers.size();
+}
+
+unsigned int Terrain::PendingTiles( void ) const {
+	std::lock_guard< std::mutex > guard( lock );
+	return ( unsigned int ) pending.size() + ( busy ? 1 : 0 );
+}
+
+}
@@ -0,0 +1,176 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Matrix4.h"
+#include "Point3.h"
+#include "TextureUnits.h"
+
+namespace DS {
+
+/**
+	Fills resolution * resolution heights, row by row along +Z, for tile
+	( x, z ), called on the terrain streaming thread. Neighbouring tiles
+	share their edge samples. Returning false leaves the tile as a hole.
+**/
+typedef std::function< bool( int x, int z, int resolution, std::vector< float >& heights ) > HeightLoader;
+
+/**
+	DS::LoadHeightTile
+
+	Reads directory/tile_<x>_<z>.height. The file is "DSHT", a version and
+	the resolution ( unsigned ints ), the lowest and highest height
+	( floats ), then resolution * resolution unsigned shorts spanning that
+	range.
+**/
+bool LoadHeightTile( const char* directory, int x, int z, int resolution, std::vector< float >& heights );
+
+/**
+	DS::GenerateHeightTile
+
+	Rolling hills from a few octaves of value noise in world space, so
+	tiles line up without any data on disk.
+**/
+void GenerateHeightTile( int x, int z, int resolution, float tileSize, float base, float amplitude, std::vector< float >& heights );
+
+struct TerrainDesc {
+	TerrainDesc( void );
+
+	float tileSize;				// World units per tile side.
+	int tileResolution;			// Height samples per tile side, 2^n + 1.
+	int patchResolution;		// Quads per patch side, even.
+	int depth;					// Quadtree levels per tile, the leaves are LOD 0.
+	float lodDistance;			// Range of LOD 0, doubling per level.
+	float morphRatio;			// Fraction of a range after which vertices morph.
+	float viewDistance;
+	unsigned int maxTiles;		// Resident tiles, one texture layer each.
+	unsigned int maxUploads;	// Tiles adopted per Update.
+	float minHeight;			// For shading only.
+	float maxHeight;
+};
+
+/**
+	DS::Terrain - Streamed heightfield with quadtree LOD
+
+	Only one grid patch of patchResolution quads is ever stored on the GPU.
+	Every visible quadtree node draws it, scaled to the node, and the
+	vertex shader displaces it from a texture array holding one layer per
+	resident height tile. The draw cost depends on the view distance and
+	the LOD ranges, not on the size of the world.
+
+	Select walks each tile's quadtree from the root: a node is drawn
+	whole once the camera is outside the range of the next finer level,
+	otherwise its children within that range are refined and the others
+	are drawn as quarters of this node's patch. Near the end of its range
+	every odd vertex slides onto the next coarser grid, so levels meet
+	without cracks or popping.
+
+	Tiles within the view distance are loaded nearest first on a
+	streaming thread. The per node height bounds used for LOD and culling
+	are built there too; Update uploads a few finished tiles per call and
+	evicts the farthest ones once the layers run out.
+**/
+class Terrain {
+public:
+	Terrain( void );
+	~Terrain( void );
+
+	// program is built from terrain.vert and must be current for Render.
+	void Init( const TerrainDesc& desc, const HeightLoader& loader, unsigned int program, TextureUnits* units, unsigned int unit );
+	void Shutdown( void );
+
+	void Update( const Math::Point3& camera );
+
+	// viewProjection as passed to OcclusionCuller::Begin.
+	void Select( const Math::Point3& camera, const Math::Matrix4& viewProjection );
+	void Render( void );
+
+	unsigned int NodeCount( void ) const;
+	unsigned int ResidentTiles( void ) const;
+	unsigned int PendingTiles( void ) const;
+
+private:
+	typedef unsigned long long TileKey;
+
+	struct Tile {
+		int x;
+		int z;
+		int layer;				// -1 until uploaded.
+		std::vector< float > heights;				// Freed once uploaded.
+		std::vector< std::vector< float > > bounds;	// Min, max per node, by depth.
+	};
+
+	struct Request {
+		int x;
+		int z;
+		float priority;
+	};
+
+	struct Node {
+		float x;
+		float z;
+		float size;
+		int lod;
+		int quadrant;			// 0..3, or -1 for the whole patch.
+		const Tile* tile;
+	};
+
+	static TileKey Key( int x, int z );
+
+	void StreamMain( void );
+	void BuildBounds( Tile& tile ) const;
+	void SelectNode( const Tile& tile, int depth, int nx, int nz );
+	void Upload( Tile* tile );
+
+	TerrainDesc desc;
+	HeightLoader loader;
+	TextureUnits* units;
+	unsigned int unit;
+
+	unsigned int program;
+	int nodeID;
+	int tileID;
+	int morphID;
+	int cameraID;
+	int heightRangeID;
+	int heightsID;
+
+	unsigned int vao;
+	unsigned int vertexBuffer;
+	unsigned int indexBuffer;
+	unsigned int heightTexture;
+	unsigned int quadrantIndices;
+
+	std::vector< float > ranges;		// Per LOD.
+
+	// Main thread only.
+	std::unordered_map< TileKey, Tile* > resident;
+	std::unordered_map< TileKey, bool > desired;		// Within view distance, value is unused.
+	std::vector< Tile* > arrived;		// Loaded, waiting for an upload.
+	std::vector< int > freeLayers;
+	std::vector< Node > nodes;
+
+	// Selection state.
+	Math::Point3 selectCamera;
+	Math::Matrix4 selectViewProjection;
+
+	// Shared with the streaming thread.
+	std::thread thread;
+	mutable std::mutex lock;
+	std::condition_variable wake;
+	std::vector< Request > pending;		// Best last.
+	std::vector< Tile* > finished;
+	TileKey inFlight;
+	bool busy;
+	bool quit;
+};
+
+}
+
+#endif
@@ -0,0 +1,418 @@
+#include "TextureLoader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+namespace DS {
+
+namespace {
+
+	const unsigned char KTX_IDENTIFIER[ 12 ] = {
+		0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+	};
+
+	const unsigned int KTX_ENDIAN_REF = 0x04030201;
+	const unsigned int KTX_HEADER_SIZE = 12 + 13 * 4;
+
+	const unsigned int DDS_MAGIC = 0x20534444;	// "DDS "
+	const unsigned int DDS_HEADER_SIZE = 124;
+	const unsigned int DDS_DX10_HEADER_SIZE = 20;
+
+	// Largest width or height accepted from a file, before anything is
+	// allocated. LoadTexture also holds it to the context's limit.
+	const unsigned int MAX_TEXTURE_DIMENSION = 16384;
+
+	const unsigned int DDPF_ALPHAPIXELS = 0x1;
+	const unsigned int DDPF_FOURCC = 0x4;
+	const unsigned int DDPF_RGB = 0x40;
+
+	// DXGI_FORMAT values used by the DX10 extension header.
+	const unsigned int DXGI_R8G8B8A8_UNORM = 28;
+	const unsigned int DXGI_BC1_UNORM = 71;
+	const unsigned int DXGI_BC1_UNORM_SRGB = 72;
+	const unsigned int DXGI_BC2_UNORM = 74;
+	const unsigned int DXGI_BC2_UNORM_SRGB = 75;
+	const unsigned int DXGI_BC3_UNORM = 77;
+	const unsigned int DXGI_BC3_UNORM_SRGB = 78;
+	const unsigned int DXGI_BC4_UNORM = 80;
+	const unsigned int DXGI_BC5_UNORM = 83;
+	const unsigned int DXGI_BC7_UNORM = 98;
+	const unsigned int DXGI_BC7_UNORM_SRGB = 99;
+
+	inline unsigned int FourCC( char a, char b, char c, char d ) {
+		return ( unsigned int ) ( unsigned char ) a |
+			   ( ( unsigned int ) ( unsigned char ) b << 8 ) |
+			   ( ( unsigned int ) ( unsigned char ) c << 16 ) |
+			   ( ( unsigned int ) ( unsigned char ) d << 24 );
+	}
+
+	inline unsigned int ReadU32( const unsigned char* p, bool swap ) {
+		unsigned int v;
+		memcpy( &v, p, 4 );
+
+		if ( swap ) {
+			v = ( v >> 24 ) | ( ( v >> 8 ) & 0xFF00 ) | ( ( v << 8 ) & 0xFF0000 ) | ( v << 24 );
+		}
+
+		return v;
+	}
+
+	// Bytes per 4x4 block, 0 if the format isn't block compressed.
+	unsigned int BlockSize( unsigned int internalFormat ) {
+		switch ( internalFormat ) {
+			case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_RED_RGTC1:
+			case GL_COMPRESSED_RGB8_ETC2:
+			case GL_COMPRESSED_SRGB8_ETC2:
+			case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+				return 8;
+			case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			case GL_COMPRESSED_RG_RGTC2:
+			case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+			case GL_COMPRESSED_RGBA8_ETC2_EAC:
+			case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+				return 16;
+		}
+
+		return 0;
+	}
+
+	// In 64 bits, so a crafted header can't wrap it to something small.
+	unsigned long long MipSize( unsigned int internalFormat, unsigned int w, unsigned int h, unsigned long long bytesPerPixel ) {
+		unsigned long long block = BlockSize( internalFormat );
+
+		if ( block ) {
+			return ( unsigned long long ) std::max( 1u, ( w + 3 ) / 4 ) * std::max( 1u, ( h + 3 ) / 4 ) * block;
+		}
+
+		return ( unsigned long long ) w * h * bytesPerPixel;
+	}
+
+	bool IsSizeValid( unsigned int width, unsigned int height ) {
+		return width > 0 && height > 0 && width <= MAX_TEXTURE_DIMENSION && height <= MAX_TEXTURE_DIMENSION;
+	}
+
+	bool ReadFile( const char* file, std::vector< unsigned char >& bytes ) {
+		std::ifstream stream( file, std::ios::in | std::ios::binary );
+
+		if ( !stream.is_open() ) {
+			return false;
+		}
+
+		stream.seekg( 0, std::ios::end );
+		std::streamoff length = stream.tellg();
+		stream.seekg( 0, std::ios::beg );
+
+		bytes.resize( ( size_t ) length );
+
+		if ( length > 0 ) {
+			stream.read( ( char* ) &bytes[ 0 ], length );
+		}
+
+		return !stream.fail();
+	}
+
+}
+
+unsigned int TextureImage::Width( void ) const {
+	return mips.empty() ? 0 : mips[ 0 ].width;
+}
+
+unsigned int TextureImage::Height( void ) const {
+	return mips.empty() ? 0 : mips[ 0 ].height;
+}
+
+unsigned int TextureImage::TotalSize( void ) const {
+	unsigned int total = 0;
+
+	for ( size_t i = 0; i < mips.size(); ++i ) {
+		total += mips[ i ].size;
+	}
+
+	return total;
+}
+
+bool ParseKTX( const std::vector< unsigned char >& file, TextureImage& image ) {
+	if ( file.size() < KTX_HEADER_SIZE || memcmp( &file[ 0 ], KTX_IDENTIFIER, 12 ) != 0 ) {
+		return false;
+	}
+
+	const unsigned char* h = &file[ 12 ];
+	bool swap = ReadU32( h, false ) != KTX_ENDIAN_REF;
+
+	unsigned int glType = ReadU32( h + 4, swap );
+	unsigned int glTypeSize = ReadU32( h + 8, swap );
+	unsigned int glFormat = ReadU32( h + 12, swap );
+	unsigned int glInternalFormat = ReadU32( h + 16, swap );
+	unsigned int width = ReadU32( h + 24, swap );
+	unsigned int height = std::max( 1u, ReadU32( h + 28, swap ) );
+	unsigned int depth = ReadU32( h + 32, swap );
+	unsigned int arrayElements = ReadU32( h + 36, swap );
+	unsigned int faces = ReadU32( h + 40, swap );
+	unsigned int mipCount = std::max( 1u, ReadU32( h + 44, swap ) );
+	unsigned int keyValueBytes = ReadU32( h + 48, swap );
+
+	if ( depth > 1 || arrayElements > 0 || faces != 1 ) {
+		fprintf( stderr, "KTX: only 2D textures are supported.\n" );
+		return false;
+	}
+
+	if ( !IsSizeValid( width, height ) ) {
+		fprintf( stderr, "KTX: bad size %ux%u.\n", width, height );
+		return false;
+	}
+
+	if ( keyValueBytes > file.size() - KTX_HEADER_SIZE ) {
+		fprintf( stderr, "KTX: truncated key/value data.\n" );
+		return false;
+	}
+
+	image.internalFormat = glInternalFormat;
+	image.format = glFormat;
+	image.type = glType;
+	image.compressed = ( glType == 0 );
+	image.mips.clear();
+	image.data.clear();
+
+	if ( image.compressed && BlockSize( glInternalFormat ) == 0 ) {
+		fprintf( stderr, "KTX: unknown compressed format 0x%x.\n", glInternalFormat );
+		return false;
+	}
+
+	// Components times component size, uncompressed only.
+	unsigned int components = ( glFormat == GL_RGBA || glFormat == GL_BGRA ) ? 4 :
+							  ( glFormat == GL_RGB || glFormat == GL_BGR ) ? 3 :
+							  ( glFormat == GL_RG ) ? 2 : 1;
+	unsigned long long bytesPerPixel = ( unsigned long long ) components * std::max( 1u, glTypeSize );
+
+	size_t pos = KTX_HEADER_SIZE + keyValueBytes;
+
+	for ( unsigned int level = 0; level < mipCount; ++level ) {
+		if ( pos > file.size() || file.size() - pos < 4 ) {
+			fprintf( stderr, "KTX: truncated at mip %u.\n", level );
+			return false;
+		}
+
+		unsigned int imageSize = ReadU32( &file[ pos ], swap );
+		pos += 4;
+
+		TextureMip mip;
+		mip.width = std::max( 1u, width >> level );
+		mip.height = std::max( 1u, height >> level );
+		mip.offset = ( unsigned int ) image.data.size();
+		mip.size = imageSize;
+
+		if ( imageSize > file.size() - pos || imageSize < MipSize( glInternalFormat, mip.width, mip.height, bytesPerPixel ) ) {
+			fprintf( stderr, "KTX: bad size for mip %u.\n", level );
+			return false;
+		}
+
+		image.data.insert( image.data.end(), file.begin() + pos, file.begin() + pos + imageSize );
+		image.mips.push_back( mip );
+
+		pos += ( imageSize + 3 ) & ~3u;		// mipPadding
+	}
+
+	return true;
+}
+
+bool ParseDDS( const std::vector< unsigned char >& file, TextureImage& image ) {
+	if ( file.size() < 4 + DDS_HEADER_SIZE || ReadU32( &file[ 0 ], false ) != DDS_MAGIC ) {
+		return false;
+	}
+
+	const unsigned char* h = &file[ 4 ];
+
+	unsigned int height = ReadU32( h + 8, false );
+	unsigned int width = ReadU32( h + 12, false );
+	unsigned int mipCount = std::max( 1u, ReadU32( h + 24, false ) );
+	unsigned int caps2 = ReadU32( h + 108, false );
+
+	const unsigned char* pf = h + 72;
+	unsigned int pfFlags = ReadU32( pf + 4, false );
+	unsigned int fourCC = ReadU32( pf + 8, false );
+	unsigned int bitCount = ReadU32( pf + 12, false );
+	unsigned int rMask = ReadU32( pf + 16, false );
+
+	size_t pos = 4 + DDS_HEADER_SIZE;
+
+	if ( caps2 & 0x200 ) {	// DDSCAPS2_CUBEMAP
+		fprintf( stderr, "DDS: cube maps are not supported.\n" );
+		return false;
+	}
+
+	if ( !IsSizeValid( width, height ) ) {
+		fprintf( stderr, "DDS: bad size %ux%u.\n", width, height );
+		return false;
+	}
+
+	image.internalFormat = 0;
+	image.format = 0;
+	image.type = 0;
+	image.compressed = true;
+	image.mips.clear();
+	image.data.clear();
+
+	unsigned int bytesPerPixel = 0;
+
+	if ( pfFlags & DDPF_FOURCC ) {
+		if ( fourCC == FourCC( 'D', 'X', 'T', '1' ) ) {
+			image.internalFormat = ( pfFlags & DDPF_ALPHAPIXELS ) ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		} else if ( fourCC == FourCC( 'D', 'X', 'T', '3' ) ) {
+			image.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		} else if ( fourCC == FourCC( 'D', 'X', 'T', '5' ) ) {
+			image.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		} else if ( fourCC == FourCC( 'A', 'T', 'I', '1' ) || fourCC == FourCC( 'B', 'C', '4', 'U' ) ) {
+			image.internalFormat = GL_COMPRESSED_RED_RGTC1;
+		} else if ( fourCC == FourCC( 'A', 'T', 'I', '2' ) || fourCC == FourCC( 'B', 'C', '5', 'U' ) ) {
+			image.internalFormat = GL_COMPRESSED_RG_RGTC2;
+		} else if ( fourCC == FourCC( 'D', 'X', '1', '0' ) ) {
+			if ( file.size() < pos + DDS_DX10_HEADER_SIZE ) {
+				return false;
+			}
+
+			unsigned int dxgi = ReadU32( &file[ pos ], false );
+			unsigned int arraySize = ReadU32( &file[ pos + 12 ], false );
+			pos += DDS_DX10_HEADER_SIZE;
+
+			if ( arraySize > 1 ) {
+				fprintf( stderr, "DDS: texture arrays are not supported.\n" );
+				return false;
+			}
+
+			switch ( dxgi ) {
+				case DXGI_BC1_UNORM:		image.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+				case DXGI_BC1_UNORM_SRGB:	image.internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; break;
+				case DXGI_BC2_UNORM:		image.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break;
+				case DXGI_BC2_UNORM_SRGB:	image.internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT; break;
+				case DXGI_BC3_UNORM:		image.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+				case DXGI_BC3_UNORM_SRGB:	image.internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; break;
+				case DXGI_BC4_UNORM:		image.internalFormat = GL_COMPRESSED_RED_RGTC1; break;
+				case DXGI_BC5_UNORM:		image.internalFormat = GL_COMPRESSED_RG_RGTC2; break;
+				case DXGI_BC7_UNORM:		image.internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+				case DXGI_BC7_UNORM_SRGB:	image.internalFormat = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; break;
+				case DXGI_R8G8B8A8_UNORM:
+					image.internalFormat = GL_RGBA8;
+					image.format = GL_RGBA;
+					image.type = GL_UNSIGNED_BYTE;
+					image.compressed = false;
+					bytesPerPixel = 4;
+					break;
+			}
+		}
+	} else if ( ( pfFlags & DDPF_RGB ) && bitCount == 32 ) {
+		image.internalFormat = GL_RGBA8;
+		image.format = ( rMask == 0x00FF0000 ) ? GL_BGRA : GL_RGBA;
+		image.type = GL_UNSIGNED_BYTE;
+		image.compressed = false;
+		bytesPerPixel = 4;
+	}
+
+	if ( image.internalFormat == 0 ) {
+		fprintf( stderr, "DDS: unsupported pixel format.\n" );
+		return false;
+	}
+
+	for ( unsigned int level = 0; level < mipCount; ++level ) {
+		TextureMip mip;
+		mip.width = std::max( 1u, width >> level );
+		mip.height = std::max( 1u, height >> level );
+		mip.offset = ( unsigned int ) image.data.size();
+
+		unsigned long long size = MipSize( image.internalFormat, mip.width, mip.height, bytesPerPixel );
+
+		if ( size > file.size() - pos ) {
+			fprintf( stderr, "DDS: truncated at mip %u.\n", level );
+			return false;
+		}
+
+		mip.size = ( unsigned int ) size;
+
+		image.data.insert( image.data.end(), file.begin() + pos, file.begin() + pos + mip.size );
+		image.mips.push_back( mip );
+
+		pos += mip.size;
+	}
+
+	return true;
+}
+
+bool LoadTexture( const char* file, TextureImage& image ) {
+	std::vector< unsigned char > bytes;
+
+	if ( !ReadFile( file, bytes ) ) {
+		fprintf( stderr, "Unable to read texture %s.\n", file );
+		return false;
+	}
+
+	bool ok = false;
+
+	if ( bytes.size() >= 12 && memcmp( &bytes[ 0 ], KTX_IDENTIFIER, 12 ) == 0 ) {
+		ok = ParseKTX( bytes, image );
+	} else if ( bytes.size() >= 4 && ReadU32( &bytes[ 0 ], false ) == DDS_MAGIC ) {
+		ok = ParseDDS( bytes, image );
+	} else {
+		fprintf( stderr, "%s is not a KTX or DDS file.\n", file );
+		return false;
+	}
+
+	if ( !ok ) {
+		fprintf( stderr, "Unable to parse texture %s.\n", file );
+		return false;
+	}
+
+	if ( !IsFormatSupported( image.internalFormat ) ) {
+		fprintf( stderr, "Texture %s uses format 0x%x, which this GPU can't sample.\n", file, image.internalFormat );
+		return false;
+	}
+
+	GLint maxSize = 0;
+	glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxSize );
+
+	if ( image.Width() > ( unsigned int ) maxSize || image.Height() > ( unsigned int ) maxSize ) {
+		fprintf( stderr, "Texture %s is %ux%u, larger than this GPU's %d.\n", file, image.Width(), image.Height(), maxSize );
+		return false;
+	}
+
+	return true;
+}
+
+bool IsFormatSupported( unsigned int internalFormat ) {
+	switch ( internalFormat ) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			return GLEW_EXT_texture_compression_s3tc != 0;
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			return GLEW_EXT_texture_compression_s3tc != 0 && GLEW_EXT_texture_sRGB != 0;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+			return GLEW_ARB_texture_compression_bptc != 0;
+		case GL_COMPRESSED_RGB8_ETC2:
+		case GL_COMPRESSED_SRGB8_ETC2:
+		case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_RGBA8_ETC2_EAC:
+		case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+			return GLEW_ARB_ES3_compatibility != 0;
+	}
+
+	// RGTC and the uncompressed formats are core in 3.0.
+	return true;
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <vector>
+
+namespace DS {
+
+struct TextureMip {
+	unsigned int width;
+	unsigned int height;
+	unsigned int offset;	// Into TextureImage::data.
+	unsigned int size;
+};
+
+/**
+	DS::TextureImage - A 2D texture as stored on disk
+
+	Mips are ordered largest first. For compressed images internalFormat is
+	the compressed GL format and format/type are unused.
+**/
+struct TextureImage {
+	unsigned int internalFormat;
+	unsigned int format;
+	unsigned int type;
+	bool compressed;
+
+	std::vector< TextureMip > mips;
+	std::vector< unsigned char > data;
+
+	unsigned int Width( void ) const;
+	unsigned int Height( void ) const;
+	unsigned int TotalSize( void ) const;
+};
+
+/**
+	DS::LoadTexture
+
+	Reads a KTX ( version 1 ) or DDS container, picked by its magic number.
+	Only single face 2D images are accepted. Returns false and prints why if
+	the file is missing, malformed, larger than the context allows or in a
+	format it can't sample.
+**/
+bool LoadTexture( const char* file, TextureImage& image );
+
+bool ParseKTX( const std::vector< unsigned char >& file, TextureImage& image );
+bool ParseDDS( const std::vector< unsigned char >& file, TextureImage& image );
+
+/**
+	DS::IsFormatSupported
+
+	Whether the current context can sample the given internal format.
+**/
+bool IsFormatSupported( unsigned int internalFormat );
+
+}
+
+#endif
@@ -0,0 +1,215 @@
+#include "TextureManager.h"
+#include "MemoryTracker.h"
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+namespace DS {
+
+TextureManager::TextureManager( void )
+	: units( NULL ), memoryBudget( 0 ), uploadBudget( 0 ), residentBytes( 0 ), frame( 1 ) {
+}
+
+TextureManager::~TextureManager( void ) {
+}
+
+void TextureManager::Init( TextureUnits* u, size_t memory, size_t upload ) {
+	units = u;
+	memoryBudget = memory;
+	uploadBudget = upload;
+}
+
+void TextureManager::Shutdown( void ) {
+	for ( size_t i = 0; i < textures.size(); ++i ) {
+		Evict( textures[ i ] );
+	}
+
+	textures.clear();
+}
+
+unsigned int TextureManager::Load( const char* file ) {
+	for ( size_t i = 0; i < textures.size(); ++i ) {
+		if ( textures[ i ].file == file ) {
+			return ( unsigned int ) i;
+		}
+	}
+
+	Texture t;
+	t.file = file;
+	t.id = 0;
+	t.mipCount = 0;
+	t.finestMip = 0;
+	t.residentBytes = 0;
+	t.lastUsed = 0;
+	t.loaded = false;
+	t.failed = false;
+
+	textures.push_back( t );
+
+	return ( unsigned int ) textures.size() - 1;
+}
+
+bool TextureManager::Bind( unsigned int texture, unsigned int unit ) {
+	if ( texture >= textures.size() ) {
+		return false;
+	}
+
+	Texture& t = textures[ texture ];
+	t.lastUsed = frame;
+
+	if ( t.id == 0 || t.finestMip >= t.mipCount ) {
+		return false;
+	}
+
+	units->Bind( unit, GL_TEXTURE_2D, t.id );
+
+	return true;
+}
+
+void TextureManager::Evict( Texture& t ) {
+	if ( t.id != 0 ) {
+		units->Invalidate( t.id );
+		Memory::ReleaseGL( MEMORY_GL_TEXTURE, t.id );
+		glDeleteTextures( 1, &t.id );
+	}
+
+	residentBytes -= t.residentBytes;
+
+	t.id = 0;
+	t.residentBytes = 0;
+	t.finestMip = t.mipCount;
+	t.loaded = false;
+
+	// Swapping with empty vectors frees their storage, clear() would keep it.
+	std::vector< TextureMip >().swap( t.image.mips );
+	std::vector< unsigned char >().swap( t.image.data );
+}
+
+bool TextureManager::MakeRoom( size_t bytes, unsigned int keep ) {
+	while ( residentBytes + bytes > memoryBudget ) {
+		Texture* victim = NULL;
+
+		// Least recently bound, never anything wanted this frame.
+		for ( size_t i = 0; i < textures.size(); ++i ) {
+			Texture& t = textures[ i ];
+
+			if ( i == keep || t.residentBytes == 0 || t.lastUsed >= frame ) {
+				continue;
+			}
+
+			if ( !victim || t.lastUsed < victim->lastUsed ) {
+				victim = &t;
+			}
+		}
+
+		if ( !victim ) {
+			return false;
+		}
+
+		Evict( *victim );
+	}
+
+	return true;
+}
+
+size_t TextureManager::UploadNextMip( Texture& t ) {
+	unsigned int level = t.finestMip - 1;
+	const TextureMip& mip = t.image.mips[ level ];
+
+	if ( t.id == 0 ) {
+		glGenTextures( 1, &t.id );
+		units->Bind( 0, GL_TEXTURE_2D, t.id );
+
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, t.mipCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, t.mipCount - 1 );
+	} else {
+		units->Bind( 0, GL_TEXTURE_2D, t.id );
+	}
+
+	const GLvoid* pixels = &t.image.data[ mip.offset ];
+
+	if ( t.image.compressed ) {
+		glCompressedTexImage2D( GL_TEXTURE_2D, level, t.image.internalFormat, mip.width, mip.height, 0, mip.size, pixels );
+	} else {
+		glTexImage2D( GL_TEXTURE_2D, level, t.image.internalFormat, mip.width, mip.height, 0, t.image.format, t.image.type, pixels );
+	}
+
+	GL::CountUpload( mip.size );
+
+	// Only sample what is there.
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level );
+
+	t.finestMip = level;
+	t.residentBytes += mip.size;
+	residentBytes += mip.size;
+
+	Memory::TrackGL( MEMORY_GL_TEXTURE, MEMORY_TEXTURE, t.id, t.residentBytes );
+
+	// Fully resident, the file copy is no longer needed.
+	if ( level == 0 ) {
+		std::vector< TextureMip >().swap( t.image.mips );
+		std::vector< unsigned char >().swap( t.image.data );
+	}
+
+	return mip.size;
+}
+
+bool TextureManager::Update( void ) {
+	MemoryScope scope( MEMORY_TEXTURE );
+	size_t uploaded = 0;
+
+	for ( size_t i = 0; i < textures.size() && uploaded < uploadBudget; ++i ) {
+		Texture& t = textures[ i ];
+
+		if ( t.lastUsed != frame || t.failed ) {
+			continue;
+		}
+
+		if ( !t.loaded && t.residentBytes == 0 ) {
+			if ( !LoadTexture( t.file.c_str(), t.image ) ) {
+				t.failed = true;
+				continue;
+			}
+
+			t.loaded = true;
+			t.mipCount = ( unsigned int ) t.image.mips.size();
+			t.finestMip = t.mipCount;
+		}
+
+		while ( t.finestMip > 0 && uploaded < uploadBudget ) {
+			if ( !MakeRoom( t.image.mips[ t.finestMip - 1 ].size, ( unsigned int ) i ) ) {
+				break;	// Stays at a coarser mip until something frees up.
+			}
+
+			uploaded += UploadNextMip( t );
+		}
+	}
+
+	++frame;
+
+	return uploaded > 0;
+}
+
+size_t TextureManager::ResidentBytes( void ) const {
+	return residentBytes;
+}
+
+size_t TextureManager::MemoryBudget( void ) const {
+	return memoryBudget;
+}
+
+unsigned int TextureManager::ResidentMips( unsigned int texture ) const {
+	if ( texture >= textures.size() ) {
+		return 0;
+	}
+
+	return textures[ texture ].mipCount - textures[ texture ].finestMip;
+}
+
+}
@@ -0,0 +1,76 @@
+#ifndef TEXTUREMANAGER_H
+#define TEXTUREMANAGER_H
+
+#include <string>
+#include <vector>
+
+#include "TextureLoader.h"
+#include "TextureUnits.h"
+
+namespace DS {
+
+/**
+	DS::TextureManager - Streamed, budgeted texture residency
+
+	Load only registers a file; nothing is read until the texture is first
+	bound. From then on Update uploads its mips smallest first, a few per
+	frame, moving GL_TEXTURE_BASE_LEVEL down as each finer one lands so the
+	texture is usable ( if blurry ) right away.
+
+	Resident GPU memory is kept under the budget by evicting the least
+	recently bound textures. If nothing can be evicted a texture simply stops
+	at the finest mip that fits.
+**/
+class TextureManager {
+public:
+	TextureManager( void );
+	~TextureManager( void );
+
+	void Init( TextureUnits* units, size_t memoryBudget, size_t uploadBudget );
+	void Shutdown( void );
+
+	unsigned int Load( const char* file );
+
+	/**
+		Binds the texture to unit if any of it is resident and marks it as
+		wanted. Returns false while nothing has been uploaded yet.
+	**/
+	bool Bind( unsigned int texture, unsigned int unit );
+
+	// Once per frame, after drawing. True if a mip was uploaded, so the
+	// next frame looks sharper.
+	bool Update( void );
+
+	size_t ResidentBytes( void ) const;
+	size_t MemoryBudget( void ) const;
+	unsigned int ResidentMips( unsigned int texture ) const;
+
+private:
+	struct Texture {
+		std::string file;
+		TextureImage image;
+		unsigned int id;
+		unsigned int mipCount;
+		unsigned int finestMip;		// mipCount when nothing is resident.
+		size_t residentBytes;
+		unsigned int lastUsed;
+		bool loaded;
+		bool failed;
+	};
+
+	bool MakeRoom( size_t bytes, unsigned int keep );
+	void Evict( Texture& t );
+	size_t UploadNextMip( Texture& t );
+
+	TextureUnits* units;
+	std::vector< Texture > textures;
+
+	size_t memoryBudget;
+	size_t uploadBudget;
+	size_t residentBytes;
+	unsigned int frame;
+};
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include "TextureUnits.h"
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+namespace DS {
+
+TextureUnits::TextureUnits( void )
+	: active( 0 ) {
+}
+
+TextureUnits::~TextureUnits( void ) {
+}
+
+void TextureUnits::Init( void ) {
+	GLint units = 0;
+	glGetIntegerv( GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &units );
+
+	// One unit kept back for the draw data buffer.
+	Binding none = { 0, 0 };
+	bound.assign( units > 1 ? units - 1 : 1, none );
+
+	glActiveTexture( GL_TEXTURE0 );
+	active = 0;
+}
+
+void TextureUnits::Bind( unsigned int unit, unsigned int target, unsigned int texture ) {
+	if ( unit >= bound.size() ) {
+		return;
+	}
+
+	Binding& b = bound[ unit ];
+
+	if ( b.target == target && b.texture == texture ) {
+		GL::CountTextureBind( true );
+		return;
+	}
+
+	GL::CountTextureBind( false );
+
+	if ( active != unit ) {
+		glActiveTexture( GL_TEXTURE0 + unit );
+		active = unit;
+	}
+
+	// Switching targets on a unit leaves the old one bound otherwise.
+	if ( b.target != target && b.target != 0 ) {
+		glBindTexture( b.target, 0 );
+	}
+
+	glBindTexture( target, texture );
+
+	b.target = target;
+	b.texture = texture;
+}
+
+void TextureUnits::Invalidate( unsigned int texture ) {
+	for ( size_t i = 0; i < bound.size(); ++i ) {
+		if ( bound[ i ].texture == texture ) {
+			bound[ i ].target = 0;
+			bound[ i ].texture = 0;
+		}
+	}
+}
+
+unsigned int TextureUnits::Count( void ) const {
+	return ( unsigned int ) bound.size();
+}
+
+}
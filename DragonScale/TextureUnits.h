@@ -0,0 +1,41 @@
+#ifndef TEXTUREUNITS_H
+#define TEXTUREUNITS_H
+
+#include <vector>
+
+namespace DS {
+
+/**
+	DS::TextureUnits - Texture unit binding cache
+
+	All texture binds go through here so redundant glActiveTexture and
+	glBindTexture calls are skipped. The last unit is left alone for
+	DrawBatch's draw data buffer.
+**/
+class TextureUnits {
+public:
+	TextureUnits( void );
+	~TextureUnits( void );
+
+	void Init( void );
+
+	void Bind( unsigned int unit, unsigned int target, unsigned int texture );
+
+	// Forget a texture that is about to be deleted.
+	void Invalidate( unsigned int texture );
+
+	unsigned int Count( void ) const;
+
+private:
+	struct Binding {
+		unsigned int target;
+		unsigned int texture;
+	};
+
+	std::vector< Binding > bound;
+	unsigned int active;
+};
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "UniformGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace DS {
+
+namespace {
+
+	// 21 bits per axis, cells wrap beyond +-1M which only costs extra tests.
+	inline unsigned long long CellKey( int x, int y, int z ) {
+		const unsigned long long mask = ( 1ULL << 21 ) - 1;
+
+		return ( ( unsigned long long ) x & mask ) | ( ( ( unsigned long long ) y & mask ) << 21 ) | ( ( ( unsigned long long ) z & mask ) << 42 );
+	}
+
+}
+
+UniformGrid::UniformGrid( float size )
+	: cellSize( size ), invCellSize( 1.0f / size ) {
+}
+
+UniformGrid::~UniformGrid( void ) {
+}
+
+unsigned int UniformGrid::CellCount( void ) const {
+	return ( unsigned int ) cells.size();
+}
+
+int UniformGrid::CellOf( float v ) const {
+	return ( int ) std::floor( v * invCellSize );
+}
+
+UniformGrid::CellRange UniformGrid::RangeOf( const Math::BBox& b ) const {
+	CellRange r;
+
+	for ( int i = 0; i < 3; ++i ) {
+		r.lo[ i ] = CellOf( b.pMin[ i ] );
+		r.hi[ i ] = CellOf( b.pMax[ i ] );
+	}
+
+	return r;
+}
+
+void UniformGrid::Link( unsigned int proxy, const CellRange& r ) {
+	for ( int z = r.lo[ 2 ]; z <= r.hi[ 2 ]; ++z ) {
+		for ( int y = r.lo[ 1 ]; y <= r.hi[ 1 ]; ++y ) {
+			for ( int x = r.lo[ 0 ]; x <= r.hi[ 0 ]; ++x ) {
+				cells[ CellKey( x, y, z ) ].push_back( proxy );
+			}
+		}
+	}
+}
+
+void UniformGrid::Unlink( unsigned int proxy, const CellRange& r ) {
+	for ( int z = r.lo[ 2 ]; z <= r.hi[ 2 ]; ++z ) {
+		for ( int y = r.lo[ 1 ]; y <= r.hi[ 1 ]; ++y ) {
+			for ( int x = r.lo[ 0 ]; x <= r.hi[ 0 ]; ++x ) {
+				CellMap::iterator cell = cells.find( CellKey( x, y, z ) );
+
+				if ( cell == cells.end() ) {
+					continue;
+				}
+
+				std::vector< unsigned int >& list = cell->second;
+				std::vector< unsigned int >::iterator it = std::find( list.begin(), list.end(), proxy );
+
+				if ( it != list.end() ) {
+					*it = list.back();
+					list.pop_back();
+				}
+
+				if ( list.empty() ) {
+					cells.erase( cell );
+				}
+			}
+		}
+	}
+}
+
+void UniformGrid::OnAdd( unsigned int proxy ) {
+	if ( ranges.size() < bounds.size() ) {
+		ranges.resize( bounds.size() );
+	}
+
+	ranges[ proxy ] = RangeOf( bounds[ proxy ] );
+	Link( proxy, ranges[ proxy ] );
+}
+
+void UniformGrid::OnRemove( unsigned int proxy ) {
+	Unlink( proxy, ranges[ proxy ] );
+}
+
+void UniformGrid::OnMove( unsigned int proxy ) {
+	CellRange r = RangeOf( bounds[ proxy ] );
+	const CellRange& old = ranges[ proxy ];
+
+	// Most moves stay inside the same cells.
+	bool same = true;
+	for ( int i = 0; i < 3; ++i ) {
+		same = same && r.lo[ i ] == old.lo[ i ] && r.hi[ i ] == old.hi[ i ];
+	}
+
+	if ( same ) {
+		return;
+	}
+
+	Unlink( proxy, old );
+	ranges[ proxy ] = r;
+	Link( proxy, r );
+}
+
+void UniformGrid::FindPairs( std::vector< BroadphasePair >& pairs ) {
+	for ( CellMap::const_iterator cell = cells.begin(); cell != cells.end(); ++cell ) {
+		const std::vector< unsigned int >& list = cell->second;
+
+		if ( list.size() < 2 ) {
+			continue;
+		}
+
+		for ( size_t i = 0; i < list.size(); ++i ) {
+			const Math::BBox& a = bounds[ list[ i ] ];
+
+			for ( size_t j = i + 1; j < list.size(); ++j ) {
+				const Math::BBox& b = bounds[ list[ j ] ];
+
+				if ( !a.Overlaps( b ) ) {
+					continue;
+				}
+
+				int x = CellOf( std::max( a.pMin.x, b.pMin.x ) );
+				int y = CellOf( std::max( a.pMin.y, b.pMin.y ) );
+				int z = CellOf( std::max( a.pMin.z, b.pMin.z ) );
+
+				if ( CellKey( x, y, z ) == cell->first ) {
+					AddPair( pairs, list[ i ], list[ j ] );
+				}
+			}
+		}
+	}
+}
+
+}
@@ -0,0 +1,62 @@
+#ifndef UNIFORMGRID_H
+#define UNIFORMGRID_H
+
+#include <unordered_map>
+
+#include "Broadphase.h"
+
+namespace DS {
+
+/**
+	DS::UniformGrid - Hashed uniform grid broadphase
+
+	Space is cut into cubes of cellSize and only occupied cells are stored,
+	hashed by their integer coordinates, so the world needs no fixed
+	extent. Each proxy is listed in every cell its box touches and is only
+	relinked when it crosses into a different set of cells.
+
+	A pair sharing several cells is reported by just one of them, the cell
+	holding the min corner of the two boxes' intersection.
+
+	Works best when bodies are of similar size with cellSize a little
+	larger than a typical box; very large boxes touch many cells. Suits
+	dense scenes spread along all axes, where one sweep axis clusters
+	badly.
+**/
+class UniformGrid : public Broadphase {
+public:
+	UniformGrid( float cellSize );
+	~UniformGrid( void );
+
+	unsigned int CellCount( void ) const;
+
+protected:
+	void OnAdd( unsigned int proxy );
+	void OnRemove( unsigned int proxy );
+	void OnMove( unsigned int proxy );
+	void FindPairs( std::vector< BroadphasePair >& pairs );
+
+private:
+	struct CellRange {
+		int lo[ 3 ];
+		int hi[ 3 ];
+	};
+
+	typedef std::unordered_map< unsigned long long, std::vector< unsigned int > > CellMap;
+
+	CellRange RangeOf( const Math::BBox& b ) const;
+	int CellOf( float v ) const;
+
+	void Link( unsigned int proxy, const CellRange& r );
+	void Unlink( unsigned int proxy, const CellRange& r );
+
+	float cellSize;
+	float invCellSize;
+
+	CellMap cells;
+	std::vector< CellRange > ranges;
+};
+
+}
+
+#endif
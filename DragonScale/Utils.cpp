@@ -1,4 +1,5 @@
 #include "Utils.h"
+#include "MemoryTracker.h"
 
 #include <string>
 #include <fstream>
@@ -54,6 +55,35 @@ Math::Matrix4 Perspective( float fovY, float aspect, float zNear, float zFar ) {
 	return Frustum( left, right, bottom, top, zNear, zFar );
 }
 
+Math::Matrix4 InfinitePerspective( float fovY, float aspect, float zNear ) {
+	Math::Matrix4 m = Perspective( fovY, aspect, zNear, 1.0f );
+
+	// The limits of the z row as zFar grows.
+	m.c[ 2 ][ 2 ] = -1.0f;
+	m.c[ 3 ][ 2 ] = -2.0f * zNear;
+
+	return m;
+}
+
+Math::Matrix4 ReversedPerspective( float fovY, float aspect, float zNear, float zFar ) {
+	Math::Matrix4 m = Perspective( fovY, aspect, zNear, zFar );
+
+	m.c[ 2 ][ 2 ] = zNear / ( zFar - zNear );
+	m.c[ 3 ][ 2 ] = zFar * zNear / ( zFar - zNear );
+
+	return m;
+}
+
+Math::Matrix4 ReversedInfinitePerspective( float fovY, float aspect, float zNear ) {
+	Math::Matrix4 m = Perspective( fovY, aspect, zNear, 1.0f );
+
+	// Depth is zNear / distance, so float precision follows the distance.
+	m.c[ 2 ][ 2 ] = 0.0f;
+	m.c[ 3 ][ 2 ] = zNear;
+
+	return m;
+}
+
 Math::Matrix4 LookAt( const Math::Vector3& eye, const Math::Vector3& center, const Math::Vector3& up ) {
 	Math::Vector3 axisZ = Math::Normalize( center - eye );
 	Math::Vector3 axisY = Math::Normalize( up );
@@ -82,6 +112,8 @@ Math::Matrix4 LookAt( const Math::Vector3& eye, const Math::Vector3& center, con
 }
 
 unsigned int LoadShaders( const char* vsFile, const char* fsFile ) {
+	MemoryScope scope( MEMORY_SHADER );
+
 	// Create Shaders
 	GLuint vsID = glCreateShader( GL_VERTEX_SHADER );
 	GLuint fsID = glCreateShader( GL_FRAGMENT_SHADER );
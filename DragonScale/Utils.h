@@ -14,6 +14,15 @@ namespace DS {
 									  float aspect, 
 									  float zNear, float zFar );
 
+	// Far plane at infinity, depth still -1 at zNear and 1 far away.
+	Math::Matrix4 InfinitePerspective( float fovY, float aspect, float zNear );
+
+	// Reverse-Z for glClipControl( GL_LOWER_LEFT, GL_ZERO_TO_ONE ): depth 1
+	// at zNear falling to 0 at zFar, or towards infinity. Test with GL_GREATER
+	// and clear to 0.
+	Math::Matrix4 ReversedPerspective( float fovY, float aspect, float zNear, float zFar );
+	Math::Matrix4 ReversedInfinitePerspective( float fovY, float aspect, float zNear );
+
 	Math::Matrix4 LookAt( const Math::Vector3& eye, 
 								 const Math::Vector3& center, 
 								 const Math::Vector3& up );
@@ -0,0 +1,298 @@
+#include "VertexFormat.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <GL/glew.h>
+
+namespace DS {
+
+namespace {
+
+	unsigned int PositionBytes( PositionFormat f ) {
+		return f == POSITION_FLOAT ? 12 : 8;
+	}
+
+	unsigned int ColorBytes( ColorFormat f ) {
+		return f == COLOR_FLOAT ? 12 : 4;
+	}
+
+	unsigned int NormalBytes( NormalFormat f ) {
+		return f == NORMAL_NONE ? 0 : 4;
+	}
+
+	unsigned int TexCoordBytes( TexCoordFormat f ) {
+		return f == TEXCOORD_NONE ? 0 : 4;
+	}
+
+	float Clamp( float x, float lo, float hi ) {
+		return x < lo ? lo : ( x > hi ? hi : x );
+	}
+
+	float SignNotZero( float x ) {
+		return x >= 0.0f ? 1.0f : -1.0f;
+	}
+
+}
+
+VertexFormat::VertexFormat( void )
+	: position( POSITION_FLOAT ), color( COLOR_FLOAT ), normal( NORMAL_NONE ), texCoord( TEXCOORD_NONE ) {
+}
+
+VertexFormat::VertexFormat( PositionFormat p, ColorFormat c, NormalFormat n, TexCoordFormat t )
+	: position( p ), color( c ), normal( n ), texCoord( t ) {
+}
+
+unsigned int VertexFormat::PositionOffset( void ) const {
+	return 0;
+}
+
+unsigned int VertexFormat::ColorOffset( void ) const {
+	return PositionBytes( position );
+}
+
+unsigned int VertexFormat::NormalOffset( void ) const {
+	return ColorOffset() + ColorBytes( color );
+}
+
+unsigned int VertexFormat::TexCoordOffset( void ) const {
+	return NormalOffset() + NormalBytes( normal );
+}
+
+unsigned int VertexFormat::Stride( void ) const {
+	return TexCoordOffset() + TexCoordBytes( texCoord );
+}
+
+unsigned int PackedVertices::VertexCount( void ) const {
+	return ( unsigned int ) ( data.size() / format.Stride() );
+}
+
+PackedVertices PackVertices( const Mesh& mesh, const VertexFormat& format ) {
+	MemoryScope scope( MEMORY_MESH );
+
+	PackedVertices out;
+	out.format = format;
+	out.scale = Math::Vector3( 1.0f, 1.0f, 1.0f );
+	out.bias = Math::Vector3( 0.0f, 0.0f, 0.0f );
+
+	unsigned int count = mesh.VertexCount();
+	unsigned int stride = format.Stride();
+
+	out.data.assign( ( size_t ) count * stride, 0 );
+
+	if ( format.position == POSITION_UNORM16 && count > 0 ) {
+		Math::Vector3 extent = mesh.bounds.Extent();
+
+		out.bias = Math::Vector3( mesh.bounds.pMin.x, mesh.bounds.pMin.y, mesh.bounds.pMin.z );
+		out.scale = extent;
+	}
+
+	for ( unsigned int v = 0; v < count; ++v ) {
+		unsigned char* vertex = &out.data[ ( size_t ) v * stride ];
+		const float* p = &mesh.positions[ v * 3 ];
+		const float* c = &mesh.colors[ v * 3 ];
+
+		switch ( format.position ) {
+			case POSITION_FLOAT:
+				memcpy( vertex, p, 3 * sizeof( float ) );
+				break;
+
+			case POSITION_HALF: {
+				unsigned short h[ 3 ] = { FloatToHalf( p[ 0 ] ), FloatToHalf( p[ 1 ] ), FloatToHalf( p[ 2 ] ) };
+				memcpy( vertex, h, sizeof( h ) );
+				break;
+			}
+
+			case POSITION_UNORM16: {
+				unsigned short q[ 3 ];
+
+				for ( int i = 0; i < 3; ++i ) {
+					// Flat axes have no extent, everything sits on the bias.
+					float t = out.scale[ i ] > 0.0f ? ( p[ i ] - out.bias[ i ] ) / out.scale[ i ] : 0.0f;
+					q[ i ] = ( unsigned short ) ( Clamp( t, 0.0f, 1.0f ) * 65535.0f + 0.5f );
+				}
+
+				memcpy( vertex, q, sizeof( q ) );
+				break;
+			}
+		}
+
+		unsigned char* color = vertex + format.ColorOffset();
+
+		if ( format.color == COLOR_FLOAT ) {
+			memcpy( color, c, 3 * sizeof( float ) );
+		} else {
+			for ( int i = 0; i < 3; ++i ) {
+				color[ i ] = ( unsigned char ) ( Clamp( c[ i ], 0.0f, 1.0f ) * 255.0f + 0.5f );
+			}
+
+			color[ 3 ] = 255;
+		}
+
+		if ( format.normal == NORMAL_OCTAHEDRAL ) {
+			Math::Vector3 n( 0.0f, 1.0f, 0.0f );
+
+			if ( !mesh.normals.empty() ) {
+				n = Math::Vector3( mesh.normals[ v * 3 ], mesh.normals[ v * 3 + 1 ], mesh.normals[ v * 3 + 2 ] );
+			}
+
+			short e[ 2 ];
+			EncodeOctahedral( n, e );
+			memcpy( vertex + format.NormalOffset(), e, sizeof( e ) );
+		}
+
+		if ( format.texCoord == TEXCOORD_HALF && !mesh.texCoords.empty() ) {
+			unsigned short h[ 2 ] = { FloatToHalf( mesh.texCoords[ v * 2 ] ), FloatToHalf( mesh.texCoords[ v * 2 + 1 ] ) };
+			memcpy( vertex + format.TexCoordOffset(), h, sizeof( h ) );
+		}
+	}
+
+	return out;
+}
+
+void SetVertexAttributes( const VertexFormat& format, int position, int color, int normal, int texCoord ) {
+	GLsizei stride = format.Stride();
+
+	if ( position >= 0 ) {
+		glEnableVertexAttribArray( position );
+
+		switch ( format.position ) {
+			case POSITION_FLOAT:
+				glVertexAttribPointer( position, 3, GL_FLOAT, GL_FALSE, stride, ( const GLvoid* ) 0 );
+				break;
+			case POSITION_HALF:
+				glVertexAttribPointer( position, 3, GL_HALF_FLOAT, GL_FALSE, stride, ( const GLvoid* ) 0 );
+				break;
+			case POSITION_UNORM16:
+				glVertexAttribPointer( position, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, ( const GLvoid* ) 0 );
+				break;
+		}
+	}
+
+	if ( color >= 0 ) {
+		const GLvoid* offset = ( const GLvoid* ) ( size_t ) format.ColorOffset();
+
+		glEnableVertexAttribArray( color );
+
+		if ( format.color == COLOR_FLOAT ) {
+			glVertexAttribPointer( color, 3, GL_FLOAT, GL_FALSE, stride, offset );
+		} else {
+			glVertexAttribPointer( color, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, offset );
+		}
+	}
+
+	// Without normals the attribute keeps its constant value.
+	if ( normal >= 0 && format.normal == NORMAL_OCTAHEDRAL ) {
+		glEnableVertexAttribArray( normal );
+		glVertexAttribPointer( normal, 2, GL_SHORT, GL_TRUE, stride, ( const GLvoid* ) ( size_t ) format.NormalOffset() );
+	}
+
+	if ( texCoord >= 0 && format.texCoord == TEXCOORD_HALF ) {
+		glEnableVertexAttribArray( texCoord );
+		glVertexAttribPointer( texCoord, 2, GL_HALF_FLOAT, GL_FALSE, stride, ( const GLvoid* ) ( size_t ) format.TexCoordOffset() );
+	}
+}
+
+/*
+	Round to nearest; overflow goes to infinity and tiny values to
+	denormals or zero.
+*/
+unsigned short FloatToHalf( float f ) {
+	unsigned int bits;
+	memcpy( &bits, &f, sizeof( bits ) );
+
+	unsigned int sign = ( bits >> 16 ) & 0x8000;
+	int exponent = ( int ) ( ( bits >> 23 ) & 0xff ) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffff;
+
+	if ( ( ( bits >> 23 ) & 0xff ) == 0xff ) {
+		return ( unsigned short ) ( sign | 0x7c00 | ( mantissa ? 0x200 : 0 ) );	// Inf or NaN.
+	}
+
+	if ( exponent >= 31 ) {
+		return ( unsigned short ) ( sign | 0x7c00 );
+	}
+
+	if ( exponent <= 0 ) {
+		if ( exponent < -10 ) {
+			return ( unsigned short ) sign;
+		}
+
+		mantissa |= 0x800000;
+		unsigned int shift = ( unsigned int ) ( 14 - exponent );
+		unsigned int half = mantissa >> shift;
+
+		if ( ( mantissa >> ( shift - 1 ) ) & 1 ) {
+			++half;
+		}
+
+		return ( unsigned short ) ( sign | half );
+	}
+
+	unsigned int half = sign | ( ( unsigned int ) exponent << 10 ) | ( mantissa >> 13 );
+
+	// A carry out of the mantissa bumps the exponent, which is still right.
+	if ( mantissa & 0x1000 ) {
+		++half;
+	}
+
+	return ( unsigned short ) half;
+}
+
+float HalfToFloat( unsigned short h ) {
+	unsigned int sign = ( unsigned int ) ( h & 0x8000 ) << 16;
+	unsigned int exponent = ( h >> 10 ) & 0x1f;
+	unsigned int mantissa = h & 0x3ff;
+	unsigned int bits;
+
+	if ( exponent == 0 ) {
+		float f = mantissa / 16777216.0f;		// 2^-24 per step.
+		return sign ? -f : f;
+	}
+
+	if ( exponent == 31 ) {
+		bits = sign | 0x7f800000 | ( mantissa << 13 );
+	} else {
+		bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+	}
+
+	float f;
+	memcpy( &f, &bits, sizeof( f ) );
+	return f;
+}
+
+void EncodeOctahedral( const Math::Vector3& n, short* out ) {
+	float l1 = fabsf( n.x ) + fabsf( n.y ) + fabsf( n.z );
+	float x = l1 > 0.0f ? n.x / l1 : 0.0f;
+	float y = l1 > 0.0f ? n.y / l1 : 0.0f;
+
+	// The lower hemisphere folds over the diagonals.
+	if ( n.z < 0.0f ) {
+		float fx = ( 1.0f - fabsf( y ) ) * SignNotZero( x );
+		float fy = ( 1.0f - fabsf( x ) ) * SignNotZero( y );
+		x = fx;
+		y = fy;
+	}
+
+	out[ 0 ] = ( short ) floorf( Clamp( x, -1.0f, 1.0f ) * 32767.0f + 0.5f );
+	out[ 1 ] = ( short ) floorf( Clamp( y, -1.0f, 1.0f ) * 32767.0f + 0.5f );
+}
+
+Math::Vector3 DecodeOctahedral( const short* in ) {
+	float x = std::max( in[ 0 ] / 32767.0f, -1.0f );
+	float y = std::max( in[ 1 ] / 32767.0f, -1.0f );
+	float z = 1.0f - fabsf( x ) - fabsf( y );
+
+	if ( z < 0.0f ) {
+		float fx = ( 1.0f - fabsf( y ) ) * SignNotZero( x );
+		float fy = ( 1.0f - fabsf( x ) ) * SignNotZero( y );
+		x = fx;
+		y = fy;
+	}
+
+	return Math::Normalize( Math::Vector3( x, y, z ) );
+}
+
+}
@@ -0,0 +1,97 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <vector>
+
+#include "Vector3.h"
+#include "Mesh.h"
+
+namespace DS {
+
+enum PositionFormat {
+	POSITION_FLOAT,				// 12 bytes.
+	POSITION_HALF,				// 3 half floats in 8 bytes.
+	POSITION_UNORM16			// 3 normalized shorts in 8 bytes, scaled to the mesh bounds.
+};
+
+enum ColorFormat {
+	COLOR_FLOAT,				// 12 bytes.
+	COLOR_UNORM8				// RGBA bytes.
+};
+
+enum NormalFormat {
+	NORMAL_NONE,
+	NORMAL_OCTAHEDRAL			// 2 normalized signed shorts.
+};
+
+enum TexCoordFormat {
+	TEXCOORD_NONE,
+	TEXCOORD_HALF				// 2 half floats, so coordinates can repeat.
+};
+
+/**
+	DS::VertexFormat - Interleaved vertex layout
+
+	Position, color, normal and texture coordinates, in that order, each
+	padded to 4 bytes. The default is the old float layout without normals
+	or texture coordinates.
+**/
+struct VertexFormat {
+	VertexFormat( void );
+	VertexFormat( PositionFormat p, ColorFormat c, NormalFormat n, TexCoordFormat t = TEXCOORD_NONE );
+
+	unsigned int PositionOffset( void ) const;
+	unsigned int ColorOffset( void ) const;
+	unsigned int NormalOffset( void ) const;
+	unsigned int TexCoordOffset( void ) const;
+	unsigned int Stride( void ) const;
+
+	PositionFormat position;
+	ColorFormat color;
+	NormalFormat normal;
+	TexCoordFormat texCoord;
+};
+
+/**
+	DS::PackedVertices
+
+	A mesh's vertices converted to a VertexFormat. A stored position p comes
+	back as p * scale + bias; for POSITION_UNORM16 that maps [ 0, 1 ] onto
+	the mesh bounds, the other formats need no dequantization.
+**/
+struct PackedVertices {
+	VertexFormat format;
+	std::vector< unsigned char > data;
+
+	Math::Vector3 scale;
+	Math::Vector3 bias;
+
+	unsigned int VertexCount( void ) const;
+};
+
+/**
+	DS::PackVertices
+
+	Converts at import time, never per frame. Meshes without normals get
+	+Y, without texture coordinates ( 0, 0 ).
+**/
+PackedVertices PackVertices( const Mesh& mesh, const VertexFormat& format );
+
+/**
+	DS::SetVertexAttributes
+
+	Points the attributes at the GL_ARRAY_BUFFER currently bound, in the
+	current vertex array. A location of -1 is skipped.
+**/
+void SetVertexAttributes( const VertexFormat& format, int position, int color, int normal, int texCoord = -1 );
+
+unsigned short FloatToHalf( float f );
+float HalfToFloat( unsigned short h );
+
+// Octahedral mapping of a unit vector onto [ -1, 1 ]^2, as snorm16.
+void EncodeOctahedral( const Math::Vector3& n, short* out );
+Math::Vector3 DecodeOctahedral( const short* in );
+
+}
+
+#endif
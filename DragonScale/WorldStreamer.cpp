@@ -0,0 +1,421 @@
+#include "WorldStreamer.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace DS {
+
+namespace {
+
+	const unsigned int CHUNK_VERSION = 1;
+	const size_t INITIAL_CHUNK_BYTES = 64 * 1024;	// Guess until something has loaded.
+	const float VELOCITY_SMOOTHING = 0.2f;
+
+	// Mesh index, transform and bounds.
+	const size_t CHUNK_OBJECT_BYTES = sizeof( unsigned int ) + 22 * sizeof( float );
+
+	struct Candidate {
+		int x;
+		int z;
+		float priority;
+		bool load;
+	};
+
+	template< typename T >
+	bool Read( std::ifstream& stream, T* out, size_t count ) {
+		stream.read( ( char* ) out, sizeof( T ) * count );
+		return !stream.fail();
+	}
+
+}
+
+bool LoadChunkFile( const char* directory, int x, int z, unsigned int meshCount, Chunk& chunk ) {
+	char path[ 512 ];
+	sprintf( path, "%s/cell_%d_%d.chunk", directory, x, z );
+
+	std::ifstream stream( path, std::ios::in | std::ios::binary );
+
+	if ( !stream.is_open() ) {
+		return true;
+	}
+
+	char magic[ 4 ];
+	unsigned int header[ 2 ];
+
+	if ( !Read( stream, magic, 4 ) || memcmp( magic, "DSCK", 4 ) != 0 || !Read( stream, header, 2 ) ) {
+		fprintf( stderr, "%s is not a chunk file\n", path );
+		return false;
+	}
+
+	if ( header[ 0 ] != CHUNK_VERSION ) {
+		fprintf( stderr, "%s has unsupported version %u\n", path, header[ 0 ] );
+		return false;
+	}
+
+	// The count is checked against what is left of the file before anything
+	// is allocated for it.
+	std::streamoff start = stream.tellg();
+	stream.seekg( 0, std::ios::end );
+	std::streamoff remaining = stream.tellg() - start;
+	stream.seekg( start );
+
+	if ( remaining < 0 || ( unsigned long long ) header[ 1 ] * CHUNK_OBJECT_BYTES > ( unsigned long long ) remaining ) {
+		fprintf( stderr, "%s is not a chunk file\n", path );
+		return false;
+	}
+
+	chunk.objects.resize( header[ 1 ] );
+
+	for ( unsigned int i = 0; i < header[ 1 ]; ++i ) {
+		ChunkObject& obj = chunk.objects[ i ];
+		float transform[ 4 ][ 4 ];
+		float bounds[ 6 ];
+
+		if ( !Read( stream, &obj.mesh, 1 ) || !Read( stream, &transform[ 0 ][ 0 ], 16 ) || !Read( stream, bounds, 6 ) ) {
+			fprintf( stderr, "%s is truncated\n", path );
+			return false;
+		}
+
+		if ( obj.mesh >= meshCount ) {
+			fprintf( stderr, "%s is not a chunk file\n", path );
+			chunk.objects.clear();
+			return false;
+		}
+
+		obj.model = Math::Matrix4( transform ).GetTranspose();
+		obj.bounds = Math::BBox( Math::Point3( bounds[ 0 ], bounds[ 1 ], bounds[ 2 ] ), Math::Point3( bounds[ 3 ], bounds[ 4 ], bounds[ 5 ] ) );
+		obj.lod = 0;
+	}
+
+	return true;
+}
+
+WorldStreamer::WorldStreamer( void )
+	: cellSize( 1.0f ), loadRadius( 0.0f ), unloadRadius( 0.0f ), lookahead( 1.0f ), memoryBudget( 0 ), maxAdoptions( 2 ),
+	  lastCamera( 0.0f, 0.0f, 0.0f ), velocity( 0.0f, 0.0f, 0.0f ), hasCamera( false ),
+	  residentBytes( 0 ), averageBytes( INITIAL_CHUNK_BYTES ), inFlight( 0 ), busy( false ), quit( false ) {
+}
+
+WorldStreamer::~WorldStreamer( void ) {
+	Shutdown();
+}
+
+void WorldStreamer::Init( const ChunkLoader& l, float size, float radius, size_t budget ) {
+	loader = l;
+	cellSize = size;
+	loadRadius = radius;
+	unloadRadius = radius * 1.25f;
+	memoryBudget = budget;
+
+	quit = false;
+	thread = std::thread( &WorldStreamer::StreamMain, this );
+}
+
+void WorldStreamer::Shutdown( void ) {
+	if ( !thread.joinable() ) {
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > guard( lock );
+		quit = true;
+		pending.clear();
+	}
+
+	wake.notify_all();
+	thread.join();
+
+	for ( size_t i = 0; i < finished.size(); ++i ) {
+		delete finished[ i ];
+	}
+
+	for ( size_t i = 0; i < arrived.size(); ++i ) {
+		delete arrived[ i ];
+	}
+
+	for ( std::unordered_map< CellKey, Loaded >::iterator it = resident.begin(); it != resident.end(); ++it ) {
+		delete it->second.chunk;
+	}
+
+	finished.clear();
+	arrived.clear();
+	failures.clear();
+	resident.clear();
+	wanted.clear();
+	residentList.clear();
+	residentBytes = 0;
+}
+
+void WorldStreamer::SetLookahead( float seconds ) {
+	lookahead = seconds;
+}
+
+void WorldStreamer::SetUnloadRadius( float radius ) {
+	unloadRadius = std::max( radius, loadRadius );
+}
+
+void WorldStreamer::SetMaxAdoptions( unsigned int perUpdate ) {
+	maxAdoptions = std::max( perUpdate, 1u );
+}
+
+WorldStreamer::CellKey WorldStreamer::Key( int x, int z ) {
+	return ( ( CellKey ) ( unsigned int ) x << 32 ) | ( unsigned int ) z;
+}
+
+size_t WorldStreamer::ChunkBytes( const Chunk& chunk ) {
+	return sizeof( Chunk ) + chunk.objects.capacity() * sizeof( ChunkObject );
+}
+
+void WorldStreamer::StreamMain( void ) {
+	MemoryScope scope( MEMORY_STREAMING );
+
+	while ( true ) {
+		Request r;
+
+		{
+			std::unique_lock< std::mutex > guard( lock );
+
+			while ( !quit && pending.empty() ) {
+				wake.wait( guard );
+			}
+
+			if ( quit ) {
+				return;
+			}
+
+			r = pending.back();
+			pending.pop_back();
+
+			inFlight = Key( r.x, r.z );
+			busy = true;
+		}
+
+		Chunk* chunk = new Chunk;
+		chunk->x = r.x;
+		chunk->z = r.z;
+
+		bool ok = loader( r.x, r.z, *chunk );
+
+		std::lock_guard< std::mutex > guard( lock );
+		busy = false;
+
+		if ( ok ) {
+			finished.push_back( chunk );
+		} else {
+			failures.push_back( Key( r.x, r.z ) );
+			delete chunk;
+		}
+	}
+}
+
+void WorldStreamer::Adopt( void ) {
+	{
+		std::lock_guard< std::mutex > guard( lock );
+
+		arrived.insert( arrived.end(), finished.begin(), finished.end() );
+		finished.clear();
+
+		for ( size_t i = 0; i < failures.size(); ++i ) {
+			failed[ failures[ i ] ] = true;
+		}
+
+		failures.clear();
+	}
+
+	size_t taken = 0;
+	unsigned int adopted = 0;
+
+	for ( ; taken < arrived.size() && adopted < maxAdoptions; ++taken ) {
+		Chunk* chunk = arrived[ taken ];
+		CellKey key = Key( chunk->x, chunk->z );
+
+		// Wanted when requested, maybe not any more.
+		if ( wanted.find( key ) == wanted.end() || resident.find( key ) != resident.end() ) {
+			delete chunk;
+			continue;
+		}
+
+		++adopted;
+
+		Loaded loaded;
+		loaded.chunk = chunk;
+		loaded.bytes = ChunkBytes( *chunk );
+
+		resident[ key ] = loaded;
+		residentBytes += loaded.bytes;
+		averageBytes = ( averageBytes * 7 + loaded.bytes ) / 8;
+	}
+
+	arrived.erase( arrived.begin(), arrived.begin() + taken );
+}
+
+void WorldStreamer::Unload( CellKey key ) {
+	std::unordered_map< CellKey, Loaded >::iterator it = resident.find( key );
+
+	residentBytes -= it->second.bytes;
+	delete it->second.chunk;
+	resident.erase( it );
+}
+
+void WorldStreamer::Update( const Math::Point3& camera, float dt ) {
+	MemoryScope scope( MEMORY_STREAMING );
+
+	Adopt();
+
+	if ( hasCamera && dt > 0.0f ) {
+		Math::Vector3 v = ( camera - lastCamera ) / dt;
+		velocity = velocity * ( 1.0f - VELOCITY_SMOOTHING ) + v * VELOCITY_SMOOTHING;
+	}
+
+	lastCamera = camera;
+	hasCamera = true;
+
+	Math::Point3 predicted = camera + velocity * lookahead;
+
+	// Every cell within unloadRadius of either point, ranked by distance.
+	float inv = 1.0f / cellSize;
+	int x0 = ( int ) std::floor( ( std::min( camera.x, predicted.x ) - unloadRadius ) * inv );
+	int x1 = ( int ) std::floor( ( std::max( camera.x, predicted.x ) + unloadRadius ) * inv );
+	int z0 = ( int ) std::floor( ( std::min( camera.z, predicted.z ) - unloadRadius ) * inv );
+	int z1 = ( int ) std::floor( ( std::max( camera.z, predicted.z ) + unloadRadius ) * inv );
+
+	std::vector< Candidate > candidates;
+
+	for ( int z = z0; z <= z1; ++z ) {
+		for ( int x = x0; x <= x1; ++x ) {
+			float cx = ( x + 0.5f ) * cellSize;
+			float cz = ( z + 0.5f ) * cellSize;
+
+			float dCamera = std::sqrt( ( cx - camera.x ) * ( cx - camera.x ) + ( cz - camera.z ) * ( cz - camera.z ) );
+			float dPredicted = std::sqrt( ( cx - predicted.x ) * ( cx - predicted.x ) + ( cz - predicted.z ) * ( cz - predicted.z ) );
+
+			Candidate c;
+			c.x = x;
+			c.z = z;
+			c.priority = std::min( dCamera, dPredicted );
+			c.load = c.priority <= loadRadius;
+
+			if ( c.priority > unloadRadius ) {
+				continue;
+			}
+
+			// Resident cells rank half a cell closer, so cells near the
+			// budget cutoff do not swap places every frame.
+			if ( resident.find( Key( x, z ) ) != resident.end() ) {
+				c.priority -= cellSize * 0.5f;
+			}
+
+			candidates.push_back( c );
+		}
+	}
+
+	std::sort( candidates.begin(), candidates.end(), []( const Candidate& a, const Candidate& b ) {
+		return a.priority < b.priority;
+	} );
+
+	// Best first until the budget is spent, counting unloaded cells at the
+	// average chunk size.
+	std::unordered_map< CellKey, bool > keep;
+	std::vector< Request > requests;
+	size_t used = 0;
+
+	wanted.clear();
+
+	for ( size_t i = 0; i < candidates.size(); ++i ) {
+		const Candidate& c = candidates[ i ];
+		CellKey key = Key( c.x, c.z );
+
+		if ( failed.find( key ) != failed.end() ) {
+			continue;
+		}
+
+		std::unordered_map< CellKey, Loaded >::iterator it = resident.find( key );
+
+		if ( it != resident.end() ) {
+			if ( used + it->second.bytes > memoryBudget ) {
+				break;
+			}
+
+			used += it->second.bytes;
+			keep[ key ] = true;
+		} else if ( c.load ) {
+			if ( used + averageBytes > memoryBudget ) {
+				break;
+			}
+
+			used += averageBytes;
+			wanted[ key ] = true;
+
+			// Already loaded, waiting for its turn to be adopted.
+			bool waiting = false;
+			for ( size_t k = 0; k < arrived.size() && !waiting; ++k ) {
+				waiting = Key( arrived[ k ]->x, arrived[ k ]->z ) == key;
+			}
+
+			if ( waiting ) {
+				continue;
+			}
+
+			Request r;
+			r.x = c.x;
+			r.z = c.z;
+			r.priority = c.priority;
+			requests.push_back( r );
+		}
+	}
+
+	std::vector< CellKey > drop;
+	for ( std::unordered_map< CellKey, Loaded >::iterator it = resident.begin(); it != resident.end(); ++it ) {
+		if ( keep.find( it->first ) == keep.end() ) {
+			drop.push_back( it->first );
+		}
+	}
+
+	for ( size_t i = 0; i < drop.size(); ++i ) {
+		Unload( drop[ i ] );
+	}
+
+	{
+		std::lock_guard< std::mutex > guard( lock );
+
+		// Replaces whatever was queued; the streaming thread pops from the back.
+		pending.clear();
+		for ( size_t i = requests.size(); i-- > 0; ) {
+			if ( busy && Key( requests[ i ].x, requests[ i ].z ) == inFlight ) {
+				continue;
+			}
+
+			pending.push_back( requests[ i ] );
+		}
+	}
+
+	wake.notify_one();
+
+	residentList.clear();
+	for ( std::unordered_map< CellKey, Loaded >::iterator it = resident.begin(); it != resident.end(); ++it ) {
+		residentList.push_back( it->second.chunk );
+	}
+}
+
+const std::vector< Chunk* >& WorldStreamer::Resident( void ) const {
+	return residentList;
+}
+
+size_t WorldStreamer::ResidentBytes( void ) const {
+	return residentBytes;
+}
+
+size_t WorldStreamer::MemoryBudget( void ) const {
+	return memoryBudget;
+}
+
+unsigned int WorldStreamer::PendingCount( void ) const {
+	std::lock_guard< std::mutex > guard( lock );
+	return ( unsigned int ) pending.size() + ( busy ? 1 : 0 );
+}
+
+}
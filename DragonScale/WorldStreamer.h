@@ -0,0 +1,143 @@
+#ifndef WORLDSTREAMER_H
+#define WORLDSTREAMER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "BBox.h"
+#include "Matrix4.h"
+
+namespace DS {
+
+struct ChunkObject {
+	unsigned int mesh;
+	Math::Matrix4 model;		// Transposed for upload.
+	Math::BBox bounds;			// World space.
+	unsigned int lod;
+};
+
+struct Chunk {
+	int x;
+	int z;
+	std::vector< ChunkObject > objects;
+};
+
+/**
+	Fills chunk for cell ( x, z ), called on the streaming thread. Returning
+	false marks the cell as failed; it is not asked for again.
+**/
+typedef std::function< bool( int x, int z, Chunk& chunk ) > ChunkLoader;
+
+/**
+	DS::LoadChunkFile
+
+	Reads directory/cell_<x>_<z>.chunk. The file is "DSCK", a version and
+	an object count ( unsigned ints ), then per object the mesh index, a
+	column vector transform ( 16 floats, row by row ) and world bounds
+	( min and max, 6 floats ). A missing file is an empty cell. Files with
+	more objects than they hold or a mesh index of meshCount or more are
+	rejected.
+**/
+bool LoadChunkFile( const char* directory, int x, int z, unsigned int meshCount, Chunk& chunk );
+
+/**
+	DS::WorldStreamer - Camera driven chunk residency
+
+	The world is cut into square cells on the XZ plane. Every Update ranks
+	the cells within reach of the camera, and of where the camera will be
+	after the lookahead time at its current velocity, by distance. Walking
+	that list in order, cells are kept or requested until the memory budget
+	runs out; everything past that point and everything out of reach is
+	unloaded.
+
+	Loading happens on a streaming thread that always takes the best
+	ranked request next. Requests that fall out of the wanted set before
+	they start are dropped. Finished chunks are only adopted a few per
+	Update, so a burst of loads never lands in one frame.
+
+	Cells unload past unloadRadius rather than loadRadius, so a camera
+	moving back and forth over a cell border does not thrash.
+**/
+class WorldStreamer {
+public:
+	WorldStreamer( void );
+	~WorldStreamer( void );
+
+	void Init( const ChunkLoader& loader, float cellSize, float loadRadius, size_t memoryBudget );
+	void Shutdown( void );
+
+	void SetLookahead( float seconds );
+	void SetUnloadRadius( float radius );
+	void SetMaxAdoptions( unsigned int perUpdate );
+
+	void Update( const Math::Point3& camera, float dt );
+
+	// Valid until the next Update.
+	const std::vector< Chunk* >& Resident( void ) const;
+
+	size_t ResidentBytes( void ) const;
+	size_t MemoryBudget( void ) const;
+	unsigned int PendingCount( void ) const;
+
+private:
+	struct Request {
+		int x;
+		int z;
+		float priority;
+	};
+
+	struct Loaded {
+		Chunk* chunk;
+		size_t bytes;
+	};
+
+	typedef unsigned long long CellKey;
+
+	static CellKey Key( int x, int z );
+	static size_t ChunkBytes( const Chunk& chunk );
+
+	void StreamMain( void );
+	void Adopt( void );
+	void Unload( CellKey key );
+
+	ChunkLoader loader;
+	float cellSize;
+	float loadRadius;
+	float unloadRadius;
+	float lookahead;
+	size_t memoryBudget;
+	unsigned int maxAdoptions;
+
+	// Camera motion, for prefetching.
+	Math::Point3 lastCamera;
+	Math::Vector3 velocity;
+	bool hasCamera;
+
+	// Main thread only.
+	std::unordered_map< CellKey, Loaded > resident;
+	std::unordered_map< CellKey, bool > wanted;		// Requested, value is unused.
+	std::unordered_map< CellKey, bool > failed;
+	std::vector< Chunk* > residentList;
+	std::vector< Chunk* > arrived;			// Loaded, waiting to be adopted.
+	size_t residentBytes;
+	size_t averageBytes;
+
+	// Shared with the streaming thread.
+	std::thread thread;
+	mutable std::mutex lock;
+	std::condition_variable wake;
+	std::vector< Request > pending;		// Best last.
+	std::vector< Chunk* > finished;
+	std::vector< CellKey > failures;
+	CellKey inFlight;
+	bool busy;
+	bool quit;
+};
+
+}
+
+#endif
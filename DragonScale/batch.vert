@@ -0,0 +1,42 @@
+#version 330 core
+layout( location = 0 ) in vec3 vPos_model;
+layout( location = 1 ) in vec3 vColor;
+layout( location = 2 ) in uint vDrawID;
+layout( location = 3 ) in vec2 vNormal;		// Octahedral.
+layout( location = 4 ) in vec2 vTexCoord;
+uniform mat4 PROJ;
+uniform mat4 VIEW;
+uniform int DRAW_BASE;
+uniform samplerBuffer DRAW_DATA;
+
+out vec3 fColor;
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoord;
+
+vec3 DecodeOctahedral( vec2 e ) {
+	vec3 n = vec3( e, 1.0 - abs( e.x ) - abs( e.y ) );
+	float t = max( -n.z, 0.0 );
+	n.xy += vec2( n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t );
+	return normalize( n );
+}
+
+void main() {
+	int id = ( DRAW_BASE + int( vDrawID ) ) * 6;
+
+	mat4 model = mat4( texelFetch( DRAW_DATA, id ),
+					   texelFetch( DRAW_DATA, id + 1 ),
+					   texelFetch( DRAW_DATA, id + 2 ),
+					   texelFetch( DRAW_DATA, id + 3 ) );
+
+	// The mesh's position scale and bias undo the quantization.
+	vec3 position = vPos_model * texelFetch( DRAW_DATA, id + 4 ).xyz + texelFetch( DRAW_DATA, id + 5 ).xyz;
+
+	vec4 v = model * vec4( position, 1 );
+	gl_Position = PROJ * VIEW * v;
+
+	fColor = vColor;
+	fPosition = v.xyz;
+	fNormal = mat3( model ) * DecodeOctahedral( vNormal );
+	fTexCoord = vTexCoord;
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+#version 330 core
+
+// Shadow casters only write depth.
+void main() {
+}
\ No newline at end of file
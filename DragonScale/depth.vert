@@ -0,0 +1,10 @@
+#version 330 core
+layout( location = 0 ) in vec3 vPos_model;
+uniform mat4 CLIP;							// World to a shadow cascade, see ShadowCascades.
+uniform mat4 MODEL;
+uniform vec3 POSITION_SCALE = vec3( 1.0 );	// See simple.vert.
+uniform vec3 POSITION_BIAS = vec3( 0.0 );
+
+void main() {
+	gl_Position = CLIP * MODEL * vec4( vPos_model * POSITION_SCALE + POSITION_BIAS, 1 );
+}
\ No newline at end of file
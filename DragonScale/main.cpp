@@ -1,6 +1,10 @@
+#include <cassert>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <GL/glew.h>
 #include <SDL.h>
@@ -9,8 +13,56 @@
 #include "Utils.h"
 #include "Vector3.h"
 #include "Matrix4.h"
+#include "Mesh.h"
+#include "LOD.h"
+#include "DrawBatch.h"
+#include "OcclusionCuller.h"
+#include "TextureManager.h"
+#include "ParticleSystem.h"
+#include "JobSystem.h"
+#include "RayTracer.h"
+#include "Image.h"
+#include "WorldStreamer.h"
+#include "SweepAndPrune.h"
+#include "PhysicsWorld.h"
+#include "InputRecord.h"
+#include "FrameLog.h"
+#include "MemoryTracker.h"
+#include "StaticBatch.h"
+#include "Crowd.h"
+#include "Audio.h"
+#include "FrameCapture.h"
+#include "Terrain.h"
+#include "NavGrid.h"
+#include "Pathfinder.h"
+#include "VertexFormat.h"
+#include "RenderTarget.h"
+#include "GLState.h"
+#include "TaskScheduler.h"
+#include "LightClusters.h"
+#include "ShadowCascades.h"
+
+// Visual Studio before 2015 only has _snprintf, which returns -1 when the
+// output does not fit instead of its length.
+#if defined( _MSC_VER ) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
 
 static bool moving = false;
+static bool batching = true;
+static bool staticBatching = true;
+static int skinningMode = DS::SKIN_CPU_MATRIX;
+static bool capture = false;
+static bool screenshot = false;
+static bool drawTerrain = true;
+static bool toggleGate = false;
+static bool memoryReport = false;
+static bool depthPrepass = false;
+static bool paused = false;
+static bool exposed = false;
+static bool statsOverlay = false;
+static bool sunMoved = false;
+static float sunAzimuth = 40.0f;
 static float camera_pos[ 3 ] = { 0.0f, 0.0f, 25.0f };
 static float target_pos[ 3 ] = { 0.0f, 0.0f, 0.0f };
 static float up_pos[ 3 ]	 = { 0.0f, 1.0f, 0.0f };
@@ -20,57 +72,271 @@ static const int WINDOW_WIDTH = 800;
 
 static const char* TITLE = "DragonScale";
 
-GLuint vao[2];
-GLuint buffers[2];
+// On demand, how long an unchanged frame sleeps before background work is
+// checked again.
+static const Uint32 IDLE_WAIT_MS = 100;
+
+// How often the GL statistics in the title bar refresh.
+static const Uint32 STATS_INTERVAL_MS = 500;
+
+// Frame capture and screenshot file names, without the extension.
+static const size_t CAPTURE_PREFIX_SIZE = 512;
+
+// Camera projection. The far plane only bounds DEPTH_STANDARD, the other
+// modes push it to infinity.
+static const float CAMERA_FOV = 45.0f;
+static const float CAMERA_NEAR = 0.1f;
+static const float CAMERA_FAR = 100.0f;
+
+enum DepthMode {
+	DEPTH_STANDARD,				// [ -1, 1 ] up to CAMERA_FAR, GL_LESS.
+	DEPTH_INFINITE,				// Same, with no far plane.
+	DEPTH_REVERSED				// 1 at the near plane to 0 at infinity, float depth, GL_GREATER.
+};
+
+// Meshes built in, indexed by every draw and by streamed chunk objects.
+static const unsigned int MESH_COUNT = 2;
+
+GLuint vao[ MESH_COUNT ];
+GLuint buffers[ MESH_COUNT ][ 2 ];
+
+const int G_VERTEX = 0;
+const int G_INDEX = 1;
+
+// Mesh vertices on the GPU: positions quantized to the mesh bounds, byte
+// colors, octahedral normals and half float texture coordinates, 20 bytes
+// instead of 44 as floats.
+static const DS::VertexFormat MESH_FORMAT( DS::POSITION_UNORM16, DS::COLOR_UNORM8, DS::NORMAL_OCTAHEDRAL, DS::TEXCOORD_HALF );
+
+// LOD selection, in pixels of projected geometric error.
+static const float LOD_THRESHOLD = 1.0f;
+static const float LOD_HYSTERESIS = 0.25f;
+
+// Software occlusion depth buffer resolution.
+static const int OCCLUSION_WIDTH = 256;
+static const int OCCLUSION_HEIGHT = 128;
+
+// Occlusion tiles per job, of the 64 a 256x128 buffer has.
+static const int OCCLUSION_TILE_GRAIN = 4;
+
+// Texture residency limits.
+static const size_t TEXTURE_MEMORY_BUDGET = 256 * 1024 * 1024;
+static const size_t TEXTURE_UPLOAD_BUDGET = 4 * 1024 * 1024;	// Per frame.
+
+// Texture files stream in on units 0..n, the first is the built in meshes'
+// diffuse texture.
+static const unsigned int DIFFUSE_UNIT = 0;
+
+// Particle pool size, shared by every emitter.
+static const unsigned int MAX_PARTICLES = 128 * 1024;
+
+// World streaming, cells on the XZ plane around the camera.
+static const float WORLD_CELL_SIZE = 16.0f;
+static const float WORLD_LOAD_RADIUS = 64.0f;
+static const float WORLD_LOOKAHEAD = 1.0f;					// Seconds of camera motion to prefetch.
+static const size_t WORLD_MEMORY_BUDGET = 8 * 1024 * 1024;
+
+// Benchmark scenes run at a fixed frame time unless replaying a recording.
+static const float BENCHMARK_DT = 1.0f / 60.0f;
+static const int STRESS_BODIES = 2048;
+static const int STRESS_DRAWS = 100;			// Per side of the grid.
+static const int STRESS_EMITTERS = 8;
+static const int STRESS_CHARACTERS = 32;		// Per side of the grid.
+static const int STRESS_VOICES = 256;
+
+// Static geometry clusters.
+static const unsigned int STATIC_CLUSTER_VERTICES = 16 * 1024;
+static const float STATIC_CLUSTER_EXTENT = 32.0f;
+
+// Animated worms, a joint chain inside a square tube.
+static const int WORM_JOINTS = 8;
+static const float WORM_SEGMENT = 0.5f;
+static const float WORM_RADIUS = 0.2f;
+static const int WORM_CLIP_FRAMES = 60;
+static const float WORM_FRAME_RATE = 30.0f;
+static const int CROWD_SIZE = 4;				// Per side of the grid.
+
+// Audio output, mixed on SDL's audio thread.
+static const int AUDIO_FREQUENCY = 44100;
+static const int AUDIO_BUFFER_FRAMES = 1024;
+
+// Frames the GPU may run ahead of a readback before captures are dropped.
+static const unsigned int CAPTURE_SLOTS = 3;
+
+// Heightfield below the scene, generated unless tiles are given on disk.
+static const float TERRAIN_BASE = -60.0f;
+static const float TERRAIN_AMPLITUDE = 40.0f;
+static const float TERRAIN_LOD_DISTANCE = 24.0f;
+
+// Navigation grid at the characters' feet, split by a wall with a gate.
+static const int NAV_CELLS = 256;				// Per side.
+static const float NAV_CELL_SIZE = 0.5f;
+static const float NAV_HEIGHT = 1.0f;			// Static objects this low block cells.
+static const int NAV_CLUSTER = 16;				// Cells per cluster side.
+static const unsigned int NAV_CACHE = 4096;		// Cached paths.
+static const float NAV_WALL_X = 7.0f;
+static const float NAV_WALL_LENGTH = 40.0f;
+static const float NAV_GATE_WIDTH = 4.0f;
+static const float AGENT_SPEED = 2.0f;
+static const float AGENT_RANGE = 30.0f;			// Goals are picked within this of the origin.
+static const float AGENT_REST_MIN = 1.0f;		// Seconds spent at a goal.
+static const float AGENT_REST_MAX = 4.0f;
+
+// Point lights circling the scene, assigned to screen tiles by exponential
+// depth slices up to CAMERA_FAR; anything farther shares the last slice.
+static const int LIGHT_COUNT = 256;
+static const float LIGHT_RADIUS = 6.0f;
+static const float LIGHT_ORBIT = 40.0f;			// Lights stay within this of the origin.
+static const int LIGHT_TILES_X = 16;
+static const int LIGHT_TILES_Y = 8;
+static const int LIGHT_SLICES = 24;
+
+// Sun shadows, L turns the sun. Cascades from SHADOW_FIRST_CACHED on only
+// redraw their static casters once the camera or the sun moved enough.
+static const float SUN_ELEVATION = 55.0f;		// Degrees.
+static const float SUN_STEP = 5.0f;
+static const int SHADOW_CASCADES = 4;
+static const int SHADOW_RESOLUTION = 1024;
+static const float SHADOW_DISTANCE = 80.0f;
+static const int SHADOW_FIRST_CACHED = 2;
+
+struct SceneObject {
+	int mesh;
+	Math::Matrix4 model;		// Transposed for upload.
+	Math::BBox bounds;			// World space.
+	unsigned int lod;
+	bool occluder;
+	int body;					// Physics body driving the model, or -1.
+	bool isStatic;				// Never moves, drawn from the static batch.
+};
+
+// A visible object outside the DrawBatch, queued so every pass draws the
+// same LOD.
+struct ObjectDraw {
+	unsigned int mesh;
+	unsigned int lod;
+	Math::Matrix4 model;
+};
+
+// Drives the crowd character of the same index.
+struct Agent {
+	DS::Path path;
+	size_t next;				// Waypoint walked to.
+	Math::Point3 goal;
+	unsigned int seed;
+	bool resting;				// At the goal, a task sends it on.
+};
+
+/*
+	Applies one key event. Live and replayed input both come through here
+	so a replay moves the camera exactly as the recorded session did.
+*/
+void HandleKey( const DS::InputEvent& event ) {
+	if ( !event.down ) {
+		moving = false;
+		return;
+	}
 
-const int G_POSITION = 0;
-const int G_COLOR = 1;
+	if ( event.key == SDLK_a ) {
+		camera_pos[ 0 ] -= 1.0f;
+		moving = true;
+	}
+	if ( event.key == SDLK_d ) {
+		camera_pos[ 0 ] += 1.0f;
+		moving = true;
+	}
+	if ( event.key == SDLK_r ) {
+		camera_pos[ 1 ] += 1.0f;
+		moving = true;
+	}
+	if ( event.key == SDLK_f ) {
+		camera_pos[ 1 ] -= 1.0f;
+		moving = true;
+	}
+	if ( event.key == SDLK_w ) {
+		camera_pos[ 2 ] -= 1.0f;
+		moving = true;
+	}
+	if ( event.key == SDLK_s ) {
+		camera_pos[ 2 ] += 1.0f;
+		moving = true;
+	}
+	if ( event.key == SDLK_t ) {
+		target_pos[ 1 ] += 1.0f;
+		moving = true;
+	}
+	if ( event.key == SDLK_g ) {
+		target_pos[ 1 ] -= 1.0f;
+		moving = true;
+	}
+	if ( event.key == SDLK_b ) {
+		batching = !batching;
+	}
+	if ( event.key == SDLK_n ) {
+		staticBatching = !staticBatching;
+	}
+	if ( event.key == SDLK_k ) {
+		skinningMode = ( skinningMode + 1 ) % DS::SKIN_MODE_COUNT;
+	}
+	if ( event.key == SDLK_p ) {
+		capture = true;
+	}
+	if ( event.key == SDLK_o ) {
+		screenshot = true;
+	}
+	if ( event.key == SDLK_h ) {
+		drawTerrain = !drawTerrain;
+	}
+	if ( event.key == SDLK_j ) {
+		toggleGate = true;
+	}
+	if ( event.key == SDLK_m ) {
+		memoryReport = true;
+	}
+	if ( event.key == SDLK_z ) {
+		depthPrepass = !depthPrepass;
+	}
+	if ( event.key == SDLK_SPACE ) {
+		paused = !paused;
+	}
+	if ( event.key == SDLK_i ) {
+		statsOverlay = !statsOverlay;
+	}
+	if ( event.key == SDLK_l ) {
+		sunAzimuth += SUN_STEP;
+		sunMoved = true;
+	}
+}
 
-int PollKeys( void ) {
+/*
+	Collects this frame's key events. Returns SDL_QUIT on escape or when the
+	window is closed. Sets exposed when the window needs presenting again.
+*/
+int PollKeys( std::vector< DS::InputEvent >& events ) {
 	int status = 0;
 	SDL_Event event;
 
 	while ( SDL_PollEvent( &event ) ) {
+		DS::InputEvent input;
+
 		switch( event.type ) {
 			case SDL_KEYDOWN:	
-				if ( event.key.keysym.sym == SDLK_a ) {
-					camera_pos[ 0 ] -= 1.0f;
-					moving = true;
-				}
-				if ( event.key.keysym.sym == SDLK_d ) {
-					camera_pos[ 0 ] += 1.0f;
-					moving = true;
-				}
-				if ( event.key.keysym.sym == SDLK_r ) {
-					camera_pos[ 1 ] += 1.0f;
-					moving = true;
-				}
-				if ( event.key.keysym.sym == SDLK_f ) {
-					camera_pos[ 1 ] -= 1.0f;
-					moving = true;
-				}
-				if ( event.key.keysym.sym == SDLK_w ) {
-					camera_pos[ 2 ] -= 1.0f;
-					moving = true;
-				}
-				if ( event.key.keysym.sym == SDLK_s ) {
-					camera_pos[ 2 ] += 1.0f;
-					moving = true;
-				}
-				if ( event.key.keysym.sym == SDLK_t ) {
-					target_pos[ 1 ] += 1.0f;
-					moving = true;
-				}
-				if ( event.key.keysym.sym == SDLK_g ) {
-					target_pos[ 1 ] -= 1.0f;
-					moving = true;
-				}
+				input.key = event.key.keysym.sym;
+				input.down = true;
+				events.push_back( input );
 				break;
 			case SDL_KEYUP:
 				if ( event.key.keysym.sym == SDLK_ESCAPE ) {
 					status = SDL_EventType::SDL_QUIT;
 				} else {
-					moving = false;
+					input.key = event.key.keysym.sym;
+					input.down = false;
+					events.push_back( input );
+				}
+				break;
+			case SDL_WINDOWEVENT:
+				if ( event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_RESTORED ) {
+					exposed = true;
 				}
 				break;
 			case SDL_QUIT:
@@ -83,42 +349,400 @@ int PollKeys( void ) {
 }
 
 /*
-	Assumes vertex and color data are the same size.
+	Uploads an indexed mesh, including every LOD level's indices.
 */
-void InitObject( const GLuint vao, 
-				const GLuint vID, const GLvoid* vData,
-				const GLuint cID, const GLvoid* cData,
-				const GLuint size ) {
-	GLuint buffers[ 2 ];
-
-	// Load Triangle Data
-	glBindVertexArray( vao );
+void InitObject( const GLuint vao, GLuint* buffers,
+				const GLint vID, const GLint cID, const GLint nID, const GLint tID,
+				const DS::PackedVertices& vertices, const DS::Mesh& mesh ) {
+	// Load Mesh Data
+	DS::GL::BindVertexArray( vao );
 
 	glGenBuffers( 2, buffers );
 
-	// Vertex Position
-	glEnableVertexAttribArray( vID );
-	glBindBuffer( GL_ARRAY_BUFFER, buffers[ G_POSITION ] );
-	glBufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * 3 * size, vData, GL_STATIC_DRAW );	
-	glVertexAttribPointer( vID, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+	// Interleaved, already converted to the mesh format.
+	DS::GL::BindBuffer( GL_ARRAY_BUFFER, buffers[ G_VERTEX ] );
+	DS::GL::BufferData( GL_ARRAY_BUFFER, vertices.data.size(), &vertices.data[ 0 ], GL_STATIC_DRAW );
+	DS::SetVertexAttributes( vertices.format, vID, cID, nID, tID );
+
+	// Indices, all LOD levels back to back.
+	DS::GL::BindBuffer( GL_ELEMENT_ARRAY_BUFFER, buffers[ G_INDEX ] );
+	DS::GL::BufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( GLuint ) * mesh.indices.size(), &mesh.indices[ 0 ], GL_STATIC_DRAW );
+
+	DS::GL::BindVertexArray( 0 );
+
+	DS::Memory::TrackGL( DS::MEMORY_GL_BUFFER, DS::MEMORY_MESH, buffers[ G_VERTEX ], vertices.data.size() );
+	DS::Memory::TrackGL( DS::MEMORY_GL_BUFFER, DS::MEMORY_MESH, buffers[ G_INDEX ], sizeof( GLuint ) * mesh.indices.size() );
+}
+
+/*
+	Projects each triangle onto the axis plane its normal is closest to,
+	[ -1, 1 ] onto [ 0, 1 ], which is enough for the built in meshes.
+*/
+void PlanarTexCoords( const float* positions, unsigned int vertexCount, float* texCoords ) {
+	for ( unsigned int i = 0; i < vertexCount; ++i ) {
+		const float* t = &positions[ ( i - i % 3 ) * 3 ];
+
+		Math::Vector3 e1( t[ 3 ] - t[ 0 ], t[ 4 ] - t[ 1 ], t[ 5 ] - t[ 2 ] );
+		Math::Vector3 e2( t[ 6 ] - t[ 0 ], t[ 7 ] - t[ 1 ], t[ 8 ] - t[ 2 ] );
+		Math::Vector3 n = Math::Cross( e1, e2 );
+
+		int axis = fabsf( n.x ) > fabsf( n.y ) ? ( fabsf( n.x ) > fabsf( n.z ) ? 0 : 2 ) : ( fabsf( n.y ) > fabsf( n.z ) ? 1 : 2 );
+		int u = axis == 0 ? 2 : 0;
+		int v = axis == 1 ? 2 : 1;
+
+		texCoords[ i * 2 ] = positions[ i * 3 + u ] * 0.5f + 0.5f;
+		texCoords[ i * 2 + 1 ] = positions[ i * 3 + v ] * 0.5f + 0.5f;
+	}
+}
+
+void ShutdownObject( const GLuint vao, GLuint* buffers ) {
+	for ( int i = 0; i < 2; ++i ) {
+		DS::Memory::ReleaseGL( DS::MEMORY_GL_BUFFER, buffers[ i ] );
+	}
+
+	DS::GL::DeleteBuffers( 2, buffers );
+	DS::GL::DeleteVertexArrays( 1, &vao );
+}
+
+void Render( const GLuint vao, const DS::LODLevel& level ) {
+	DS::GL::BindVertexArray( vao );
+	DS::GL::DrawElements( GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, 
+					( const GLvoid* ) ( sizeof( GLuint ) * level.indexOffset ) );
+	DS::GL::BindVertexArray( 0 );
+}
+
+SceneObject MakeObject( int mesh, const DS::Mesh& data, const Math::Matrix4& transform ) {
+	SceneObject obj;
+
+	obj.mesh = mesh;
+	obj.model = Math::Matrix4( transform.c ).GetTranspose();
+	obj.bounds = Math::TransformBounds( transform, data.bounds );
+	obj.lod = 0;
+	obj.occluder = false;
+	obj.body = -1;
+	obj.isStatic = true;
+
+	return obj;
+}
+
+/*
+	Square tube along +Y around a chain of joints, each ring of vertices
+	skinned to the two joints it sits between.
+*/
+void BuildWorm( DS::Skeleton& skeleton, DS::SkinnedMesh& mesh ) {
+	for ( int i = 0; i < WORM_JOINTS; ++i ) {
+		DS::JointPose joint;
+		joint.translation = Math::Vector3( 0.0f, i == 0 ? 0.0f : WORM_SEGMENT, 0.0f );
+
+		skeleton.parents.push_back( i - 1 );
+		skeleton.bindPose.push_back( joint );
+	}
+
+	skeleton.Finalize();
+
+	const float corners[ 4 ][ 2 ] = {
+		{ -WORM_RADIUS, -WORM_RADIUS },
+		{  WORM_RADIUS, -WORM_RADIUS },
+		{  WORM_RADIUS,  WORM_RADIUS },
+		{ -WORM_RADIUS,  WORM_RADIUS }
+	};
+
+	int rings = WORM_JOINTS * 4 + 1;
+	float height = WORM_SEGMENT * WORM_JOINTS;
+
+	for ( int ring = 0; ring < rings; ++ring ) {
+		float y = height * ring / ( rings - 1 );
+		float s = y / WORM_SEGMENT;
+
+		int j0 = std::min( ( int ) s, WORM_JOINTS - 1 );
+		int j1 = std::min( j0 + 1, WORM_JOINTS - 1 );
+		float t = j0 == j1 ? 0.0f : s - j0;
+
+		for ( int c = 0; c < 4; ++c ) {
+			mesh.positions.push_back( corners[ c ][ 0 ] );
+			mesh.positions.push_back( y );
+			mesh.positions.push_back( corners[ c ][ 1 ] );
+
+			mesh.colors.push_back( 0.2f + 0.8f * y / height );
+			mesh.colors.push_back( 0.8f - 0.6f * y / height );
+			mesh.colors.push_back( c % 2 ? 0.3f : 0.5f );
+
+			unsigned char joints[ 4 ] = { ( unsigned char ) j0, ( unsigned char ) j1, 0, 0 };
+			float weights[ 4 ] = { 1.0f - t, t, 0.0f, 0.0f };
+
+			mesh.joints.insert( mesh.joints.end(), joints, joints + 4 );
+			mesh.weights.insert( mesh.weights.end(), weights, weights + 4 );
+		}
+	}
+
+	for ( int ring = 0; ring + 1 < rings; ++ring ) {
+		for ( int c = 0; c < 4; ++c ) {
+			unsigned int a = ring * 4 + c;
+			unsigned int b = ring * 4 + ( c + 1 ) % 4;
+			unsigned int quad[ 6 ] = { a, a + 4, b + 4, a, b + 4, b };
+
+			mesh.indices.insert( mesh.indices.end(), quad, quad + 6 );
+		}
+	}
+
+	unsigned int top = ( rings - 1 ) * 4;
+	unsigned int caps[ 12 ] = { 0, 1, 2, 0, 2, 3, top, top + 2, top + 1, top, top + 3, top + 2 };
+	mesh.indices.insert( mesh.indices.end(), caps, caps + 12 );
+
+	mesh.bounds = DS::ComputeBounds( &mesh.positions[ 0 ], mesh.VertexCount() );
+}
+
+/*
+	Two looping clips for the worm: a side to side wave and a twist.
+*/
+void BuildWormClips( const DS::Skeleton& skeleton, DS::AnimationClip& sway, DS::AnimationClip& twist ) {
+	std::vector< DS::Pose > swayFrames;
+	std::vector< DS::Pose > twistFrames;
+
+	Math::Vector3 axisX( 1.0f, 0.0f, 0.0f );
+	Math::Vector3 axisY( 0.0f, 1.0f, 0.0f );
+	Math::Vector3 axisZ( 0.0f, 0.0f, 1.0f );
+
+	for ( int f = 0; f <= WORM_CLIP_FRAMES; ++f ) {
+		float phase = 2.0f * Math::PI * f / WORM_CLIP_FRAMES;
+
+		DS::Pose a = skeleton.bindPose;
+		DS::Pose b = skeleton.bindPose;
+
+		for ( int j = 1; j < WORM_JOINTS; ++j ) {
+			a[ j ].rotation = Math::AxisAngle( axisZ, 15.0f * sinf( phase + j * 0.6f ) );
+			b[ j ].rotation = Math::AxisAngle( axisY, 20.0f * sinf( phase ) ) * Math::AxisAngle( axisX, 10.0f * cosf( phase + j * 0.4f ) );
+		}
+
+		swayFrames.push_back( a );
+		twistFrames.push_back( b );
+	}
+
+	sway.Build( swayFrames, WORM_FRAME_RATE, 0.5f, 0.001f );
+	twist.Build( twistFrames, WORM_FRAME_RATE, 0.5f, 0.001f );
+}
+
+/*
+	Ray traces the scene from the current camera into reference.ppm.
+*/
+void TraceReference( const SceneObject* objects, int objectCount,
+					 const DS::Mesh* meshes, const DS::LODChain* lods,
+					 DS::JobSystem& jobs ) {
+	DS::RayTracer tracer;
+
+	for ( int i = 0; i < objectCount; ++i ) {
+		const SceneObject& obj = objects[ i ];
+		tracer.AddMesh( meshes[ obj.mesh ], lods[ obj.mesh ].levels[ 0 ], Math::Matrix4( obj.model.c ).GetTranspose() );
+	}
+
+	tracer.Build();
+
+	std::vector< unsigned char > image;
+	tracer.Render( Math::Vector3( camera_pos[ 0 ], camera_pos[ 1 ], camera_pos[ 2 ] ),
+				   Math::Vector3( target_pos[ 0 ], target_pos[ 1 ], target_pos[ 2 ] ),
+				   Math::Vector3( up_pos[ 0 ], up_pos[ 1 ], up_pos[ 2 ] ),
+				   45.0f, WINDOW_WIDTH, WINDOW_HEIGHT, jobs, image );
+
+	if ( DS::WritePPM( "reference.ppm", WINDOW_WIDTH, WINDOW_HEIGHT, &image[ 0 ] ) ) {
+		std::cout << "Wrote reference.ppm" << std::endl;
+	}
+}
+
+/*
+	Walks every character along its path. Those that arrived rest for a
+	while, then pick a new goal, as do those that could not reach theirs;
+	those whose path crosses a changed obstacle plan again to the same goal.
+	Everything is planned in one batch, a whole crowd asking in the same
+	frame is the normal case.
+*/
+void UpdateAgents( std::vector< Agent >& agents, DS::Crowd& crowd, DS::Pathfinder& pathfinder,
+				   const DS::NavGrid& grid, DS::JobSystem& jobs, DS::TaskScheduler& scheduler, float dt ) {
+	std::vector< DS::PathRequest > requests;
+	std::vector< unsigned int > planning;
+
+	for ( size_t i = 0; i < agents.size(); ++i ) {
+		Agent& agent = agents[ i ];
+
+		if ( agent.next < agent.path.waypoints.size() && pathfinder.Valid( agent.path ) ) {
+			continue;
+		}
+
+		// Resting costs nothing per frame, the task sleeps until it is over.
+		if ( agent.path.found && agent.next >= agent.path.waypoints.size() ) {
+			if ( !agent.resting ) {
+				agent.seed = agent.seed * 1664525u + 1013904223u;
+				float rest = AGENT_REST_MIN + ( ( agent.seed >> 8 ) % 1024 / 1023.0f ) * ( AGENT_REST_MAX - AGENT_REST_MIN );
+				Agent* resting = &agent;
+
+				agent.resting = true;
+				scheduler.Spawn( [ resting, rest ]( DS::TaskState& state ) -> DS::TaskWait {
+					if ( state.resume == 0 ) {
+						state.resume = 1;
+						return DS::TaskSleep( rest );
+					}
+
+					resting->resting = false;
+					resting->path.found = false;
+					return DS::TaskDone();
+				} );
+			}
+
+			continue;
+		}
+
+		if ( !agent.path.found ) {
+			int x, z;
+
+			do {
+				agent.seed = agent.seed * 1664525u + 1013904223u;
+				float gx = ( ( agent.seed >> 8 ) % 1024 / 512.0f - 1.0f ) * AGENT_RANGE;
+				agent.seed = agent.seed * 1664525u + 1013904223u;
+				float gz = ( ( agent.seed >> 8 ) % 1024 / 512.0f - 1.0f ) * AGENT_RANGE;
+
+				agent.goal = Math::Point3( gx, crowd.Character( ( unsigned int ) i ).position.y, gz );
+			} while ( !grid.CellAt( agent.goal, x, z ) || !grid.Walkable( x, z ) );
+		}
+
+		DS::PathRequest request;
+		request.start = crowd.Character( ( unsigned int ) i ).position;
+		request.goal = agent.goal;
+
+		requests.push_back( request );
+		planning.push_back( ( unsigned int ) i );
+	}
+
+	if ( !requests.empty() ) {
+		std::vector< DS::Path > paths( requests.size() );
+		pathfinder.FindPaths( &requests[ 0 ], ( unsigned int ) requests.size(), &paths[ 0 ], jobs );
+
+		for ( size_t i = 0; i < planning.size(); ++i ) {
+			Agent& agent = agents[ planning[ i ] ];
+			agent.path.waypoints.swap( paths[ i ].waypoints );
+			agent.path.clusters.swap( paths[ i ].clusters );
+			agent.path.found = paths[ i ].found;
+			agent.path.cost = paths[ i ].cost;
+
+			// The first waypoint is the center of the cell we stand in.
+			agent.next = 1;
+		}
+	}
+
+	float step = AGENT_SPEED * dt;
 
-	// Color Data
-	glEnableVertexAttribArray( cID );
-	glBindBuffer( GL_ARRAY_BUFFER, buffers[ G_COLOR ] );
-	glBufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * 3 * size, cData, GL_STATIC_DRAW );
-	glVertexAttribPointer( cID, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+	for ( size_t i = 0; i < agents.size(); ++i ) {
+		Agent& agent = agents[ i ];
+		DS::CharacterDesc& character = crowd.Character( ( unsigned int ) i );
 
-	glBindVertexArray( 0 );
+		if ( agent.next >= agent.path.waypoints.size() ) {
+			continue;
+		}
+
+		Math::Point3 target = agent.path.waypoints[ agent.next ];
+		target.y = character.position.y;
+
+		Math::Vector3 d = target - character.position;
+		float distance = d.Length();
+
+		if ( distance <= step ) {
+			character.position = target;
+			++agent.next;
+		} else {
+			character.position += d * ( step / distance );
+			character.heading = atan2f( d.x, d.z ) * 180.0f / Math::PI;
+		}
+	}
+}
+
+/*
+	Spreads the lights over a disc by the golden angle, on a few heights,
+	each circling the origin at its own speed and direction.
+*/
+void AnimateLights( std::vector< DS::PointLight >& lights, float time ) {
+	for ( size_t i = 0; i < lights.size(); ++i ) {
+		float t = ( i + 0.5f ) / lights.size();
+		float orbit = LIGHT_ORBIT * sqrtf( t );
+		float speed = ( 0.1f + ( i % 7 ) * 0.03f ) * ( i % 2 ? 1.0f : -1.0f );
+		float angle = i * 2.39996f + time * speed;
+
+		lights[ i ].position = Math::Point3( orbit * cosf( angle ), -8.0f + ( i % 5 ) * 3.0f, orbit * sinf( angle ) );
+	}
 }
 
-void Render( const GLuint vao, const GLuint size ) {
-	glBindVertexArray( vao );
-	glDrawArrays( GL_TRIANGLES, 0, size );
-	glBindVertexArray( 0 );
+float Milliseconds( Uint64 from, Uint64 to ) {
+	return ( float ) ( ( double ) ( to - from ) * 1000.0 / SDL_GetPerformanceFrequency() );
 }
 
 int main( int argc, char* argv[] ) {
 
+	// --scene objects|draws|particles|crowd|audio, --record file,
+	// --replay file, --timing file.csv|.json, --frames n, --memory file,
+	// --music file.wav, --capture directory, --terrain directory,
+	// --depth standard|infinite|reversed, --prepass, --on-demand,
+	// --no-elide. Anything else is a texture.
+	std::string scene;
+	const char* recordFile = NULL;
+	const char* replayFile = NULL;
+	const char* timingFile = NULL;
+	const char* memoryFile = NULL;
+	const char* musicFile = NULL;
+	const char* captureDir = NULL;
+	const char* terrainDir = NULL;
+	int frameLimit = 0;
+	DepthMode depthMode = DEPTH_REVERSED;
+	bool onDemand = false;
+	std::vector< const char* > textureFiles;
+
+	for ( int i = 1; i < argc; ++i ) {
+		bool hasValue = i + 1 < argc;
+
+		if ( strcmp( argv[ i ], "--scene" ) == 0 && hasValue ) {
+			scene = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--record" ) == 0 && hasValue ) {
+			recordFile = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--replay" ) == 0 && hasValue ) {
+			replayFile = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--timing" ) == 0 && hasValue ) {
+			timingFile = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--memory" ) == 0 && hasValue ) {
+			memoryFile = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--music" ) == 0 && hasValue ) {
+			musicFile = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--capture" ) == 0 && hasValue ) {
+			captureDir = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--terrain" ) == 0 && hasValue ) {
+			terrainDir = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--frames" ) == 0 && hasValue ) {
+			frameLimit = atoi( argv[ ++i ] );
+		} else if ( strcmp( argv[ i ], "--depth" ) == 0 && hasValue ) {
+			const char* mode = argv[ ++i ];
+			depthMode = strcmp( mode, "standard" ) == 0 ? DEPTH_STANDARD : ( strcmp( mode, "infinite" ) == 0 ? DEPTH_INFINITE : DEPTH_REVERSED );
+		} else if ( strcmp( argv[ i ], "--prepass" ) == 0 ) {
+			depthPrepass = true;
+		} else if ( strcmp( argv[ i ], "--on-demand" ) == 0 ) {
+			onDemand = true;
+		} else if ( strcmp( argv[ i ], "--no-elide" ) == 0 ) {
+			DS::GL::SetElision( false );
+		} else {
+			textureFiles.push_back( argv[ i ] );
+		}
+	}
+
+	// Room for the frame number's ten digits after the directory.
+	if ( captureDir && strlen( captureDir ) + sizeof( "/frame_0000000000" ) > CAPTURE_PREFIX_SIZE ) {
+		fprintf( stderr, "Capture directory too long: %s\n", captureDir );
+		captureDir = NULL;
+	}
+
+	DS::InputPlayer player;
+	if ( replayFile && player.Open( replayFile ) && scene.empty() ) {
+		scene = player.Scene();
+	}
+
+	DS::InputRecorder recorder;
+	if ( recordFile ) {
+		recorder.Open( recordFile, scene );
+	}
+
 	// Initialize video subsystem.
 	if ( SDL_Init( SDL_INIT_VIDEO ) < 0 ) {
 		DS::SDLDie( "Unable to initialize SDL." );
@@ -158,6 +782,21 @@ int main( int argc, char* argv[] ) {
 	std::cout << "GL Version: " << glGetString( GL_VERSION ) << std::endl;
 	std::cout << "GLSL Version: " << glGetString( GL_SHADING_LANGUAGE_VERSION ) << std::endl;
 
+	// Reverse-Z wants depth in [ 0, 1 ], otherwise the float precision is
+	// spent around 0.5, and a float depth buffer the window does not offer.
+	DS::RenderTarget renderTarget;
+	bool offscreen = false;
+
+	if ( depthMode == DEPTH_REVERSED ) {
+		if ( !( GLEW_VERSION_4_5 || GLEW_ARB_clip_control ) ) {
+			std::cout << "Depth: no glClipControl, using an infinite far plane" << std::endl;
+			depthMode = DEPTH_INFINITE;
+		} else if ( !( offscreen = renderTarget.Init( WINDOW_WIDTH, WINDOW_HEIGHT, true ) ) ) {
+			std::cout << "Depth: no float depth target, using an infinite far plane" << std::endl;
+			depthMode = DEPTH_INFINITE;
+		}
+	}
+
 
 	// Triangle Data
 	static const GLfloat triangleBufferData[] = {
@@ -254,88 +893,1126 @@ int main( int argc, char* argv[] ) {
 
 	// GLSL Shaders
 	GLuint programID = DS::LoadShaders( "simple.vert", "simple.frag" );
-	glUseProgram( programID );
+	DS::GL::UseProgram( programID );
 
 	GLuint vertexID = glGetAttribLocation( programID, "vPos_model" );
 	GLuint colorID = glGetAttribLocation( programID, "vColor" );
+	GLint normalID = glGetAttribLocation( programID, "vNormal" );
+	GLint texCoordID = glGetAttribLocation( programID, "vTexCoord" );
+
+	// Read by every vertex array without normals, see simple.vert.
+	if ( normalID >= 0 ) {
+		glVertexAttrib2f( normalID, 2.0f, 2.0f );
+	}
+
+	// Import, building LOD chains up front.
+	DS::Mesh meshes[ MESH_COUNT ];
+	DS::LODChain lods[ MESH_COUNT ];
+
+	{
+		DS::MemoryScope scope( DS::MEMORY_MESH );
+
+		float cubeTexCoords[ 36 * 2 ];
+		float triangleTexCoords[ 3 * 2 ];
 
-	glGenVertexArrays( 2, &vao[ 0 ] );
+		PlanarTexCoords( &cubeBufferData[ 0 ], 36, cubeTexCoords );
+		PlanarTexCoords( &triangleBufferData[ 0 ], 3, triangleTexCoords );
+
+		meshes[ 0 ] = DS::ImportTriangles( &cubeBufferData[ 0 ], &cubeColorData[ 0 ], 36, cubeTexCoords );
+		meshes[ 1 ] = DS::ImportTriangles( &triangleBufferData[ 0 ], &triangleColorData[ 0 ], 3, triangleTexCoords );
+
+		for ( unsigned int i = 0; i < MESH_COUNT; ++i ) {
+			lods[ i ] = DS::GenerateLODs( meshes[ i ], 4, 0.5f );
+		}
+	}
+
+	// Converted once here, the float data stays for LODs, physics and tracing.
+	DS::PackedVertices packed[ MESH_COUNT ];
+
+	for ( unsigned int i = 0; i < MESH_COUNT; ++i ) {
+		packed[ i ] = DS::PackVertices( meshes[ i ], MESH_FORMAT );
+	}
+
+	std::cout << "Mesh vertices: " << packed[ 0 ].data.size() + packed[ 1 ].data.size() << " bytes, "
+			  << ( meshes[ 0 ].VertexCount() + meshes[ 1 ].VertexCount() ) * 11 * sizeof( float ) << " as floats" << std::endl;
+
+	glGenVertexArrays( MESH_COUNT, &vao[ 0 ] );
 
 	// Cube
-	InitObject( vao[ 0 ], 
-				vertexID, &cubeBufferData[ 0 ], 
-				colorID, &cubeColorData[ 0 ], 
-				36 );
+	InitObject( vao[ 0 ], buffers[ 0 ], vertexID, colorID, normalID, texCoordID, packed[ 0 ], meshes[ 0 ] );
 
 	// Triangle
-	InitObject( vao[ 1 ], 
-				vertexID, &triangleBufferData[ 0 ], 
-				colorID, &triangleColorData[ 0 ], 
-				3 );
+	InitObject( vao[ 1 ], buffers[ 1 ], vertexID, colorID, normalID, texCoordID, packed[ 1 ], meshes[ 1 ] );
+
+	float aspect = ( float ) WINDOW_WIDTH / WINDOW_HEIGHT;
+	Math::Matrix4 projection = DS::Perspective( CAMERA_FOV, aspect, CAMERA_NEAR, CAMERA_FAR );
 
-	Math::Matrix4 projection = DS::Perspective( 
-								45.0f, 
-								( float ) WINDOW_WIDTH / WINDOW_HEIGHT, 
-								0.1f, 100.0f );
+	// Culling and terrain LOD clip against conventional depth.
+	Math::Matrix4 cullingProjection = projection;
+
+	if ( depthMode == DEPTH_INFINITE ) {
+		projection = DS::InfinitePerspective( CAMERA_FOV, aspect, CAMERA_NEAR );
+		cullingProjection = projection;
+	} else if ( depthMode == DEPTH_REVERSED ) {
+		projection = DS::ReversedInfinitePerspective( CAMERA_FOV, aspect, CAMERA_NEAR );
+		cullingProjection = DS::InfinitePerspective( CAMERA_FOV, aspect, CAMERA_NEAR );
+	}
 
 	Math::Matrix4 view = DS::LookAt( 
 							Math::Vector3( camera_pos[ 0 ], camera_pos[ 1 ], camera_pos[ 2 ] ),
 							Math::Vector3( target_pos[ 0 ], target_pos[ 1 ], target_pos[ 2 ] ),
 							Math::Vector3( up_pos[ 0 ], up_pos[ 1 ], up_pos[ 2 ] ) );
 
-	Math::Matrix4 cubeModel = Math::Translate( Math::Vector3( 5.0f, 0.0f, 0.0f ) ).GetTranspose();
-	Math::Matrix4 cubeModel2 = Math::Translate( Math::Vector3( -5.0f, 0.0f, 0.0f ) ).GetTranspose();
-	Math::Matrix4 triangleModel = Math::Translate( Math::Vector3( 0.0f, 5.0f, 0.0f ) ).GetTranspose();
-	Math::Matrix4 triangleModel2 = Math::Translate( Math::Vector3( 0.0f, -5.0f, 0.0f ) ).GetTranspose();
+	std::vector< SceneObject > objects;
+
+	objects.push_back( MakeObject( 0, meshes[ 0 ], Math::Translate( Math::Vector3( 5.0f, 0.0f, 0.0f ) ) ) );		// Cube
+	objects.push_back( MakeObject( 0, meshes[ 0 ], Math::Translate( Math::Vector3( -5.0f, 0.0f, 0.0f ) ) ) );		// Cube2
+	objects.push_back( MakeObject( 1, meshes[ 1 ], Math::Translate( Math::Vector3( 0.0f, 5.0f, 0.0f ) ) ) );		// Triangle
+	objects.push_back( MakeObject( 1, meshes[ 1 ], Math::Translate( Math::Vector3( 0.0f, -5.0f, 0.0f ) ) ) );		// Triangle2
+
+	// The cubes are solid enough to hide things behind them.
+	objects[ 0 ].occluder = true;
+	objects[ 1 ].occluder = true;
+
+	float lodScale = DS::LODErrorScale( projection, WINDOW_HEIGHT );
+
+	DS::JobSystem jobs;
+	jobs.Init( -1 );
+
+	// Streamed cells come from world/ if present, otherwise each cell is
+	// filled with a few cubes below the scene.
+	DS::WorldStreamer world;
+	const DS::Mesh& cube = meshes[ 0 ];
+
+	world.Init( [ &cube ]( int x, int z, DS::Chunk& chunk ) {
+		if ( !DS::LoadChunkFile( "world", x, z, MESH_COUNT, chunk ) ) {
+			return false;
+		}
+
+		if ( !chunk.objects.empty() ) {
+			return true;
+		}
+
+		unsigned int hash = ( unsigned int ) x * 73856093u ^ ( unsigned int ) z * 19349663u;
+
+		for ( int i = 0; i < 4; ++i ) {
+			hash = hash * 1664525u + 1013904223u;
+
+			float ox = ( ( hash >> 8 ) & 0xFF ) / 255.0f * WORLD_CELL_SIZE;
+			float oz = ( ( hash >> 16 ) & 0xFF ) / 255.0f * WORLD_CELL_SIZE;
+			Math::Matrix4 transform = Math::Translate( Math::Vector3( x * WORLD_CELL_SIZE + ox, -10.0f, z * WORLD_CELL_SIZE + oz ) );
+
+			DS::ChunkObject obj;
+			obj.mesh = 0;
+			obj.model = Math::Matrix4( transform.c ).GetTranspose();
+			obj.bounds = Math::TransformBounds( transform, cube.bounds );
+			obj.lod = 0;
+
+			chunk.objects.push_back( obj );
+		}
+
+		return true;
+	}, WORLD_CELL_SIZE, WORLD_LOAD_RADIUS, WORLD_MEMORY_BUDGET );
+
+	world.SetLookahead( WORLD_LOOKAHEAD );
+
+	DS::OcclusionCuller culler( OCCLUSION_WIDTH, OCCLUSION_HEIGHT );
+
+	DS::TextureUnits textureUnits;
+	textureUnits.Init();
+
+	DS::TextureManager textures;
+	textures.Init( &textureUnits, TEXTURE_MEMORY_BUDGET, TEXTURE_UPLOAD_BUDGET );
+	DS::Memory::SetBudget( DS::MEMORY_GL_TEXTURE, DS::MEMORY_TEXTURE, TEXTURE_MEMORY_BUDGET );
+
+	// The unit below DrawBatch's is the terrain's height array, the three
+	// below that the light clusters, then the shadow map. The units under
+	// it, from DIFFUSE_UNIT up, are the command line textures'.
+	assert( textureUnits.Count() > 6 + DIFFUSE_UNIT );
+
+	unsigned int terrainUnit = textureUnits.Count() - 2;
+	unsigned int lightUnit = terrainUnit - 3;
+	unsigned int shadowUnit = lightUnit - 1;
+
+	// KTX/DDS files named on the command line, see DIFFUSE_UNIT.
+	std::vector< unsigned int > textureIDs;
+	for ( size_t i = 0; i < textureFiles.size() && i < shadowUnit; ++i ) {
+		textureIDs.push_back( textures.Load( textureFiles[ i ] ) );
+	}
+
+	if ( textureIDs.size() < textureFiles.size() ) {
+		fprintf( stderr, "Only %u texture units free, skipped %u textures from %s on\n",
+				 shadowUnit, ( unsigned int ) ( textureFiles.size() - textureIDs.size() ), textureFiles[ textureIDs.size() ] );
+	}
+
+	assert( textureIDs.size() <= shadowUnit );
 
 	GLuint projID = glGetUniformLocation( programID, "PROJ" );
 	GLuint mvID = glGetUniformLocation( programID, "VIEW" );
 	GLuint modID = glGetUniformLocation( programID, "MODEL" );
+	GLuint positionScaleID = glGetUniformLocation( programID, "POSITION_SCALE" );
+	GLuint positionBiasID = glGetUniformLocation( programID, "POSITION_BIAS" );
+	GLint texturedID = glGetUniformLocation( programID, "TEXTURED" );
+
+	DS::GL::UniformMatrix4fv( projID, 1, GL_FALSE, &projection.c[ 0 ][ 0 ] );
+
+	// Batched path, every mesh shares one set of buffers.
+	GLuint batchProgramID = DS::LoadShaders( "batch.vert", "simple.frag" );
+	DS::GL::UseProgram( batchProgramID );
+
+	GLuint batchProjID = glGetUniformLocation( batchProgramID, "PROJ" );
+	GLuint batchViewID = glGetUniformLocation( batchProgramID, "VIEW" );
+	GLint batchTexturedID = glGetUniformLocation( batchProgramID, "TEXTURED" );
+
+	DS::GL::UniformMatrix4fv( batchProjID, 1, GL_FALSE, &projection.c[ 0 ][ 0 ] );
+
+	DS::DrawBatch batch;
+	batch.Init( batchProgramID, MESH_FORMAT );
+
+	for ( unsigned int i = 0; i < MESH_COUNT; ++i ) {
+		batch.AddMesh( meshes[ i ] );
+	}
+
+	std::cout << "Batching: " << ( batch.IsIndirect() ? "glMultiDrawElementsIndirect" : "instanced fallback" ) << std::endl;
+
+	// Particles, simulated on the CPU and streamed every frame.
+	GLuint particleProgramID = DS::LoadShaders( "particle.vert", "particle.frag" );
+	DS::GL::UseProgram( particleProgramID );
+
+	GLuint particleProjID = glGetUniformLocation( particleProgramID, "PROJ" );
+	GLuint particleViewID = glGetUniformLocation( particleProgramID, "VIEW" );
+
+	DS::GL::UniformMatrix4fv( particleProjID, 1, GL_FALSE, &projection.c[ 0 ][ 0 ] );
+
+	DS::ParticleSystem particles;
+	particles.Init( particleProgramID, MAX_PARTICLES );
+
+	DS::EmitterDesc fountain;
+	fountain.origin = Math::Point3( 0.0f, -5.0f, 0.0f );
+	fountain.velocity = Math::Vector3( 0.0f, 10.0f, 0.0f );
+	fountain.spread = 2.0f;
+	fountain.rate = 20000.0f;
+	fountain.life = 2.0f;
+	fountain.size = 0.05f;
+	fountain.color[ 0 ] = 1.0f;
+	fountain.color[ 1 ] = 0.6f;
+	fountain.color[ 2 ] = 0.2f;
+	fountain.color[ 3 ] = 0.5f;
+
+	particles.AddEmitter( fountain );
+
+	// Audio is optional, the mixer ignores everything if no device opened.
+	DS::AudioMixer audio;
+	audio.Init( AUDIO_FREQUENCY, AUDIO_BUFFER_FRAMES );
+
+	DS::Sound hum;
+	DS::MakeTone( 110.0f, 1.0f, AUDIO_FREQUENCY, hum );
+
+	DS::VoiceDesc fountainVoice;
+	fountainVoice.position = fountain.origin;
+	fountainVoice.volume = 0.5f;
+	fountainVoice.minDistance = 5.0f;
+	fountainVoice.loop = true;
+
+	audio.Play( &hum, fountainVoice );
+
+	if ( musicFile ) {
+		audio.PlayMusic( musicFile, true );
+	}
+
+	// Skinned crowd, CPU skinned in parallel or GPU skinned.
+	GLuint skinnedProgramID = DS::LoadShaders( "skinned.vert", "simple.frag" );
+	DS::GL::UseProgram( skinnedProgramID );
+
+	GLuint skinnedProjID = glGetUniformLocation( skinnedProgramID, "PROJ" );
+	GLuint skinnedViewID = glGetUniformLocation( skinnedProgramID, "VIEW" );
+
+	DS::GL::UniformMatrix4fv( skinnedProjID, 1, GL_FALSE, &projection.c[ 0 ][ 0 ] );
+
+	DS::Skeleton wormSkeleton;
+	DS::SkinnedMesh wormMesh;
+	DS::AnimationClip sway;
+	DS::AnimationClip twist;
 
-	glUniformMatrix4fv( projID, 1, GL_FALSE, &projection.c[ 0 ][ 0 ] );
+	BuildWorm( wormSkeleton, wormMesh );
+	BuildWormClips( wormSkeleton, sway, twist );
+
+	std::cout << "Worm clips: " << sway.CompressedBytes() + twist.CompressedBytes() << " bytes, "
+			  << sway.RawBytes() + twist.RawBytes() << " uncompressed" << std::endl;
+
+	DS::Crowd crowd;
+	crowd.Init( &jobs, &wormSkeleton, &wormMesh, skinnedProgramID );
+	crowd.AddClip( &sway );
+	crowd.AddClip( &twist );
+
+	// Varied clocks, headings and blends so no two move alike.
+	auto addCharacters = [ &crowd ]( int side, float spacing, float y ) {
+		for ( int i = 0; i < side * side; ++i ) {
+			DS::CharacterDesc desc;
+			desc.position = Math::Point3( ( i % side - side / 2 ) * spacing, y, ( i / side - side / 2 ) * spacing );
+			desc.heading = ( i * 37 ) % 360;
+			desc.clipA = 0;
+			desc.clipB = 1;
+			desc.blend = ( i % 5 ) / 4.0f;
+			desc.time = i * 0.13f;
+			desc.speed = 1.0f;
+
+			crowd.AddCharacter( desc );
+		}
+	};
+
+	// Terrain only in the default scene, benchmarks stay comparable.
+	GLuint terrainProgramID = DS::LoadShaders( "terrain.vert", "simple.frag" );
+	DS::GL::UseProgram( terrainProgramID );
+
+	GLuint terrainProjID = glGetUniformLocation( terrainProgramID, "PROJ" );
+	GLuint terrainViewID = glGetUniformLocation( terrainProgramID, "VIEW" );
+
+	DS::GL::UniformMatrix4fv( terrainProjID, 1, GL_FALSE, &projection.c[ 0 ][ 0 ] );
+
+	bool terrainEnabled = scene.empty();
+	DS::Terrain terrain;
+
+	if ( terrainEnabled ) {
+		DS::TerrainDesc terrainDesc;
+		terrainDesc.lodDistance = TERRAIN_LOD_DISTANCE;
+		terrainDesc.minHeight = TERRAIN_BASE;
+		terrainDesc.maxHeight = TERRAIN_BASE + TERRAIN_AMPLITUDE;
+
+		float tileSize = terrainDesc.tileSize;
+
+		terrain.Init( terrainDesc, [ terrainDir, tileSize ]( int x, int z, int resolution, std::vector< float >& heights ) {
+			if ( terrainDir ) {
+				return DS::LoadHeightTile( terrainDir, x, z, resolution, heights );
+			}
+
+			DS::GenerateHeightTile( x, z, resolution, tileSize, TERRAIN_BASE, TERRAIN_AMPLITUDE, heights );
+			return true;
+		}, terrainProgramID, &textureUnits, terrainUnit );
+	}
+
+	// Every program shading with simple.frag picks its lights from the clusters.
+	DS::LightClusters lightClusters;
+	lightClusters.Init( LIGHT_TILES_X, LIGHT_TILES_Y, LIGHT_SLICES, &textureUnits, lightUnit );
+	lightClusters.SetProjection( CAMERA_FOV, aspect, CAMERA_NEAR, CAMERA_FAR );
+
+	GLuint litPrograms[] = { programID, batchProgramID, skinnedProgramID, terrainProgramID };
+
+	// Samplers of different types may not share a unit, so the shadow map
+	// gets its own even when there are no shadows.
+	for ( int i = 0; i < 4; ++i ) {
+		lightClusters.SetupProgram( litPrograms[ i ], WINDOW_WIDTH, WINDOW_HEIGHT );
+		DS::GL::Uniform1i( glGetUniformLocation( litPrograms[ i ], "DIFFUSE" ), DIFFUSE_UNIT );
+		DS::GL::Uniform1i( glGetUniformLocation( litPrograms[ i ], "SHADOW_MAP" ), shadowUnit );
+	}
+
+	std::vector< DS::PointLight > lights( LIGHT_COUNT );
+	float lightTime = 0.0f;
+
+	for ( size_t i = 0; i < lights.size(); ++i ) {
+		DS::PointLight& light = lights[ i ];
+		float hue = i * 0.618034f;
+		hue -= floorf( hue );
+
+		light.radius = LIGHT_RADIUS;
+		light.color = Math::Vector3( 0.5f + 0.5f * cosf( 2.0f * Math::PI * hue ),
+									 0.5f + 0.5f * cosf( 2.0f * Math::PI * ( hue - 1.0f / 3.0f ) ),
+									 0.5f + 0.5f * cosf( 2.0f * Math::PI * ( hue - 2.0f / 3.0f ) ) );
+	}
+
+	AnimateLights( lights, lightTime );
+
+	std::cout << "Lights: " << lights.size() << " in " << LIGHT_TILES_X << "x" << LIGHT_TILES_Y << "x" << LIGHT_SLICES << " clusters" << std::endl;
+
+	// Terrain receives shadows but casts none, its slopes are shaded by the normal.
+	DS::ShadowDesc shadowDesc;
+	shadowDesc.cascades = SHADOW_CASCADES;
+	shadowDesc.resolution = SHADOW_RESOLUTION;
+	shadowDesc.distance = SHADOW_DISTANCE;
+	shadowDesc.firstCached = SHADOW_FIRST_CACHED;
+	shadowDesc.reversed = depthMode == DEPTH_REVERSED;
+
+	DS::ShadowCascades shadows;
+	bool shadowing = shadows.Init( shadowDesc, &textureUnits, shadowUnit );
+
+	for ( int i = 0; i < 4 && shadowing; ++i ) {
+		shadows.SetupProgram( litPrograms[ i ] );
+	}
+
+	// Casters only need depth, without the lights and shadow lookups.
+	GLuint depthProgramID = DS::LoadShaders( "depth.vert", "depth.frag" );
+	GLuint skinnedDepthProgramID = DS::LoadShaders( "skinned.vert", "depth.frag" );
+
+	GLuint depthClipID = glGetUniformLocation( depthProgramID, "CLIP" );
+	GLuint depthModelID = glGetUniformLocation( depthProgramID, "MODEL" );
+	GLuint depthScaleID = glGetUniformLocation( depthProgramID, "POSITION_SCALE" );
+	GLuint depthBiasID = glGetUniformLocation( depthProgramID, "POSITION_BIAS" );
+	GLuint skinnedDepthProjID = glGetUniformLocation( skinnedDepthProgramID, "PROJ" );
+	GLuint skinnedDepthViewID = glGetUniformLocation( skinnedDepthProgramID, "VIEW" );
+
+	crowd.SetDepthProgram( skinnedDepthProgramID );
+
+	Math::Vector3 sunDirection;
+
+	auto aimSun = [ & ]( void ) {
+		float elevation = SUN_ELEVATION * Math::PI / 180.0f;
+		float azimuth = sunAzimuth * Math::PI / 180.0f;
+
+		sunDirection = Math::Vector3( cosf( elevation ) * cosf( azimuth ), sinf( elevation ), cosf( elevation ) * sinf( azimuth ) );
+
+		for ( int i = 0; i < 4; ++i ) {
+			DS::GL::UseProgram( litPrograms[ i ] );
+			DS::GL::Uniform3f( glGetUniformLocation( litPrograms[ i ], "SUN_DIRECTION" ), sunDirection.x, sunDirection.y, sunDirection.z );
+		}
+	};
+
+	aimSun();
+
+	// Streamed chunks are static casters, cached cascades redraw when they change.
+	std::vector< DS::Chunk* > shadowChunks;
+	std::vector< unsigned int > shadowClusters;
+
+	DS::SweepAndPrune broadphase( 0 );
+	DS::PhysicsWorld physics;
+	physics.Init( &jobs, &broadphase );
+	physics.SetDeterministic( true, BENCHMARK_DT );
+	physics.SetGround( -10.0f );
+
+	// Built-in stress scenes for benchmark runs.
+	if ( scene == "objects" ) {
+		// A pile of bodies dropped onto the ground.
+		for ( int i = 0; i < STRESS_BODIES; ++i ) {
+			float x = ( i % 16 ) * 1.1f - 8.0f;
+			float z = ( ( i / 16 ) % 16 ) * 1.1f - 8.0f;
+			float y = ( i / 256 ) * 1.1f - 5.0f;
+
+			SceneObject obj = MakeObject( 0, meshes[ 0 ], Math::Translate( Math::Vector3( x, y, z ) ) );
+			obj.body = ( int ) physics.AddBody( Math::Point3( x, y, z ), 0.5f, 1.0f );
+			obj.isStatic = false;
+			objects.push_back( obj );
+		}
+	} else if ( scene == "draws" ) {
+		// A large grid of static cubes, mostly submission cost.
+		for ( int i = 0; i < STRESS_DRAWS * STRESS_DRAWS; ++i ) {
+			float x = ( i % STRESS_DRAWS - STRESS_DRAWS / 2 ) * 3.0f;
+			float z = ( i / STRESS_DRAWS - STRESS_DRAWS ) * 3.0f;
+
+			objects.push_back( MakeObject( i % 2, meshes[ i % 2 ], Math::Translate( Math::Vector3( x, -8.0f, z ) ) ) );
+		}
+	} else if ( scene == "crowd" ) {
+		addCharacters( STRESS_CHARACTERS, 2.0f, -8.0f );
+	} else if ( scene == "audio" ) {
+		// A ring of detuned voices, every slot of the mixer busy.
+		for ( int i = 0; i < STRESS_VOICES; ++i ) {
+			float angle = 2.0f * Math::PI * i / STRESS_VOICES;
+
+			DS::VoiceDesc desc;
+			desc.position = Math::Point3( cosf( angle ) * 20.0f, 0.0f, sinf( angle ) * 20.0f );
+			desc.volume = 0.05f;
+			desc.pitch = 0.5f + 1.5f * i / STRESS_VOICES;
+			desc.minDistance = 5.0f;
+			desc.loop = true;
+
+			audio.Play( &hum, desc );
+		}
+	} else if ( scene == "particles" ) {
+		// Enough emitters to keep the pool close to full.
+		for ( int i = 0; i < STRESS_EMITTERS; ++i ) {
+			DS::EmitterDesc desc = fountain;
+			desc.origin = Math::Point3( ( i - STRESS_EMITTERS / 2 ) * 4.0f, -5.0f, 0.0f );
+			desc.rate = MAX_PARTICLES / ( STRESS_EMITTERS * fountain.life );
+			particles.AddEmitter( desc );
+		}
+	} else if ( !scene.empty() ) {
+		fprintf( stderr, "Unknown scene %s\n", scene.c_str() );
+	}
+
+	if ( scene.empty() ) {
+		addCharacters( CROWD_SIZE, 3.0f, -8.0f );
+	}
+
+	// Walls and anything static standing at the characters' feet block the grid.
+	DS::NavGrid navGrid;
+	navGrid.Init( NAV_CELLS, NAV_CELLS, NAV_CELL_SIZE, Math::Point3( -0.5f * NAV_CELLS * NAV_CELL_SIZE, -8.0f, -0.5f * NAV_CELLS * NAV_CELL_SIZE ) );
+
+	for ( size_t i = 0; i < objects.size(); ++i ) {
+		const Math::BBox& b = objects[ i ].bounds;
+
+		if ( objects[ i ].isStatic && b.pMin.y < -8.0f + NAV_HEIGHT && b.pMax.y > -8.0f ) {
+			navGrid.Block( b );
+		}
+	}
+
+	navGrid.Block( Math::BBox( Math::Point3( NAV_WALL_X, 0.0f, -0.5f * NAV_WALL_LENGTH ), Math::Point3( NAV_WALL_X, 0.0f, 0.5f * NAV_WALL_LENGTH ) ) );
+
+	DS::Pathfinder pathfinder;
+	pathfinder.Init( &navGrid, NAV_CLUSTER, NAV_CACHE );
+
+	std::cout << "Navigation: " << pathfinder.NodeCount() << " nodes, " << pathfinder.EdgeCount() << " edges" << std::endl;
+
+	// J opens and closes the gate, the pathfinder repairs only the clusters around it.
+	bool gateOpen = false;
+	Math::BBox gate( Math::Point3( NAV_WALL_X, 0.0f, -0.5f * NAV_GATE_WIDTH ), Math::Point3( NAV_WALL_X, 0.0f, 0.5f * NAV_GATE_WIDTH ) );
+
+	std::vector< Agent > agents( crowd.CharacterCount() );
+
+	// Gameplay tasks. They may point into agents, which is never resized.
+	DS::TaskScheduler scheduler;
+	scheduler.Init( ( unsigned int ) agents.size(), &jobs );
+
+	for ( size_t i = 0; i < agents.size(); ++i ) {
+		agents[ i ].next = 0;
+		agents[ i ].seed = ( unsigned int ) i * 2654435761u + 1u;
+		agents[ i ].resting = false;
+	}
+
+	// Everything that never moves is baked into world space clusters once.
+	DS::StaticBatch staticBatch;
+
+	for ( size_t i = 0; i < objects.size(); ++i ) {
+		if ( objects[ i ].isStatic ) {
+			const SceneObject& obj = objects[ i ];
+			staticBatch.Add( meshes[ obj.mesh ], lods[ obj.mesh ].levels[ 0 ], Math::Matrix4( obj.model.c ).GetTranspose(), 0 );
+		}
+	}
+
+	staticBatch.Build( STATIC_CLUSTER_VERTICES, STATIC_CLUSTER_EXTENT );
+	staticBatch.Upload( vertexID, colorID, texCoordID );
+
+	std::vector< unsigned int > visibleClusters;
+
+	// Benchmarks step a fixed frame time so runs are repeatable.
+	bool fixedStep = !scene.empty() || frameLimit > 0;
+
+	DS::FrameLog frameLog;
+	unsigned int frame = 0;
+
+	DS::FrameCapture frameCapture;
+	frameCapture.Init( WINDOW_WIDTH, WINDOW_HEIGHT, CAPTURE_SLOTS );
+
+	// After a pre-pass the shading pass has to pass on equal depth too.
+	GLenum depthTest = GL_LESS;
+	GLenum depthTestEqual = GL_LEQUAL;
+
+	if ( depthMode == DEPTH_REVERSED ) {
+		glClipControl( GL_LOWER_LEFT, GL_ZERO_TO_ONE );
+		glClearDepth( 0.0 );
+		depthTest = GL_GREATER;
+		depthTestEqual = GL_GEQUAL;
+	}
+
+	std::cout << "Depth: " << ( depthMode == DEPTH_REVERSED ? "reversed" : ( depthMode == DEPTH_INFINITE ? "infinite" : "standard" ) ) << std::endl;
+
+	std::vector< ObjectDraw > objectDraws;
 
 	glEnable( GL_DEPTH_TEST );
-	glDepthFunc( GL_LESS );
+	glDepthFunc( depthTest );
 	glClearColor( 0.0f, 0.0f, 1.0f, 1.0f );
 
+	// Benchmarks and replays time every frame, they never idle.
+	if ( onDemand && ( fixedStep || player.IsOpen() ) ) {
+		std::cout << "On demand rendering is off for benchmarks and replays" << std::endl;
+		onDemand = false;
+	}
+
+	unsigned int skippedFrames = 0;
+	bool texturesStreaming = false;
+
+	Uint32 statsTicks = 0;
+	bool statsShown = false;
+
 	bool firstPass = true;
+	Uint32 lastTicks = SDL_GetTicks();
 
 	// Main Loop
 	while ( true ) {
-		if ( PollKeys() == SDL_EventType::SDL_QUIT ) {
+		Uint64 frameStart = SDL_GetPerformanceCounter();
+
+		std::vector< DS::InputEvent > events;
+		if ( PollKeys( events ) == SDL_EventType::SDL_QUIT ) {
 			break;
 		}
 
+		Uint32 ticks = SDL_GetTicks();
+		float dt = ( ticks - lastTicks ) / 1000.0f;
+		lastTicks = ticks;
+
+		// A replay supplies both the input and the frame time.
+		if ( player.IsOpen() ) {
+			if ( !player.Next( &dt, events ) ) {
+				break;
+			}
+		} else if ( fixedStep ) {
+			dt = BENCHMARK_DT;
+		}
+
+		recorder.Frame( dt, events );
+
+		for ( size_t i = 0; i < events.size(); ++i ) {
+			HandleKey( events[ i ] );
+		}
+
+		// Whether this frame can look any different from the last one. Off
+		// demand every frame is drawn.
+		bool redraw = !onDemand || firstPass || moving || !events.empty() || captureDir || texturesStreaming;
+
+		// The back buffer is gone after the swap, without a render target an
+		// exposed window is drawn from scratch.
+		redraw = redraw || ( exposed && !offscreen );
+
 		if ( moving || firstPass ) {
 			view = DS::LookAt( 
 							Math::Vector3( camera_pos[ 0 ], camera_pos[ 1 ], camera_pos[ 2 ] ),
 							Math::Vector3( target_pos[ 0 ], target_pos[ 1 ], target_pos[ 2 ] ),
 							Math::Vector3( up_pos[ 0 ], up_pos[ 1 ], up_pos[ 2 ] ) );
 
-			glUniformMatrix4fv( mvID, 1, GL_FALSE, &view.c[ 0 ][ 0 ] );
+			DS::GL::UseProgram( programID );
+			DS::GL::UniformMatrix4fv( mvID, 1, GL_FALSE, &view.c[ 0 ][ 0 ] );
+			DS::GL::UseProgram( batchProgramID );
+			DS::GL::UniformMatrix4fv( batchViewID, 1, GL_FALSE, &view.c[ 0 ][ 0 ] );
+			DS::GL::UseProgram( particleProgramID );
+			DS::GL::UniformMatrix4fv( particleViewID, 1, GL_FALSE, &view.c[ 0 ][ 0 ] );
+			DS::GL::UseProgram( skinnedProgramID );
+			DS::GL::UniformMatrix4fv( skinnedViewID, 1, GL_FALSE, &view.c[ 0 ][ 0 ] );
+			DS::GL::UseProgram( terrainProgramID );
+			DS::GL::UniformMatrix4fv( terrainViewID, 1, GL_FALSE, &view.c[ 0 ][ 0 ] );
+
+			audio.SetListener( Math::Point3( camera_pos[ 0 ], camera_pos[ 1 ], camera_pos[ 2 ] ),
+							   Math::Vector3( target_pos[ 0 ] - camera_pos[ 0 ], target_pos[ 1 ] - camera_pos[ 1 ], target_pos[ 2 ] - camera_pos[ 2 ] ),
+							   Math::Vector3( up_pos[ 0 ], up_pos[ 1 ], up_pos[ 2 ] ) );
 
 			if ( firstPass ) { firstPass = false; }
 		}
 
+		Math::Point3 eye( camera_pos[ 0 ], camera_pos[ 1 ], camera_pos[ 2 ] );
+
+		// Streaming completes asynchronously, keep it out of benchmark runs.
+		// Loads in flight before an update may be adopted by it.
+		if ( scene.empty() ) {
+			redraw = redraw || world.PendingCount() > 0;
+			world.Update( eye, dt );
+		}
+
+		// Joins music streams the audio thread is done with.
+		audio.Update();
+
+		if ( terrainEnabled ) {
+			redraw = redraw || terrain.PendingTiles() > 0;
+			terrain.Update( eye );
+		}
+
+		// Space stops the clock for everything but the camera. The simulations
+		// report whether they changed anything worth drawing.
+		if ( physics.BodyCount() > 0 && !paused && physics.Step( dt ) > 0 ) {
+			redraw = true;
+
+			for ( size_t i = 0; i < objects.size(); ++i ) {
+				SceneObject& obj = objects[ i ];
+
+				if ( obj.body < 0 ) {
+					continue;
+				}
+
+				Math::Point3 p = physics.Position( obj.body );
+				float r = physics.Radius( obj.body );
+
+				Math::Matrix4 transform = Math::Multiply( Math::Translate( Math::Vector3( p.x, p.y, p.z ) ), Math::Scale( Math::Vector3( r, r, r ) ) );
+				obj.model = transform.GetTranspose();
+				obj.bounds = Math::TransformBounds( transform, meshes[ obj.mesh ].bounds );
+			}
+		}
+
+		if ( !paused ) {
+			redraw = particles.Update( dt ) || redraw;
+		}
+
+		if ( toggleGate ) {
+			gateOpen = !gateOpen;
+			toggleGate = false;
+
+			int x0, z0, x1, z1;
+			navGrid.CellAt( gate.pMin, x0, z0 );
+			navGrid.CellAt( gate.pMax, x1, z1 );
+
+			for ( int z = z0; z <= z1; ++z ) {
+				for ( int x = x0; x <= x1; ++x ) {
+					pathfinder.SetBlocked( x, z, !gateOpen );
+				}
+			}
+		}
+
+		crowd.SetMode( ( DS::SkinningMode ) skinningMode );
+
+		if ( !paused ) {
+			scheduler.Update( dt );
+			UpdateAgents( agents, crowd, pathfinder, navGrid, jobs, scheduler, dt );
+			redraw = crowd.Update( dt ) || redraw;
+		}
+
+		// The lights never stop orbiting, on demand they only move in frames
+		// drawn for something else so they cannot keep the loop awake.
+		if ( !paused && redraw ) {
+			lightTime += dt;
+			AnimateLights( lights, lightTime );
+		}
+
+		Uint64 updateEnd = SDL_GetPerformanceCounter();
+
+		// Nothing changed: the window keeps showing the last frame, presented
+		// again if it was exposed, and the loop sleeps until input arrives or
+		// the timeout comes round to check on background work.
+		if ( !redraw ) {
+			if ( exposed ) {
+				renderTarget.Present();
+				SDL_GL_SwapWindow( mainWindow );
+				exposed = false;
+			}
+
+			frameCapture.Poll();
+			SDL_WaitEventTimeout( NULL, IDLE_WAIT_MS );
+
+			lastTicks = SDL_GetTicks();			// Time spent asleep is not simulated.
+			++skippedFrames;
+			continue;
+		}
+
+		exposed = false;
+
+		if ( sunMoved ) {
+			aimSun();
+			sunMoved = false;
+		}
+
+		// Shadow maps first, they have their own framebuffer and viewport.
+		if ( shadowing ) {
+			const std::vector< DS::Chunk* >& resident = world.Resident();
+
+			if ( resident != shadowChunks ) {
+				shadowChunks = resident;
+				shadows.Invalidate();
+			}
+
+			Math::BBox crowdBounds;
+
+			for ( unsigned int i = 0; i < crowd.CharacterCount(); ++i ) {
+				crowdBounds = Math::Union( crowdBounds, crowd.Character( i ).position );
+			}
+
+			crowdBounds.Expand( WORM_JOINTS * WORM_SEGMENT );
+
+			Math::Matrix4 identity;
+
+			// Everything is drawn straight into the cascade's clip space.
+			auto casterCamera = [ & ]( int cascade ) {
+				DS::GL::UseProgram( depthProgramID );
+				DS::GL::UniformMatrix4fv( depthClipID, 1, GL_FALSE, &shadows.Matrix( cascade ).c[ 0 ][ 0 ] );
+			};
+
+			auto drawCaster = [ & ]( unsigned int mesh, unsigned int lod, const Math::Matrix4& model ) {
+				const DS::PackedVertices& vertices = packed[ mesh ];
+
+				DS::GL::UniformMatrix4fv( depthModelID, 1, GL_FALSE, &model.c[ 0 ][ 0 ] );
+				DS::GL::Uniform3f( depthScaleID, vertices.scale.x, vertices.scale.y, vertices.scale.z );
+				DS::GL::Uniform3f( depthBiasID, vertices.bias.x, vertices.bias.y, vertices.bias.z );
+				Render( vao[ mesh ], lods[ mesh ].levels[ lod ] );
+			};
+
+			// The static batch, whether or not it is drawn batched, and the streamed chunks.
+			auto drawStatic = [ & ]( int cascade ) {
+				const std::vector< DS::StaticCluster >& clusters = staticBatch.Clusters();
+				shadowClusters.clear();
+
+				for ( size_t i = 0; i < clusters.size(); ++i ) {
+					if ( shadows.Overlaps( cascade, clusters[ i ].bounds ) ) {
+						shadowClusters.push_back( ( unsigned int ) i );
+					}
+				}
+
+				casterCamera( cascade );
+
+				DS::GL::UniformMatrix4fv( depthModelID, 1, GL_FALSE, &identity.c[ 0 ][ 0 ] );
+				DS::GL::Uniform3f( depthScaleID, 1.0f, 1.0f, 1.0f );
+				DS::GL::Uniform3f( depthBiasID, 0.0f, 0.0f, 0.0f );
+				staticBatch.Draw( shadowClusters );
+
+				for ( size_t i = 0; i < shadowChunks.size(); ++i ) {
+					for ( size_t j = 0; j < shadowChunks[ i ]->objects.size(); ++j ) {
+						const DS::ChunkObject& obj = shadowChunks[ i ]->objects[ j ];
+
+						if ( shadows.Overlaps( cascade, obj.bounds ) ) {
+							drawCaster( obj.mesh, obj.lod, obj.model );
+						}
+					}
+				}
+			};
+
+			auto drawDynamic = [ & ]( int cascade ) {
+				casterCamera( cascade );
+
+				for ( size_t i = 0; i < objects.size(); ++i ) {
+					const SceneObject& obj = objects[ i ];
+
+					if ( !obj.isStatic && shadows.Overlaps( cascade, obj.bounds ) ) {
+						drawCaster( obj.mesh, obj.lod, obj.model );
+					}
+				}
+
+				if ( crowd.CharacterCount() == 0 || !shadows.Overlaps( cascade, crowdBounds ) ) {
+					return;
+				}
+
+				if ( crowd.Mode() == DS::SKIN_GPU ) {
+					DS::GL::UseProgram( skinnedDepthProgramID );
+					DS::GL::UniformMatrix4fv( skinnedDepthProjID, 1, GL_FALSE, &shadows.Matrix( cascade ).c[ 0 ][ 0 ] );
+					DS::GL::UniformMatrix4fv( skinnedDepthViewID, 1, GL_FALSE, &identity.c[ 0 ][ 0 ] );
+				} else {
+					DS::GL::UniformMatrix4fv( depthModelID, 1, GL_FALSE, &identity.c[ 0 ][ 0 ] );
+					DS::GL::Uniform3f( depthScaleID, 1.0f, 1.0f, 1.0f );
+					DS::GL::Uniform3f( depthBiasID, 0.0f, 0.0f, 0.0f );
+				}
+
+				crowd.RenderDepth();
+			};
+
+			shadows.Update( view, CAMERA_FOV, aspect, CAMERA_NEAR, sunDirection );
+			shadows.Render( drawStatic, drawDynamic );
+
+			shadows.Bind();
+			glViewport( 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT );
+		}
+
+		if ( offscreen ) {
+			renderTarget.Bind();
+		}
+
 		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
-		glUniformMatrix4fv( modID, 1, GL_FALSE, &cubeModel.c[ 0 ][ 0 ] );
-		Render( vao[ 0 ], 36 );	// Cube
-		glUniformMatrix4fv( modID, 1, GL_FALSE, &cubeModel2.c[ 0 ][ 0 ] );
-		Render( vao[ 0 ], 36 );	// Cube2
+		// Occluders go in at full detail so the depth never covers more than the real mesh.
+		culler.Begin( Math::Multiply( view, cullingProjection ) );
+
+		for ( size_t i = 0; i < objects.size(); ++i ) {
+			if ( objects[ i ].occluder ) {
+				const DS::Mesh& mesh = meshes[ objects[ i ].mesh ];
+				const DS::LODLevel& level = lods[ objects[ i ].mesh ].levels[ 0 ];
+
+				culler.AddOccluder( &mesh.positions[ 0 ], &mesh.indices[ level.indexOffset ], level.indexCount, objects[ i ].model );
+			}
+		}
+
+		// Tiles never share pixels.
+		jobs.ParallelFor( culler.TileCount(), OCCLUSION_TILE_GRAIN, [ &culler ]( int begin, int end ) {
+			for ( int tile = begin; tile < end; ++tile ) {
+				culler.RasterizeTile( tile );
+			}
+		} );
+
+		culler.BuildPyramid();
+
+		unsigned int drawn = 0;
+
+		// Visibility and LOD are picked once, so the pre-pass and the
+		// shading pass lay down exactly the same depth.
+		if ( staticBatching ) {
+			const std::vector< DS::StaticCluster >& clusters = staticBatch.Clusters();
+			visibleClusters.clear();
+
+			for ( size_t i = 0; i < clusters.size(); ++i ) {
+				if ( culler.IsVisible( clusters[ i ].bounds ) ) {
+					visibleClusters.push_back( ( unsigned int ) i );
+				}
+			}
+		}
+
+		if ( terrainEnabled && drawTerrain ) {
+			terrain.Select( eye, Math::Multiply( view, cullingProjection ) );
+		}
+
+		// One job per depth slice.
+		lightClusters.Update( view, lights.empty() ? NULL : &lights[ 0 ], ( unsigned int ) lights.size(), jobs );
+		lightClusters.Bind();
+
+		// Binding marks a texture wanted, Update streams it in after the
+		// frame. The meshes stay untextured until some of it is resident.
+		bool textured = false;
+
+		for ( size_t i = 0; i < textureIDs.size(); ++i ) {
+			bool resident = textures.Bind( textureIDs[ i ], ( unsigned int ) i );
+			textured = textured || ( i == DIFFUSE_UNIT && resident );
+		}
+
+		DS::GL::UseProgram( programID );
+		DS::GL::Uniform1i( texturedID, textured ? 1 : 0 );
+		DS::GL::UseProgram( batchProgramID );
+		DS::GL::Uniform1i( batchTexturedID, textured ? 1 : 0 );
+
+		batch.Begin();
+		objectDraws.clear();
+
+		auto queueObject = [ & ]( unsigned int mesh, const Math::Matrix4& model, const Math::BBox& bounds, unsigned int& lod ) {
+			const DS::LODChain& chain = lods[ mesh ];
+
+			if ( !culler.IsVisible( bounds ) ) {
+				return;
+			}
+
+			float distance = Math::Distance( eye, bounds.Center() ) - bounds.Radius();
+			lod = DS::SelectLOD( chain, lod, distance, lodScale, LOD_THRESHOLD, LOD_HYSTERESIS );
+			++drawn;
+
+			if ( batching ) {
+				batch.Draw( mesh, chain.levels[ lod ], model );
+			} else {
+				ObjectDraw draw;
+				draw.mesh = mesh;
+				draw.lod = lod;
+				draw.model = model;
+				objectDraws.push_back( draw );
+			}
+		};
+
+		for ( size_t i = 0; i < objects.size(); ++i ) {
+			SceneObject& obj = objects[ i ];
+
+			if ( obj.isStatic && staticBatching ) {
+				continue;
+			}
+
+			queueObject( obj.mesh, obj.model, obj.bounds, obj.lod );
+		}
+
+		const std::vector< DS::Chunk* >& chunks = world.Resident();
+
+		for ( size_t i = 0; i < chunks.size(); ++i ) {
+			for ( size_t j = 0; j < chunks[ i ]->objects.size(); ++j ) {
+				DS::ChunkObject& obj = chunks[ i ]->objects[ j ];
+				queueObject( obj.mesh, obj.model, obj.bounds, obj.lod );
+			}
+		}
+
+		// Static clusters, terrain and objects. Returns the clusters and
+		// terrain nodes drawn, the objects were counted when queued.
+		bool batchUploaded = false;
 
-		glUniformMatrix4fv( modID, 1, GL_FALSE, &triangleModel.c[ 0 ][ 0 ] );
-		Render( vao[ 1 ], 3 );	// Triangle
-		glUniformMatrix4fv( modID, 1, GL_FALSE, &triangleModel2.c[ 0 ][ 0 ] );
-		Render( vao[ 1 ], 3 );	// Triangle2
+		auto drawOpaque = [ & ]( void ) -> unsigned int {
+			unsigned int count = 0;
+
+			if ( staticBatching ) {
+				// Already in world space, as floats.
+				Math::Matrix4 identity;
+
+				DS::GL::UseProgram( programID );
+				DS::GL::UniformMatrix4fv( modID, 1, GL_FALSE, &identity.c[ 0 ][ 0 ] );
+				DS::GL::Uniform3f( positionScaleID, 1.0f, 1.0f, 1.0f );
+				DS::GL::Uniform3f( positionBiasID, 0.0f, 0.0f, 0.0f );
+				count += staticBatch.Draw( visibleClusters );
+			}
+
+			if ( terrainEnabled && drawTerrain ) {
+				DS::GL::UseProgram( terrainProgramID );
+				terrain.Render();
+				count += terrain.NodeCount();
+			}
+
+			if ( batching ) {
+				DS::GL::UseProgram( batchProgramID );
+
+				if ( batchUploaded ) {
+					batch.Submit();
+				} else {
+					batch.Flush();
+					batchUploaded = true;
+				}
+			} else {
+				DS::GL::UseProgram( programID );
+
+				for ( size_t i = 0; i < objectDraws.size(); ++i ) {
+					const ObjectDraw& draw = objectDraws[ i ];
+					const DS::PackedVertices& vertices = packed[ draw.mesh ];
+
+					DS::GL::UniformMatrix4fv( modID, 1, GL_FALSE, &draw.model.c[ 0 ][ 0 ] );
+					DS::GL::Uniform3f( positionScaleID, vertices.scale.x, vertices.scale.y, vertices.scale.z );
+					DS::GL::Uniform3f( positionBiasID, vertices.bias.x, vertices.bias.y, vertices.bias.z );
+					Render( vao[ draw.mesh ], lods[ draw.mesh ].levels[ draw.lod ] );
+				}
+			}
+
+			return count;
+		};
+
+		// Depth only first, so the shading pass below runs each covered
+		// pixel's fragment shader once thanks to early-Z.
+		if ( depthPrepass ) {
+			glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+			drawOpaque();
+			glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+
+			glDepthFunc( depthTestEqual );
+			drawn += drawOpaque();
+			glDepthFunc( depthTest );
+		} else {
+			drawn += drawOpaque();
+		}
+
+		if ( crowd.Mode() == DS::SKIN_GPU ) {
+			DS::GL::UseProgram( skinnedProgramID );
+		} else {
+			// Skinned straight into world space, as floats, without texture
+			// coordinates.
+			Math::Matrix4 identity;
+
+			DS::GL::UseProgram( programID );
+			DS::GL::UniformMatrix4fv( modID, 1, GL_FALSE, &identity.c[ 0 ][ 0 ] );
+			DS::GL::Uniform3f( positionScaleID, 1.0f, 1.0f, 1.0f );
+			DS::GL::Uniform3f( positionBiasID, 0.0f, 0.0f, 0.0f );
+			DS::GL::Uniform1i( texturedID, 0 );
+		}
+
+		crowd.Render();
+		drawn += crowd.CharacterCount();
+
+		DS::GL::UseProgram( particleProgramID );
+		particles.Render();
+
+		texturesStreaming = textures.Update();
+
+		if ( capture ) {
+			TraceReference( &objects[ 0 ], ( int ) objects.size(), meshes, lods, jobs );
+			capture = false;
+		}
+
+		if ( memoryReport ) {
+			DS::Memory::Report( stdout );
+			memoryReport = false;
+		}
+
+		// Readbacks from earlier frames land here, this frame's a few later.
+		frameCapture.Poll();
+
+		if ( captureDir ) {
+			char prefix[ CAPTURE_PREFIX_SIZE ];
+			int length = snprintf( prefix, sizeof( prefix ), "%s/frame_%05u", captureDir, frame );
+
+			if ( length > 0 && length < ( int ) sizeof( prefix ) ) {
+				frameCapture.Readback( prefix, DS::CAPTURE_COLOR | DS::CAPTURE_DEPTH );
+			}
+		}
+
+		if ( screenshot ) {
+			char prefix[ CAPTURE_PREFIX_SIZE ];
+			int length = snprintf( prefix, sizeof( prefix ), "screenshot_%05u", frame );
+
+			if ( length > 0 && length < ( int ) sizeof( prefix ) && frameCapture.Readback( prefix, DS::CAPTURE_COLOR | DS::CAPTURE_DEPTH ) ) {
+				std::cout << "Capturing " << prefix << std::endl;
+			}
+
+			screenshot = false;
+		}
+
+		if ( offscreen ) {
+			renderTarget.Present();
+		}
+
+		Uint64 renderEnd = SDL_GetPerformanceCounter();
 		
 		SDL_GL_SwapWindow( mainWindow );		
+
+		Uint64 frameEnd = SDL_GetPerformanceCounter();
+
+		DS::GL::EndFrame();
+		const DS::GLStats& gl = DS::GL::Last();
+
+		// No text rendering, the title bar doubles as the overlay.
+		if ( statsOverlay && ticks - statsTicks >= STATS_INTERVAL_MS ) {
+			char title[ 256 ];
+			sprintf( title, "%s - %u calls, %u tris, %u programs, %u vaos, %u buffers, %u textures, %u uniforms, %u redundant%s, %u KB uploaded",
+					 TITLE, gl.drawCalls, gl.triangles, gl.programBinds, gl.vertexArrayBinds, gl.bufferBinds, gl.textureBinds,
+					 gl.uniforms, gl.redundant, DS::GL::Elision() ? " skipped" : "", ( unsigned int ) ( gl.uploadBytes / 1024 ) );
+
+			SDL_SetWindowTitle( mainWindow, title );
+			statsTicks = ticks;
+			statsShown = true;
+		} else if ( !statsOverlay && statsShown ) {
+			SDL_SetWindowTitle( mainWindow, TITLE );
+			statsShown = false;
+		}
+
+		DS::FrameSample sample;
+		sample.frame = frame;
+		sample.dt = dt;
+		sample.updateMs = Milliseconds( frameStart, updateEnd );
+		sample.renderMs = Milliseconds( updateEnd, renderEnd );
+		sample.swapMs = Milliseconds( renderEnd, frameEnd );
+		sample.totalMs = Milliseconds( frameStart, frameEnd );
+		sample.draws = drawn;
+		sample.particles = particles.Count();
+		sample.drawCalls = gl.drawCalls;
+		sample.triangles = gl.triangles;
+		sample.redundant = gl.redundant;
+		sample.uploadKB = ( unsigned int ) ( gl.uploadBytes / 1024 );
+		frameLog.Add( sample );
+
+		++frame;
+
+		if ( frameLimit > 0 && frame >= ( unsigned int ) frameLimit ) {
+			break;
+		}
+	}
+
+	if ( timingFile ) {
+		frameLog.Write( timingFile, scene );
 	}
 
+	if ( timingFile || fixedStep ) {
+		frameLog.Summary( scene );
+	}
+
+	if ( onDemand ) {
+		std::cout << "On demand: " << frame << " frames drawn, " << skippedFrames << " skipped" << std::endl;
+	}
+
+	if ( shadowing ) {
+		std::cout << "Shadows: static casters redrawn " << shadows.StaticRedraws() << " times, reused " << shadows.StaticReuses() << " times" << std::endl;
+	}
+
+	recorder.Close();
+
+	batch.Shutdown();
+	staticBatch.Shutdown();
+	crowd.Shutdown();
+	terrain.Shutdown();
+
+	std::cout << "Paths: " << pathfinder.CacheHits() << " cached, " << pathfinder.CacheMisses() << " searched" << std::endl;
+	pathfinder.Shutdown();
+	scheduler.Shutdown();
+	lightClusters.Shutdown();
+	shadows.Shutdown();
+	audio.Shutdown();
+	frameCapture.Shutdown();
+	renderTarget.Shutdown();
+
+	if ( frameCapture.Dropped() > 0 ) {
+		fprintf( stderr, "Dropped %u captured frames\n", frameCapture.Dropped() );
+	}
+
+	particles.Shutdown();
+	world.Shutdown();
+	jobs.Shutdown();
+	textures.Shutdown();
+
+	ShutdownObject( vao[ 0 ], buffers[ 0 ] );
+	ShutdownObject( vao[ 1 ], buffers[ 1 ] );
+
+	// After shutdown, so anything still current is a leak.
+	if ( memoryFile ) {
+		DS::Memory::Dump( memoryFile );
+	}
+
+	bool withinBudget = DS::Memory::CheckBudgets();
+
 	// Delete the OpenGL context, destroy window, shutdown SDL.
 	SDL_GL_DeleteContext( mainContext );
 	SDL_DestroyWindow( mainWindow );
 	SDL_Quit();
 
-	return 0;
+	return withinBudget ? 0 : 1;
 }
@@ -0,0 +1,13 @@
+#version 330 core
+in vec4 fColor;
+in vec2 fCorner;
+out vec4 color;
+
+void main() {
+	float falloff = 1.0 - dot( fCorner, fCorner );
+	if ( falloff <= 0.0 ) {
+		discard;
+	}
+
+	color = vec4( fColor.rgb, fColor.a * falloff );
+}
\ No newline at end of file
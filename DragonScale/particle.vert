@@ -0,0 +1,19 @@
+#version 330 core
+layout( location = 0 ) in vec2 vCorner;
+layout( location = 1 ) in vec4 vPosSize;
+layout( location = 2 ) in vec4 vColor;
+uniform mat4 PROJ;
+uniform mat4 VIEW;
+
+out vec4 fColor;
+out vec2 fCorner;
+
+void main() {
+	// Expand in eye space so the quad always faces the camera.
+	vec4 eye = VIEW * vec4( vPosSize.xyz, 1 );
+	eye.xy += vCorner * vPosSize.w;
+	gl_Position = PROJ * eye;
+
+	fColor = vColor;
+	fCorner = vCorner;
+}
\ No newline at end of file
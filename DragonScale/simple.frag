@@ -1,7 +1,93 @@
 #version 330 core
 in vec3 fColor;
+in vec3 fPosition;			// World space.
+in vec3 fNormal;			// Zero when the mesh has none.
+in vec2 fTexCoord;
 out vec3 color;
 
+uniform mat4 VIEW;
+uniform vec3 SUN_DIRECTION = vec3( 0.4, 0.8, 0.45 );	// Towards the sun.
+uniform vec3 SUN_COLOR = vec3( 0.75, 0.72, 0.65 );
+uniform vec3 AMBIENT = vec3( 0.3, 0.32, 0.36 );
+
+// Multiplies the vertex color, for meshes with texture coordinates.
+uniform sampler2D DIFFUSE;
+uniform int TEXTURED = 0;
+
+// See LightClusters.
+uniform samplerBuffer LIGHTS;			// Position and radius, color.
+uniform usamplerBuffer LIGHT_INDICES;
+uniform usamplerBuffer LIGHT_CLUSTERS;	// Offset and count.
+uniform vec3 CLUSTER_GRID;				// Tiles across, tiles up, slices.
+uniform vec2 CLUSTER_SIZE;				// Pixels per tile.
+uniform vec2 CLUSTER_DEPTH;				// slice = log( depth ) * x + y.
+
+// See ShadowCascades. No shadows until it sets the count.
+uniform sampler2DArrayShadow SHADOW_MAP;
+uniform int SHADOW_CASCADES = 0;
+uniform mat4 SHADOW_MATRICES[ 4 ];		// World to shadow map, depth included.
+uniform vec4 SHADOW_SPLITS;				// View depth each cascade ends at.
+uniform vec4 SHADOW_TEXELS;				// World size of a texel, per cascade.
+
+float Shadow( vec3 n, float depth ) {
+	for ( int i = 0; i < SHADOW_CASCADES; ++i ) {
+		if ( depth < SHADOW_SPLITS[ i ] ) {
+			// Off the surface along the normal, scaled to the cascade's texels.
+			vec4 p = SHADOW_MATRICES[ i ] * vec4( fPosition + n * SHADOW_TEXELS[ i ] * 1.5, 1 );
+			vec2 texel = 1.0 / vec2( textureSize( SHADOW_MAP, 0 ).xy );
+			float lit = 0.0;
+
+			// Four filtered comparisons half a texel apart, 3x3 texels in all.
+			for ( int j = 0; j < 4; ++j ) {
+				vec2 offset = ( vec2( j & 1, j >> 1 ) - 0.5 ) * texel;
+				lit += texture( SHADOW_MAP, vec4( p.xy + offset, float( i ), p.z ) );
+			}
+
+			return lit * 0.25;
+		}
+	}
+
+	return 1.0;
+}
+
 void main() {
-    color = fColor;
+	vec3 n = fNormal;
+
+	// Faceted from the screen space derivatives when there is no normal.
+	if ( dot( n, n ) < 1e-6 ) {
+		n = cross( dFdx( fPosition ), dFdy( fPosition ) );
+	}
+
+	n = normalize( n );
+
+	float depth = -( VIEW * vec4( fPosition, 1 ) ).z;
+
+	vec3 light = AMBIENT + SUN_COLOR * max( dot( n, normalize( SUN_DIRECTION ) ), 0.0 ) * Shadow( n, depth );
+	ivec3 grid = ivec3( CLUSTER_GRID );
+
+	ivec3 cell;
+	cell.xy = clamp( ivec2( gl_FragCoord.xy / CLUSTER_SIZE ), ivec2( 0 ), grid.xy - 1 );
+	cell.z = clamp( int( log( max( depth, 1e-4 ) ) * CLUSTER_DEPTH.x + CLUSTER_DEPTH.y ), 0, grid.z - 1 );
+
+	uvec2 range = texelFetch( LIGHT_CLUSTERS, ( cell.z * grid.y + cell.y ) * grid.x + cell.x ).xy;
+
+	for ( uint i = 0u; i < range.y; ++i ) {
+		int index = int( texelFetch( LIGHT_INDICES, int( range.x + i ) ).r );
+		vec4 p = texelFetch( LIGHTS, index * 2 );
+		vec3 c = texelFetch( LIGHTS, index * 2 + 1 ).rgb;
+
+		vec3 d = p.xyz - fPosition;
+		float d2 = dot( d, d );
+		float falloff = max( 1.0 - d2 / ( p.w * p.w ), 0.0 );
+
+		light += c * falloff * falloff * max( dot( n, d * inversesqrt( max( d2, 1e-6 ) ) ), 0.0 );
+	}
+
+	vec3 albedo = fColor;
+
+	if ( TEXTURED != 0 ) {
+		albedo *= texture( DIFFUSE, fTexCoord ).rgb;
+	}
+
+	color = albedo * light;
 }
\ No newline at end of file
@@ -1,15 +1,35 @@
 #version 330 core
 layout( location = 0 ) in vec3 vPos_model;
 layout( location = 1 ) in vec3 vColor;
+layout( location = 2 ) in vec2 vNormal;		// Octahedral.
+layout( location = 3 ) in vec2 vTexCoord;
 uniform mat4 PROJ;
 uniform mat4 VIEW;
 uniform mat4 MODEL;
+uniform vec3 POSITION_SCALE = vec3( 1.0 );	// Per mesh, undoes the position quantization.
+uniform vec3 POSITION_BIAS = vec3( 0.0 );
 
 out vec3 fColor;
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoord;
+
+vec3 DecodeOctahedral( vec2 e ) {
+	vec3 n = vec3( e, 1.0 - abs( e.x ) - abs( e.y ) );
+	float t = max( -n.z, 0.0 );
+	n.xy += vec2( n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t );
+	return normalize( n );
+}
 
 void main() {
-	vec4 v = vec4( vPos_model, 1 );
-	gl_Position = PROJ * VIEW * MODEL * v;
+	vec4 v = MODEL * vec4( vPos_model * POSITION_SCALE + POSITION_BIAS, 1 );
+	gl_Position = PROJ * VIEW * v;
 
 	fColor = vColor;
+	fPosition = v.xyz;
+	fTexCoord = vTexCoord;
+
+	// Meshes drawn without normals leave the attribute at ( 2, 2 ), off the
+	// octahedral square; simple.frag falls back to the face normal.
+	fNormal = abs( vNormal.x ) > 1.5 ? vec3( 0 ) : mat3( MODEL ) * DecodeOctahedral( vNormal );
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 330 core
+layout( location = 0 ) in vec3 vPos_model;
+layout( location = 1 ) in vec3 vColor;
+layout( location = 2 ) in uvec4 vJoints;
+layout( location = 3 ) in vec4 vWeights;
+uniform mat4 PROJ;
+uniform mat4 VIEW;
+uniform mat4 BONES[ 48 ];
+
+out vec3 fColor;
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoord;
+
+void main() {
+	// Bones already include the character's world transform.
+	mat4 skin = BONES[ vJoints.x ] * vWeights.x +
+				BONES[ vJoints.y ] * vWeights.y +
+				BONES[ vJoints.z ] * vWeights.z +
+				BONES[ vJoints.w ] * vWeights.w;
+
+	vec4 v = skin * vec4( vPos_model, 1 );
+	gl_Position = PROJ * VIEW * v;
+
+	fColor = vColor;
+	fPosition = v.xyz;
+	fNormal = vec3( 0 );		// No normals in the mesh, see simple.frag.
+	fTexCoord = vec2( 0 );		// Nor texture coordinates, drawn with TEXTURED off.
+}
\ No newline at end of file
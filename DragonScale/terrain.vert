@@ -0,0 +1,50 @@
+#version 330 core
+layout( location = 0 ) in vec2 vGrid;
+uniform mat4 PROJ;
+uniform mat4 VIEW;
+uniform vec4 NODE;			// x, z, size, quads per side.
+uniform vec4 TILE;			// x, z, size, texture layer.
+uniform vec2 MORPH;			// Start and end distance.
+uniform vec3 CAMERA;
+uniform vec2 HEIGHT_RANGE;
+uniform sampler2DArray HEIGHTS;
+
+out vec3 fColor;
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoord;
+
+float Height( vec2 world ) {
+	float res = float( textureSize( HEIGHTS, 0 ).x );
+	vec2 uv = ( world - TILE.xy ) / TILE.z;
+
+	// Sample centers, so the tile edges land exactly on the edge texels.
+	uv = ( uv * ( res - 1.0 ) + 0.5 ) / res;
+	return textureLod( HEIGHTS, vec3( uv, TILE.w ), 0.0 ).r;
+}
+
+void main() {
+	vec2 world = NODE.xy + vGrid * NODE.z;
+
+	float distance = length( CAMERA - vec3( world.x, Height( world ), world.y ) );
+	float morph = clamp( ( distance - MORPH.x ) / ( MORPH.y - MORPH.x ), 0.0, 1.0 );
+
+	// Odd vertices slide onto their even neighbours, the next coarser grid.
+	vec2 odd = fract( vGrid * NODE.w * 0.5 ) * 2.0 / NODE.w;
+	world -= odd * NODE.z * morph;
+
+	float h = Height( world );
+	gl_Position = PROJ * VIEW * vec4( world.x, h, world.y, 1 );
+
+	// Central differences one grid step apart.
+	float spacing = NODE.z / NODE.w;
+	float dx = Height( world + vec2( spacing, 0 ) ) - Height( world - vec2( spacing, 0 ) );
+	float dz = Height( world + vec2( 0, spacing ) ) - Height( world - vec2( 0, spacing ) );
+
+	fPosition = vec3( world.x, h, world.y );
+	fNormal = normalize( vec3( -dx, 2.0 * spacing, -dz ) );
+	fTexCoord = vec2( 0 );		// Colored by height, drawn with TEXTURED off.
+
+	float t = clamp( ( h - HEIGHT_RANGE.x ) / ( HEIGHT_RANGE.y - HEIGHT_RANGE.x ), 0.0, 1.0 );
+	fColor = mix( vec3( 0.15, 0.4, 0.1 ), vec3( 0.85, 0.85, 0.8 ), t );
+}
\ No newline at end of file